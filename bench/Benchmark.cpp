@@ -0,0 +1,497 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Adaptive.h"
+#include "Compositor.h"
+#include "Config.h"
+#include "File.h"
+#include "Gamma.h"
+#include "MenuModel.h"
+#include "Monitor.h"
+#include "Reconcile.h"
+#include "TimerWheel.h"
+#include "Utf.h"
+#include "Util.h"
+#include "json.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/* times the portable hot paths and, given a baseline, fails if any of them
+got slower than it allows.
+
+    dimmer_bench [--filter text] [--json results.json] [--baseline baseline.json]
+
+results are in nanoseconds per operation, and also relative to a fixed
+calibration loop run at the same time, so a baseline recorded on one
+machine still means something on another. the baseline is a results file
+with a "threshold" added: a benchmark fails once its relative time is more
+than that many times the baseline's. entries may carry their own threshold;
+the ones that hit the disk are noisier than the rest. */
+
+using namespace dimmer;
+using namespace nlohmann;
+using Clock = std::chrono::steady_clock;
+
+constexpr double batchNs = 20e6; /* each sample runs for about this long */
+constexpr int samples = 5;
+constexpr double defaultThreshold = 2.0;
+
+struct Benchmark {
+    std::string name;
+    std::function<void()> run; /* one operation */
+};
+
+struct Result {
+    double ns;
+    double relative;
+};
+
+static volatile uint32_t sink;
+
+/* the median of a few batches, each sized to run for about batchNs. */
+static double measure(const std::function<void()>& run) {
+    run(); /* warm up, and size the first batch */
+    auto start = Clock::now();
+    run();
+    double single = std::max(1.0, (double) std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    size_t iterations = (size_t) std::max(1.0, std::min(1e8, batchNs / single));
+
+    std::vector<double> times;
+    for (int i = 0; i < samples; i++) {
+        start = Clock::now();
+        for (size_t j = 0; j < iterations; j++) {
+            run();
+        }
+        double elapsed = (double) std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+        times.push_back(elapsed / (double) iterations);
+    }
+
+    std::sort(times.begin(), times.end());
+    return times[samples / 2];
+}
+
+static void calibrate() {
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < 1000; i++) {
+        hash = (hash ^ i) * 16777619u;
+    }
+    sink = hash;
+}
+
+static std::vector<Monitor> makeMonitors(int count) {
+    std::vector<Monitor> monitors;
+    for (int i = 0; i < count; i++) {
+        monitors.push_back(Monitor(L"DP-" + std::to_wstring(i + 1), i, { i * 2560, 0, (i + 1) * 2560, 1440 }));
+    }
+    return monitors;
+}
+
+/* gives every monitor options of its own, so they're all written out. */
+static void populate(const std::vector<Monitor>& monitors) {
+    ChangeSet changes;
+    for (size_t i = 0; i < monitors.size(); i++) {
+        changes.setMonitorOpacity(monitors[i], (float) (i % 9) / 10.0f);
+        changes.setMonitorTemperature(monitors[i], 4000 + (int) (i % 5) * 500);
+    }
+    changes.commit();
+}
+
+/* config-ish text: ASCII, with an accented or CJK character every so often. */
+static std::wstring makeText(size_t length) {
+    std::wstring text;
+    for (size_t i = 0; text.size() < length; i++) {
+        text += (i % 97 == 96) ? L'\u00e9' : (i % 251 == 250) ? L'\u6f22' : (wchar_t) (L'a' + i % 26);
+    }
+    return text;
+}
+
+/* the downsampled frames in bench/frames, at the size DesktopCapture reads
+back from a 1080p display. */
+static const std::vector<Image>& recordedFrames() {
+    static const std::vector<Image> frames = []() {
+        std::vector<Image> result;
+        for (auto name : { "editor-light", "terminal-dark", "photo-page", "desktop-window" }) {
+            std::string fn = std::string(FRAMES_DIRECTORY) + "/" + name + ".bmp";
+            MappedFile file;
+            Image image;
+            if (!file.open(u8to16(fn)) || !decodeBmp((const uint8_t*) file.data(), file.size(), image)) {
+                fprintf(stderr, "can't read frame %s\n", fn.c_str());
+                exit(2);
+            }
+            result.push_back(std::move(image));
+        }
+        return result;
+    }();
+    return frames;
+}
+
+struct FakeOverlay {
+    unsigned dirty = 0;
+
+    void apply(Monitor&, unsigned changed) {
+        this->dirty |= changed;
+    }
+};
+
+static std::vector<Benchmark> benchmarks() {
+    std::vector<Benchmark> list;
+
+    list.push_back({ "colorTemperatureToRgb", []() {
+        static int kelvin = 1000;
+        float red, green, blue;
+        colorTemperatureToRgb(kelvin, red, green, blue);
+        kelvin = (kelvin >= 6500) ? 1000 : kelvin + 100;
+        sink = (uint32_t) (red + green + blue);
+    } });
+
+    list.push_back({ "buildTemperatureRamp", []() {
+        static GammaRamp ramp;
+        buildTemperatureRamp(4500, ramp);
+        sink = ramp[2][255];
+    } });
+
+    list.push_back({ "buildTemperatureRamp/1024", []() {
+        static std::vector<uint16_t> red(1024), green(1024), blue(1024);
+        buildTemperatureRamp(4500, 0.7f, { red.data(), green.data(), blue.data(), red.size() });
+        sink = blue[1023];
+    } });
+
+    list.push_back({ "u16to8", []() {
+        static const std::wstring id = L"\\\\.\\DISPLAY1-0 Dell U2720Q (DisplayPort)";
+        sink = (uint32_t) u16to8(id).size();
+    } });
+
+    list.push_back({ "u8to16", []() {
+        static const std::string id = "\\\\.\\DISPLAY1-0 Dell U2720Q (DisplayPort)";
+        sink = (uint32_t) u8to16(id).size();
+    } });
+
+    list.push_back({ "u16to8/into", []() {
+        static const std::wstring id = L"\\\\.\\DISPLAY1-0 Dell U2720Q (DisplayPort)";
+        static std::string output;
+        u16to8(id, output);
+        sink = (uint32_t) output.size();
+    } });
+
+    /* a page of mostly ASCII, which is what the vector kernels are for. */
+    for (UtfKernel kernel : { UtfKernel::Scalar, UtfKernel::Best }) {
+        std::string suffix = (kernel == UtfKernel::Scalar) ? "/scalar" : "/best";
+
+        list.push_back({ "utf16to8/4096" + suffix, [kernel]() {
+            static const std::wstring text = makeText(4096);
+            static std::string output(utf8Capacity(text.size()), '\0');
+            sink = (uint32_t) utf16to8(text.data(), text.size(), &output[0], output.size(), kernel);
+        } });
+
+        list.push_back({ "utf8to16/4096" + suffix, [kernel]() {
+            static const std::string text = u16to8(makeText(4096));
+            static std::wstring output(utf16Capacity(text.size()), L'\0');
+            sink = (uint32_t) utf8to16(text.data(), text.size(), &output[0], output.size(), kernel);
+        } });
+    }
+
+    /* one pass over the recorded frames per operation: their histograms,
+    then the whole sampling step as Overlay runs it every 250ms. */
+    for (LumaKernel kernel : { LumaKernel::Scalar, LumaKernel::Sse2 }) {
+        if (!isLumaKernelSupported(kernel)) {
+            continue;
+        }
+
+        std::string suffix = (kernel == LumaKernel::Scalar) ? "/scalar" : "/sse2";
+        list.push_back({ "lumaHistogram/frames" + suffix, [kernel]() {
+            uint32_t black = 0;
+            for (const Image& frame : recordedFrames()) {
+                uint32_t histogram[256] = {};
+                lumaHistogram(frame.pixels.data(), frame.width, frame.height, frame.width * 4, histogram, kernel);
+                black += histogram[0];
+            }
+            sink = black;
+        } });
+    }
+
+    list.push_back({ "adaptive/frames", []() {
+        static AdaptiveController controller;
+        static uint64_t now = 0;
+        float opacity = 0.0f;
+        for (const Image& frame : recordedFrames()) {
+            uint32_t histogram[256] = {};
+            lumaHistogram(frame.pixels.data(), frame.width, frame.height, frame.width * 4, histogram);
+            now += 250;
+            opacity = controller.update(0.4f, 0.9f, lumaStats(histogram), now);
+        }
+        sink = (uint32_t) (opacity * 1000.0f);
+    } });
+
+    /* thousands of timers spread from a few ms to hours out, so they're
+    linked on every level and cascade on their way down. each operation
+    schedules them all and runs the wheel until it's empty. */
+    list.push_back({ "timerWheel/4096", []() {
+        static TimerWheel wheel;
+        static uint64_t now = 0;
+        static uint32_t fired = 0;
+        uint32_t seed = 2166136261u;
+        for (int i = 0; i < 4096; i++) {
+            seed = seed * 1664525u + 1013904223u;
+            uint64_t delay = 1 + ((seed >> 8) & ((1u << (4 + i % 20)) - 1));
+            wheel.schedule(now + delay, 0, 0, []() { fired++; });
+        }
+        while (wheel.size()) {
+            now = wheel.nextDeadline();
+            wheel.advance(now);
+        }
+        sink = fired;
+    } });
+
+    /* the usual life of a timeout: scheduled, then cancelled before it's due. */
+    list.push_back({ "timerWheel/cancel/4096", []() {
+        static TimerWheel wheel;
+        static std::vector<TimerWheel::Id> ids(4096);
+        for (size_t i = 0; i < ids.size(); i++) {
+            ids[i] = wheel.schedule(1000 + i * 37, 0, 0, []() { });
+        }
+        for (auto id : ids) {
+            wheel.cancel(id);
+        }
+        sink = (uint32_t) wheel.size();
+    } });
+
+    /* the config store is global, so each size is set up just before it's
+    measured. */
+    for (int count : { 1, 16, 256 }) {
+        auto monitors = std::make_shared<std::vector<Monitor>>(makeMonitors(count));
+        auto ready = std::make_shared<int>(0);
+        auto setup = [monitors, ready]() {
+            if (!*ready) {
+                setAttachedMonitors(*monitors);
+                populate(*monitors);
+                saveConfig();
+                *ready = 1;
+            }
+        };
+
+        std::string suffix = "/" + std::to_string(count);
+
+        list.push_back({ "saveConfig" + suffix, [setup]() {
+            setup();
+            saveConfig();
+        } });
+
+        list.push_back({ "loadConfig" + suffix, [setup]() {
+            setup();
+            loadConfig();
+        } });
+
+        list.push_back({ "options" + suffix, [setup, monitors]() {
+            setup();
+            float total = 0.0f;
+            for (auto& monitor : *monitors) {
+                total += getMonitorOpacity(monitor);
+            }
+            sink = (uint32_t) total;
+        } });
+    }
+
+    list.push_back({ "buildMenuModel/4", []() {
+        static std::vector<Monitor> monitors = makeMonitors(4);
+        static std::vector<MenuItem> items;
+        buildMenuModel(monitors, items);
+        sink = (uint32_t) items.size();
+    } });
+
+    list.push_back({ "reconcileOverlays/4", []() {
+        using Overlays = std::map<std::wstring, std::shared_ptr<FakeOverlay>>;
+        static std::vector<Monitor> previous = makeMonitors(4);
+        static std::vector<Monitor> current = makeMonitors(4);
+        static Overlays overlays;
+
+        Overlays old;
+        std::swap(overlays, old);
+        reconcileOverlays(overlays, old, previous, current, PropertyTemperature,
+            [](Monitor&) { return std::make_shared<FakeOverlay>(); });
+        sink = (uint32_t) overlays.size();
+    } });
+
+    /* what the compositor pays per 1080p frame to darken it, with each
+    blend kernel this cpu has, and for the whole pipeline. these go last:
+    they churn through far more than the cache holds. */
+    for (BlendKernel kernel : { BlendKernel::Scalar, BlendKernel::Sse2, BlendKernel::Avx2 }) {
+        if (!isBlendKernelSupported(kernel)) {
+            continue;
+        }
+
+        static const char* suffixes[] = { "/scalar", "/sse2", "/avx2" };
+        std::string suffix = suffixes[(int) kernel];
+
+        list.push_back({ "blendOverlay/1080p" + suffix, [kernel]() {
+            static std::vector<uint32_t> frame(1920 * 1080, 0xff8040c0);
+            blendOverlay(frame.data(), frame.size(), 128, kernel);
+            sink = frame[0];
+        } });
+    }
+
+    list.push_back({ "composite/1080p", []() {
+        static Image frame = { 1920, 1080, std::vector<uint32_t>(1920 * 1080, 0xff8040c0) };
+        static const MonitorOptions options = []() {
+            MonitorOptions options;
+            options.opacity = 0.4f;
+            options.temperature = 4500;
+            return options;
+        }();
+        composite(frame, options);
+        sink = frame.pixels[0];
+    } });
+
+    return list;
+}
+
+static bool readJson(const std::string& fn, json& result) {
+    std::ifstream in(fn);
+    if (!in) {
+        return false;
+    }
+    try {
+        in >> result;
+    }
+    catch (const std::exception&) {
+        return false;
+    }
+    return result.is_object();
+}
+
+int main(int argc, char* argv[]) {
+    std::string filter, output, baselineFn;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (!strcmp(argv[i], "--filter")) {
+            filter = argv[i + 1];
+        }
+        else if (!strcmp(argv[i], "--json")) {
+            output = argv[i + 1];
+        }
+        else if (!strcmp(argv[i], "--baseline")) {
+            baselineFn = argv[i + 1];
+        }
+    }
+
+    json baseline = json::object();
+    if (!baselineFn.empty() && !readJson(baselineFn, baseline)) {
+        fprintf(stderr, "can't read baseline %s\n", baselineFn.c_str());
+        return 2;
+    }
+
+    /* the config layer writes to $XDG_CONFIG_HOME/dimmer; keep it out of
+    the real one. */
+    char directory[] = "/tmp/dimmer-bench-XXXXXX";
+    if (!mkdtemp(directory)) {
+        return 2;
+    }
+    setenv("XDG_CONFIG_HOME", directory, 1);
+    setenv("XDG_CONFIG_DIRS", directory, 1);
+
+    double threshold = baseline.value("threshold", defaultThreshold);
+    json results = { { "threshold", threshold }, { "benchmarks", json::object() } };
+    int regressions = 0;
+
+    for (auto& benchmark : benchmarks()) {
+        if (!filter.empty() && benchmark.name.find(filter) == std::string::npos) {
+            continue;
+        }
+
+        /* calibrated right alongside, so a busy machine slows both. */
+        auto run = [&benchmark]() -> Result {
+            double calibration = measure(&calibrate);
+            double ns = measure(benchmark.run);
+            return { ns, ns / calibration };
+        };
+
+        Result result = run();
+
+        json entry = { { "ns", result.ns }, { "relative", result.relative } };
+        const char* verdict = "";
+
+        json recorded = baseline.value("benchmarks", json::object());
+        auto it = recorded.find(benchmark.name);
+        if (it != recorded.end()) {
+            const json& expected = *it;
+            double limit = expected.value("threshold", threshold);
+            double allowed = expected.value("relative", 0.0) * limit;
+
+            /* one retry, in case something else had the cpu for a moment. */
+            if (result.relative > allowed) {
+                result = std::min(result, run(), [](const Result& a, const Result& b) {
+                    return a.relative < b.relative;
+                });
+                entry = { { "ns", result.ns }, { "relative", result.relative } };
+            }
+
+            if (expected.find("threshold") != expected.end()) {
+                entry["threshold"] = limit;
+            }
+
+            if (result.relative > allowed) {
+                verdict = "  REGRESSION";
+                regressions++;
+            }
+        }
+
+        printf("%-28s %12.1f ns %10.3f x%s\n", benchmark.name.c_str(), result.ns, result.relative, verdict);
+        fflush(stdout);
+        results["benchmarks"][benchmark.name] = entry;
+    }
+
+    if (!output.empty()) {
+        std::ofstream out(output);
+        out << results.dump(2) << "\n";
+    }
+
+    std::string cleanup = std::string("rm -rf ") + directory;
+    if (system(cleanup.c_str()) != 0) {
+        fprintf(stderr, "couldn't remove %s\n", directory);
+    }
+
+    if (regressions) {
+        fprintf(stderr, "%d benchmark(s) slower than the baseline allows\n", regressions);
+        return 1;
+    }
+
+    return 0;
+}
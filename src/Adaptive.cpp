@@ -0,0 +1,221 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Adaptive.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DIMMER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+using namespace dimmer;
+
+#ifdef DIMMER_SSE2
+constexpr LumaKernel vectorKernel = LumaKernel::Sse2;
+#else
+constexpr LumaKernel vectorKernel = LumaKernel::Scalar;
+#endif
+
+/* BT.709 weights in 8.8 fixed point; they add up to 256, so white stays 255. */
+constexpr int weightRed = 54;
+constexpr int weightGreen = 183;
+constexpr int weightBlue = 19;
+
+/* the controller's hysteresis. */
+constexpr float deadband = 0.03f;
+constexpr uint64_t holdMs = 750;
+constexpr float slewPerSecond = 0.25f;
+
+static inline uint32_t luma(uint32_t p) {
+    return (((p >> 16) & 0xff) * weightRed + ((p >> 8) & 0xff) * weightGreen + (p & 0xff) * weightBlue) >> 8;
+}
+
+/* an unsupported kernel falls back to the scalar one. */
+static bool useVector(LumaKernel kernel) {
+    return kernel == LumaKernel::Best || (kernel != LumaKernel::Scalar && kernel == vectorKernel);
+}
+
+static void histogramRow(const uint32_t* row, size_t width, uint32_t histogram[256], bool vector) {
+    size_t x = 0;
+
+    if (vector) {
+#ifdef DIMMER_SSE2
+        /* two pixels per madd: each widens to [B G R A] as 16-bit lanes, and
+        madd against [19 183 54 0] leaves B+G and R+A sums in 32-bit lanes,
+        which a 64-bit shift lines up to be added. */
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i weights = _mm_setr_epi16(
+            weightBlue, weightGreen, weightRed, 0, weightBlue, weightGreen, weightRed, 0);
+
+        alignas(16) uint32_t lumas[4];
+        for (; x + 4 <= width; x += 4) {
+            __m128i p = _mm_loadu_si128((const __m128i*) (row + x));
+            __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(p, zero), weights);
+            __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(p, zero), weights);
+            lo = _mm_add_epi32(lo, _mm_srli_epi64(lo, 32));
+            hi = _mm_add_epi32(hi, _mm_srli_epi64(hi, 32));
+
+            /* lanes 0 and 2 of each now hold a pixel's weighted sum. */
+            __m128i sums = _mm_castps_si128(_mm_shuffle_ps(
+                _mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0)));
+
+            _mm_store_si128((__m128i*) lumas, _mm_srli_epi32(sums, 8));
+            histogram[lumas[0]]++;
+            histogram[lumas[1]]++;
+            histogram[lumas[2]]++;
+            histogram[lumas[3]]++;
+        }
+#endif
+    }
+
+    for (; x < width; x++) {
+        histogram[luma(row[x])]++;
+    }
+}
+
+namespace dimmer {
+    bool isLumaKernelSupported(LumaKernel kernel) {
+        return kernel == LumaKernel::Scalar || kernel == LumaKernel::Best || kernel == vectorKernel;
+    }
+
+    void lumaHistogram(
+        const void* pixels, size_t width, size_t height, size_t pitch, uint32_t histogram[256],
+        LumaKernel kernel)
+    {
+        bool vector = useVector(kernel);
+
+        const uint8_t* bytes = (const uint8_t*) pixels;
+        for (size_t y = 0; y < height; y++) {
+            histogramRow((const uint32_t*) (bytes + y * pitch), width, histogram, vector);
+        }
+    }
+
+    LumaStats lumaStats(const uint32_t histogram[256], float percentile) {
+        LumaStats result;
+
+        uint64_t total = 0, sum = 0;
+        for (int i = 0; i < 256; i++) {
+            total += histogram[i];
+            sum += (uint64_t) histogram[i] * i;
+        }
+
+        if (total == 0) {
+            return result;
+        }
+
+        uint64_t target = (uint64_t) std::ceil(percentile * (double) total);
+        uint64_t seen = 0;
+        int level = 0;
+        for (; level < 255; level++) {
+            seen += histogram[level];
+            if (seen >= target) {
+                break;
+            }
+        }
+
+        result.mean = (float) sum / (float) total / 255.0f;
+        result.percentile = (float) level / 255.0f;
+        result.samples = (uint32_t) std::min<uint64_t>(total, UINT32_MAX);
+        return result;
+    }
+}
+
+/* AdaptiveController */
+
+AdaptiveController::AdaptiveController(float strength)
+: strength(strength) {
+    this->reset();
+}
+
+void AdaptiveController::reset() {
+    this->opacity = 0.0f;
+    this->lastBase = 0.0f;
+    this->lastUpdate = 0;
+    this->pendingSince = 0;
+    this->pending = false;
+    this->started = false;
+}
+
+float AdaptiveController::update(float base, float maximum, const LumaStats& stats, uint64_t now) {
+    /* the first frame, or the user picked a new opacity: start over from
+    their setting rather than sliding away from the old one. */
+    if (!this->started || base != this->lastBase) {
+        this->opacity = std::min(base, maximum);
+        this->lastBase = base;
+        this->lastUpdate = now;
+        this->pending = false;
+        this->started = true;
+    }
+
+    float elapsed = (float) (now - this->lastUpdate) / 1000.0f;
+    this->lastUpdate = now;
+
+    if (stats.samples == 0) {
+        return this->opacity;
+    }
+
+    /* 0.5 is "average" content, and leaves the user's setting alone. */
+    float brightness = (stats.mean + stats.percentile) / 2.0f;
+    float target = base + this->strength * (brightness - 0.5f) * 2.0f;
+    target = std::min(maximum, std::max(0.0f, target));
+
+    /* the deadband decides whether to start moving; once under way, the
+    slide goes all the way to the target. */
+    float error = target - this->opacity;
+    bool moving = this->pending && now - this->pendingSince >= holdMs;
+    if (!moving && std::fabs(error) < deadband) {
+        this->pending = false;
+        return this->opacity;
+    }
+
+    if (!this->pending) {
+        this->pending = true;
+        this->pendingSince = now;
+    }
+
+    if (now - this->pendingSince >= holdMs) {
+        float step = slewPerSecond * elapsed;
+        if (std::fabs(error) <= step) {
+            this->opacity = target;
+            this->pending = false;
+        }
+        else {
+            this->opacity += error > 0.0f ? step : -step;
+        }
+    }
+
+    return this->opacity;
+}
@@ -0,0 +1,94 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dimmer {
+    /* how bright a frame is, 0-1. percentile is the luma that the given
+    share of pixels are at or below; it catches a mostly dark screen with
+    one big white window on it, which the mean alone doesn't. */
+    struct LumaStats {
+        float mean = 0.0f;
+        float percentile = 0.0f;
+        uint32_t samples = 0;
+    };
+
+    enum class LumaKernel {
+        Scalar,
+        Sse2,
+        Best /* whichever of the above this CPU has */
+    };
+
+    extern bool isLumaKernelSupported(LumaKernel kernel);
+
+    /* adds the BT.709 luma of every pixel in a 32-bit BGRA image to
+    histogram, which the caller zeroes. pitch is in bytes, so a mapped
+    texture can be passed as is. every kernel counts the same. */
+    extern void lumaHistogram(
+        const void* pixels, size_t width, size_t height, size_t pitch, uint32_t histogram[256],
+        LumaKernel kernel = LumaKernel::Best);
+
+    extern LumaStats lumaStats(const uint32_t histogram[256], float percentile = 0.9f);
+
+    /* turns a stream of LumaStats into the overlay opacity to show: more
+    than the user's own setting for bright content, less for dark. changes
+    smaller than the deadband are ignored, larger ones have to hold for a
+    while before anything moves (so an alt-tab doesn't pump the screen),
+    and then the opacity slides over rather than jumping. */
+    class AdaptiveController {
+        public:
+            /* strength is how far content can move the opacity either way
+            from the user's setting. */
+            explicit AdaptiveController(float strength = 0.2f);
+
+            /* base is the user's opacity, maximum the policy's limit, now in
+            milliseconds. returns the opacity to show. */
+            float update(float base, float maximum, const LumaStats& stats, uint64_t now);
+
+            float current() const { return this->opacity; }
+            void reset();
+
+        private:
+            float strength;
+            float opacity;
+            float lastBase;
+            uint64_t lastUpdate;
+            uint64_t pendingSince;
+            bool pending;
+            bool started;
+    };
+}
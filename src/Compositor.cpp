@@ -0,0 +1,326 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Compositor.h"
+#include "File.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define DIMMER_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AVX2_FUNCTION
+#else
+#define AVX2_FUNCTION __attribute__((target("avx2")))
+#endif
+#endif
+
+using namespace dimmer;
+
+/* the layered window never gets more opaque than this. */
+constexpr uint8_t maximumAlpha = 240;
+
+/* the range colorTemperatureToRgb is good for at the warm end. whatever
+SetDeviceGammaRamp wouldn't take is left to fitRamp. */
+constexpr int minimumTemperature = 1000;
+constexpr int maximumTemperature = 6000;
+
+constexpr uint32_t alphaMask = 0xff000000;
+
+/* round(x / 255) for x up to 255 * 255, without dividing. */
+static inline uint32_t div255(uint32_t x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+static void blendScalar(uint32_t* pixels, size_t count, uint32_t scale) {
+    for (size_t i = 0; i < count; i++) {
+        uint32_t p = pixels[i];
+        uint32_t b = div255((p & 0xff) * scale);
+        uint32_t g = div255(((p >> 8) & 0xff) * scale);
+        uint32_t r = div255(((p >> 16) & 0xff) * scale);
+        pixels[i] = (p & alphaMask) | (r << 16) | (g << 8) | b;
+    }
+}
+
+#ifdef DIMMER_X86
+
+/* each 8-bit channel is widened to 16 bits, scaled, divided by 255 with the
+same shift trick as div255, and narrowed back. alpha bytes are copied
+over from the source afterwards. */
+
+static inline __m128i blend4(__m128i p, __m128i scale, __m128i zero, __m128i bias, __m128i mask) {
+    __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(p, zero), scale);
+    __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(p, zero), scale);
+    lo = _mm_add_epi16(lo, bias);
+    hi = _mm_add_epi16(hi, bias);
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+    __m128i result = _mm_packus_epi16(lo, hi);
+    return _mm_or_si128(_mm_andnot_si128(mask, result), _mm_and_si128(mask, p));
+}
+
+static void blendSse2(uint32_t* pixels, size_t count, uint32_t scale) {
+    const __m128i factor = _mm_set1_epi16((short) scale);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(128);
+    const __m128i mask = _mm_set1_epi32((int) alphaMask);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i* at = (__m128i*) (pixels + i);
+        _mm_storeu_si128(at, blend4(_mm_loadu_si128(at), factor, zero, bias, mask));
+    }
+
+    blendScalar(pixels + i, count - i, scale);
+}
+
+AVX2_FUNCTION static void blendAvx2(uint32_t* pixels, size_t count, uint32_t scale) {
+    const __m256i factor = _mm256_set1_epi16((short) scale);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i bias = _mm256_set1_epi16(128);
+    const __m256i mask = _mm256_set1_epi32((int) alphaMask);
+
+    /* unpack and pack both work within 128-bit lanes, so the pixel order
+    comes back out the way it went in. */
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i* at = (__m256i*) (pixels + i);
+        __m256i p = _mm256_loadu_si256(at);
+        __m256i lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(p, zero), factor);
+        __m256i hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(p, zero), factor);
+        lo = _mm256_add_epi16(lo, bias);
+        hi = _mm256_add_epi16(hi, bias);
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+        __m256i result = _mm256_packus_epi16(lo, hi);
+        result = _mm256_or_si256(_mm256_andnot_si256(mask, result), _mm256_and_si256(mask, p));
+        _mm256_storeu_si256(at, result);
+    }
+
+    blendSse2(pixels + i, count - i, scale);
+}
+
+static bool hasAvx2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+
+    /* the OS has to save the upper halves of the registers, too. */
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+        return false;
+    }
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+namespace dimmer {
+    uint8_t overlayAlpha(float opacity) {
+        opacity = std::min(1.0f, std::max(0.0f, opacity));
+        return std::min(maximumAlpha, (uint8_t) (opacity * 255.0f));
+    }
+
+    int rampTemperature(int kelvin) {
+        return std::min(maximumTemperature, std::max(minimumTemperature, kelvin));
+    }
+
+    bool isBlendKernelSupported(BlendKernel kernel) {
+        switch (kernel) {
+            case BlendKernel::Scalar:
+            case BlendKernel::Best:
+                return true;
+#ifdef DIMMER_X86
+            case BlendKernel::Sse2:
+                return true;
+            case BlendKernel::Avx2: {
+                static const bool supported = hasAvx2();
+                return supported;
+            }
+#endif
+            default:
+                return false;
+        }
+    }
+
+    void blendOverlay(uint32_t* pixels, size_t count, uint8_t alpha, BlendKernel kernel) {
+        if (alpha == 0) {
+            return;
+        }
+
+        uint32_t scale = 255 - alpha;
+
+        if (kernel == BlendKernel::Best) {
+            kernel = isBlendKernelSupported(BlendKernel::Avx2)
+                ? BlendKernel::Avx2
+                : isBlendKernelSupported(BlendKernel::Sse2)
+                    ? BlendKernel::Sse2 : BlendKernel::Scalar;
+        }
+        else if (!isBlendKernelSupported(kernel)) {
+            kernel = BlendKernel::Scalar;
+        }
+
+        switch (kernel) {
+#ifdef DIMMER_X86
+            case BlendKernel::Avx2: blendAvx2(pixels, count, scale); break;
+            case BlendKernel::Sse2: blendSse2(pixels, count, scale); break;
+#endif
+            default: blendScalar(pixels, count, scale); break;
+        }
+    }
+
+    void applyGammaRamp(Image& image, const GammaRamp& ramp) {
+        /* an 8-bit framebuffer only ever reads the high byte of each entry. */
+        uint8_t red[256], green[256], blue[256];
+        for (int i = 0; i < 256; i++) {
+            int entry = i * GAMMA_RAMP_SIZE / 256;
+            red[i] = (uint8_t) (ramp[0][entry] >> 8);
+            green[i] = (uint8_t) (ramp[1][entry] >> 8);
+            blue[i] = (uint8_t) (ramp[2][entry] >> 8);
+        }
+
+        for (uint32_t& p : image.pixels) {
+            p = (p & alphaMask) |
+                ((uint32_t) red[(p >> 16) & 0xff] << 16) |
+                ((uint32_t) green[(p >> 8) & 0xff] << 8) |
+                (uint32_t) blue[p & 0xff];
+        }
+    }
+
+    void composite(Image& image, const MonitorOptions& options, BlendKernel kernel) {
+        if (!options.enabled) {
+            return;
+        }
+
+        if (options.temperature != DEFAULT_TEMPERATURE) {
+            GammaRamp ramp;
+            buildTemperatureRamp(rampTemperature(options.temperature), ramp);
+            fitRamp(ramp, DEFAULT_GAMMA_RANGE);
+            applyGammaRamp(image, ramp);
+        }
+
+        blendOverlay(image.pixels.data(), image.pixels.size(), overlayAlpha(options.opacity), kernel);
+    }
+
+    /* BITMAPFILEHEADER (14 bytes) + BITMAPINFOHEADER (40 bytes), written
+    out by hand so this builds anywhere. a negative height is top-down. */
+    constexpr size_t bmpHeaderSize = 54;
+
+    static void put16(uint8_t* at, uint16_t value) {
+        at[0] = (uint8_t) value;
+        at[1] = (uint8_t) (value >> 8);
+    }
+
+    static void put32(uint8_t* at, uint32_t value) {
+        put16(at, (uint16_t) value);
+        put16(at + 2, (uint16_t) (value >> 16));
+    }
+
+    static uint32_t get32(const uint8_t* at) {
+        return at[0] | (at[1] << 8) | (at[2] << 16) | ((uint32_t) at[3] << 24);
+    }
+
+    std::vector<uint8_t> encodeBmp(const Image& image) {
+        size_t pixelBytes = image.pixels.size() * sizeof(uint32_t);
+        std::vector<uint8_t> result(bmpHeaderSize + pixelBytes, 0);
+        uint8_t* header = result.data();
+
+        header[0] = 'B';
+        header[1] = 'M';
+        put32(header + 2, (uint32_t) result.size());
+        put32(header + 10, (uint32_t) bmpHeaderSize);
+        put32(header + 14, 40);
+        put32(header + 18, (uint32_t) image.width);
+        put32(header + 22, (uint32_t) -image.height);
+        put16(header + 26, 1);
+        put16(header + 28, 32);
+        put32(header + 34, (uint32_t) pixelBytes);
+
+        if (pixelBytes) {
+            memcpy(header + bmpHeaderSize, image.pixels.data(), pixelBytes);
+        }
+        return result;
+    }
+
+    bool decodeBmp(const uint8_t* data, size_t size, Image& image) {
+        if (size < bmpHeaderSize || data[0] != 'B' || data[1] != 'M' || get32(data + 14) < 40) {
+            return false;
+        }
+
+        uint32_t offset = get32(data + 10);
+        int width = (int) get32(data + 18);
+        int height = (int) get32(data + 22);
+        bool bottomUp = height > 0;
+        height = bottomUp ? height : -height;
+
+        /* only what encodeBmp writes: 32 bits, uncompressed. */
+        if (data[28] != 32 || get32(data + 30) != 0 || width <= 0 || height <= 0 ||
+            offset > size || (size - offset) / 4 / (size_t) width < (size_t) height)
+        {
+            return false;
+        }
+
+        image.width = width;
+        image.height = height;
+        image.pixels.resize((size_t) width * height);
+
+        for (int y = 0; y < height; y++) {
+            int row = bottomUp ? height - 1 - y : y;
+            memcpy(
+                image.pixels.data() + (size_t) y * width,
+                data + offset + (size_t) row * width * 4,
+                (size_t) width * 4);
+        }
+
+        return true;
+    }
+
+    bool writeBmp(const std::wstring& fn, const Image& image) {
+        std::vector<uint8_t> bytes = encodeBmp(image);
+        return writeFileAtomic(fn, bytes.data(), bytes.size());
+    }
+}
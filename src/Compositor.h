@@ -0,0 +1,86 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Config.h"
+#include "Gamma.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dimmer {
+    /* the layered window's alpha for an opacity. capped, so the screen
+    never goes entirely black. */
+    extern uint8_t overlayAlpha(float opacity);
+
+    /* the temperature the gamma ramp is actually built for. */
+    extern int rampTemperature(int kelvin);
+
+    /* 32-bit BGRA, top-down, tightly packed; the layout of a DIB section or
+    a desktop capture. */
+    struct Image {
+        int width = 0;
+        int height = 0;
+        std::vector<uint32_t> pixels;
+    };
+
+    enum class BlendKernel {
+        Scalar,
+        Sse2,
+        Avx2,
+        Best /* the widest one this CPU has */
+    };
+
+    extern bool isBlendKernelSupported(BlendKernel kernel);
+
+    /* darkens color by a black layer at the given alpha, the way DWM
+    composites the overlay: c * (255 - alpha) / 255, rounded. every kernel
+    gives the same bytes; alpha (the 4th byte) is left alone. */
+    extern void blendOverlay(uint32_t* pixels, size_t count, uint8_t alpha, BlendKernel kernel = BlendKernel::Best);
+
+    /* looks every channel up in the ramp, as the display hardware does. */
+    extern void applyGammaRamp(Image& image, const GammaRamp& ramp);
+
+    /* a software reference for what dimmer puts on screen for a monitor's
+    options: the ramp from updateColorTemperature, fitted to the default
+    gamma range, then the overlay from updateBrightnessOverlay on top. */
+    extern void composite(Image& image, const MonitorOptions& options, BlendKernel kernel = BlendKernel::Best);
+
+    /* 32-bit BI_RGB bitmaps, so results can be looked at and diffed. */
+    extern std::vector<uint8_t> encodeBmp(const Image& image);
+    extern bool decodeBmp(const uint8_t* data, size_t size, Image& image);
+    extern bool writeBmp(const std::wstring& fn, const Image& image);
+}
@@ -0,0 +1,99 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Gamma.h"
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <unordered_map>
+
+namespace dimmer {
+    constexpr float DEFAULT_OPACITY = 0.3f;
+    constexpr int DEFAULT_TEMPERATURE = -1;
+    constexpr int DEFAULT_BACKLIGHT = -1; /* leave the panel alone */
+    constexpr int HYBRID_BACKLIGHT = -2; /* follow the brightness setting */
+
+    struct MonitorOptions {
+        float opacity;
+        int temperature;
+        int backlight; /* hardware brightness, 0-100 */
+        bool enabled;
+
+        MonitorOptions() {
+            this->opacity = DEFAULT_OPACITY;
+            this->temperature = DEFAULT_TEMPERATURE;
+            this->backlight = DEFAULT_BACKLIGHT;
+            this->enabled = true;
+        }
+
+        bool operator==(const MonitorOptions& other) const {
+            return this->opacity == other.opacity &&
+                this->temperature == other.temperature &&
+                this->backlight == other.backlight &&
+                this->enabled == other.enabled;
+        }
+
+        bool operator!=(const MonitorOptions& other) const {
+            return !(*this == other);
+        }
+    };
+
+    /* options keyed by monitor id. presets may also carry a "*" entry that
+    applies to any monitor not listed by id. lookups take any string type,
+    so a caller holding an id in a buffer doesn't have to copy it. */
+    using MonitorOptionsMap = std::map<std::wstring, MonitorOptions, std::less<>>;
+
+    constexpr wchar_t PRESET_ANY_MONITOR[] = L"*";
+
+    struct Config {
+        MonitorOptionsMap monitors;
+
+        /* named presets, applied on demand from the tray menu. */
+        std::map<std::wstring, MonitorOptionsMap> presets;
+
+        /* options for every display topology other than the active one,
+        keyed by topology hash. the active layout's options live in
+        monitors, and are swapped out when the topology changes. */
+        std::unordered_map<uint64_t, MonitorOptionsMap> layouts;
+        uint64_t layout = 0;
+
+        bool pollingEnabled = false;
+        bool globalEnabled = true;
+        bool adaptiveEnabled = false; /* follow on-screen content */
+        GammaDither gammaDither = GammaDither::None;
+    };
+}
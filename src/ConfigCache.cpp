@@ -0,0 +1,328 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "ConfigCache.h"
+#include "File.h"
+#include "Util.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cwchar>
+#include <vector>
+
+using namespace dimmer;
+
+constexpr uint32_t cacheMagic = 0x43434d44; /* 'DMCC' */
+constexpr uint32_t cacheVersion = 4;
+constexpr int maxIdLength = 48;
+
+constexpr uint32_t FLAG_POLLING_ENABLED = 0x01;
+constexpr uint32_t FLAG_GLOBAL_ENABLED = 0x02;
+constexpr uint32_t FLAG_ADAPTIVE_ENABLED = 0x04;
+constexpr uint32_t FLAG_DITHER_SHIFT = 3; /* two bits of GammaDither */
+constexpr uint32_t FLAG_DITHER_MASK = 0x18;
+
+constexpr uint32_t GROUP_PRESET = 1;
+constexpr uint32_t GROUP_LAYOUT = 2;
+
+#pragma pack(push, 4)
+struct CacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t checksum; /* fnv-1a of everything after the header */
+    uint32_t flags;
+    uint32_t monitorCount; /* live monitors, followed by every group's */
+    uint32_t groupCount;
+    uint32_t reserved[2];
+    uint64_t jsonWriteTime;
+    uint64_t jsonSize;
+    uint64_t layout;
+};
+
+/* presets and stashed layouts. each owns the next monitorCount option
+records after the live ones, in group order. */
+struct CacheGroup {
+    uint32_t kind;
+    uint32_t monitorCount;
+    uint64_t layout;
+    wchar_t name[maxIdLength];
+};
+
+/* within the live set and each group, records are in the same (ascending)
+order as the map they were written from. */
+struct CacheMonitor {
+    wchar_t id[maxIdLength];
+    float opacity;
+    int32_t temperature;
+    uint32_t enabled;
+    int32_t backlight;
+};
+#pragma pack(pop)
+
+static uint32_t checksum(const char* data, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t) data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static std::wstring getCacheFilename() {
+    return getDataDirectory() + PATH_SEPARATOR + L"config.bin";
+}
+
+/* ids have to be terminated and strictly ascending, which is what lets
+readMonitors() append every record at the end of its map. */
+static bool checkMonitors(const CacheMonitor* records, uint32_t count) {
+    const wchar_t* previous = nullptr;
+    for (uint32_t i = 0; i < count; i++) {
+        const wchar_t* id = records[i].id;
+        if (wcsnlen(id, maxIdLength) == maxIdLength) {
+            return false;
+        }
+        if (previous && wcscmp(previous, id) >= 0) {
+            return false;
+        }
+        previous = id;
+    }
+    return true;
+}
+
+static void readMonitors(const CacheMonitor*& records, uint32_t count, MonitorOptionsMap& result) {
+    for (uint32_t i = 0; i < count; i++) {
+        const CacheMonitor& record = *records++;
+        MonitorOptions options;
+        options.opacity = record.opacity;
+        options.temperature = record.temperature;
+        options.enabled = record.enabled != 0;
+        options.backlight = record.backlight;
+        result.emplace_hint(result.end(), record.id, options);
+    }
+}
+
+static bool writeMonitors(const MonitorOptionsMap& options, std::vector<CacheMonitor>& records) {
+    for (auto& entry : options) {
+        if (entry.first.size() >= maxIdLength) {
+            return false;
+        }
+        CacheMonitor record = {};
+        wcsncpy(record.id, entry.first.c_str(), maxIdLength - 1);
+        record.opacity = entry.second.opacity;
+        record.temperature = entry.second.temperature;
+        record.enabled = entry.second.enabled ? 1 : 0;
+        record.backlight = entry.second.backlight;
+        records.push_back(record);
+    }
+    return true;
+}
+
+static bool parseCache(const char* data, size_t length, uint64_t writeTime, uint64_t size, Config& config) {
+    if (length < sizeof(CacheHeader)) {
+        return false;
+    }
+
+    const CacheHeader* header = reinterpret_cast<const CacheHeader*>(data);
+    if (header->magic != cacheMagic || header->version != cacheVersion) {
+        return false;
+    }
+
+    if (header->jsonWriteTime != writeTime || header->jsonSize != size) {
+        return false; /* config.json was edited since the snapshot was taken */
+    }
+
+    uint64_t expected = sizeof(CacheHeader) +
+        (uint64_t) header->groupCount * sizeof(CacheGroup) +
+        (uint64_t) header->monitorCount * sizeof(CacheMonitor);
+
+    if (expected != length) {
+        return false;
+    }
+
+    const char* payload = data + sizeof(CacheHeader);
+    if (checksum(payload, length - sizeof(CacheHeader)) != header->checksum) {
+        return false;
+    }
+
+    const CacheGroup* groups = reinterpret_cast<const CacheGroup*>(payload);
+    const CacheMonitor* monitors = reinterpret_cast<const CacheMonitor*>(groups + header->groupCount);
+
+    uint64_t grouped = 0;
+    for (uint32_t i = 0; i < header->groupCount; i++) {
+        grouped += groups[i].monitorCount;
+    }
+
+    if (grouped > header->monitorCount) {
+        return false;
+    }
+
+    /* everything is checked against the mapping in place before a single
+    map node is built, so a snapshot that's going to be rejected costs
+    nothing but the read. */
+    uint32_t live = (uint32_t) (header->monitorCount - grouped);
+    if (!checkMonitors(monitors, live)) {
+        return false;
+    }
+
+    const CacheMonitor* next = monitors + live;
+    for (uint32_t i = 0; i < header->groupCount; i++) {
+        const CacheGroup& group = groups[i];
+        bool valid =
+            (group.kind == GROUP_PRESET && wcsnlen(group.name, maxIdLength) < maxIdLength) ||
+            (group.kind == GROUP_LAYOUT && group.layout);
+
+        if (!valid || !checkMonitors(next, group.monitorCount)) {
+            return false;
+        }
+        next += group.monitorCount;
+    }
+
+    next = monitors;
+    readMonitors(next, live, config.monitors);
+
+    auto preset = config.presets.end();
+    for (uint32_t i = 0; i < header->groupCount; i++) {
+        const CacheGroup& group = groups[i];
+        MonitorOptionsMap* target;
+
+        if (group.kind == GROUP_PRESET) {
+            /* presets are written in name order too; an out of order one is
+            still placed correctly, just not in constant time. */
+            preset = config.presets.emplace_hint(preset, group.name, MonitorOptionsMap());
+            target = &preset->second;
+            ++preset;
+        }
+        else {
+            target = &config.layouts[group.layout];
+        }
+
+        readMonitors(next, group.monitorCount, *target);
+    }
+
+    config.layout = header->layout;
+    config.pollingEnabled = (header->flags & FLAG_POLLING_ENABLED) != 0;
+    config.globalEnabled = (header->flags & FLAG_GLOBAL_ENABLED) != 0;
+    config.adaptiveEnabled = (header->flags & FLAG_ADAPTIVE_ENABLED) != 0;
+    config.gammaDither = (GammaDither) std::min<uint32_t>(
+        (header->flags & FLAG_DITHER_MASK) >> FLAG_DITHER_SHIFT, (uint32_t) GammaDither::Temporal);
+    return true;
+}
+
+namespace dimmer {
+    bool readConfigCache(const std::wstring& jsonFilename, Config& config) {
+        uint64_t writeTime, size;
+        if (!getFileStamp(jsonFilename, writeTime, size)) {
+            return false;
+        }
+
+        MappedFile file;
+        if (!file.open(getCacheFilename())) {
+            return false;
+        }
+
+        /* parse into a scratch copy so a corrupt snapshot can't leave the
+        live config half-populated. */
+        Config cached;
+        if (!parseCache(file.data(), file.size(), writeTime, size, cached)) {
+            return false;
+        }
+
+        config = std::move(cached);
+        return true;
+    }
+
+    bool writeConfigCache(const std::wstring& jsonFilename, const Config& config) {
+        CacheHeader header = {};
+        header.magic = cacheMagic;
+        header.version = cacheVersion;
+
+        if (!getFileStamp(jsonFilename, header.jsonWriteTime, header.jsonSize)) {
+            return false;
+        }
+
+        std::vector<CacheMonitor> monitors;
+        monitors.reserve(config.monitors.size());
+        if (!writeMonitors(config.monitors, monitors)) {
+            return false;
+        }
+
+        std::vector<CacheGroup> groups;
+        for (auto& entry : config.presets) {
+            if (entry.first.size() >= maxIdLength) {
+                return false;
+            }
+            CacheGroup group = {};
+            group.kind = GROUP_PRESET;
+            group.monitorCount = (uint32_t) entry.second.size();
+            wcsncpy(group.name, entry.first.c_str(), maxIdLength - 1);
+            groups.push_back(group);
+            if (!writeMonitors(entry.second, monitors)) {
+                return false;
+            }
+        }
+
+        for (auto& entry : config.layouts) {
+            CacheGroup group = {};
+            group.kind = GROUP_LAYOUT;
+            group.monitorCount = (uint32_t) entry.second.size();
+            group.layout = entry.first;
+            groups.push_back(group);
+            if (!writeMonitors(entry.second, monitors)) {
+                return false;
+            }
+        }
+
+        header.flags =
+            (config.pollingEnabled ? FLAG_POLLING_ENABLED : 0) |
+            (config.globalEnabled ? FLAG_GLOBAL_ENABLED : 0) |
+            (config.adaptiveEnabled ? FLAG_ADAPTIVE_ENABLED : 0) |
+            ((uint32_t) config.gammaDither << FLAG_DITHER_SHIFT);
+        header.monitorCount = (uint32_t) monitors.size();
+        header.groupCount = (uint32_t) groups.size();
+        header.layout = config.layout;
+
+        std::string contents;
+        contents.reserve(sizeof(header) +
+            groups.size() * sizeof(CacheGroup) +
+            monitors.size() * sizeof(CacheMonitor));
+
+        contents.append(reinterpret_cast<const char*>(&header), sizeof(header));
+        contents.append(reinterpret_cast<const char*>(groups.data()), groups.size() * sizeof(CacheGroup));
+        contents.append(reinterpret_cast<const char*>(monitors.data()), monitors.size() * sizeof(CacheMonitor));
+
+        CacheHeader* written = reinterpret_cast<CacheHeader*>(&contents[0]);
+        written->checksum = checksum(contents.data() + sizeof(header), contents.size() - sizeof(header));
+
+        return writeFileAtomic(getCacheFilename(), contents.data(), contents.size());
+    }
+}
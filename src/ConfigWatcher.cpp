@@ -0,0 +1,219 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "ConfigWatcher.h"
+
+#ifndef _WIN32
+#include "Util.h"
+#include <cerrno>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using namespace dimmer;
+
+#ifdef _WIN32
+
+constexpr DWORD notifyFilter =
+    FILE_NOTIFY_CHANGE_LAST_WRITE |
+    FILE_NOTIFY_CHANGE_FILE_NAME |
+    FILE_NOTIFY_CHANGE_SIZE;
+
+ConfigWatcher::ConfigWatcher(const std::wstring& directory, const std::wstring& filename)
+: filename(filename)
+, directory(INVALID_HANDLE_VALUE)
+, event(nullptr)
+, overlapped({}) {
+    this->directory = CreateFile(
+        directory.c_str(),
+        FILE_LIST_DIRECTORY,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+        nullptr);
+
+    if (this->directory != INVALID_HANDLE_VALUE) {
+        this->event = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+        if (!this->arm()) {
+            CloseHandle(this->event);
+            this->event = nullptr;
+        }
+    }
+}
+
+ConfigWatcher::~ConfigWatcher() {
+    if (this->directory != INVALID_HANDLE_VALUE) {
+        CancelIo(this->directory);
+        if (this->event) {
+            DWORD bytes = 0;
+            GetOverlappedResult(this->directory, &this->overlapped, &bytes, TRUE);
+        }
+        CloseHandle(this->directory);
+    }
+
+    if (this->event) {
+        CloseHandle(this->event);
+    }
+}
+
+bool ConfigWatcher::arm() {
+    if (!this->event) {
+        return false;
+    }
+
+    this->overlapped = {};
+    this->overlapped.hEvent = this->event;
+
+    return ReadDirectoryChangesW(
+        this->directory,
+        this->buffer,
+        sizeof(this->buffer),
+        FALSE,
+        notifyFilter,
+        nullptr,
+        &this->overlapped,
+        nullptr) != FALSE;
+}
+
+bool ConfigWatcher::isOpen() const {
+    return this->event != nullptr;
+}
+
+bool ConfigWatcher::changed() {
+    if (!this->event) {
+        return false;
+    }
+
+    DWORD bytes = 0;
+    if (!GetOverlappedResult(this->directory, &this->overlapped, &bytes, FALSE)) {
+        if (GetLastError() != ERROR_IO_INCOMPLETE) {
+            this->arm();
+        }
+        return false;
+    }
+
+    /* zero bytes means the notification buffer overflowed and the details
+    were dropped; assume the file may have changed. */
+    bool result = (bytes == 0);
+
+    const char* cursor = reinterpret_cast<const char*>(this->buffer);
+    while (!result && bytes > 0) {
+        auto info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(cursor);
+        size_t length = info->FileNameLength / sizeof(wchar_t);
+
+        result =
+            length == this->filename.size() &&
+            _wcsnicmp(info->FileName, this->filename.c_str(), length) == 0;
+
+        if (info->NextEntryOffset == 0) {
+            break;
+        }
+        cursor += info->NextEntryOffset;
+    }
+
+    this->arm();
+    return result;
+}
+
+#else
+
+/* writeFileAtomic() renames over the file, which shows up as IN_MOVED_TO;
+editors that write in place finish with IN_CLOSE_WRITE. */
+constexpr uint32_t notifyMask =
+    IN_CLOSE_WRITE |
+    IN_MOVED_TO |
+    IN_MOVED_FROM |
+    IN_CREATE |
+    IN_DELETE;
+
+ConfigWatcher::ConfigWatcher(const std::wstring& directory, const std::wstring& filename)
+: filename(u16to8(filename))
+, event(-1) {
+    this->event = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (this->event >= 0 && inotify_add_watch(this->event, u16to8(directory).c_str(), notifyMask) < 0) {
+        close(this->event);
+        this->event = -1;
+    }
+}
+
+ConfigWatcher::~ConfigWatcher() {
+    if (this->event >= 0) {
+        close(this->event);
+    }
+}
+
+bool ConfigWatcher::isOpen() const {
+    return this->event >= 0;
+}
+
+bool ConfigWatcher::changed() {
+    if (this->event < 0) {
+        return false;
+    }
+
+    /* the watch stays armed; all that's needed is to drain the queue, or
+    the descriptor stays readable. */
+    alignas(inotify_event) char buffer[4096];
+    bool result = false;
+
+    for (;;) {
+        ssize_t bytes = read(this->event, buffer, sizeof(buffer));
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes <= 0) {
+            break;
+        }
+
+        for (ssize_t offset = 0; offset < bytes; ) {
+            auto info = reinterpret_cast<const inotify_event*>(buffer + offset);
+
+            /* an overflowed queue dropped the details; assume the file may
+            have changed. */
+            if (info->mask & IN_Q_OVERFLOW) {
+                result = true;
+            }
+            else if (info->len && this->filename == info->name) {
+                result = true;
+            }
+
+            offset += sizeof(inotify_event) + info->len;
+        }
+    }
+
+    return result;
+}
+
+#endif
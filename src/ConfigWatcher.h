@@ -0,0 +1,78 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "EventLoop.h"
+#include <string>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+namespace dimmer {
+    /* watches a single file through its parent directory: overlapped
+    ReadDirectoryChangesW on Windows, inotify elsewhere. handle() becomes
+    ready when the directory changes; the owner waits on it (usually with
+    EventLoop::addHandle) and then calls changed(), which consumes the
+    pending notifications, re-arms the watch, and reports whether the file
+    itself was touched. isOpen() is false if the directory can't be
+    watched, e.g. because it doesn't exist. */
+    class ConfigWatcher {
+        public:
+            ConfigWatcher(const std::wstring& directory, const std::wstring& filename);
+            ~ConfigWatcher();
+
+            EventLoop::Handle handle() const { return this->event; }
+            bool isOpen() const;
+            bool changed();
+
+        private:
+            ConfigWatcher(const ConfigWatcher&) = delete;
+            ConfigWatcher& operator=(const ConfigWatcher&) = delete;
+
+#ifdef _WIN32
+            bool arm();
+
+            std::wstring filename;
+            HANDLE directory;
+            HANDLE event;
+            OVERLAPPED overlapped;
+            DWORD buffer[1024]; /* FILE_NOTIFY_INFORMATION must be DWORD aligned */
+#else
+            std::string filename; /* as the kernel reports it */
+            int event; /* the inotify descriptor */
+#endif
+    };
+}
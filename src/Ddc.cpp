@@ -0,0 +1,327 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Ddc.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#ifdef _WIN32
+#include <PhysicalMonitorEnumerationAPI.h>
+#include <LowLevelMonitorConfigurationAPI.h>
+#pragma comment(lib, "dxva2.lib")
+#else
+#include <fcntl.h>
+#include <linux/i2c-dev.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+using namespace dimmer;
+
+/* the host's address as the display sees it, as a sender and as a
+receiver, and the display's 8-bit write address. */
+constexpr uint8_t HOST_SOURCE = 0x51;
+constexpr uint8_t HOST_DESTINATION = 0x50;
+constexpr uint8_t DISPLAY_WRITE = DDC_ADDRESS << 1;
+
+constexpr uint8_t OP_GET_VCP = 0x01;
+constexpr uint8_t OP_GET_VCP_REPLY = 0x02;
+constexpr uint8_t OP_SET_VCP = 0x03;
+
+/* DDC/CI 1.1: the display needs 40ms before a reply can be read, and 50ms
+after a set before it takes the next command. */
+constexpr uint32_t replyDelayMs = 40;
+constexpr uint32_t setDelayMs = 50;
+constexpr uint32_t retryDelayMs = 50;
+constexpr int maxAttempts = 3;
+
+static uint8_t checksum(uint8_t initial, const uint8_t* data, size_t size) {
+    uint8_t result = initial;
+    for (size_t i = 0; i < size; i++) {
+        result ^= data[i];
+    }
+    return result;
+}
+
+static size_t encode(const uint8_t* payload, size_t size, uint8_t* out) {
+    out[0] = HOST_SOURCE;
+    out[1] = (uint8_t) (0x80 | size);
+    std::copy(payload, payload + size, out + 2);
+    out[size + 2] = checksum(DISPLAY_WRITE, out, size + 2);
+    return size + 3;
+}
+
+namespace dimmer {
+    size_t encodeVcpGet(uint8_t code, uint8_t* out) {
+        uint8_t payload[] = { OP_GET_VCP, code };
+        return encode(payload, sizeof(payload), out);
+    }
+
+    size_t encodeVcpSet(uint8_t code, uint16_t value, uint8_t* out) {
+        uint8_t payload[] = { OP_SET_VCP, code, (uint8_t) (value >> 8), (uint8_t) value };
+        return encode(payload, sizeof(payload), out);
+    }
+
+    DdcReply decodeVcpReply(const uint8_t* data, size_t size, uint8_t code, VcpValue& value) {
+        if (size < 3 || !(data[1] & 0x80)) {
+            return DdcReply::Invalid;
+        }
+
+        size_t length = data[1] & 0x7f;
+        if (length + 3 > size || checksum(HOST_DESTINATION, data, length + 2) != data[length + 2]) {
+            return DdcReply::Invalid;
+        }
+
+        if (length == 0) {
+            return DdcReply::Busy;
+        }
+
+        /* opcode, result, code, type, maximum (2), current (2) */
+        const uint8_t* payload = data + 2;
+        if (length != 8 || payload[0] != OP_GET_VCP_REPLY || payload[2] != code) {
+            return DdcReply::Invalid;
+        }
+
+        if (payload[1] != 0) {
+            return DdcReply::Unsupported;
+        }
+
+        value.maximum = (uint16_t) ((payload[4] << 8) | payload[5]);
+        value.current = (uint16_t) ((payload[6] << 8) | payload[7]);
+        return DdcReply::Ok;
+    }
+}
+
+/* DdcTransport */
+
+DdcTransport::DdcTransport(I2cBus& bus, Sleep sleep)
+: bus(bus)
+, sleep(sleep) {
+    if (!this->sleep) {
+        this->sleep = [](uint32_t ms) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+        };
+    }
+}
+
+bool DdcTransport::getVcp(uint8_t code, VcpValue& value) {
+    uint8_t request[DDC_MAX_REQUEST];
+    size_t size = encodeVcpGet(code, request);
+
+    for (int attempt = 0; attempt < maxAttempts; attempt++) {
+        if (attempt > 0) {
+            this->sleep(retryDelayMs);
+        }
+
+        if (!this->bus.write(DDC_ADDRESS, request, size)) {
+            continue;
+        }
+
+        this->sleep(replyDelayMs);
+
+        uint8_t reply[DDC_REPLY_SIZE];
+        if (!this->bus.read(DDC_ADDRESS, reply, sizeof(reply))) {
+            continue;
+        }
+
+        switch (decodeVcpReply(reply, sizeof(reply), code, value)) {
+            case DdcReply::Ok: return true;
+            case DdcReply::Unsupported: return false;
+            default: break;
+        }
+    }
+
+    return false;
+}
+
+bool DdcTransport::setVcp(uint8_t code, uint16_t value) {
+    uint8_t request[DDC_MAX_REQUEST];
+    size_t size = encodeVcpSet(code, value, request);
+
+    /* sets aren't acknowledged, so a bus error is the only thing to retry. */
+    for (int attempt = 0; attempt < maxAttempts; attempt++) {
+        bool written = this->bus.write(DDC_ADDRESS, request, size);
+        this->sleep(written ? setDelayMs : retryDelayMs);
+        if (written) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#ifdef _WIN32
+
+/* PhysicalMonitorTransport */
+
+PhysicalMonitorTransport::PhysicalMonitorTransport(HMONITOR monitor)
+: handle(nullptr) {
+    DWORD count = 0;
+    if (GetNumberOfPhysicalMonitorsFromHMONITOR(monitor, &count) && count > 0) {
+        std::unique_ptr<PHYSICAL_MONITOR[]> physical(new PHYSICAL_MONITOR[count]);
+        if (GetPhysicalMonitorsFromHMONITOR(monitor, count, physical.get())) {
+            this->handle = physical[0].hPhysicalMonitor;
+            if (count > 1) {
+                DestroyPhysicalMonitors(count - 1, physical.get() + 1);
+            }
+        }
+    }
+}
+
+PhysicalMonitorTransport::~PhysicalMonitorTransport() {
+    if (this->handle) {
+        DestroyPhysicalMonitor(this->handle);
+    }
+}
+
+bool PhysicalMonitorTransport::getVcp(uint8_t code, VcpValue& value) {
+    DWORD current = 0, maximum = 0;
+    if (!this->handle || !GetVCPFeatureAndVCPFeatureReply(this->handle, code, nullptr, &current, &maximum)) {
+        return false;
+    }
+    value.current = (uint16_t) current;
+    value.maximum = (uint16_t) maximum;
+    return true;
+}
+
+bool PhysicalMonitorTransport::setVcp(uint8_t code, uint16_t value) {
+    return this->handle && SetVCPFeature(this->handle, code, value);
+}
+
+#else
+
+/* LinuxI2cBus */
+
+LinuxI2cBus::LinuxI2cBus(const std::string& device)
+: fd(open(device.c_str(), O_RDWR | O_CLOEXEC))
+, selected(-1) {
+}
+
+LinuxI2cBus::~LinuxI2cBus() {
+    if (this->fd >= 0) {
+        close(this->fd);
+    }
+}
+
+bool LinuxI2cBus::select(uint8_t address) {
+    if (this->selected != address) {
+        if (this->fd < 0 || ioctl(this->fd, I2C_SLAVE, (long) address) < 0) {
+            return false;
+        }
+        this->selected = address;
+    }
+    return true;
+}
+
+bool LinuxI2cBus::write(uint8_t address, const uint8_t* data, size_t size) {
+    return this->select(address) && ::write(this->fd, data, size) == (ssize_t) size;
+}
+
+bool LinuxI2cBus::read(uint8_t address, uint8_t* data, size_t size) {
+    return this->select(address) && ::read(this->fd, data, size) == (ssize_t) size;
+}
+
+#endif
+
+/* Backlight */
+
+Backlight::Backlight() {
+}
+
+void Backlight::setTransport(std::unique_ptr<VcpTransport> transport) {
+    this->transport = std::move(transport);
+    this->cache.clear();
+    this->unsupported.clear();
+}
+
+bool Backlight::get(uint8_t code, VcpValue& value) {
+    auto it = this->cache.find(code);
+    if (it != this->cache.end()) {
+        value = it->second;
+        return true;
+    }
+
+    /* a display that doesn't answer is asked again, but not one that said
+    it doesn't have the feature. */
+    if (!this->transport || this->unsupported[code] || !this->transport->getVcp(code, value)) {
+        return false;
+    }
+
+    if (value.maximum == 0) {
+        this->unsupported[code] = true;
+        return false;
+    }
+
+    this->cache[code] = value;
+    this->original.emplace(code, value.current);
+    return true;
+}
+
+bool Backlight::set(uint8_t code, uint16_t value) {
+    VcpValue current;
+    if (!this->get(code, current)) {
+        return false;
+    }
+
+    value = std::min(value, current.maximum);
+    if (current.current == value) {
+        return true;
+    }
+
+    if (!this->transport->setVcp(code, value)) {
+        /* the display may or may not have taken it; read it back next time. */
+        this->cache.erase(code);
+        return false;
+    }
+
+    this->cache[code].current = value;
+    return true;
+}
+
+bool Backlight::setPercent(uint8_t code, int percent) {
+    VcpValue current;
+    if (!this->get(code, current)) {
+        return false;
+    }
+
+    percent = std::min(100, std::max(0, percent));
+    return this->set(code, (uint16_t) ((percent * current.maximum + 50) / 100));
+}
+
+void Backlight::restore() {
+    for (auto& entry : this->original) {
+        this->set(entry.first, entry.second);
+    }
+}
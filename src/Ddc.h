@@ -0,0 +1,186 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+namespace dimmer {
+    /* VCP feature codes from the MCCS spec. */
+    constexpr uint8_t VCP_LUMINANCE = 0x10;
+    constexpr uint8_t VCP_CONTRAST = 0x12;
+    constexpr uint8_t VCP_COLOR_PRESET = 0x14;
+
+    /* the display's DDC/CI address on the I2C bus (7-bit). */
+    constexpr uint8_t DDC_ADDRESS = 0x37;
+
+    /* largest encoded request, and the size of a "get VCP" reply. */
+    constexpr size_t DDC_MAX_REQUEST = 8;
+    constexpr size_t DDC_REPLY_SIZE = 11;
+
+    struct VcpValue {
+        uint16_t current = 0;
+        uint16_t maximum = 0;
+    };
+
+    enum class DdcReply {
+        Ok,
+        Busy,        /* a null message: the display wants more time */
+        Unsupported, /* the display doesn't implement the feature */
+        Invalid      /* bad checksum, length, or opcode */
+    };
+
+    /* DDC/CI message framing. requests are the bytes written after the
+    I2C address byte; replies are the bytes read back, starting with the
+    display's source address. both end in an XOR checksum. */
+    extern size_t encodeVcpGet(uint8_t code, uint8_t* out);
+    extern size_t encodeVcpSet(uint8_t code, uint16_t value, uint8_t* out);
+    extern DdcReply decodeVcpReply(const uint8_t* data, size_t size, uint8_t code, VcpValue& value);
+
+    /* raw access to one I2C bus, e.g. /dev/i2c-N, or a fake one in tests. */
+    class I2cBus {
+        public:
+            virtual ~I2cBus() { }
+            virtual bool write(uint8_t address, const uint8_t* data, size_t size) = 0;
+            virtual bool read(uint8_t address, uint8_t* data, size_t size) = 0;
+    };
+
+    /* gets and sets VCP features on one display. */
+    class VcpTransport {
+        public:
+            virtual ~VcpTransport() { }
+            virtual bool getVcp(uint8_t code, VcpValue& value) = 0;
+            virtual bool setVcp(uint8_t code, uint16_t value) = 0;
+    };
+
+    /* speaks DDC/CI over a raw I2C bus, with the delays the spec asks for
+    between commands, and retries for busy displays and corrupt replies.
+    sleep is injectable so tests don't have to wait. */
+    class DdcTransport : public VcpTransport {
+        public:
+            using Sleep = std::function<void(uint32_t ms)>;
+
+            explicit DdcTransport(I2cBus& bus, Sleep sleep = nullptr);
+
+            bool getVcp(uint8_t code, VcpValue& value) override;
+            bool setVcp(uint8_t code, uint16_t value) override;
+
+        private:
+            I2cBus& bus;
+            Sleep sleep;
+    };
+
+#ifdef _WIN32
+    /* the monitor configuration API, which does its own framing, timing
+    and retries. only the first physical monitor behind an HMONITOR is
+    used; clones share a single HMONITOR. */
+    class PhysicalMonitorTransport : public VcpTransport {
+        public:
+            explicit PhysicalMonitorTransport(HMONITOR monitor);
+            ~PhysicalMonitorTransport();
+
+            bool isOpen() const { return this->handle != nullptr; }
+
+            bool getVcp(uint8_t code, VcpValue& value) override;
+            bool setVcp(uint8_t code, uint16_t value) override;
+
+        private:
+            PhysicalMonitorTransport(const PhysicalMonitorTransport&) = delete;
+            PhysicalMonitorTransport& operator=(const PhysicalMonitorTransport&) = delete;
+
+            HANDLE handle;
+    };
+#else
+    class LinuxI2cBus : public I2cBus {
+        public:
+            explicit LinuxI2cBus(const std::string& device); /* e.g. /dev/i2c-4 */
+            ~LinuxI2cBus();
+
+            bool isOpen() const { return this->fd >= 0; }
+
+            bool write(uint8_t address, const uint8_t* data, size_t size) override;
+            bool read(uint8_t address, uint8_t* data, size_t size) override;
+
+        private:
+            LinuxI2cBus(const LinuxI2cBus&) = delete;
+            LinuxI2cBus& operator=(const LinuxI2cBus&) = delete;
+
+            bool select(uint8_t address);
+
+            int fd;
+            int selected;
+    };
+#endif
+
+    /* one display's VCP features, cached. every write takes ~50ms, so
+    values are read once and writes that wouldn't change anything are
+    skipped. the first value seen for each feature is remembered, so it
+    can be put back when dimmer lets go of the display.
+
+    not thread safe; the DevicePool already keeps calls for one device
+    from overlapping. */
+    class Backlight {
+        public:
+            Backlight();
+
+            /* drops cached values, e.g. after the display was reconnected,
+            but keeps the remembered originals. */
+            void setTransport(std::unique_ptr<VcpTransport> transport);
+            bool hasTransport() const { return this->transport != nullptr; }
+
+            bool get(uint8_t code, VcpValue& value);
+            bool set(uint8_t code, uint16_t value);
+
+            /* 0-100, scaled to the feature's maximum */
+            bool setPercent(uint8_t code, int percent);
+
+            /* writes back the original value of every feature changed. */
+            void restore();
+
+        private:
+            std::unique_ptr<VcpTransport> transport;
+            std::map<uint8_t, VcpValue> cache;
+            std::map<uint8_t, uint16_t> original;
+            std::map<uint8_t, bool> unsupported;
+    };
+}
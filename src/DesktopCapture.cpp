@@ -0,0 +1,234 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifdef _WIN32
+
+#include "DesktopCapture.h"
+#include <d3d11.h>
+#include <dxgi1_2.h>
+#include <algorithm>
+
+#pragma comment(lib, "d3d11.lib")
+#pragma comment(lib, "dxgi.lib")
+#pragma comment(lib, "dxguid.lib")
+
+using namespace dimmer;
+
+/* frames are shrunk until they're about this wide. */
+constexpr UINT sampleWidth = 256;
+
+template <typename T>
+static void release(T*& object) {
+    if (object) {
+        object->Release();
+        object = nullptr;
+    }
+}
+
+DesktopCapture::DesktopCapture(const std::wstring& device)
+: device(device)
+, d3d(nullptr)
+, context(nullptr)
+, duplication(nullptr)
+, mips(nullptr)
+, view(nullptr)
+, staging(nullptr)
+, width(0)
+, height(0)
+, level(0) {
+}
+
+DesktopCapture::~DesktopCapture() {
+    this->close();
+}
+
+bool DesktopCapture::open() {
+    IDXGIFactory1* factory = nullptr;
+    if (FAILED(CreateDXGIFactory1(IID_IDXGIFactory1, (void**) &factory))) {
+        return false;
+    }
+
+    /* the D3D device has to live on the adapter the display is attached to,
+    or DuplicateOutput refuses it. */
+    IDXGIAdapter1* adapter = nullptr;
+    for (UINT i = 0; !this->duplication && factory->EnumAdapters1(i, &adapter) == S_OK; i++) {
+        IDXGIOutput* output = nullptr;
+        for (UINT j = 0; !this->duplication && adapter->EnumOutputs(j, &output) == S_OK; j++) {
+            DXGI_OUTPUT_DESC desc;
+            IDXGIOutput1* output1 = nullptr;
+
+            if (SUCCEEDED(output->GetDesc(&desc)) && this->device == desc.DeviceName &&
+                SUCCEEDED(output->QueryInterface(IID_IDXGIOutput1, (void**) &output1)))
+            {
+                if (SUCCEEDED(D3D11CreateDevice(adapter, D3D_DRIVER_TYPE_UNKNOWN, nullptr, 0,
+                    nullptr, 0, D3D11_SDK_VERSION, &this->d3d, nullptr, &this->context)))
+                {
+                    output1->DuplicateOutput(this->d3d, &this->duplication);
+                }
+                release(output1);
+            }
+
+            release(output);
+        }
+        release(adapter);
+    }
+    release(factory);
+
+    if (!this->duplication) {
+        this->close();
+        return false;
+    }
+
+    return true;
+}
+
+void DesktopCapture::close() {
+    release(this->staging);
+    release(this->view);
+    release(this->mips);
+    release(this->duplication);
+    release(this->context);
+    release(this->d3d);
+    this->width = this->height = this->level = 0;
+}
+
+bool DesktopCapture::prepare(ID3D11Texture2D* frame) {
+    D3D11_TEXTURE2D_DESC desc;
+    frame->GetDesc(&desc);
+
+    if (this->mips && desc.Width == this->width && desc.Height == this->height) {
+        return true;
+    }
+
+    release(this->staging);
+    release(this->view);
+    release(this->mips);
+
+    UINT level = 0;
+    while ((desc.Width >> level) > sampleWidth && (desc.Height >> (level + 1)) > 0) {
+        level++;
+    }
+
+    D3D11_TEXTURE2D_DESC mipDesc = {};
+    mipDesc.Width = desc.Width;
+    mipDesc.Height = desc.Height;
+    mipDesc.MipLevels = level + 1;
+    mipDesc.ArraySize = 1;
+    mipDesc.Format = desc.Format;
+    mipDesc.SampleDesc.Count = 1;
+    mipDesc.Usage = D3D11_USAGE_DEFAULT;
+    mipDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+    mipDesc.MiscFlags = D3D11_RESOURCE_MISC_GENERATE_MIPS;
+
+    D3D11_TEXTURE2D_DESC stagingDesc = {};
+    stagingDesc.Width = std::max(1u, desc.Width >> level);
+    stagingDesc.Height = std::max(1u, desc.Height >> level);
+    stagingDesc.MipLevels = 1;
+    stagingDesc.ArraySize = 1;
+    stagingDesc.Format = desc.Format;
+    stagingDesc.SampleDesc.Count = 1;
+    stagingDesc.Usage = D3D11_USAGE_STAGING;
+    stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+
+    if (FAILED(this->d3d->CreateTexture2D(&mipDesc, nullptr, &this->mips)) ||
+        FAILED(this->d3d->CreateShaderResourceView(this->mips, nullptr, &this->view)) ||
+        FAILED(this->d3d->CreateTexture2D(&stagingDesc, nullptr, &this->staging)))
+    {
+        release(this->staging);
+        release(this->view);
+        release(this->mips);
+        return false;
+    }
+
+    this->width = desc.Width;
+    this->height = desc.Height;
+    this->level = level;
+    return true;
+}
+
+bool DesktopCapture::capture(LumaStats& stats) {
+    if (!this->duplication && !this->open()) {
+        return false;
+    }
+
+    DXGI_OUTDUPL_FRAME_INFO info;
+    IDXGIResource* resource = nullptr;
+    HRESULT hr = this->duplication->AcquireNextFrame(0, &info, &resource);
+
+    if (hr == DXGI_ERROR_WAIT_TIMEOUT) {
+        return false;
+    }
+
+    if (FAILED(hr)) {
+        this->close(); /* DXGI_ERROR_ACCESS_LOST and friends */
+        return false;
+    }
+
+    /* a frame with no present time only moved the mouse. */
+    bool copied = false;
+    ID3D11Texture2D* frame = nullptr;
+    if (info.LastPresentTime.QuadPart != 0 &&
+        SUCCEEDED(resource->QueryInterface(IID_ID3D11Texture2D, (void**) &frame)) &&
+        this->prepare(frame))
+    {
+        this->context->CopySubresourceRegion(this->mips, 0, 0, 0, 0, frame, 0, nullptr);
+        this->context->GenerateMips(this->view);
+        this->context->CopySubresourceRegion(this->staging, 0, 0, 0, 0, this->mips, this->level, nullptr);
+        copied = true;
+    }
+
+    release(frame);
+    release(resource);
+    this->duplication->ReleaseFrame();
+
+    if (!copied) {
+        return false;
+    }
+
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if (FAILED(this->context->Map(this->staging, 0, D3D11_MAP_READ, 0, &mapped))) {
+        return false;
+    }
+
+    uint32_t histogram[256] = { 0 };
+    UINT w = std::max(1u, this->width >> this->level);
+    UINT h = std::max(1u, this->height >> this->level);
+    lumaHistogram(mapped.pData, w, h, mapped.RowPitch, histogram);
+    this->context->Unmap(this->staging, 0);
+
+    stats = lumaStats(histogram);
+    return true;
+}
+
+#endif
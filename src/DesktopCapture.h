@@ -0,0 +1,87 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifdef _WIN32
+
+#include "Adaptive.h"
+#include <string>
+#include <Windows.h>
+
+struct ID3D11Device;
+struct ID3D11DeviceContext;
+struct ID3D11Texture2D;
+struct ID3D11ShaderResourceView;
+struct IDXGIOutputDuplication;
+
+namespace dimmer {
+    /* samples one display through DXGI desktop duplication. frames are
+    shrunk on the GPU (a mip chain, down to ~256 pixels across) before
+    anything comes back to the CPU, so a capture costs a few kilobytes of
+    readback however big the display is.
+
+    windows marked WDA_EXCLUDEFROMCAPTURE, like the overlays, aren't in
+    the frame, and neither is the gamma ramp, so what's measured is the
+    content itself. not thread safe; use one from a single queue. */
+    class DesktopCapture {
+        public:
+            explicit DesktopCapture(const std::wstring& device); /* \\.\DISPLAY1 */
+            ~DesktopCapture();
+
+            /* false if nothing on screen has changed since the last call, or
+            the display can't be captured right now (a mode change, the
+            secure desktop); it's reopened on the next call. */
+            bool capture(LumaStats& stats);
+
+        private:
+            DesktopCapture(const DesktopCapture&) = delete;
+            DesktopCapture& operator=(const DesktopCapture&) = delete;
+
+            bool open();
+            void close();
+            bool prepare(ID3D11Texture2D* frame);
+
+            std::wstring device;
+            ID3D11Device* d3d;
+            ID3D11DeviceContext* context;
+            IDXGIOutputDuplication* duplication;
+            ID3D11Texture2D* mips;
+            ID3D11ShaderResourceView* view;
+            ID3D11Texture2D* staging;
+            UINT width, height, level;
+    };
+}
+
+#endif
@@ -0,0 +1,161 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "DevicePool.h"
+#include <algorithm>
+
+using namespace dimmer;
+
+static DevicePool* currentPool = nullptr;
+
+DevicePool::DevicePool(size_t maxThreads)
+: maxThreads(std::max<size_t>(1, maxThreads))
+, idle(0)
+, stopping(false)
+, readyHead(nullptr)
+, readyTail(nullptr)
+, readyCount(0)
+, previous(currentPool) {
+    currentPool = this;
+}
+
+DevicePool::~DevicePool() {
+    if (currentPool == this) {
+        currentPool = this->previous;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->stopping = true;
+    }
+    this->wake.notify_all();
+
+    for (auto& thread : this->threads) {
+        thread.join();
+    }
+}
+
+DevicePool* DevicePool::current() {
+    return currentPool;
+}
+
+void DevicePool::submit(const std::wstring& device, Operation operation, Operation completion) {
+    EventLoop* loop = EventLoop::current();
+    if (!loop) {
+        operation();
+        if (completion) {
+            completion();
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(this->lock);
+
+        Device& entry = this->devices[device];
+        entry.hasPending = true;
+        entry.pending = { operation, completion, loop };
+
+        if (!entry.busy) {
+            entry.busy = true;
+            this->pushReady(&entry);
+        }
+
+        /* threads are only started once there's more work than idle ones. */
+        if (this->idle < this->readyCount && this->threads.size() < this->maxThreads) {
+            this->threads.emplace_back([this]() {
+                this->work();
+            });
+        }
+    }
+
+    this->wake.notify_one();
+}
+
+void DevicePool::pushReady(Device* device) {
+    device->next = nullptr;
+    if (this->readyTail) {
+        this->readyTail->next = device;
+    }
+    else {
+        this->readyHead = device;
+    }
+    this->readyTail = device;
+    this->readyCount++;
+}
+
+void DevicePool::work() {
+    std::unique_lock<std::mutex> guard(this->lock);
+
+    for (;;) {
+        this->idle++;
+        this->wake.wait(guard, [this]() {
+            return this->stopping || this->readyHead;
+        });
+        this->idle--;
+
+        /* anything submitted before shutdown still runs; that's how the
+        gamma ramps get reset on the way out. */
+        if (!this->readyHead) {
+            return;
+        }
+
+        Device& entry = *this->readyHead;
+        this->readyHead = entry.next;
+        if (!this->readyHead) {
+            this->readyTail = nullptr;
+        }
+        this->readyCount--;
+
+        Pending pending = std::move(entry.pending);
+        entry.hasPending = false;
+
+        guard.unlock();
+
+        pending.operation();
+        if (pending.completion) {
+            pending.loop->post(pending.completion);
+        }
+
+        guard.lock();
+
+        /* submitted while this one was running; it's next for the device. */
+        if (entry.hasPending) {
+            this->pushReady(&entry);
+        }
+        else {
+            entry.busy = false;
+        }
+    }
+}
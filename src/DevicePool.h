@@ -0,0 +1,108 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "EventLoop.h"
+
+namespace dimmer {
+    /* runs blocking device calls (gamma ramps, DDC/CI) on a few worker
+    threads, so that updating several monitors takes as long as the slowest
+    one rather than all of them added together.
+
+    operations on the same device never overlap, and run in the order they
+    were submitted, except that only the newest one that hasn't started yet
+    is kept: anything it replaces is dropped, completion and all. operations
+    on different devices run in parallel, up to the thread limit.
+
+    completions run on the EventLoop that was current when the operation was
+    submitted. without one, submit() simply runs both right away. */
+    class DevicePool {
+        public:
+            using Operation = std::function<void()>;
+
+            explicit DevicePool(size_t maxThreads = 4);
+
+            /* waits for everything already submitted to finish. */
+            ~DevicePool();
+
+            void submit(const std::wstring& device, Operation operation, Operation completion = nullptr);
+
+            /* the pool that was most recently created, or nullptr. */
+            static DevicePool* current();
+
+        private:
+            DevicePool(const DevicePool&) = delete;
+            DevicePool& operator=(const DevicePool&) = delete;
+
+            struct Pending {
+                Operation operation;
+                Operation completion;
+                EventLoop* loop;
+            };
+
+            struct Device {
+                bool busy = false; /* queued in ready, or running */
+                bool hasPending = false;
+                Pending pending;
+                Device* next = nullptr; /* in ready */
+            };
+
+            void work();
+            void pushReady(Device* device);
+
+            size_t maxThreads;
+            size_t idle;
+            bool stopping;
+            std::mutex lock;
+            std::condition_variable wake;
+            std::map<std::wstring, Device> devices;
+
+            /* devices waiting for a thread, oldest first. linked through the
+            devices themselves, which never move, so queueing one doesn't
+            allocate. */
+            Device* readyHead;
+            Device* readyTail;
+            size_t readyCount;
+            std::vector<std::thread> threads;
+            DevicePool* previous;
+    };
+}
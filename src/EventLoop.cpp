@@ -0,0 +1,342 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "EventLoop.h"
+#include <algorithm>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <ctime>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+using namespace dimmer;
+
+#ifndef _WIN32
+constexpr EventLoop::Id wakeId = 0; /* epoll tag for the wake eventfd */
+#endif
+
+static thread_local EventLoop* currentLoop = nullptr;
+
+EventLoop::EventLoop(Clock clock)
+: clock(clock)
+, nextId(1)
+, timers(clock())
+, previous(currentLoop)
+, quitting(false)
+, exitCode(0) {
+    currentLoop = this;
+
+#ifdef _WIN32
+    this->wakeEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+#else
+    this->epoll = epoll_create1(EPOLL_CLOEXEC);
+    this->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = wakeId;
+    epoll_ctl(this->epoll, EPOLL_CTL_ADD, this->wakeFd, &event);
+#endif
+}
+
+EventLoop::~EventLoop() {
+    if (currentLoop == this) {
+        currentLoop = this->previous;
+    }
+
+#ifdef _WIN32
+    CloseHandle(this->wakeEvent);
+#else
+    close(this->wakeFd);
+    close(this->epoll);
+#endif
+}
+
+uint64_t EventLoop::now() {
+#ifdef _WIN32
+    return GetTickCount64();
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + (uint64_t) ts.tv_nsec / 1000000;
+#endif
+}
+
+EventLoop* EventLoop::current() {
+    return currentLoop;
+}
+
+EventLoop::Id EventLoop::addHandle(Handle handle, Callback callback) {
+    Id id = this->nextId++;
+    this->watches.push_back({ id, handle, callback });
+
+#ifndef _WIN32
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = id;
+    epoll_ctl(this->epoll, EPOLL_CTL_ADD, handle, &event);
+#endif
+
+    return id;
+}
+
+void EventLoop::removeHandle(Id id) {
+    auto it = std::find_if(this->watches.begin(), this->watches.end(),
+        [id](const Watch& watch) { return watch.id == id; });
+
+    if (it != this->watches.end()) {
+#ifndef _WIN32
+        epoll_ctl(this->epoll, EPOLL_CTL_DEL, it->handle, nullptr);
+#endif
+        this->watches.erase(it);
+    }
+}
+
+EventLoop::Id EventLoop::schedule(uint32_t delayMs, Callback callback, uint32_t slackMs) {
+    return this->timers.schedule(this->clock() + delayMs, slackMs, 0, callback);
+}
+
+EventLoop::Id EventLoop::repeat(uint32_t intervalMs, Callback callback, uint32_t slackMs) {
+    return this->timers.schedule(this->clock() + intervalMs, slackMs, intervalMs, callback);
+}
+
+void EventLoop::cancel(Id id) {
+    this->timers.cancel(id);
+}
+
+void EventLoop::post(Callback callback) {
+    {
+        std::lock_guard<std::mutex> lock(this->postedLock);
+        this->posted.push_back(callback);
+    }
+    this->wake();
+}
+
+void EventLoop::quit(int exitCode) {
+    this->exitCode = exitCode;
+    this->quitting = true;
+    this->wake();
+}
+
+void EventLoop::wake() {
+#ifdef _WIN32
+    SetEvent(this->wakeEvent);
+#else
+    uint64_t one = 1;
+    while (write(this->wakeFd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+#endif
+}
+
+void EventLoop::runPosted() {
+    std::vector<Callback> tasks;
+    {
+        std::lock_guard<std::mutex> lock(this->postedLock);
+        tasks.swap(this->posted);
+    }
+
+    for (auto& task : tasks) {
+        task();
+    }
+
+    /* the storage is handed back unless more was posted meanwhile, so a
+    steady trickle of posts doesn't allocate every time. */
+    tasks.clear();
+    std::lock_guard<std::mutex> lock(this->postedLock);
+    if (this->posted.empty()) {
+        this->posted.swap(tasks);
+    }
+}
+
+void EventLoop::runDue() {
+    this->timers.advance(this->clock());
+}
+
+void EventLoop::poll() {
+    this->runPosted();
+    this->runDue();
+}
+
+void EventLoop::dispatch(Id id) {
+    /* copied, so the callback may remove its own watch. */
+    for (auto& watch : this->watches) {
+        if (watch.id == id) {
+            Callback callback = watch.callback;
+            callback();
+            return;
+        }
+    }
+}
+
+int EventLoop::nextTimeout() {
+    uint64_t deadline = this->timers.nextDeadline();
+    if (deadline == UINT64_MAX) {
+        return -1;
+    }
+
+    uint64_t current = this->clock();
+    if (deadline <= current) {
+        return 0;
+    }
+
+    return (int) std::min<uint64_t>(deadline - current, INT32_MAX);
+}
+
+#ifdef _WIN32
+
+int EventLoop::run() {
+    std::vector<HANDLE> handles;
+    std::vector<Id> ids;
+
+    while (!this->quitting) {
+        /* the wake event always comes first; at most MAXIMUM_WAIT_OBJECTS - 1
+        other handles can be waited on at once. */
+        handles.assign(1, this->wakeEvent);
+        ids.assign(1, 0);
+        for (auto& watch : this->watches) {
+            if (handles.size() == MAXIMUM_WAIT_OBJECTS - 1) {
+                break;
+            }
+            handles.push_back(watch.handle);
+            ids.push_back(watch.id);
+        }
+
+        int timeout = this->nextTimeout();
+        DWORD result = MsgWaitForMultipleObjectsEx(
+            (DWORD) handles.size(),
+            handles.data(),
+            timeout < 0 ? INFINITE : (DWORD) timeout,
+            QS_ALLINPUT,
+            MWMO_INPUTAVAILABLE);
+
+        if (result == WAIT_FAILED) {
+            return -1;
+        }
+
+        DWORD index = result - WAIT_OBJECT_0;
+        if (index == 0) {
+            this->runPosted();
+        }
+        else if (index < handles.size()) {
+            this->dispatch(ids[index]);
+        }
+
+        MSG msg;
+        while (!this->quitting && PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
+            if (msg.message == WM_QUIT) {
+                return (int) msg.wParam;
+            }
+            TranslateMessage(&msg);
+            DispatchMessage(&msg);
+        }
+
+        this->runDue();
+    }
+
+    return this->exitCode;
+}
+
+#else
+
+int EventLoop::run() {
+    epoll_event events[16];
+
+    while (!this->quitting) {
+        int count = epoll_wait(this->epoll, events, 16, this->nextTimeout());
+
+        if (count < 0 && errno != EINTR) {
+            return -1;
+        }
+
+        for (int i = 0; i < count && !this->quitting; i++) {
+            if (events[i].data.u64 == wakeId) {
+                uint64_t value;
+                while (read(this->wakeFd, &value, sizeof(value)) > 0) {
+                }
+                this->runPosted();
+            }
+            else {
+                this->dispatch(events[i].data.u64);
+            }
+        }
+
+        this->runDue();
+    }
+
+    return this->exitCode;
+}
+
+#endif
+
+Throttle::Throttle(uint32_t intervalMs, EventLoop::Callback callback)
+: interval(intervalMs)
+, callback(callback)
+, loop(nullptr)
+, timer(0)
+, pending(false) {
+}
+
+Throttle::~Throttle() {
+    /* throttles are often statics, which can outlive the loop. */
+    if (this->timer && EventLoop::current() == this->loop) {
+        this->loop->cancel(this->timer);
+    }
+}
+
+void Throttle::operator()() {
+    if (this->timer) {
+        this->pending = true;
+        return;
+    }
+
+    this->callback();
+
+    this->loop = EventLoop::current();
+    if (this->loop) {
+        this->timer = this->loop->schedule(this->interval, [this]() {
+            this->expire();
+        });
+    }
+}
+
+void Throttle::expire() {
+    this->timer = 0;
+    if (this->pending) {
+        this->pending = false;
+        (*this)();
+    }
+}
@@ -0,0 +1,166 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "TimerWheel.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+namespace dimmer {
+    /* a single-threaded dispatcher for everything the app waits on: window
+    messages (on Windows), waitable handles, deadlines, and tasks posted from
+    other threads. it sleeps in one wait call until one of those is ready,
+    so subsystems built on it need neither threads nor polling.
+
+    all callbacks run on the thread that called run(). post() and quit() are
+    the only members that may be called from other threads.
+
+    deadlines live in a TimerWheel, so the loop wakes up once for the
+    nearest one no matter how many are pending. */
+    class EventLoop {
+        public:
+            using Callback = std::function<void()>;
+            using Id = uint64_t;
+            using Clock = uint64_t (*)(); /* monotonic milliseconds */
+
+#ifdef _WIN32
+            using Handle = HANDLE; /* any waitable handle */
+#else
+            using Handle = int; /* any pollable file descriptor */
+#endif
+
+            /* a different clock, together with poll(), lets tests drive
+            the loop's timers deterministically. */
+            explicit EventLoop(Clock clock = &EventLoop::now);
+            ~EventLoop();
+
+            /* the callback runs every time the handle is signaled, until it
+            is removed. handles must stay valid while registered. */
+            Id addHandle(Handle handle, Callback callback);
+            void removeHandle(Id id);
+
+            /* runs the callback once, no sooner than delayMs from now. it
+            may run up to slackMs later than that, so it can share a wakeup
+            with other timers. */
+            Id schedule(uint32_t delayMs, Callback callback, uint32_t slackMs = 0);
+
+            /* runs the callback every intervalMs until cancelled. */
+            Id repeat(uint32_t intervalMs, Callback callback, uint32_t slackMs = 0);
+
+            void cancel(Id id);
+
+            void post(Callback callback);
+
+            /* dispatches until quit() is called or, on Windows, WM_QUIT is
+            received. returns the exit code. */
+            int run();
+            void quit(int exitCode = 0);
+
+            /* runs posted tasks and due timers without waiting for anything. */
+            void poll();
+
+            static uint64_t now(); /* monotonic milliseconds */
+
+            /* the loop that was most recently created on this thread, or
+            nullptr if there is none. */
+            static EventLoop* current();
+
+        private:
+            EventLoop(const EventLoop&) = delete;
+            EventLoop& operator=(const EventLoop&) = delete;
+
+            struct Watch {
+                Id id;
+                Handle handle;
+                Callback callback;
+            };
+
+            void wake();
+            void runPosted();
+            void runDue();
+            void dispatch(Id id);
+            int nextTimeout();
+
+            Clock clock;
+            Id nextId;
+            std::vector<Watch> watches;
+            TimerWheel timers;
+            EventLoop* previous;
+
+            std::mutex postedLock;
+            std::vector<Callback> posted;
+
+            std::atomic<bool> quitting;
+            std::atomic<int> exitCode;
+
+#ifdef _WIN32
+            HANDLE wakeEvent;
+#else
+            int epoll;
+            int wakeFd;
+#endif
+    };
+
+    /* rate-limits a callback to once per interval. the first call in a quiet
+    period runs immediately; calls made within the interval after it are
+    collapsed into a single trailing run at the end of it. the trailing run
+    needs the current thread's EventLoop; without one it is dropped. */
+    class Throttle {
+        public:
+            Throttle(uint32_t intervalMs, EventLoop::Callback callback);
+            ~Throttle();
+
+            void operator()();
+
+        private:
+            Throttle(const Throttle&) = delete;
+            Throttle& operator=(const Throttle&) = delete;
+
+            void expire();
+
+            uint32_t interval;
+            EventLoop::Callback callback;
+            EventLoop* loop;
+            EventLoop::Id timer;
+            bool pending;
+    };
+}
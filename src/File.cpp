@@ -0,0 +1,368 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "File.h"
+#include "Utf.h"
+#include <cstdint>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace dimmer;
+
+static const char emptyView[1] = { 0 };
+
+#ifdef _WIN32
+
+/* WriteFile takes a DWORD, so very large buffers go out in pieces. */
+static bool writeAll(HANDLE file, const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        DWORD chunk = (size > 0x40000000) ? 0x40000000 : (DWORD) size;
+        DWORD written = 0;
+        if (!WriteFile(file, bytes, chunk, &written, nullptr) || written == 0) {
+            return false;
+        }
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+
+namespace dimmer {
+    MappedFile::MappedFile()
+    : view(nullptr)
+    , length(0)
+    , file(INVALID_HANDLE_VALUE)
+    , mapping(nullptr) {
+    }
+
+    bool MappedFile::open(const std::wstring& fn) {
+        this->close();
+
+        this->file = CreateFile(
+            fn.c_str(),
+            GENERIC_READ,
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+            nullptr,
+            OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL,
+            nullptr);
+
+        LARGE_INTEGER size = {};
+        if (this->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(this->file, &size) ||
+            (uint64_t) size.QuadPart > (uint64_t) SIZE_MAX)
+        {
+            this->close();
+            return false;
+        }
+
+        /* zero-length files can't be mapped. */
+        if (size.QuadPart == 0) {
+            this->view = emptyView;
+            return true;
+        }
+
+        this->mapping = CreateFileMapping(this->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (this->mapping) {
+            this->view = static_cast<const char*>(MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0));
+        }
+
+        if (!this->view) {
+            this->close();
+            return false;
+        }
+
+        this->length = (size_t) size.QuadPart;
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (this->view && this->view != emptyView) {
+            UnmapViewOfFile(this->view);
+        }
+        if (this->mapping) {
+            CloseHandle(this->mapping);
+        }
+        if (this->file != INVALID_HANDLE_VALUE) {
+            CloseHandle(this->file);
+        }
+        this->view = nullptr;
+        this->length = 0;
+        this->mapping = nullptr;
+        this->file = INVALID_HANDLE_VALUE;
+    }
+
+    AppendFile::AppendFile()
+    : file(INVALID_HANDLE_VALUE) {
+    }
+
+    bool AppendFile::create(const std::wstring& fn) {
+        this->close();
+
+        this->file = CreateFile(
+            fn.c_str(),
+            GENERIC_WRITE,
+            FILE_SHARE_READ,
+            nullptr,
+            CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_WRITE_THROUGH,
+            nullptr);
+
+        return this->file != INVALID_HANDLE_VALUE;
+    }
+
+    bool AppendFile::open(const std::wstring& fn) {
+        this->close();
+
+        /* with only FILE_APPEND_DATA, every write goes to the end. */
+        this->file = CreateFile(
+            fn.c_str(),
+            FILE_APPEND_DATA,
+            FILE_SHARE_READ,
+            nullptr,
+            OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_WRITE_THROUGH,
+            nullptr);
+
+        return this->file != INVALID_HANDLE_VALUE;
+    }
+
+    bool AppendFile::append(const void* data, size_t size) {
+        if (this->file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        if (!writeAll(this->file, data, size)) {
+            this->close();
+            return false;
+        }
+        return true;
+    }
+
+    bool AppendFile::isOpen() const {
+        return this->file != INVALID_HANDLE_VALUE;
+    }
+
+    void AppendFile::close() {
+        if (this->file != INVALID_HANDLE_VALUE) {
+            CloseHandle(this->file);
+            this->file = INVALID_HANDLE_VALUE;
+        }
+    }
+
+    bool writeFileAtomic(const std::wstring& fn, const void* data, size_t size) {
+        std::wstring temp = fn + L".tmp";
+
+        HANDLE file = CreateFile(
+            temp.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        bool result = writeAll(file, data, size) && FlushFileBuffers(file);
+
+        CloseHandle(file);
+
+        if (result) {
+            result = MoveFileEx(
+                temp.c_str(), fn.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != FALSE;
+        }
+
+        if (!result) {
+            DeleteFile(temp.c_str());
+        }
+
+        return result;
+    }
+}
+
+#else
+
+static std::string nativePath(const std::wstring& fn) {
+    std::string result(utf8Capacity(fn.size()), '\0');
+    size_t size = utf16to8(fn.data(), fn.size(), &result[0], result.size());
+    result.resize(size != UTF_ERROR ? size : 0);
+    return result;
+}
+
+static bool writeAll(int fd, const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        size -= (size_t) written;
+    }
+    return true;
+}
+
+namespace dimmer {
+    MappedFile::MappedFile()
+    : view(nullptr)
+    , length(0) {
+    }
+
+    bool MappedFile::open(const std::wstring& fn) {
+        this->close();
+
+        int fd = ::open(nativePath(fn).c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat info;
+        bool result = false;
+        if (fstat(fd, &info) == 0 && (uint64_t) info.st_size <= (uint64_t) SIZE_MAX) {
+            if (info.st_size == 0) {
+                this->view = emptyView;
+                result = true;
+            }
+            else {
+                void* mapped = mmap(nullptr, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapped != MAP_FAILED) {
+                    this->view = static_cast<const char*>(mapped);
+                    this->length = (size_t) info.st_size;
+                    result = true;
+                }
+            }
+        }
+
+        ::close(fd); /* the mapping keeps the file alive */
+        return result;
+    }
+
+    void MappedFile::close() {
+        if (this->view && this->view != emptyView) {
+            munmap(const_cast<char*>(this->view), this->length);
+        }
+        this->view = nullptr;
+        this->length = 0;
+    }
+
+    AppendFile::AppendFile()
+    : file(-1) {
+    }
+
+    bool AppendFile::create(const std::wstring& fn) {
+        this->close();
+        this->file = ::open(
+            nativePath(fn).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_DSYNC | O_CLOEXEC, 0644);
+        return this->file >= 0;
+    }
+
+    bool AppendFile::open(const std::wstring& fn) {
+        this->close();
+        this->file = ::open(nativePath(fn).c_str(), O_WRONLY | O_APPEND | O_DSYNC | O_CLOEXEC);
+        return this->file >= 0;
+    }
+
+    bool AppendFile::append(const void* data, size_t size) {
+        if (this->file < 0) {
+            return false;
+        }
+        if (!writeAll(this->file, data, size)) {
+            this->close();
+            return false;
+        }
+        return true;
+    }
+
+    bool AppendFile::isOpen() const {
+        return this->file >= 0;
+    }
+
+    void AppendFile::close() {
+        if (this->file >= 0) {
+            ::close(this->file);
+            this->file = -1;
+        }
+    }
+
+    bool writeFileAtomic(const std::wstring& fn, const void* data, size_t size) {
+        std::string path = nativePath(fn);
+        std::string temp = path + ".tmp";
+
+        int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+
+        bool result = writeAll(fd, data, size) && fsync(fd) == 0;
+        result = (::close(fd) == 0) && result;
+
+        if (result) {
+            result = rename(temp.c_str(), path.c_str()) == 0;
+        }
+
+        if (!result) {
+            unlink(temp.c_str());
+            return false;
+        }
+
+        /* the rename itself only survives a crash once the directory is
+        flushed too. */
+        size_t slash = path.find_last_of('/');
+        std::string directory = (slash == std::string::npos) ? "." : path.substr(0, slash + 1);
+        int dir = ::open(directory.c_str(), O_RDONLY | O_CLOEXEC);
+        if (dir >= 0) {
+            fsync(dir);
+            ::close(dir);
+        }
+
+        return true;
+    }
+}
+
+#endif
+
+namespace dimmer {
+    MappedFile::~MappedFile() {
+        this->close();
+    }
+
+    AppendFile::~AppendFile() {
+        this->close();
+    }
+}
@@ -0,0 +1,101 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+namespace dimmer {
+    /* a read-only view of an entire file. the contents are mapped rather
+    than read, so nothing is copied until the caller decides to. an empty
+    file opens successfully with size() == 0. */
+    class MappedFile {
+        public:
+            MappedFile();
+            ~MappedFile();
+
+            bool open(const std::wstring& fn);
+            void close();
+
+            const char* data() const { return this->view; }
+            size_t size() const { return this->length; }
+
+        private:
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+
+            const char* view;
+            size_t length;
+#ifdef _WIN32
+            HANDLE file;
+            HANDLE mapping;
+#endif
+    };
+
+    /* a file that is created empty, or opened as it is, and then only ever
+    appended to. every append is durable (write-through) by the time it
+    returns. any failed or short write closes the file, since its tail is no
+    longer known. */
+    class AppendFile {
+        public:
+            AppendFile();
+            ~AppendFile();
+
+            bool create(const std::wstring& fn);
+            bool open(const std::wstring& fn);
+            bool append(const void* data, size_t size);
+            bool isOpen() const;
+            void close();
+
+        private:
+            AppendFile(const AppendFile&) = delete;
+            AppendFile& operator=(const AppendFile&) = delete;
+
+#ifdef _WIN32
+            HANDLE file;
+#else
+            int file;
+#endif
+    };
+
+    /* replaces fn with the given contents: they're written to a temporary
+    file next to it, flushed to disk, then renamed over the original. a
+    crash at any point leaves either the old file or the new one. */
+    extern bool writeFileAtomic(const std::wstring& fn, const void* data, size_t size);
+}
@@ -0,0 +1,209 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Gamma.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+/* rounds each entry of a plane to 1/steps of an 8-bit level, carrying the
+rounding error on to the next entry so the ramp keeps its average slope.
+an entry held up to the one before it, to stay monotonic, carries the whole
+overshoot, and the ones after it make up for it; only what's cut off at the
+top is dropped. */
+static void diffusePlane(const uint16_t* plane, int steps, int* units) {
+    int maximum = 255 * steps;
+    int previous = 0;
+    float error = 0.0f;
+
+    for (int i = 0; i < dimmer::GAMMA_RAMP_SIZE; i++) {
+        float exact = (float) plane[i] * (float) steps / 256.0f + error;
+        int rounded = std::min(maximum, std::max(previous, (int) std::floor(exact + 0.5f)));
+        error = std::min(0.5f, exact - (float) rounded);
+        units[i] = previous = rounded;
+    }
+}
+
+namespace dimmer {
+    void colorTemperatureToRgb(int kelvin, float& red, float& green, float& blue) {
+        kelvin /= 100;
+
+        if (kelvin <= 66) {
+            red = 255;
+        }
+        else {
+            red = kelvin - 60.0f;
+            red = (float)(329.698727446 * (pow(red, -0.1332047592)));
+            red = std::max(0.0f, std::min(255.0f, red));
+        }
+
+        if (kelvin <= 66) {
+            green = (float) kelvin;
+            green = (float)(99.4708025861 * log(green) - 161.1195681661);
+            green = std::max(0.0f, std::min(255.0f, green));
+        }
+        else {
+            green = kelvin - 60.0f;
+            green = (float)(288.1221695283 * (pow(green, -0.0755148492)));
+            green = std::max(0.0f, std::min(255.0f, green));
+        }
+
+        if (kelvin >= 66) {
+            blue = 255.0f;
+        }
+        else {
+            blue = kelvin - 10.0f;
+            blue = (float)(138.5177312231 * log(blue) - 305.0447927307);
+            blue = std::max(0.0f, std::min(255.0f, blue));
+        }
+
+        red /= 255.0f;
+        green /= 255.0f;
+        blue /= 255.0f;
+    }
+
+    void buildRamp(float red, float green, float blue, const GammaPlanes& planes) {
+        /* entry i is i / size of full scale; for 256 entries that's i * 256,
+        which is what SetDeviceGammaRamp has always been given. */
+        float step = 65536.0f / (float) planes.size;
+
+        for (size_t i = 0; i < planes.size; i++) {
+            float brightness = i * step;
+            planes.red[i] = (uint16_t)std::max(0.0f, std::min(65535.0f, brightness * red));
+            planes.green[i] = (uint16_t)std::max(0.0f, std::min(65535.0f, brightness * green));
+            planes.blue[i] = (uint16_t)std::max(0.0f, std::min(65535.0f, brightness * blue));
+        }
+    }
+
+    void buildTemperatureRamp(int kelvin, float brightness, const GammaPlanes& planes) {
+        float red = 1.0f;
+        float green = 1.0f;
+        float blue = 1.0f;
+
+        if (kelvin != -1) {
+            colorTemperatureToRgb(kelvin, red, green, blue);
+        }
+
+        buildRamp(red * brightness, green * brightness, blue * brightness, planes);
+    }
+
+    void buildDitheredRamps(const GammaRamp& target, GammaDither dither, DitheredRamps& ramps) {
+        if (dither == GammaDither::None) {
+            memcpy(ramps.frames[0], target, sizeof(GammaRamp));
+            ramps.count = 1;
+            return;
+        }
+
+        int steps = (dither == GammaDither::Temporal) ? DITHER_FRAMES : 1;
+        int units[GAMMA_RAMP_SIZE];
+
+        for (int channel = 0; channel < 3; channel++) {
+            diffusePlane(target[channel], steps, units);
+
+            for (int i = 0; i < GAMMA_RAMP_SIZE; i++) {
+                int level = units[i] / steps;
+                int extra = units[i] % steps;
+
+                /* an entry a quarter of the way to the next level is bumped
+                up in one frame of four. which frame depends on the level,
+                so the screen as a whole doesn't pulse; entries on the same
+                level share it, which keeps every frame monotonic. */
+                for (int frame = 0; frame < steps; frame++) {
+                    int bump = ((frame + level + channel) % steps) < extra ? 1 : 0;
+                    ramps.frames[frame][channel][i] = (uint16_t) ((level + bump) << 8);
+                }
+            }
+        }
+
+        ramps.count = steps;
+    }
+
+    int rampDeviation(const GammaRamp& ramp) {
+        int deviation = 0;
+        for (int channel = 0; channel < 3; channel++) {
+            for (int i = 0; i < GAMMA_RAMP_SIZE; i++) {
+                deviation = std::max(deviation, std::abs((ramp[channel][i] >> 8) - i));
+            }
+        }
+        return deviation;
+    }
+
+    bool isRampAcceptable(const GammaRamp& ramp, int range) {
+        for (int channel = 0; channel < 3; channel++) {
+            for (int i = 0; i < GAMMA_RAMP_SIZE; i++) {
+                if (std::abs((ramp[channel][i] >> 8) - i) > range ||
+                    (i > 0 && ramp[channel][i] < ramp[channel][i - 1]))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    GammaFit fitRamp(GammaRamp& ramp, int range) {
+        GammaFit fit;
+
+        for (int channel = 0; channel < 3; channel++) {
+            int previous = 0;
+            for (int i = 0; i < GAMMA_RAMP_SIZE; i++) {
+                /* the bounds only ever go up with i, so clamping to them
+                can't introduce a dip of its own. */
+                int lowest = std::max(0, i - range) << 8;
+                int highest = std::min(0xffff, ((i + range) << 8) | 0xff);
+                int value = ramp[channel][i];
+                int fitted = std::max(previous, std::min(highest, std::max(lowest, value)));
+
+                if (fitted != value) {
+                    fit.clampedEntries++;
+                    fit.maximumClamp = std::max(fit.maximumClamp, (float) std::abs(fitted - value) / 256.0f);
+                    ramp[channel][i] = (uint16_t) fitted;
+                }
+
+                previous = fitted;
+            }
+        }
+
+        return fit;
+    }
+
+    void buildIdentityRamp(GammaRamp& ramp) {
+        buildRamp(1.0f, 1.0f, 1.0f, { ramp[0], ramp[1], ramp[2], GAMMA_RAMP_SIZE });
+    }
+
+    void buildTemperatureRamp(int kelvin, GammaRamp& ramp) {
+        buildTemperatureRamp(kelvin, 1.0f, { ramp[0], ramp[1], ramp[2], GAMMA_RAMP_SIZE });
+    }
+}
@@ -0,0 +1,111 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dimmer {
+    constexpr int GAMMA_RAMP_SIZE = 256;
+
+    using GammaRamp = uint16_t[3][GAMMA_RAMP_SIZE];
+
+    /* 8-bit panels only look at the top byte of each entry, so a warm ramp
+    lands on fewer distinct levels than it has entries, and gradients band.
+    dithering spreads the rounding out, in space or in time. */
+    enum class GammaDither : uint32_t {
+        None = 0,
+        Static = 1, /* one ramp, with the rounding error diffused along it */
+        Temporal = 2 /* DITHER_FRAMES ramps, shown in turn */
+    };
+
+    constexpr int DITHER_FRAMES = 4;
+
+    /* SetDeviceGammaRamp refuses a ramp that goes down anywhere, or that has
+    any entry more than a range of 8-bit levels away from identity. the
+    range is the GdiIcmGammaRange registry value, or 128 without one; 256
+    lets anything through. these model that, so a ramp can be made
+    acceptable before it's sent instead of failing on the way. */
+    constexpr int DEFAULT_GAMMA_RANGE = 128;
+    constexpr int FULL_GAMMA_RANGE = 256;
+
+    /* what fitRamp had to change. */
+    struct GammaFit {
+        int clampedEntries = 0;
+        float maximumClamp = 0.0f; /* in 8-bit levels */
+    };
+
+    /* every ramp for one setting, built up front; cycling through them
+    is then only a matter of handing frames[n] to the driver. */
+    struct DitheredRamps {
+        GammaRamp frames[DITHER_FRAMES];
+        int count = 0;
+    };
+
+    /* one array per channel, as many entries as the driver wants: always
+    256 for SetDeviceGammaRamp, but often 1024 or 4096 for XRandR. */
+    struct GammaPlanes {
+        uint16_t* red;
+        uint16_t* green;
+        uint16_t* blue;
+        size_t size;
+    };
+
+    extern void colorTemperatureToRgb(int kelvin, float& red, float& green, float& blue);
+    extern void buildIdentityRamp(GammaRamp& ramp);
+    extern void buildTemperatureRamp(int kelvin, GammaRamp& ramp);
+
+    /* a linear ramp scaled per channel, 0-1. */
+    extern void buildRamp(float red, float green, float blue, const GammaPlanes& planes);
+
+    /* kelvin may be -1 for no color shift; brightness scales all three
+    channels, for backends that dim through the ramp itself. */
+    extern void buildTemperatureRamp(int kelvin, float brightness, const GammaPlanes& planes);
+
+    /* the ramps to show for target. with GammaDither::Temporal, each entry
+    of each frame is on a whole 8-bit level, and the frames average out to
+    the target within a quarter of a level. every frame is monotonic, and
+    the identity ramp comes back unchanged in any mode. */
+    extern void buildDitheredRamps(const GammaRamp& target, GammaDither dither, DitheredRamps& ramps);
+
+    /* the furthest any entry is from identity, in 8-bit levels. */
+    extern int rampDeviation(const GammaRamp& ramp);
+    extern bool isRampAcceptable(const GammaRamp& ramp, int range);
+
+    /* moves every entry that's out of range to the nearest value that isn't,
+    and flattens any dip, which is the closest acceptable ramp entry by
+    entry. a ramp that was already acceptable comes back unchanged. */
+    extern GammaFit fitRamp(GammaRamp& ramp, int range);
+}
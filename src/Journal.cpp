@@ -0,0 +1,405 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Journal.h"
+#include "File.h"
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <ctime>
+#include <unistd.h>
+#endif
+
+using namespace dimmer;
+
+constexpr uint32_t journalMagic = 0x4c4a4d44; /* 'DMJL' */
+constexpr uint32_t journalVersion = 1;
+constexpr int maxIdLength = 48;
+constexpr uint16_t generalSlot = 0xffff;
+constexpr uint16_t commitFlag = 0x8000;
+constexpr size_t maxSlots = generalSlot;
+
+#pragma pack(push, 4)
+struct JournalHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t baseWriteTime;
+    uint64_t baseSize;
+    uint32_t salt;
+    uint32_t slotCount;
+    uint32_t checksum; /* covers the header fields above and the slot table */
+};
+
+struct JournalSlot {
+    wchar_t id[maxIdLength];
+};
+
+struct JournalRecord {
+    uint16_t slot;
+    uint16_t field;
+    uint32_t value;
+    uint32_t sequence;
+    uint32_t checksum;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(JournalRecord) == 16, "journal records must stay 16 bytes");
+
+static uint32_t checksum(const void* data, size_t length, uint32_t hash = 2166136261u) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t recordChecksum(const JournalRecord& record, uint32_t salt) {
+    return checksum(&record, offsetof(JournalRecord, checksum), salt);
+}
+
+/* only has to differ between journals, so a record from an older one that
+happens to sit at the right offset doesn't validate. never 0, which a mark
+uses for none. */
+static uint32_t newSalt(uint64_t baseWriteTime) {
+#ifdef _WIN32
+    uint32_t salt = GetTickCount() ^ (GetCurrentProcessId() << 16) ^ (uint32_t) baseWriteTime;
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    uint32_t salt = (uint32_t) ts.tv_nsec ^ ((uint32_t) getpid() << 16) ^ (uint32_t) baseWriteTime;
+#endif
+    return salt ? salt : 1;
+}
+
+/* the header at the start of data, if it and the slot table it covers are
+intact. */
+static bool readHeader(const char* data, size_t length, JournalHeader& header) {
+    if (length < sizeof(JournalHeader)) {
+        return false;
+    }
+
+    memcpy(&header, data, sizeof(header));
+
+    if (header.magic != journalMagic ||
+        header.version != journalVersion ||
+        header.slotCount > maxSlots ||
+        length < sizeof(JournalHeader) + (size_t) header.slotCount * sizeof(JournalSlot))
+    {
+        return false;
+    }
+
+    size_t tableSize = (size_t) header.slotCount * sizeof(JournalSlot);
+    uint32_t expected = checksum(&header, offsetof(JournalHeader, checksum));
+    expected = checksum(data + sizeof(JournalHeader), tableSize, expected);
+    return expected == header.checksum;
+}
+
+/* fills in records for a transaction of count entries, numbered from
+sequence. false if a monitor isn't in slots. */
+static bool encodeRecords(
+    const std::map<std::wstring, uint16_t>& slots,
+    uint32_t salt,
+    uint32_t sequence,
+    const JournalEntry* entries,
+    size_t count,
+    JournalRecord* records)
+{
+    for (size_t i = 0; i < count; i++) {
+        uint16_t slot = generalSlot;
+        if (entries[i].monitorId) {
+            auto it = slots.find(*entries[i].monitorId);
+            if (it == slots.end()) {
+                return false;
+            }
+            slot = it->second;
+        }
+
+        JournalRecord& record = records[i];
+        record = {};
+        record.slot = slot;
+        record.field = (uint16_t) entries[i].field | (i == count - 1 ? commitFlag : 0);
+        record.value = entries[i].value;
+        record.sequence = sequence + (uint32_t) i;
+        record.checksum = recordChecksum(record, salt);
+    }
+    return true;
+}
+
+static float toFloat(uint32_t value) {
+    float result;
+    memcpy(&result, &value, sizeof(result));
+    return result;
+}
+
+static void applyRecord(
+    const JournalRecord& record,
+    const std::wstring* id,
+    const MonitorOptions& defaults,
+    Config& config)
+{
+    JournalField field = (JournalField) (record.field & ~commitFlag);
+    if (id) {
+        /* the slot table comes from the config the journal was started
+        against, and config.json saves the whole live map, so the base
+        normally has every journaled monitor. one it lacks anyway starts
+        from the policy's defaults, as it did when it was first changed,
+        rather than its changes being dropped. */
+        auto it = config.monitors.find(*id);
+        if (it == config.monitors.end()) {
+            it = config.monitors.emplace(*id, defaults).first;
+        }
+        MonitorOptions& options = it->second;
+        switch (field) {
+            case JournalField::Opacity: options.opacity = toFloat(record.value); break;
+            case JournalField::Temperature: options.temperature = (int32_t) record.value; break;
+            case JournalField::Enabled: options.enabled = record.value != 0; break;
+            case JournalField::Backlight: options.backlight = (int32_t) record.value; break;
+            default: break;
+        }
+    }
+    else {
+        switch (field) {
+            case JournalField::PollingEnabled: config.pollingEnabled = record.value != 0; break;
+            case JournalField::GlobalEnabled: config.globalEnabled = record.value != 0; break;
+            case JournalField::AdaptiveEnabled: config.adaptiveEnabled = record.value != 0; break;
+            case JournalField::GammaDither:
+                if (record.value <= (uint32_t) GammaDither::Temporal) {
+                    config.gammaDither = (GammaDither) record.value;
+                }
+                break;
+            default: break;
+        }
+    }
+}
+
+Journal::Journal()
+: salt(0)
+, sequence(0) {
+}
+
+Journal::~Journal() {
+    this->close();
+}
+
+void Journal::close() {
+    this->file.close();
+    this->slots.clear();
+    this->sequence = 0;
+}
+
+bool Journal::replay(
+    const std::wstring& fn,
+    uint64_t baseWriteTime,
+    uint64_t baseSize,
+    const MonitorOptions& defaults,
+    Config& config,
+    const JournalMark& compacted)
+{
+    MappedFile file;
+    if (!file.open(fn)) {
+        return false;
+    }
+
+    const char* data = file.data();
+    size_t length = file.size();
+
+    JournalHeader header;
+    if (!readHeader(data, length, header)) {
+        return false;
+    }
+
+    /* a journal written against a different config.json is stale: either it
+    was already compacted, or the file was replaced from outside. the one
+    exception is the journal config.json was just compacted from, which may
+    have gained changes since; those are applied, and the rest skipped. */
+    uint32_t from = 0;
+    if (header.baseWriteTime != baseWriteTime || header.baseSize != baseSize) {
+        if (!compacted.salt || compacted.salt != header.salt) {
+            return false;
+        }
+        from = compacted.sequence;
+    }
+
+    std::vector<std::wstring> ids;
+    ids.reserve(header.slotCount);
+    const char* cursor = data + sizeof(JournalHeader);
+    for (uint32_t i = 0; i < header.slotCount; i++) {
+        JournalSlot slot;
+        memcpy(&slot, cursor, sizeof(slot));
+        slot.id[maxIdLength - 1] = L'\0';
+        ids.push_back(slot.id);
+        cursor += sizeof(JournalSlot);
+    }
+
+    bool applied = false;
+    std::vector<JournalRecord> pending;
+    const char* end = data + length;
+    for (uint32_t sequence = 0; end - cursor >= (ptrdiff_t) sizeof(JournalRecord); sequence++) {
+        JournalRecord record;
+        memcpy(&record, cursor, sizeof(record));
+        cursor += sizeof(record);
+
+        if (record.sequence != sequence ||
+            record.checksum != recordChecksum(record, header.salt) ||
+            (record.slot != generalSlot && record.slot >= ids.size()))
+        {
+            break; /* torn or garbage tail */
+        }
+
+        pending.push_back(record);
+
+        if (record.field & commitFlag) {
+            /* marks fall between transactions, so this skips whole ones. */
+            if (record.sequence >= from) {
+                for (auto& change : pending) {
+                    applyRecord(change, change.slot == generalSlot ? nullptr : &ids[change.slot], defaults, config);
+                }
+                applied = true;
+            }
+            pending.clear();
+        }
+    }
+
+    return applied;
+}
+
+bool Journal::readBase(const std::wstring& fn, uint64_t& baseWriteTime, uint64_t& baseSize) {
+    MappedFile file;
+    JournalHeader header;
+    if (!file.open(fn) || !readHeader(file.data(), file.size(), header)) {
+        return false;
+    }
+
+    baseWriteTime = header.baseWriteTime;
+    baseSize = header.baseSize;
+    return true;
+}
+
+bool Journal::reset(
+    const std::wstring& fn,
+    uint64_t baseWriteTime,
+    uint64_t baseSize,
+    const Config& config,
+    const JournalEntry* entries,
+    size_t count)
+{
+    this->close();
+
+    if (config.monitors.size() > maxSlots || count > JOURNAL_MAX_TRANSACTION) {
+        return false;
+    }
+
+    JournalHeader header = {};
+    header.magic = journalMagic;
+    header.version = journalVersion;
+    header.baseWriteTime = baseWriteTime;
+    header.baseSize = baseSize;
+    header.salt = newSalt(baseWriteTime);
+
+    std::vector<JournalSlot> table;
+    table.reserve(config.monitors.size());
+    for (auto& entry : config.monitors) {
+        if (entry.first.size() >= maxIdLength) {
+            continue; /* changes to this monitor will force a compaction instead */
+        }
+        JournalSlot slot = {};
+        wcsncpy(slot.id, entry.first.c_str(), maxIdLength - 1);
+        table.push_back(slot);
+    }
+
+    header.slotCount = (uint32_t) table.size();
+    uint32_t sum = checksum(&header, offsetof(JournalHeader, checksum));
+    header.checksum = checksum(table.data(), table.size() * sizeof(JournalSlot), sum);
+
+    for (size_t i = 0; i < table.size(); i++) {
+        this->slots[table[i].id] = (uint16_t) i;
+    }
+
+    std::string contents;
+    contents.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    contents.append(reinterpret_cast<const char*>(table.data()), table.size() * sizeof(JournalSlot));
+
+    if (count) {
+        JournalRecord records[JOURNAL_MAX_TRANSACTION];
+        if (!encodeRecords(this->slots, header.salt, 0, entries, count, records)) {
+            this->close();
+            return false;
+        }
+        contents.append(reinterpret_cast<const char*>(records), count * sizeof(JournalRecord));
+    }
+
+    /* the new journal replaces the old one whole, so a crash leaves one or
+    the other, and never a header without the changes it was given. */
+    if (!writeFileAtomic(fn, contents.data(), contents.size()) || !this->file.open(fn)) {
+        this->close();
+        return false;
+    }
+
+    this->salt = header.salt;
+    this->sequence = (uint32_t) count;
+    return true;
+}
+
+bool Journal::append(const JournalEntry* entries, size_t count) {
+    if (!this->file.isOpen() || count == 0 || count > JOURNAL_MAX_TRANSACTION) {
+        return false;
+    }
+
+    JournalRecord records[JOURNAL_MAX_TRANSACTION];
+    if (!encodeRecords(this->slots, this->salt, this->sequence, entries, count, records)) {
+        return false;
+    }
+
+    /* the whole transaction goes out in a single write. */
+    if (!this->file.append(records, count * sizeof(JournalRecord))) {
+        this->close(); /* the caller falls back to a full save */
+        return false;
+    }
+
+    this->sequence += (uint32_t) count;
+    return true;
+}
+
+JournalMark Journal::mark() const {
+    JournalMark result;
+    if (this->file.isOpen()) {
+        result.salt = this->salt;
+        result.sequence = this->sequence;
+    }
+    return result;
+}
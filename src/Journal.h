@@ -0,0 +1,128 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Config.h"
+#include "File.h"
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace dimmer {
+    enum class JournalField : uint16_t {
+        Opacity = 1,
+        Temperature = 2,
+        Enabled = 3,
+        PollingEnabled = 4,
+        GlobalEnabled = 5,
+        Backlight = 6,
+        AdaptiveEnabled = 7,
+        GammaDither = 8
+    };
+
+    /* the most entries a single append() takes. */
+    constexpr size_t JOURNAL_MAX_TRANSACTION = 256;
+
+    struct JournalEntry {
+        const std::wstring* monitorId; /* null for general options */
+        JournalField field;
+        uint32_t value;
+    };
+
+    /* where a compaction left off: the config.json it wrote already has
+    everything before record `sequence` of the journal with this salt. */
+    struct JournalMark {
+        uint32_t salt = 0; /* 0 for none */
+        uint32_t sequence = 0;
+    };
+
+    /* journal.bin is an append-only log of option changes applied on top of
+    a specific config.json snapshot (identified by its size and write time).
+    the header interns every known monitor id into a slot table, so each
+    change is a single fixed-size, checksummed record. records appended
+    together form a transaction that is only applied once its final record
+    (which carries a commit flag) has been read back. replay stops at the
+    first record that doesn't validate, so a torn write at any byte offset
+    only loses the transaction that was being written. monitors that replay
+    has to add to the config start out at the given defaults.
+
+    config.json is replaced before the journal is restarted against it, so
+    for a moment the journal on disk belongs to the previous file. a
+    config.json written from a journal carries that journal's mark, and
+    replay then accepts the older journal too, applying only what came after
+    the mark. reset() replaces the file in one rename, along with any
+    changes it's given, so a crash leaves either journal whole. */
+    class Journal {
+        public:
+            Journal();
+            ~Journal();
+
+            static bool replay(
+                const std::wstring& fn,
+                uint64_t baseWriteTime,
+                uint64_t baseSize,
+                const MonitorOptions& defaults,
+                Config& config,
+                const JournalMark& compacted = JournalMark());
+
+            /* which config.json the journal in fn was started against. */
+            static bool readBase(const std::wstring& fn, uint64_t& baseWriteTime, uint64_t& baseSize);
+
+            /* entries, if any, are the new journal's first transaction. */
+            bool reset(
+                const std::wstring& fn,
+                uint64_t baseWriteTime,
+                uint64_t baseSize,
+                const Config& config,
+                const JournalEntry* entries = nullptr,
+                size_t count = 0);
+
+            bool append(const JournalEntry* entries, size_t count);
+
+            size_t recordCount() const { return this->sequence; }
+            JournalMark mark() const;
+
+        private:
+            Journal(const Journal&) = delete;
+            Journal& operator=(const Journal&) = delete;
+
+            void close();
+
+            AppendFile file;
+            std::map<std::wstring, uint16_t> slots;
+            uint32_t salt;
+            uint32_t sequence;
+    };
+}
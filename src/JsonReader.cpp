@@ -0,0 +1,427 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "JsonReader.h"
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+
+using namespace dimmer;
+
+constexpr int maxDepth = 64;
+constexpr size_t maxNumberLength = 63;
+
+static bool isWhitespace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static void appendUtf8(std::string& out, unsigned codepoint) {
+    if (codepoint < 0x80) {
+        out += (char) codepoint;
+    }
+    else if (codepoint < 0x800) {
+        out += (char) (0xc0 | (codepoint >> 6));
+        out += (char) (0x80 | (codepoint & 0x3f));
+    }
+    else if (codepoint < 0x10000) {
+        out += (char) (0xe0 | (codepoint >> 12));
+        out += (char) (0x80 | ((codepoint >> 6) & 0x3f));
+        out += (char) (0x80 | (codepoint & 0x3f));
+    }
+    else {
+        out += (char) (0xf0 | (codepoint >> 18));
+        out += (char) (0x80 | ((codepoint >> 12) & 0x3f));
+        out += (char) (0x80 | ((codepoint >> 6) & 0x3f));
+        out += (char) (0x80 | (codepoint & 0x3f));
+    }
+}
+
+JsonReader::JsonReader(const char* data, size_t length)
+: cursor(data)
+, end(data + length)
+, error(false)
+, firstMember(false) {
+    /* tolerate a utf-8 byte order mark, notepad likes to add one. */
+    if (length >= 3 && memcmp(data, "\xef\xbb\xbf", 3) == 0) {
+        this->cursor += 3;
+    }
+}
+
+char JsonReader::peek() {
+    while (this->cursor < this->end && isWhitespace(*this->cursor)) {
+        ++this->cursor;
+    }
+    return (this->cursor < this->end) ? *this->cursor : '\0';
+}
+
+bool JsonReader::expect(char c) {
+    if (this->error || this->peek() != c) {
+        return this->fail();
+    }
+    ++this->cursor;
+    return true;
+}
+
+bool JsonReader::fail() {
+    this->error = true;
+    return false;
+}
+
+bool JsonReader::beginObject() {
+    if (this->error) {
+        return false;
+    }
+
+    if (this->peek() != '{') {
+        this->skipValue();
+        return false;
+    }
+
+    ++this->cursor;
+    this->firstMember = true;
+    return true;
+}
+
+bool JsonReader::nextKey(std::string& key) {
+    if (this->error) {
+        return false;
+    }
+
+    /* every member after the first must be preceded by a comma. the one
+    leniency is a trailing comma before the closing brace, since hand-edited
+    configs often have one. */
+    char c = this->peek();
+    if (!this->firstMember) {
+        if (c == ',') {
+            ++this->cursor;
+            c = this->peek();
+        }
+        else if (c != '}') {
+            return this->fail();
+        }
+    }
+
+    /* either a key follows, or this closes the object; then it was a value
+    in the enclosing object, which is past its first member too. */
+    this->firstMember = false;
+
+    if (c == '}') {
+        ++this->cursor;
+        return false;
+    }
+
+    if (c != '"') {
+        return this->fail();
+    }
+
+    return this->readString(key) && this->expect(':');
+}
+
+bool JsonReader::readString(std::string& value) {
+    if (this->error) {
+        return false;
+    }
+
+    if (this->peek() != '"') {
+        this->skipValue();
+        return false;
+    }
+
+    ++this->cursor;
+
+    value.clear();
+
+    while (this->cursor < this->end) {
+        char c = *this->cursor++;
+
+        if (c == '"') {
+            return true;
+        }
+        else if (c != '\\') {
+            value += c;
+            continue;
+        }
+
+        if (this->cursor >= this->end) {
+            break;
+        }
+
+        switch (*this->cursor++) {
+            case '"': value += '"'; break;
+            case '\\': value += '\\'; break;
+            case '/': value += '/'; break;
+            case 'b': value += '\b'; break;
+            case 'f': value += '\f'; break;
+            case 'n': value += '\n'; break;
+            case 'r': value += '\r'; break;
+            case 't': value += '\t'; break;
+            case 'u': {
+                unsigned codepoint = 0;
+                for (int i = 0; i < 4; i++) {
+                    int digit = (this->cursor < this->end) ? hexValue(*this->cursor++) : -1;
+                    if (digit < 0) {
+                        return this->fail();
+                    }
+                    codepoint = (codepoint << 4) | digit;
+                }
+
+                /* combine surrogate pairs; lone surrogates are replaced. */
+                if (codepoint >= 0xd800 && codepoint <= 0xdbff &&
+                    this->end - this->cursor >= 6 &&
+                    this->cursor[0] == '\\' && this->cursor[1] == 'u')
+                {
+                    unsigned low = 0;
+                    bool valid = true;
+                    for (int i = 2; i < 6 && valid; i++) {
+                        int digit = hexValue(this->cursor[i]);
+                        valid = (digit >= 0);
+                        low = (low << 4) | digit;
+                    }
+                    if (valid && low >= 0xdc00 && low <= 0xdfff) {
+                        codepoint = 0x10000 + ((codepoint - 0xd800) << 10) + (low - 0xdc00);
+                        this->cursor += 6;
+                    }
+                }
+
+                if (codepoint >= 0xd800 && codepoint <= 0xdfff) {
+                    codepoint = 0xfffd;
+                }
+
+                appendUtf8(value, codepoint);
+                break;
+            }
+            default:
+                return this->fail();
+        }
+    }
+
+    return this->fail(); /* unterminated */
+}
+
+bool JsonReader::readNumber(double& value) {
+    if (this->error) {
+        return false;
+    }
+
+    char c = this->peek();
+    if (c != '-' && (c < '0' || c > '9')) {
+        this->skipValue();
+        return false;
+    }
+
+    /* -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)? and nothing more, so
+    strtod is never handed anything it would read differently. */
+    const char* start = this->cursor;
+    const char* p = start;
+    auto digits = [&p, this]() {
+        const char* first = p;
+        while (p < this->end && isDigit(*p)) {
+            ++p;
+        }
+        return p > first;
+    };
+
+    if (*p == '-') {
+        ++p;
+    }
+    if (p < this->end && *p == '0') {
+        ++p;
+    }
+    else if (!digits()) {
+        return this->fail();
+    }
+    if (p < this->end && *p == '.') {
+        ++p;
+        if (!digits()) {
+            return this->fail();
+        }
+    }
+    if (p < this->end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        if (p < this->end && (*p == '+' || *p == '-')) {
+            ++p;
+        }
+        if (!digits()) {
+            return this->fail();
+        }
+    }
+
+    /* "01" or "1.2.3" stop early; what's left is part of no valid token. */
+    if (p < this->end && (isDigit(*p) || strchr("+-.eE", *p))) {
+        return this->fail();
+    }
+
+    size_t length = p - start;
+    if (length > maxNumberLength) {
+        return this->fail();
+    }
+    this->cursor = p;
+
+    /* the input buffer isn't guaranteed to be terminated, so the digits are
+    copied to the stack before handing them to strtod. */
+    char buffer[maxNumberLength + 1];
+    memcpy(buffer, start, length);
+    buffer[length] = '\0';
+
+    char* parsed = nullptr;
+    value = strtod(buffer, &parsed);
+    if (parsed != buffer + length) {
+        return this->fail();
+    }
+
+    return true;
+}
+
+bool JsonReader::readFloat(float& value) {
+    double result;
+    if (this->readNumber(result)) {
+        value = (float) result;
+        return true;
+    }
+    return false;
+}
+
+bool JsonReader::readInt(int& value) {
+    double result;
+    if (this->readNumber(result) && result >= INT_MIN && result <= INT_MAX) {
+        value = (int) result;
+        return true;
+    }
+    return false;
+}
+
+bool JsonReader::readBool(bool& value) {
+    if (this->error) {
+        return false;
+    }
+
+    char c = this->peek();
+    if (c == 't' && this->skipLiteral("true")) {
+        value = true;
+        return true;
+    }
+    else if (c == 'f' && this->skipLiteral("false")) {
+        value = false;
+        return true;
+    }
+
+    this->skipValue();
+    return false;
+}
+
+bool JsonReader::skipLiteral(const char* literal) {
+    size_t length = strlen(literal);
+    if ((size_t)(this->end - this->cursor) < length || memcmp(this->cursor, literal, length) != 0) {
+        return this->fail();
+    }
+    this->cursor += length;
+    return true;
+}
+
+bool JsonReader::skipValue() {
+    return this->skipValue(0);
+}
+
+bool JsonReader::skipValue(int depth) {
+    if (this->error || depth > maxDepth) {
+        return this->fail();
+    }
+
+    switch (this->peek()) {
+        case '{': {
+            ++this->cursor;
+            this->firstMember = true;
+            std::string key;
+            while (this->nextKey(key)) {
+                if (!this->skipValue(depth + 1)) {
+                    return false;
+                }
+            }
+            return !this->error;
+        }
+
+        case '[': {
+            ++this->cursor;
+            for (bool first = true; ; first = false) {
+                /* the same separators as an object's members. */
+                char c = this->peek();
+                if (!first) {
+                    if (c == ',') {
+                        ++this->cursor;
+                        c = this->peek();
+                    }
+                    else if (c != ']') {
+                        return this->fail();
+                    }
+                }
+                if (c == ']') {
+                    ++this->cursor;
+                    return true;
+                }
+                if (!this->skipValue(depth + 1)) {
+                    return false;
+                }
+            }
+        }
+
+        case '"': {
+            std::string ignored;
+            return this->readString(ignored);
+        }
+
+        case 't': return this->skipLiteral("true");
+        case 'f': return this->skipLiteral("false");
+        case 'n': return this->skipLiteral("null");
+
+        case '-': case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9': {
+            double ignored;
+            return this->readNumber(ignored);
+        }
+
+        default:
+            return this->fail();
+    }
+}
@@ -0,0 +1,75 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <string>
+
+namespace dimmer {
+    /* a minimal pull-style json tokenizer. values are read straight out of the
+    input buffer into caller-provided storage; nothing is materialized beyond
+    the current key. a value of the wrong type is skipped and the read returns
+    false, leaving the destination untouched. any syntax error latches failed()
+    and every subsequent call returns false, so callers can simply stop. the
+    input is held to the json grammar, with two exceptions: a utf-8 byte order
+    mark is skipped, and a trailing comma may close an object or an array. */
+    class JsonReader {
+        public:
+            JsonReader(const char* data, size_t length);
+
+            bool beginObject();
+            bool nextKey(std::string& key);
+
+            bool readString(std::string& value);
+            bool readNumber(double& value);
+            bool readFloat(float& value);
+            bool readInt(int& value);
+            bool readBool(bool& value);
+            bool skipValue();
+
+            bool failed() const { return this->error; }
+
+        private:
+            char peek();
+            bool expect(char c);
+            bool fail();
+            bool skipValue(int depth);
+            bool skipLiteral(const char* literal);
+
+            const char* cursor;
+            const char* end;
+            bool error;
+            bool firstMember; /* just inside '{': no comma before the next key */
+    };
+}
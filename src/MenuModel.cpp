@@ -0,0 +1,153 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "MenuModel.h"
+#include "Config.h"
+#include "Profile.h"
+#include <cmath>
+
+using namespace dimmer;
+
+static MenuItem& append(std::vector<MenuItem>& items, unsigned id, unsigned flags, const std::wstring& title) {
+    items.emplace_back();
+    MenuItem& item = items.back();
+    item.id = id;
+    item.flags = flags;
+    item.title = title;
+    return item;
+}
+
+static void separator(std::vector<MenuItem>& items) {
+    append(items, 0, MenuItem::Separator, L"-");
+}
+
+static unsigned checked(bool value) {
+    return value ? (unsigned) MenuItem::Checked : 0;
+}
+
+static unsigned temperatureFlags(int temp, int value) {
+    return checked(temp == value) | (isTemperatureAllowed(value) ? 0 : (unsigned) MenuItem::Grayed);
+}
+
+namespace dimmer {
+    void buildMenuModel(const std::vector<Monitor>& monitors, std::vector<MenuItem>& items) {
+        PROFILE_ALLOCATIONS("buildMenuModel");
+
+        items.clear();
+
+        unsigned submenuEnabled = isDimmerEnabled() ? 0 : (unsigned) MenuItem::Disabled;
+
+        int i = 1;
+        for (auto& m : monitors) {
+            const int checkedValue = (int) round(getMonitorOpacity(m) * 100.0f);
+            unsigned baseId = (MENU_ID_MONITOR_BASE * i++);
+
+            /* brightness, temperature, backlight popup */
+            MenuItem& brightTemp = append(items, 0, submenuEnabled, m.getName());
+
+            /* "brightness" submenu */
+            MenuItem& brightness = append(brightTemp.children, 0, 0, L"brightness");
+            for (int j = 0; j < 10; j++) {
+                const int currentValue = j * 10;
+
+                const std::wstring title = (j == 0)
+                    ? L"full brightness"
+                    : std::to_wstring(100 - currentValue) + L"%";
+
+                unsigned flags = checked(currentValue == checkedValue);
+                if (!isOpacityAllowed((float) currentValue / 100)) {
+                    flags |= MenuItem::Grayed; /* below the policy's minimum brightness */
+                }
+                append(brightness.children, baseId + (j * 10), flags, title);
+            }
+
+            /* "temperature" submenu */
+            MenuItem& temperature = append(brightTemp.children, 0, 0, L"temperature");
+            const int currentTemp = getMonitorTemperature(m);
+            append(temperature.children, baseId + MENU_ID_DEFAULTK, temperatureFlags(currentTemp, -1), L"default");
+            append(temperature.children, baseId + MENU_ID_4000K, temperatureFlags(currentTemp, 4000), L"4000k");
+            append(temperature.children, baseId + MENU_ID_4500K, temperatureFlags(currentTemp, 4500), L"4500k");
+            append(temperature.children, baseId + MENU_ID_5000K, temperatureFlags(currentTemp, 5000), L"5000k");
+            append(temperature.children, baseId + MENU_ID_5500K, temperatureFlags(currentTemp, 5500), L"5500k");
+            append(temperature.children, baseId + MENU_ID_6000K, temperatureFlags(currentTemp, 6000), L"6000k");
+
+            /* "backlight" submenu, for monitors that support DDC/CI and
+            internal panels */
+            MenuItem& backlight = append(brightTemp.children, 0, 0, L"backlight");
+            const int currentBacklight = getMonitorBacklight(m);
+            append(backlight.children, baseId + MENU_ID_BACKLIGHT_NONE,
+                checked(currentBacklight == DEFAULT_BACKLIGHT), L"don't change");
+            append(backlight.children, baseId + MENU_ID_BACKLIGHT_HYBRID,
+                checked(currentBacklight == HYBRID_BACKLIGHT), L"follow brightness");
+
+            for (int percent = 100; percent > 0; percent -= 10) {
+                unsigned flags = checked(percent == currentBacklight);
+                if (!isBacklightAllowed(percent)) {
+                    flags |= MenuItem::Grayed; /* below the policy's minimum brightness */
+                }
+                append(backlight.children, baseId + MENU_ID_BACKLIGHT_BASE + (percent / 10),
+                    flags, std::to_wstring(percent) + L"%");
+            }
+        }
+
+        /* "presets" submenu, only shown once some are defined in config.json */
+        auto presets = getPresetNames();
+        if (!presets.empty()) {
+            separator(items);
+            MenuItem& presetsMenu = append(items, 0, submenuEnabled, L"presets");
+            unsigned menuId = MENU_ID_PRESET_BASE;
+            for (auto& name : presets) {
+                if (menuId > MENU_ID_PRESET_MAX) {
+                    break;
+                }
+                append(presetsMenu.children, menuId++, 0, name);
+            }
+        }
+
+        separator(items);
+        append(items, MENU_ID_ENABLED, checked(isDimmerEnabled()), L"enabled");
+        append(items, MENU_ID_POLL,
+            checked(isPollingEnabled()) | (isPollingLocked() ? (unsigned) MenuItem::Grayed : 0), L"dim popups");
+        append(items, MENU_ID_ADAPTIVE, checked(isAdaptiveEnabled()), L"adapt to content");
+
+        GammaDither dither = getGammaDither();
+        MenuItem& ditherMenu = append(items, 0, 0, L"smooth gradients");
+        append(ditherMenu.children, MENU_ID_DITHER_NONE, checked(dither == GammaDither::None), L"off");
+        append(ditherMenu.children, MENU_ID_DITHER_STATIC, checked(dither == GammaDither::Static), L"static");
+        append(ditherMenu.children, MENU_ID_DITHER_TEMPORAL, checked(dither == GammaDither::Temporal), L"temporal");
+
+        separator(items);
+        append(items, MENU_ID_EXIT, 0, L"exit");
+    }
+}
@@ -0,0 +1,85 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Monitor.h"
+#include <string>
+#include <vector>
+
+#define MENU_ID_EXIT 500
+#define MENU_ID_POLL 501
+#define MENU_ID_ENABLED 502
+#define MENU_ID_ADAPTIVE 503
+#define MENU_ID_DITHER_NONE 504 /* + GammaDither */
+#define MENU_ID_DITHER_STATIC 505
+#define MENU_ID_DITHER_TEMPORAL 506
+#define MENU_ID_PRESET_BASE 600
+#define MENU_ID_PRESET_MAX 999
+#define MENU_ID_MONITOR_BASE 1000
+#define MENU_ID_MONITOR_USER 100
+#define MENU_ID_MONITOR_COLOR 1
+
+#define MENU_ID_DEFAULTK (MENU_ID_MONITOR_USER + 1)
+#define MENU_ID_4500K (MENU_ID_MONITOR_USER + 2)
+#define MENU_ID_5000K (MENU_ID_MONITOR_USER + 3)
+#define MENU_ID_5500K (MENU_ID_MONITOR_USER + 4)
+#define MENU_ID_6000K (MENU_ID_MONITOR_USER + 5)
+#define MENU_ID_4000K (MENU_ID_MONITOR_USER + 6)
+
+/* backlight percentages are MENU_ID_BACKLIGHT_BASE + (percent / 10) */
+#define MENU_ID_BACKLIGHT_BASE (MENU_ID_MONITOR_USER + 100)
+#define MENU_ID_BACKLIGHT_NONE (MENU_ID_BACKLIGHT_BASE + 11)
+#define MENU_ID_BACKLIGHT_HYBRID (MENU_ID_BACKLIGHT_BASE + 12)
+
+namespace dimmer {
+    /* the tray menu as plain data, so that deciding what's in it (which
+    reads every option and policy limit) is separate from the win32 calls
+    that show it. */
+    struct MenuItem {
+        enum Flags : unsigned {
+            Checked = 0x01,
+            Grayed = 0x02, /* outside the policy's limits */
+            Disabled = 0x04,
+            Separator = 0x08
+        };
+
+        unsigned id = 0;
+        unsigned flags = 0;
+        std::wstring title;
+        std::vector<MenuItem> children; /* a submenu, if not empty */
+    };
+
+    extern void buildMenuModel(const std::vector<Monitor>& monitors, std::vector<MenuItem>& items);
+}
@@ -33,53 +33,586 @@
 //////////////////////////////////////////////////////////////////////////////
 
 #include "Monitor.h"
+#include "Config.h"
+#include "ConfigCache.h"
+#include "Policy.h"
+#include "File.h"
+#include "Journal.h"
+#include "EventLoop.h"
+#include "DevicePool.h"
 #include "Util.h"
+#include "Profile.h"
+#include "JsonReader.h"
 #include <map>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include <string_view>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include "json.hpp"
 
 using namespace dimmer;
 using namespace nlohmann;
 
-constexpr float DEFAULT_OPACITY = 0.3f;
-constexpr int DEFAULT_TEMPERATURE = -1;
+/* journaled changes are folded back into config.json once things have been
+quiet for a while, or right away if the journal gets long. nothing is
+lost if it happens a little late, hence the slack. */
+constexpr uint32_t compactionDelayMs = 5000;
+constexpr uint32_t compactionSlackMs = 1000;
+constexpr size_t maxJournalRecords = 4096;
 
-struct MonitorOptions {
-    float opacity;
-    int temperature;
-    bool enabled;
+/* config is the user's layer, and the only one that is ever persisted.
+everything else reads the snapshot it is merged into. */
+static Config config;
+static Policy policy;
+static ConfigSnapshot snapshot;
+static bool configCacheDirty = false;
+static Journal journal;
+static EventLoop::Id compactionTimer = 0;
+static ConfigListener configListener;
+static uint64_t lastSeenWriteTime = 0;
+static uint64_t lastSeenSize = 0;
 
-    MonitorOptions() {
-        this->opacity = DEFAULT_OPACITY;
-        this->temperature = DEFAULT_TEMPERATURE;
-        this->enabled = true;
-    }
-};
+/* config.json is written either right here by saveConfig(), or by a
+compaction on the DevicePool. every write carries a generation, and a
+writer holding an older snapshot than the one already on disk skips its
+write, so a late compaction can't undo a save that overtook it. */
+static std::mutex saveLock;
+static uint64_t writtenGeneration = 0; /* guarded by saveLock */
+static uint64_t saveGeneration = 0;
+static uint64_t appliedGeneration = 0;
+static uint64_t compactionPending = 0; /* the newest one not yet completed */
 
-static std::map<std::wstring, std::shared_ptr<MonitorOptions>> monitorOptions;
-static bool pollingEnabled = false;
-static bool globalEnabled = true;
+#ifndef _WIN32
+static std::vector<Monitor> attachedMonitors;
+#endif
 
 static std::wstring getConfigFilename() {
-    return getDataDirectory() + L"\\config.json";
+    return getDataDirectory() + PATH_SEPARATOR + L"config.json";
+}
+
+static std::wstring getJournalFilename() {
+    return getDataDirectory() + PATH_SEPARATOR + L"journal.bin";
+}
+
+static std::wstring getPolicyFilename() {
+    return getPolicyDirectory() + PATH_SEPARATOR + L"policy.json";
+}
+
+static void cancelCompaction() {
+    auto loop = EventLoop::current();
+    if (loop && compactionTimer) {
+        loop->cancel(compactionTimer);
+    }
+    compactionTimer = 0;
+}
+
+static void compactConfig();
+
+static void scheduleCompaction() {
+    /* without a loop the journal simply grows until the next save. */
+    auto loop = EventLoop::current();
+    if (loop) {
+        cancelCompaction();
+        compactionTimer = loop->schedule(compactionDelayMs, []() {
+            compactionTimer = 0;
+            compactConfig();
+        }, compactionSlackMs);
+    }
+}
+
+static uint32_t journalValue(float value) {
+    uint32_t result;
+    memcpy(&result, &value, sizeof(result));
+    return result;
+}
+
+static unsigned diffOptions(const MonitorOptions& from, const MonitorOptions& to) {
+    return
+        (from.opacity != to.opacity ? (unsigned) PropertyOpacity : 0) |
+        (from.temperature != to.temperature ? (unsigned) PropertyTemperature : 0) |
+        (from.backlight != to.backlight ? (unsigned) PropertyBacklight : 0) |
+        (from.enabled != to.enabled ? (unsigned) PropertyEnabled : 0);
+}
+
+/* re-merges the layers after either one changed, and reports what that
+did to the values everyone else sees. the snapshot is merged in place, so
+only what isn't per monitor is kept aside to compare against. */
+static void refreshSnapshot(ConfigChanges& changes) {
+    MonitorOptions defaults = snapshot.defaults;
+    bool pollingEnabled = snapshot.pollingEnabled;
+    bool globalEnabled = snapshot.globalEnabled;
+    bool adaptiveEnabled = snapshot.adaptiveEnabled;
+    GammaDither gammaDither = snapshot.gammaDither;
+
+    mergeConfig(policy, config, snapshot, [&changes](
+        const std::wstring& id, const MonitorOptions& before, const MonitorOptions& after)
+    {
+        changes.monitors[id] |= diffOptions(before, after);
+    });
+
+    /* new defaults affect every monitor without options of its own. */
+    changes.general |= diffOptions(defaults, snapshot.defaults);
+
+    if (pollingEnabled != snapshot.pollingEnabled) {
+        changes.general |= PropertyPolling;
+    }
+
+    if (globalEnabled != snapshot.globalEnabled) {
+        changes.general |= PropertyEnabled;
+    }
+
+    if (adaptiveEnabled != snapshot.adaptiveEnabled) {
+        changes.general |= PropertyAdaptive;
+    }
+
+    if (gammaDither != snapshot.gammaDither) {
+        changes.general |= PropertyDither;
+    }
+}
+
+static void notifyListener(const ConfigChanges& changes) {
+    if (configListener && !changes.empty()) {
+        configListener(changes);
+    }
 }
 
+/* whatever differs between the config that was just written and the live
+one, i.e. the changes made while the write was in flight, as a single
+transaction. false if they can't all be journaled. */
+static bool collectDifferences(
+    const Config& from,
+    const Config& to,
+    JournalEntry entries[JOURNAL_MAX_TRANSACTION],
+    size_t& count)
+{
+    count = 0;
+
+    auto record = [&](const std::wstring* id, JournalField field, uint32_t value) {
+        if (count < JOURNAL_MAX_TRANSACTION) {
+            entries[count] = { id, field, value };
+        }
+        count++;
+    };
+
+    for (auto& entry : to.monitors) {
+        auto it = from.monitors.find(entry.first);
+        if (it == from.monitors.end()) {
+            return false; /* not in the journal's slot table */
+        }
+
+        const MonitorOptions& before = it->second;
+        const MonitorOptions& after = entry.second;
+        const std::wstring* id = &entry.first;
+
+        if (before.opacity != after.opacity) {
+            record(id, JournalField::Opacity, journalValue(after.opacity));
+        }
+        if (before.temperature != after.temperature) {
+            record(id, JournalField::Temperature, (uint32_t) after.temperature);
+        }
+        if (before.backlight != after.backlight) {
+            record(id, JournalField::Backlight, (uint32_t) after.backlight);
+        }
+        if (before.enabled != after.enabled) {
+            record(id, JournalField::Enabled, after.enabled ? 1u : 0u);
+        }
+    }
+
+    if (from.pollingEnabled != to.pollingEnabled) {
+        record(nullptr, JournalField::PollingEnabled, to.pollingEnabled ? 1u : 0u);
+    }
+    if (from.globalEnabled != to.globalEnabled) {
+        record(nullptr, JournalField::GlobalEnabled, to.globalEnabled ? 1u : 0u);
+    }
+    if (from.adaptiveEnabled != to.adaptiveEnabled) {
+        record(nullptr, JournalField::AdaptiveEnabled, to.adaptiveEnabled ? 1u : 0u);
+    }
+    if (from.gammaDither != to.gammaDither) {
+        record(nullptr, JournalField::GammaDither, (uint32_t) to.gammaDither);
+    }
+
+    return count <= JOURNAL_MAX_TRANSACTION;
+}
+
+#ifdef _WIN32
 static BOOL CALLBACK MonitorEnumProc(HMONITOR monitor, HDC hdc, LPRECT rect, LPARAM data) {
     auto monitors = reinterpret_cast<std::vector<Monitor>*>(data);
     int index = (int) monitors->size();
     monitors->push_back(Monitor(monitor, index));
     return TRUE;
 }
+#endif
 
-static MonitorOptions& options(Monitor& monitor) {
-    auto id = monitor.getId();
-    if (monitorOptions.find(id) == monitorOptions.end()) {
-        monitorOptions[id] = std::make_shared<MonitorOptions>();
+static const MonitorOptions& options(const Monitor& monitor) {
+    auto it = snapshot.monitors.find(monitor.getId());
+    return (it == snapshot.monitors.end()) ? snapshot.defaults : it->second;
+}
+
+static ChangeSet& stageOptions(ChangeSet& changes, const Monitor& monitor, const MonitorOptions& options) {
+    return changes
+        .setMonitorOpacity(monitor, options.opacity)
+        .setMonitorTemperature(monitor, options.temperature)
+        .setMonitorBacklight(monitor, options.backlight)
+        .setMonitorEnabled(monitor, options.enabled);
+}
+
+/* identifies a display topology by the ids and resolutions of the attached
+monitors. 0 is reserved for "no layout recorded yet". */
+static uint64_t topologyHash(const std::vector<Monitor>& monitors) {
+    std::vector<const Monitor*> sorted;
+    for (auto& monitor : monitors) {
+        sorted.push_back(&monitor);
+    }
+
+    std::sort(sorted.begin(), sorted.end(), [](const Monitor* a, const Monitor* b) {
+        return a->getId() < b->getId();
+    });
+
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](const void* data, size_t length) {
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < length; i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+    };
+
+    for (auto monitor : sorted) {
+        const std::wstring& id = monitor->getId();
+        MonitorBounds bounds = monitor->getBounds();
+        int32_t dimensions[] = { bounds.right - bounds.left, bounds.bottom - bounds.top };
+        mix(id.c_str(), (id.size() + 1) * sizeof(wchar_t));
+        mix(dimensions, sizeof(dimensions));
     }
-    return *monitorOptions[id];
+
+    return hash ? hash : 1;
+}
+
+/* layout hashes are stored as hex strings; json numbers are doubles and
+can't hold them exactly. */
+static std::string layoutKey(uint64_t hash) {
+    char buffer[17];
+    snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long) hash);
+    return buffer;
+}
+
+static bool parseLayoutKey(const std::string& key, uint64_t& hash) {
+    char* end = nullptr;
+    hash = strtoull(key.c_str(), &end, 16);
+    return !key.empty() && *end == '\0';
+}
+
+static const char* gammaDitherName(GammaDither dither) {
+    switch (dither) {
+        case GammaDither::Static: return "static";
+        case GammaDither::Temporal: return "temporal";
+        default: return "off";
+    }
+}
+
+static void parseGammaDither(const std::string& name, GammaDither& dither) {
+    if (name == "static") {
+        dither = GammaDither::Static;
+    }
+    else if (name == "temporal") {
+        dither = GammaDither::Temporal;
+    }
+    else {
+        dither = GammaDither::None;
+    }
+}
+
+static json optionsToJson(const MonitorOptions& options) {
+    return {
+        { "opacity", options.opacity },
+        { "temperature", options.temperature },
+        { "backlight", options.backlight },
+        { "enabled", options.enabled }
+    };
+}
+
+static json optionsMapToJson(const MonitorOptionsMap& map) {
+    json result = json::object();
+    for (auto& entry : map) {
+        result[u16to8(entry.first)] = optionsToJson(entry.second);
+    }
+    return result;
+}
+
+static void readMonitorOptions(JsonReader& reader, MonitorOptions& options) {
+    if (!reader.beginObject()) {
+        return;
+    }
+
+    std::string key;
+    while (reader.nextKey(key)) {
+        if (key == "opacity") {
+            reader.readFloat(options.opacity);
+        }
+        else if (key == "temperature") {
+            reader.readInt(options.temperature);
+        }
+        else if (key == "backlight") {
+            reader.readInt(options.backlight);
+        }
+        else if (key == "enabled") {
+            reader.readBool(options.enabled);
+        }
+        else {
+            reader.skipValue();
+        }
+    }
+}
+
+static void readMonitorOptionsMap(JsonReader& reader, MonitorOptionsMap& result) {
+    if (!reader.beginObject()) {
+        return;
+    }
+
+    std::string key;
+    while (reader.nextKey(key)) {
+        readMonitorOptions(reader, result[u8to16(key)]);
+    }
+}
+
+static void readJournalMark(JsonReader& reader, JournalMark& mark) {
+    if (!reader.beginObject()) {
+        return;
+    }
+
+    std::string key;
+    double value;
+    while (reader.nextKey(key)) {
+        if (key == "salt" && reader.readNumber(value)) {
+            mark.salt = (uint32_t) value;
+        }
+        else if (key == "sequence" && reader.readNumber(value)) {
+            mark.sequence = (uint32_t) value;
+        }
+        else {
+            reader.skipValue();
+        }
+    }
+}
+
+/* compacted, if given, is where the journal this was written from left off. */
+static bool parseConfig(const MappedFile& file, Config& result, JournalMark* compacted = nullptr) {
+    JsonReader reader(file.data(), file.size());
+
+    if (!reader.beginObject()) {
+        return false;
+    }
+
+    /* unknown keys are skipped at every level so configs written by newer
+    versions still load. */
+    std::string key;
+    while (reader.nextKey(key)) {
+        if (key == "monitors") {
+            readMonitorOptionsMap(reader, result.monitors);
+        }
+        else if (key == "presets") {
+            if (reader.beginObject()) {
+                while (reader.nextKey(key)) {
+                    readMonitorOptionsMap(reader, result.presets[u8to16(key)]);
+                }
+            }
+        }
+        else if (key == "layouts") {
+            if (reader.beginObject()) {
+                uint64_t hash;
+                while (reader.nextKey(key)) {
+                    if (parseLayoutKey(key, hash) && hash) {
+                        readMonitorOptionsMap(reader, result.layouts[hash]);
+                    }
+                    else {
+                        reader.skipValue();
+                    }
+                }
+            }
+        }
+        else if (key == "journal" && compacted) {
+            readJournalMark(reader, *compacted);
+        }
+        else if (key == "general") {
+            if (reader.beginObject()) {
+                while (reader.nextKey(key)) {
+                    if (key == "pollingEnabled") {
+                        reader.readBool(result.pollingEnabled);
+                    }
+                    else if (key == "globalEnabled") {
+                        reader.readBool(result.globalEnabled);
+                    }
+                    else if (key == "adaptiveEnabled") {
+                        reader.readBool(result.adaptiveEnabled);
+                    }
+                    else if (key == "gammaDither") {
+                        std::string value;
+                        if (reader.readString(value)) {
+                            parseGammaDither(value, result.gammaDither);
+                        }
+                    }
+                    else if (key == "layout") {
+                        std::string value;
+                        if (reader.readString(value) && !parseLayoutKey(value, result.layout)) {
+                            result.layout = 0;
+                        }
+                    }
+                    else {
+                        reader.skipValue();
+                    }
+                }
+            }
+        }
+        else {
+            reader.skipValue();
+        }
+    }
+
+    return !reader.failed();
+}
+
+static std::string serializeConfig(const Config& config, const JournalMark& compacted) {
+    /* only the user's own options are saved; anything else comes from
+    the policy, and should keep following it. that's every monitor in the
+    live map, attached or not: selectLayout() already moved the ones that
+    belong to other layouts out of it. */
+    json j = { { "monitors", optionsMapToJson(config.monitors) } };
+
+    j["presets"] = json::object();
+    for (auto& entry : config.presets) {
+        j["presets"][u16to8(entry.first)] = optionsMapToJson(entry.second);
+    }
+
+    j["layouts"] = json::object();
+    for (auto& entry : config.layouts) {
+        j["layouts"][layoutKey(entry.first)] = optionsMapToJson(entry.second);
+    }
+
+    j["general"] = {
+        { "globalEnabled", config.globalEnabled },
+        { "pollingEnabled", config.pollingEnabled },
+        { "adaptiveEnabled", config.adaptiveEnabled },
+        { "gammaDither", gammaDitherName(config.gammaDither) },
+        { "layout", layoutKey(config.layout) }
+    };
+
+    if (compacted.salt) {
+        j["journal"] = { { "salt", compacted.salt }, { "sequence", compacted.sequence } };
+    }
+
+    return j.dump(2);
+}
+
+/* writes config.json (and, if asked, config.bin to match it) unless a newer
+generation is already on disk. compacted is how far into the journal config
+goes. safe to call from any thread. */
+static bool writeConfig(
+    const Config& config,
+    const JournalMark& compacted,
+    uint64_t generation,
+    bool withCache,
+    uint64_t& writeTime,
+    uint64_t& size)
+{
+    std::string contents = serializeConfig(config, compacted);
+
+    std::lock_guard<std::mutex> guard(saveLock);
+    if (generation <= writtenGeneration) {
+        return false;
+    }
+
+    if (!writeFileAtomic(getConfigFilename(), contents.data(), contents.size())) {
+        return false;
+    }
+
+    writtenGeneration = generation;
+    getFileStamp(getConfigFilename(), writeTime, size);
+
+    if (withCache) {
+        writeConfigCache(getConfigFilename(), config);
+    }
+
+    return true;
+}
+
+/* folds the journal back into config.json without blocking this thread:
+the config is copied here, then serialized and written on the DevicePool.
+once the write lands, the journal is restarted against the copy that was
+written, with anything changed in the meantime as its first transaction.
+until then, changes still go to the old journal; config.json records
+where the copy left off in it, so a crash before the restart replays them
+over the new file. without a pool it's just a save. */
+static void compactConfig() {
+    cancelCompaction();
+
+    auto pool = DevicePool::current();
+    if (!pool) {
+        saveConfig();
+        saveConfigCache();
+        return;
+    }
+
+    struct Compaction {
+        Config config;
+        JournalMark mark;
+        uint64_t generation;
+        bool written = false;
+        uint64_t writeTime = 0;
+        uint64_t size = 0;
+    };
+
+    auto compaction = std::make_shared<Compaction>();
+    compaction->config = config;
+    compaction->mark = journal.mark();
+    compaction->generation = ++saveGeneration;
+    compactionPending = compaction->generation;
+
+    /* a newer compaction replaces one that hasn't started yet, completion
+    and all; only the newest one submitted clears compactionPending. */
+    pool->submit(L"config.json", [compaction]() {
+        compaction->written = writeConfig(
+            compaction->config,
+            compaction->mark,
+            compaction->generation,
+            true,
+            compaction->writeTime,
+            compaction->size);
+    },
+    [compaction]() {
+        if (compaction->generation == compactionPending) {
+            compactionPending = 0;
+        }
+
+        if (compaction->written && compaction->generation > appliedGeneration) {
+            appliedGeneration = compaction->generation;
+            lastSeenWriteTime = compaction->writeTime;
+            lastSeenSize = compaction->size;
+            configCacheDirty = false;
+
+            JournalEntry entries[JOURNAL_MAX_TRANSACTION];
+            size_t count;
+            if (!collectDifferences(compaction->config, config, entries, count) ||
+                !journal.reset(getJournalFilename(), lastSeenWriteTime, lastSeenSize, compaction->config, entries, count))
+            {
+                saveConfig();
+            }
+        }
+
+        /* edits made from outside while the write was in flight were held
+        back; they're picked up now. */
+        if (!compactionPending) {
+            reloadConfig();
+        }
+    });
 }
 
 namespace dimmer {
+#ifdef _WIN32
     std::vector<Monitor> queryMonitors() {
+        PROFILE_ALLOCATIONS("queryMonitors");
+
         std::vector<Monitor> result;
 
         EnumDisplayMonitors(
@@ -90,100 +623,499 @@ namespace dimmer {
 
         return result;
     }
+#else
+    std::vector<Monitor> queryMonitors() {
+        return attachedMonitors;
+    }
 
-    float getMonitorOpacity(Monitor& monitor) {
+    void setAttachedMonitors(const std::vector<Monitor>& monitors) {
+        attachedMonitors = monitors;
+    }
+#endif
+
+    bool ChangeSet::differs(const Staged& staged, const MonitorOptions& options) {
+        return
+            ((staged.fields & PropertyOpacity) && staged.opacity != options.opacity) ||
+            ((staged.fields & PropertyTemperature) && staged.temperature != options.temperature) ||
+            ((staged.fields & PropertyBacklight) && staged.backlight != options.backlight) ||
+            ((staged.fields & PropertyEnabled) && staged.enabled != options.enabled);
+    }
+
+    ChangeSet& ChangeSet::setMonitorOpacity(const Monitor& monitor, float opacity) {
+        Staged& staged = this->monitors[monitor.getId()];
+        staged.fields |= PropertyOpacity;
+        staged.opacity = opacity;
+        return *this;
+    }
+
+    ChangeSet& ChangeSet::setMonitorTemperature(const Monitor& monitor, int temperature) {
+        Staged& staged = this->monitors[monitor.getId()];
+        staged.fields |= PropertyTemperature;
+        staged.temperature = temperature;
+        return *this;
+    }
+
+    ChangeSet& ChangeSet::setMonitorEnabled(const Monitor& monitor, bool enabled) {
+        Staged& staged = this->monitors[monitor.getId()];
+        staged.fields |= PropertyEnabled;
+        staged.enabled = enabled;
+        return *this;
+    }
+
+    ChangeSet& ChangeSet::setMonitorBacklight(const Monitor& monitor, int backlight) {
+        Staged& staged = this->monitors[monitor.getId()];
+        staged.fields |= PropertyBacklight;
+        staged.backlight = backlight;
+        return *this;
+    }
+
+    ChangeSet& ChangeSet::setPollingEnabled(bool enabled) {
+        this->general |= PropertyPolling;
+        this->pollingEnabled = enabled;
+        return *this;
+    }
+
+    ChangeSet& ChangeSet::setDimmerEnabled(bool enabled) {
+        this->general |= PropertyEnabled;
+        this->dimmerEnabled = enabled;
+        return *this;
+    }
+
+    ChangeSet& ChangeSet::setAdaptiveEnabled(bool enabled) {
+        this->general |= PropertyAdaptive;
+        this->adaptiveEnabled = enabled;
+        return *this;
+    }
+
+    ChangeSet& ChangeSet::setGammaDither(GammaDither dither) {
+        this->general |= PropertyDither;
+        this->gammaDither = dither;
+        return *this;
+    }
+
+    bool ChangeSet::empty() const {
+        return this->monitors.empty() && !this->general;
+    }
+
+    void ChangeSet::commit(bool persist) {
+        ConfigChanges changes;
+
+        /* a transaction too big for the journal (only possible with a
+        great many monitors) goes straight to a full save instead. */
+        JournalEntry entries[JOURNAL_MAX_TRANSACTION];
+        size_t count = 0;
+        bool overflowed = false;
+
+        auto record = [&](const std::wstring* id, JournalField field, uint32_t value) {
+            if (count < JOURNAL_MAX_TRANSACTION) {
+                entries[count++] = { id, field, value };
+            }
+            else {
+                overflowed = true;
+            }
+        };
+
+        auto apply = [&](std::wstring_view id, const Staged& staged) {
+            auto it = config.monitors.find(id);
+            if (it == config.monitors.end()) {
+                /* a monitor without options of its own shows the merged
+                defaults. staging exactly those changes nothing, and it keeps
+                following the policy; only a value that differs gives it an
+                entry, whose other fields start out at the policy's defaults. */
+                if (!differs(staged, snapshot.defaults)) {
+                    return;
+                }
+                it = config.monitors.emplace(std::wstring(id), policy.defaults).first;
+            }
+
+            MonitorOptions& live = it->second;
+            const std::wstring* key = &it->first;
+
+            if ((staged.fields & PropertyOpacity) && live.opacity != staged.opacity) {
+                live.opacity = staged.opacity;
+                record(key, JournalField::Opacity, journalValue(staged.opacity));
+            }
+
+            if ((staged.fields & PropertyTemperature) && live.temperature != staged.temperature) {
+                live.temperature = staged.temperature;
+                record(key, JournalField::Temperature, (uint32_t) staged.temperature);
+            }
+
+            if ((staged.fields & PropertyBacklight) && live.backlight != staged.backlight) {
+                live.backlight = staged.backlight;
+                record(key, JournalField::Backlight, (uint32_t) staged.backlight);
+            }
+
+            if ((staged.fields & PropertyEnabled) && live.enabled != staged.enabled) {
+                live.enabled = staged.enabled;
+                record(key, JournalField::Enabled, staged.enabled ? 1u : 0u);
+            }
+        };
+
+        this->monitors.forEach(apply);
+
+        if ((this->general & PropertyPolling) && config.pollingEnabled != this->pollingEnabled) {
+            config.pollingEnabled = this->pollingEnabled;
+            record(nullptr, JournalField::PollingEnabled, this->pollingEnabled ? 1u : 0u);
+        }
+
+        if ((this->general & PropertyEnabled) && config.globalEnabled != this->dimmerEnabled) {
+            config.globalEnabled = this->dimmerEnabled;
+            record(nullptr, JournalField::GlobalEnabled, this->dimmerEnabled ? 1u : 0u);
+        }
+
+        if ((this->general & PropertyAdaptive) && config.adaptiveEnabled != this->adaptiveEnabled) {
+            config.adaptiveEnabled = this->adaptiveEnabled;
+            record(nullptr, JournalField::AdaptiveEnabled, this->adaptiveEnabled ? 1u : 0u);
+        }
+
+        if ((this->general & PropertyDither) && config.gammaDither != this->gammaDither) {
+            config.gammaDither = this->gammaDither;
+            record(nullptr, JournalField::GammaDither, (uint32_t) this->gammaDither);
+        }
+
+        this->monitors.clear();
+        this->general = 0;
+
+        if (count == 0 && !overflowed) {
+            return;
+        }
+
+        /* one persistence event per commit: a single journal transaction, or
+        a full save if the journal can't take it. */
+        if (!persist) {
+            /* the caller saves */
+        }
+        else if (overflowed || !journal.append(entries, count)) {
+            saveConfig();
+        }
+        else if (journal.recordCount() < maxJournalRecords) {
+            scheduleCompaction();
+        }
+        else {
+            compactConfig();
+        }
+
+        /* the listener hears about effective changes only; a value the
+        policy clamps to what it already was doesn't change anything. */
+        refreshSnapshot(changes);
+        notifyListener(changes);
+    }
+
+    float getMonitorOpacity(const Monitor& monitor) {
         return options(monitor).opacity;
     }
 
     void setMonitorOpacity(Monitor& monitor, float opacity) {
-        options(monitor).opacity = opacity;
-        saveConfig();
+        ChangeSet().setMonitorOpacity(monitor, opacity).commit();
     }
 
-    int getMonitorTemperature(Monitor& monitor) {
+    int getMonitorTemperature(const Monitor& monitor) {
         return options(monitor).temperature;
     }
 
     void setMonitorTemperature(Monitor& monitor, int temperature) {
-        options(monitor).temperature = temperature;
-        saveConfig();
+        ChangeSet().setMonitorTemperature(monitor, temperature).commit();
     }
 
     bool isPollingEnabled() {
-        return pollingEnabled;
+        return snapshot.pollingEnabled;
     }
 
     void setPollingEnabled(bool enabled) {
-        pollingEnabled = enabled;
-        saveConfig();
+        ChangeSet().setPollingEnabled(enabled).commit();
     }
 
-    extern bool isDimmerEnabled() {
-        return globalEnabled;
+    bool isDimmerEnabled() {
+        return snapshot.globalEnabled;
     }
 
-    extern void setDimmerEnabled(bool enabled) {
-        if (globalEnabled != enabled) {
-            globalEnabled = enabled;
-            saveConfig();
-        }
+    void setDimmerEnabled(bool enabled) {
+        ChangeSet().setDimmerEnabled(enabled).commit();
+    }
+
+    bool isAdaptiveEnabled() {
+        return snapshot.adaptiveEnabled;
+    }
+
+    void setAdaptiveEnabled(bool enabled) {
+        ChangeSet().setAdaptiveEnabled(enabled).commit();
     }
 
-    bool isMonitorEnabled(Monitor& monitor) {
+    GammaDither getGammaDither() {
+        return snapshot.gammaDither;
+    }
+
+    void setGammaDither(GammaDither dither) {
+        ChangeSet().setGammaDither(dither).commit();
+    }
+
+    bool isMonitorEnabled(const Monitor& monitor) {
         return options(monitor).enabled;
     }
 
     void setMonitorEnabled(Monitor& monitor, bool enabled) {
-        options(monitor).enabled = enabled;
+        ChangeSet().setMonitorEnabled(monitor, enabled).commit();
+    }
+
+    int getMonitorBacklight(const Monitor& monitor) {
+        return options(monitor).backlight;
+    }
+
+    void setMonitorBacklight(Monitor& monitor, int backlight) {
+        ChangeSet().setMonitorBacklight(monitor, backlight).commit();
+    }
+
+    std::vector<std::wstring> getPresetNames() {
+        std::vector<std::wstring> result;
+        for (auto& entry : config.presets) {
+            result.push_back(entry.first);
+        }
+        return result;
+    }
+
+    void applyPreset(const std::wstring& name) {
+        auto preset = config.presets.find(name);
+        if (preset == config.presets.end()) {
+            return;
+        }
+
+        const MonitorOptionsMap& values = preset->second;
+        auto any = values.find(PRESET_ANY_MONITOR);
+
+        ChangeSet changes;
+        for (auto& monitor : queryMonitors()) {
+            auto it = values.find(monitor.getId());
+            if (it == values.end()) {
+                it = any;
+            }
+            if (it != values.end()) {
+                stageOptions(changes, monitor, it->second);
+            }
+        }
+
+        changes.commit();
+    }
+
+    bool selectLayout(const std::vector<Monitor>& monitors) {
+        PROFILE_ALLOCATIONS("selectLayout");
+
+        uint64_t hash = topologyHash(monitors);
+        if (hash == config.layout) {
+            return false;
+        }
+
+        /* the outgoing layout's options are stashed under its hash... */
+        bool stashed = config.layout != 0;
+        if (stashed) {
+            config.layouts[config.layout] = config.monitors;
+        }
+
+        /* ...and the incoming layout's are applied as a single batch.
+        monitors a layout hasn't seen before keep their current values. */
+        ChangeSet changes;
+        auto layout = config.layouts.find(hash);
+        if (layout != config.layouts.end()) {
+            for (auto& monitor : monitors) {
+                auto it = layout->second.find(monitor.getId());
+                if (it != layout->second.end()) {
+                    stageOptions(changes, monitor, it->second);
+                }
+            }
+        }
+
+        changes.commit(false);
+
+        if (layout != config.layouts.end()) {
+            config.layouts.erase(layout);
+        }
+
+        config.layout = hash;
+
+        /* the live map only holds the monitors that are attached now; the
+        rest were stashed with the layout they belong to. a config that
+        didn't know its layout had nowhere to stash them, so there they
+        stay rather than being lost. */
+        if (stashed) {
+            for (auto it = config.monitors.begin(); it != config.monitors.end(); ) {
+                bool attached = std::any_of(monitors.begin(), monitors.end(),
+                    [&it](const Monitor& monitor) { return monitor.getId() == it->first; });
+                it = attached ? std::next(it) : config.monitors.erase(it);
+            }
+
+            ConfigChanges removed;
+            refreshSnapshot(removed);
+            notifyListener(removed);
+        }
+
+        /* layouts aren't journaled; topology changes are rare enough that a
+        full save is fine, and it covers the options just applied too. */
         saveConfig();
+        return true;
+    }
+
+    bool isOpacityAllowed(float opacity) {
+        return opacity <= policy.maximumOpacity;
+    }
+
+    float getMaximumOpacity() {
+        return policy.maximumOpacity;
+    }
+
+    bool isTemperatureAllowed(int temperature) {
+        MonitorOptions options;
+        options.temperature = temperature;
+        return applyPolicy(policy, options).temperature == temperature;
+    }
+
+    bool isBacklightAllowed(int backlight) {
+        MonitorOptions options;
+        options.backlight = backlight;
+        return applyPolicy(policy, options).backlight == backlight;
+    }
+
+    bool isPollingLocked() {
+        return policy.pollingLocked;
+    }
+
+    void setConfigListener(ConfigListener listener) {
+        configListener = listener;
     }
 
     void loadConfig() {
-        std::string config = fileToString(getConfigFilename());
-        try {
-            json j = json::parse(config);
-            auto m = j.find("monitors");
-            if (m != j.end()) {
-                for (auto it = (*m).begin(); it != (*m).end(); ++it) {
-                    auto key = u8to16(it.key());
-                    auto value = it.value();
-                    auto options = std::make_shared<MonitorOptions>();
-                    options->opacity = value.value<float>("opacity", DEFAULT_OPACITY);
-                    options->temperature = value.value<int>("temperature", DEFAULT_TEMPERATURE);
-                    options->enabled = value.value<bool>("enabled", true);
-                    monitorOptions[key] = options;
-                }
+        PROFILE_ALLOCATIONS("loadConfig");
+
+        loadPolicy(getPolicyFilename(), policy);
+
+        getFileStamp(getConfigFilename(), lastSeenWriteTime, lastSeenSize);
+
+        if (!readConfigCache(getConfigFilename(), config)) {
+            configCacheDirty = true;
+
+            MappedFile file;
+            Config loaded;
+            if (file.open(getConfigFilename()) && parseConfig(file, loaded)) {
+                config = std::move(loaded);
             }
+        }
 
-            auto g = j.find("general");
-            if (g != j.end()) {
-                pollingEnabled = (*g).value("pollingEnabled", false);
-                globalEnabled = (*g).value("globalEnabled", true);
+        /* a journal started against an older config.json may be the one this
+        file was compacted from, if the restart never happened; the mark in
+        the file says how much of it is already in there. */
+        JournalMark compacted;
+        uint64_t baseWriteTime, baseSize;
+        if (Journal::readBase(getJournalFilename(), baseWriteTime, baseSize) &&
+            (baseWriteTime != lastSeenWriteTime || baseSize != lastSeenSize))
+        {
+            MappedFile file;
+            Config ignored;
+            if (file.open(getConfigFilename())) {
+                parseConfig(file, ignored, &compacted);
             }
         }
-        catch (...) {
-            /* move on... */
+
+        /* changes that were journaled but never compacted (crash, power loss)
+        are replayed over the snapshot and folded back in immediately. */
+        if (Journal::replay(getJournalFilename(), lastSeenWriteTime, lastSeenSize, policy.defaults, config, compacted)) {
+            saveConfig();
+        }
+        else {
+            journal.reset(getJournalFilename(), lastSeenWriteTime, lastSeenSize, config);
         }
+
+        mergeConfig(policy, config, snapshot);
     }
 
-    void saveConfig() {
-        json j = { { "monitors", { } } };
-        json& m = j["monitors"];
+    void reloadConfig() {
+        PROFILE_ALLOCATIONS("reloadConfig");
 
-        auto monitors = queryMonitors();
-        for (auto monitor : monitors) {
-            m[u16to8(monitor.getId())] = {
-                { "opacity", getMonitorOpacity(monitor) },
-                { "temperature", getMonitorTemperature(monitor) },
-                { "enabled", isMonitorEnabled(monitor) }
-            };
+        ConfigChanges changes;
+
+        /* while a compaction is writing, the file on disk is about to be
+        ours again; its completion calls back in here once it's done. */
+        if (compactionPending) {
+            return;
         }
 
-        j["general"] = {
-            { "globalEnabled", globalEnabled },
-            { "pollingEnabled", pollingEnabled }
-        };
+        /* notifications for our own saves are ignored: the file on disk is
+        still exactly what we last loaded or saveConfig() last produced. */
+        uint64_t writeTime, size;
+        if (!getFileStamp(getConfigFilename(), writeTime, size) ||
+            (writeTime == lastSeenWriteTime && size == lastSeenSize))
+        {
+            return;
+        }
+
+        /* a half-written file fails to parse; the next notification will
+        arrive once the writer is done, so just wait for it. */
+        MappedFile file;
+        Config loaded;
+        if (!file.open(getConfigFilename()) || !parseConfig(file, loaded)) {
+            return;
+        }
 
-        stringToFile(getConfigFilename(), j.dump(2));
+        config.monitors = std::move(loaded.monitors);
+        config.pollingEnabled = loaded.pollingEnabled;
+        config.globalEnabled = loaded.globalEnabled;
+        config.adaptiveEnabled = loaded.adaptiveEnabled;
+        config.gammaDither = loaded.gammaDither;
+
+        /* presets and stashed layouts take effect the next time they're
+        used; the active layout is whatever is attached right now. */
+        config.presets = std::move(loaded.presets);
+        config.layouts = std::move(loaded.layouts);
+        config.layouts.erase(config.layout);
+
+        lastSeenWriteTime = writeTime;
+        lastSeenSize = size;
+
+        /* the new file wins over anything still sitting in the journal. */
+        journal.reset(getJournalFilename(), lastSeenWriteTime, lastSeenSize, config);
+
+        configCacheDirty = true;
+
+        refreshSnapshot(changes);
+        notifyListener(changes);
+    }
+
+    void reloadPolicy() {
+        PROFILE_ALLOCATIONS("reloadPolicy");
+
+        /* as with config.json, a half-written file is skipped until the
+        writer is done with it. */
+        if (!loadPolicy(getPolicyFilename(), policy)) {
+            return;
+        }
+
+        ConfigChanges changes;
+        refreshSnapshot(changes);
+        notifyListener(changes);
+    }
+
+    void saveConfig() {
+        PROFILE_ALLOCATIONS("saveConfig");
+
+        cancelCompaction();
+
+        /* config.json is replaced atomically, and only then is the journal
+        restarted against it. a crash in between leaves the old journal, and
+        the mark saved with config.json says it has nothing more to add. */
+        uint64_t writeTime, size;
+        uint64_t generation = ++saveGeneration;
+        if (writeConfig(config, journal.mark(), generation, false, writeTime, size)) {
+            appliedGeneration = generation;
+            lastSeenWriteTime = writeTime;
+            lastSeenSize = size;
+            journal.reset(getJournalFilename(), lastSeenWriteTime, lastSeenSize, config);
+            configCacheDirty = true;
+        }
+    }
+
+    void saveConfigCache() {
+        if (configCacheDirty) {
+            std::lock_guard<std::mutex> guard(saveLock);
+            writeConfigCache(getConfigFilename(), config);
+            configCacheDirty = false;
+        }
     }
 }
\ No newline at end of file
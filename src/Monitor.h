@@ -34,11 +34,37 @@
 
 #pragma once
 
-#include <Windows.h>
+#include "Gamma.h"
+#include <cstdint>
+#include <cwchar>
+#include <functional>
+#include <map>
 #include <vector>
 #include <string>
+#include <string_view>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
 
 namespace dimmer {
+    struct MonitorOptions;
+
+    /* where a monitor sits on the virtual desktop. */
+    struct MonitorBounds {
+        int32_t left, top, right, bottom;
+
+        bool operator==(const MonitorBounds& other) const {
+            return this->left == other.left && this->top == other.top &&
+                this->right == other.right && this->bottom == other.bottom;
+        }
+
+        bool operator!=(const MonitorBounds& other) const {
+            return !(*this == other);
+        }
+    };
+
+#ifdef _WIN32
     struct Monitor {
         Monitor(HMONITOR handle, int index) {
             this->handle = handle;
@@ -46,37 +72,241 @@ namespace dimmer {
             this->info = {};
             this->info.cbSize = sizeof(MONITORINFOEX);
             GetMonitorInfo(handle, &this->info);
+            this->id = std::wstring(this->info.szDevice) + L"-" + std::to_wstring(index);
         }
 
-        std::wstring getId() const {
-            return std::wstring(this->info.szDevice) + L"-" + std::to_wstring(index);
+        const std::wstring& getId() const {
+            return this->id;
         }
 
-        std::wstring getName() const {
-            std::wstring name = this->info.szDevice;
-            auto pos = name.find(L"\\\\.\\");
-            if (pos == 0) {
-                name = name.substr(4);
+        const wchar_t* getName() const {
+            const wchar_t* name = this->info.szDevice;
+            if (wcsncmp(name, L"\\\\.\\", 4) == 0) {
+                name += 4;
             }
             return name;
         }
 
+        MonitorBounds getBounds() const {
+            const RECT& rect = this->info.rcMonitor;
+            return { rect.left, rect.top, rect.right, rect.bottom };
+        }
+
         int index;
         HMONITOR handle;
         MONITORINFOEX info;
+        std::wstring id;
+    };
+#else
+    /* an output as the display backend reports it. ids are output names
+    (DP-1), which are already unique, so they aren't numbered. */
+    struct Monitor {
+        Monitor(const std::wstring& name, int index, const MonitorBounds& bounds) {
+            this->index = index;
+            this->bounds = bounds;
+            this->id = name;
+        }
+
+        const std::wstring& getId() const {
+            return this->id;
+        }
+
+        const wchar_t* getName() const {
+            return this->id.c_str();
+        }
+
+        MonitorBounds getBounds() const {
+            return this->bounds;
+        }
+
+        int index;
+        MonitorBounds bounds;
+        std::wstring id;
+    };
+#endif
+
+    enum Property : unsigned {
+        PropertyOpacity = 0x01,
+        PropertyTemperature = 0x02,
+        PropertyEnabled = 0x04,
+        PropertyGeometry = 0x08,
+        PropertyPolling = 0x10,
+        PropertyBacklight = 0x20,
+        PropertyAdaptive = 0x40,
+        PropertyDither = 0x80,
+        PropertyAll = 0xff
+    };
+
+    constexpr size_t MAX_INLINE_MONITORS = 8;
+    constexpr size_t MAX_INLINE_MONITOR_ID = 48;
+
+    /* a small map from monitor id to T. the first MAX_INLINE_MONITORS ids
+    (shorter than MAX_INLINE_MONITOR_ID) are kept inline, which covers any
+    real set of displays, so filling and clearing it doesn't allocate. only
+    past that does it fall back to the heap. */
+    template <typename T>
+    class MonitorTable {
+        public:
+            /* adds the id, with a value-initialized T, if it's not there. */
+            T& operator[](std::wstring_view id) {
+                T* value = this->find(id);
+                if (value) {
+                    return *value;
+                }
+
+                if (this->count < MAX_INLINE_MONITORS && id.size() < MAX_INLINE_MONITOR_ID) {
+                    Entry& entry = this->entries[this->count++];
+                    id.copy(entry.id, id.size());
+                    entry.id[id.size()] = L'\0';
+                    entry.value = T();
+                    return entry.value;
+                }
+
+                return this->overflow.emplace(std::wstring(id), T()).first->second;
+            }
+
+            T* find(std::wstring_view id) {
+                for (size_t i = 0; i < this->count; i++) {
+                    if (id == this->entries[i].id) {
+                        return &this->entries[i].value;
+                    }
+                }
+                auto it = this->overflow.find(id);
+                return (it == this->overflow.end()) ? nullptr : &it->second;
+            }
+
+            const T* find(std::wstring_view id) const {
+                return const_cast<MonitorTable*>(this)->find(id);
+            }
+
+            /* calls visit(std::wstring_view id, const T& value) for each. */
+            template <typename Visit>
+            void forEach(Visit visit) const {
+                for (size_t i = 0; i < this->count; i++) {
+                    visit(std::wstring_view(this->entries[i].id), this->entries[i].value);
+                }
+                for (auto& entry : this->overflow) {
+                    visit(std::wstring_view(entry.first), entry.second);
+                }
+            }
+
+            bool empty() const {
+                return this->count == 0 && this->overflow.empty();
+            }
+
+            void clear() {
+                this->count = 0;
+                this->overflow.clear();
+            }
+
+        private:
+            struct Entry {
+                wchar_t id[MAX_INLINE_MONITOR_ID];
+                T value;
+            };
+
+            Entry entries[MAX_INLINE_MONITORS];
+            size_t count = 0;
+            std::map<std::wstring, T, std::less<>> overflow;
+    };
+
+    /* which effective properties changed, per monitor id. general carries
+    the global flags: PropertyPolling, PropertyAdaptive, PropertyDither, and
+    PropertyEnabled for the dimmer as a whole. it also carries any
+    per-monitor property whose policy default changed, which applies to
+    every monitor without options of its own. */
+    struct ConfigChanges {
+        MonitorTable<unsigned> monitors;
+        unsigned general = 0;
+
+        bool empty() const {
+            return monitors.empty() && !general;
+        }
+    };
+
+    using ConfigListener = std::function<void(const ConfigChanges&)>;
+
+    /* stages any number of option changes across monitors and global flags.
+    commit() applies the ones that actually differ from the live values,
+    persists them as a single journal transaction, and notifies the config
+    listener once with every affected monitor.
+
+    monitors are staged in a MonitorTable, so neither staging nor committing
+    allocates for any real set of displays, as long as each of them already
+    has options of its own. */
+    class ChangeSet {
+        public:
+            ChangeSet& setMonitorOpacity(const Monitor& monitor, float opacity);
+            ChangeSet& setMonitorTemperature(const Monitor& monitor, int temperature);
+            ChangeSet& setMonitorEnabled(const Monitor& monitor, bool enabled);
+            ChangeSet& setMonitorBacklight(const Monitor& monitor, int backlight);
+            ChangeSet& setPollingEnabled(bool enabled);
+            ChangeSet& setDimmerEnabled(bool enabled);
+            ChangeSet& setAdaptiveEnabled(bool enabled);
+            ChangeSet& setGammaDither(GammaDither dither);
+
+            bool empty() const;
+
+            /* persist = false applies the changes and notifies as usual, but
+            leaves saving them to the caller, who is about to do a full save
+            anyway. */
+            void commit(bool persist = true);
+
+        private:
+            struct Staged {
+                unsigned fields = 0;
+                float opacity = 0.0f;
+                int temperature = 0;
+                int backlight = 0;
+                bool enabled = false;
+            };
+
+            static bool differs(const Staged& staged, const MonitorOptions& options);
+
+            MonitorTable<Staged> monitors;
+            unsigned general = 0;
+            bool pollingEnabled = false;
+            bool dimmerEnabled = false;
+            bool adaptiveEnabled = false;
+            GammaDither gammaDither = GammaDither::None;
     };
 
     extern std::vector<Monitor> queryMonitors();
-    extern float getMonitorOpacity(Monitor& monitor);
+#ifndef _WIN32
+    /* there's no one way to enumerate displays here; whichever backend is
+    driving them reports what it found, and queryMonitors() returns that. */
+    extern void setAttachedMonitors(const std::vector<Monitor>& monitors);
+#endif
+    extern float getMonitorOpacity(const Monitor& monitor);
     extern void setMonitorOpacity(Monitor& monitor, float opacity);
-    extern int getMonitorTemperature(Monitor& monitor);
+    extern int getMonitorTemperature(const Monitor& monitor);
     extern void setMonitorTemperature(Monitor& monitor, int temperature);
-    extern bool isMonitorEnabled(Monitor& monitor);
+    extern bool isMonitorEnabled(const Monitor& monitor);
     extern void setMonitorEnabled(Monitor& monitor, bool enabled);
+    extern int getMonitorBacklight(const Monitor& monitor);
+    extern void setMonitorBacklight(Monitor& monitor, int backlight);
     extern bool isPollingEnabled();
     extern void setPollingEnabled(bool enabled);
     extern bool isDimmerEnabled();
     extern void setDimmerEnabled(bool enabled);
+    extern bool isAdaptiveEnabled();
+    extern void setAdaptiveEnabled(bool enabled);
+    extern GammaDither getGammaDither();
+    extern void setGammaDither(GammaDither dither);
+    extern std::vector<std::wstring> getPresetNames();
+    extern void applyPreset(const std::wstring& name);
+    /* switches to the options remembered for this set of monitors. true if
+    it was a different layout than the current one. */
+    extern bool selectLayout(const std::vector<Monitor>& monitors);
+    extern bool isOpacityAllowed(float opacity);
+    extern bool isTemperatureAllowed(int temperature);
+    extern bool isBacklightAllowed(int backlight);
+    extern float getMaximumOpacity();
+    extern bool isPollingLocked();
+    extern void setConfigListener(ConfigListener listener);
     extern void loadConfig();
+    extern void reloadConfig();
+    extern void reloadPolicy();
     extern void saveConfig();
+    extern void saveConfigCache();
 }
\ No newline at end of file
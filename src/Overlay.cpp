@@ -34,8 +34,21 @@
 
 #include "Overlay.h"
 #include "Monitor.h"
+#include "Gamma.h"
+#include "Compositor.h"
+#include "EventLoop.h"
+#include "DevicePool.h"
+#include "Ddc.h"
+#include "PanelBacklight.h"
+#include "Config.h"
+#include "Adaptive.h"
+#include "DesktopCapture.h"
 #include <algorithm>
+#include <atomic>
+#include <functional>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <magnification.h>
 #include <CommCtrl.h>
@@ -46,11 +59,14 @@
 
 using namespace dimmer;
 
-#define TIMER_ID 0xdeadbeef
-#define AGGRESSIVE_TIMER_ID 0xdeadc0de
-
-constexpr int timerTickMs = 10;
-constexpr int aggressiveTimerMs = 50; // Reduced frequency to prevent lag
+/* every overlay runs its own enforcement timers; the slack lets the
+timers of all overlays share their wakeups. */
+constexpr uint32_t timerTickMs = 10;
+constexpr uint32_t aggressiveTimerMs = 50; // Reduced frequency to prevent lag
+constexpr uint32_t shellHookThrottleMs = 100; // Limit to 10 updates per second
+constexpr uint32_t mouseHookThrottleMs = 500; // Limit to 2 updates per second
+constexpr uint32_t adaptiveSampleMs = 250;
+constexpr uint32_t ditherFrameMs = 33; /* temporal dithering cycles ~7 times a second */
 constexpr wchar_t className[] = L"DimmerOverlayClass";
 constexpr wchar_t windowTitle[] = L"DimmerOverlayWindow";
 constexpr wchar_t magnificationHostClass[] = L"DimmerMagnificationHost";
@@ -58,7 +74,87 @@ constexpr wchar_t magnificationHostTitle[] = L"DimmerMagnificationHost";
 
 static ATOM overlayClass = 0;
 static std::map<HWND, Overlay*> hwndToOverlay;
-static WORD gammaRamp[3][256];
+
+/* one per display for as long as the app runs, so the panel's original
+values outlive the overlays. entries are only used from device pool
+operations, which never overlap for the same display. */
+struct BacklightEntry {
+    HMONITOR handle = nullptr;
+    Backlight backlight;
+};
+
+static std::mutex backlightsLock;
+static std::map<std::wstring, std::shared_ptr<BacklightEntry>> backlights;
+
+/* with HYBRID_BACKLIGHT, the level each panel was last set to, by device.
+only touched on the UI thread; a panel that isn't listed has no hardware
+backlight, as far as we know, and the overlay does all the dimming. this
+and adaptiveStates are looked up on every opacity update, straight from
+szDevice, hence the transparent comparators. */
+static std::map<std::wstring, int, std::less<>> hybridBacklights;
+static std::map<std::wstring, Overlay*> deviceToOverlay;
+
+/* the ramps each display is showing, by device. set from operations under
+the display's ":gamma" key and advanced from ones under ":dither", which
+can overlap, hence the lock per entry. the DC is only kept open while
+there's more than one frame to cycle through.
+
+range is how far from identity the display is believed to accept, and
+accepted the furthest it has actually taken; see setGammaRamp. fit is what
+had to be trimmed off the setting the display is showing to get there.
+
+the ":dither" key and the operation that shows the next frame are built
+once, with the entry, and only ever submitted again; see advanceGammaRamp. */
+struct GammaEntry {
+    std::mutex lock;
+    HDC dc = nullptr;
+    std::shared_ptr<const DitheredRamps> ramps;
+    int frame = 0;
+    int range = -1;
+    int accepted = 0;
+    GammaFit fit;
+    std::wstring ditherKey;
+    DevicePool::Operation showNextFrame;
+    std::atomic<bool> frameQueued { false };
+};
+
+static std::mutex gammasLock;
+static std::map<std::wstring, std::shared_ptr<GammaEntry>> gammas;
+
+/* with adaptive brightness on, the controller for each display and the last
+frame it was fed, by device. UI thread only; a display without an entry
+shows the user's own opacity. */
+struct AdaptiveState {
+    AdaptiveController controller;
+    LumaStats stats;
+};
+
+static std::map<std::wstring, AdaptiveState, std::less<>> adaptiveStates;
+
+/* what each display's adaptive sample needs, built the first time the
+feature is turned on for it and kept from then on, so the operations can
+refer to it by plain pointer and are simply submitted again every time.
+capture runs on the device pool under key and leaves the frame here;
+deliver feeds it to the controller on the UI thread. the next capture may
+already be running by then, hence the lock. queued is set while a capture
+is waiting for a thread, so ticks don't pile up behind a slow one. */
+struct AdaptiveSampler {
+    std::wstring device;
+    std::wstring key;
+    DevicePool::Operation capture;
+    DevicePool::Operation deliver;
+    std::atomic<bool> queued { false };
+    std::mutex lock;
+    LumaStats stats;
+    bool captured = false;
+};
+
+static std::map<std::wstring, std::unique_ptr<AdaptiveSampler>, std::less<>> adaptiveSamplers;
+
+/* captures hold a D3D device each, and are only used from device pool
+operations queued under the display's ":capture" key. */
+static std::mutex capturesLock;
+static std::map<std::wstring, std::shared_ptr<DesktopCapture>> captures;
 
 // Static members for aggressive mode
 HHOOK Overlay::shellHook = nullptr;
@@ -67,11 +163,23 @@ HHOOK Overlay::mouseHook = nullptr;
 HHOOK Overlay::keyboardHook = nullptr;
 bool Overlay::magnificationInitialized = false;
 
-// Performance optimization: track last update times
-static DWORD lastShellHookUpdate = 0;
-static DWORD lastMouseHookUpdate = 0;
 static bool altTabActive = false;
 static bool altKeyPressed = false;
+static POINT lastMousePos = {};
+
+static void raiseOverlays(const std::vector<HWND>& windows) {
+    // Don't interfere during Alt+Tab
+    if (altTabActive) {
+        return;
+    }
+
+    for (HWND overlayHwnd : windows) {
+        if (IsWindow(overlayHwnd)) {
+            SetWindowPos(overlayHwnd, HWND_TOPMOST, 0, 0, 0, 0,
+                       SWP_NOMOVE | SWP_NOSIZE | SWP_NOACTIVATE | SWP_NOOWNERZORDER);
+        }
+    }
+}
 
 static void registerClass(HINSTANCE instance, WNDPROC wndProc) {
     if (!overlayClass) {
@@ -87,11 +195,46 @@ static bool enabled(Monitor& monitor) {
     return isDimmerEnabled() && isMonitorEnabled(monitor);
 }
 
+/* the user's opacity, or where content has moved it to. */
+static float contentOpacity(Monitor& monitor) {
+    auto it = adaptiveStates.find(monitor.info.szDevice);
+    if (it == adaptiveStates.end()) {
+        return getMonitorOpacity(monitor);
+    }
+    return it->second.controller.current();
+}
+
+/* the overlay would otherwise darken the very frames that adaptive
+brightness measures. being excluded also keeps it out of screenshots and
+screen sharing, so it's only asked for while the feature is on. fails
+before windows 10 2004. */
+static bool excludeFromCapture(HWND hwnd, bool exclude) {
+    return SetWindowDisplayAffinity(hwnd, exclude ? WDA_EXCLUDEFROMCAPTURE : WDA_NONE) != FALSE;
+}
+
+/* in hybrid mode, this uses the level the panel is actually at, so the
+result stays right while a change is still on its way to the panel. */
+static float effectiveOpacity(Monitor& monitor) {
+    float opacity = contentOpacity(monitor);
+    if (getMonitorBacklight(monitor) != HYBRID_BACKLIGHT) {
+        return opacity;
+    }
+
+    auto it = hybridBacklights.find(monitor.info.szDevice);
+    if (it == hybridBacklights.end()) {
+        return opacity;
+    }
+
+    return hybridOverlayOpacity(opacity, it->second);
+}
+
 Overlay::Overlay(HINSTANCE instance, Monitor monitor)
 : instance(instance)
 , monitor(monitor)
 , timerId(0)
 , aggressiveTimerId(0)
+, adaptiveTimerId(0)
+, ditherTimerId(0)
 , bgBrush(CreateSolidBrush(RGB(0, 0, 0)))
 , hwnd(nullptr)
 , magnificationHost(nullptr)
@@ -105,6 +248,7 @@ Overlay::Overlay(HINSTANCE instance, Monitor monitor)
         }
     }
     
+    deviceToOverlay[monitor.info.szDevice] = this;
     registerClass(instance, &Overlay::windowProc);
     this->update(monitor);
     installShellHook();
@@ -115,9 +259,16 @@ Overlay::Overlay(HINSTANCE instance, Monitor monitor)
 
 Overlay::~Overlay() {
     this->disableColorTemperature();
+    this->disableBacklight();
+    this->disableAdaptive();
     this->disableBrigthnessOverlay();
     this->destroyMagnificationOverlay();
     DeleteObject(this->bgBrush);
+
+    auto self = deviceToOverlay.find(this->monitor.info.szDevice);
+    if (self != deviceToOverlay.end() && self->second == this) {
+        deviceToOverlay.erase(self);
+    }
     
     // Remove from overlay windows list
     if (this->hwnd) {
@@ -141,52 +292,372 @@ Overlay::~Overlay() {
     }
 }
 
-static void colorTemperatureToRgb(int kelvin, float& red, float& green, float& blue) {
-    kelvin /= 100;
-
-    if (kelvin <= 66) {
-        red = 255;
+static void submitDeviceOperation(
+    const std::wstring& key,
+    DevicePool::Operation operation,
+    DevicePool::Operation completion = nullptr)
+{
+    auto pool = DevicePool::current();
+    if (pool) {
+        pool->submit(key, operation, completion);
     }
     else {
-        red = kelvin - 60.0f;
-        red = (float)(329.698727446 * (pow(red, -0.1332047592)));
-        red = std::max(0.0f, std::min(255.0f, red));
+        operation();
+        if (completion) {
+            completion();
+        }
     }
+}
+
+static void showNextGammaFrame(GammaEntry& entry) {
+    /* no math here, just the next of the prebuilt frames. */
+    entry.frameQueued = false;
+    std::lock_guard<std::mutex> lock(entry.lock);
+    if (entry.dc && entry.ramps && entry.ramps->count > 1) {
+        entry.frame = (entry.frame + 1) % entry.ramps->count;
+        SetDeviceGammaRamp(entry.dc, (LPVOID) entry.ramps->frames[entry.frame]);
+    }
+}
+
+static std::shared_ptr<GammaEntry> gammaEntry(const std::wstring& device) {
+    std::lock_guard<std::mutex> lock(gammasLock);
+    auto& slot = gammas[device];
+    if (!slot) {
+        slot = std::make_shared<GammaEntry>();
+        slot->ditherKey = device + L":dither";
 
-    if (kelvin <= 66) {
-        green = (float) kelvin;
-        green = (float)(99.4708025861 * log(green) - 161.1195681661);
-        green = std::max(0.0f, std::min(255.0f, green));
+        /* entries are never removed, so a plain pointer will do, and keeps
+        the operation small enough to be copied without allocating. */
+        GammaEntry* entry = slot.get();
+        slot->showNextFrame = [entry]() {
+            showNextGammaFrame(*entry);
+        };
+    }
+    return slot;
+}
+
+/* GdiIcmGammaRange, if an administrator has set it; read once. */
+static int systemGammaRange() {
+    static const int range = []() {
+        DWORD value = 0;
+        DWORD size = sizeof(value);
+        LONG result = RegGetValue(
+            HKEY_LOCAL_MACHINE,
+            L"SOFTWARE\\Microsoft\\Windows NT\\CurrentVersion\\ICM",
+            L"GdiIcmGammaRange",
+            RRF_RT_REG_DWORD,
+            nullptr,
+            &value,
+            &size);
+
+        return result == ERROR_SUCCESS
+            ? (int) std::min<DWORD>(value, FULL_GAMMA_RANGE) : DEFAULT_GAMMA_RANGE;
+    }();
+
+    return range;
+}
+
+/* every frame for a setting, each fitted to range. fit is what that took
+off the setting itself; the frames only ever lose rounding on top. */
+static std::shared_ptr<const DitheredRamps> buildGammaRamps(
+    int temperature, GammaDither dither, int range, GammaFit& fit)
+{
+    GammaRamp target;
+    if (temperature == -1) {
+        buildIdentityRamp(target);
+        dither = GammaDither::None;
     }
     else {
-        green = kelvin - 60.0f;
-        green = (float)(288.1221695283 * (pow(green, -0.0755148492)));
-        green = std::max(0.0f, std::min(255.0f, green));
+        buildTemperatureRamp(temperature, target);
+    }
+
+    fit = fitRamp(target, range);
+
+    auto ramps = std::make_shared<DitheredRamps>();
+    buildDitheredRamps(target, dither, *ramps);
+    for (int i = 0; i < ramps->count; i++) {
+        fitRamp(ramps->frames[i], range);
+    }
+
+    return ramps;
+}
+
+static void setGammaRamp(const std::wstring& device, int temperature, GammaDither dither) {
+    /* CreateDC and SetDeviceGammaRamp can each take milliseconds per display,
+    so this runs on the device pool when there is one. -1 resets the ramp.
+    every frame for the setting is built here, once.
+
+    ramps are fitted to what the display should accept before they're sent,
+    so a refused call is the exception. if one is refused anyway, and it
+    went further from identity than the display has ever taken, the range
+    for the display is narrowed to just short of it and the setting tried
+    once more; the range sticks for as long as dimmer runs. */
+    auto operation = [device, temperature, dither]() {
+        auto entry = gammaEntry(device);
+        std::lock_guard<std::mutex> lock(entry->lock);
+
+        if (entry->range < 0) {
+            entry->range = systemGammaRange();
+        }
+        if (!entry->dc) {
+            entry->dc = CreateDC(nullptr, device.c_str(), nullptr, nullptr);
+        }
+
+        entry->ramps = nullptr;
+        entry->frame = 0;
+        entry->fit = GammaFit();
+
+        for (int attempt = 0; attempt < 2 && entry->dc; attempt++) {
+            GammaFit fit;
+            auto ramps = buildGammaRamps(temperature, dither, entry->range, fit);
+            int deviation = rampDeviation(ramps->frames[0]);
+
+            if (SetDeviceGammaRamp(entry->dc, (LPVOID) ramps->frames[0])) {
+                entry->accepted = std::max(entry->accepted, deviation);
+                entry->ramps = ramps;
+                entry->fit = fit;
+                break;
+            }
+
+            if (deviation <= entry->accepted) {
+                break; /* refused for some other reason */
+            }
+
+            entry->range = deviation - 1;
+        }
+
+        if ((!entry->ramps || entry->ramps->count == 1) && entry->dc) {
+            DeleteDC(entry->dc);
+            entry->dc = nullptr;
+        }
+    };
+
+    submitDeviceOperation(device + L":gamma", operation);
+}
+
+namespace dimmer {
+    std::map<std::wstring, GammaFit> getTrimmedGammaRamps() {
+        std::map<std::wstring, GammaFit> result;
+        std::lock_guard<std::mutex> lock(gammasLock);
+        for (auto& it : gammas) {
+            std::lock_guard<std::mutex> entryLock(it.second->lock);
+            if (it.second->ramps && it.second->fit.clampedEntries) {
+                result[it.first] = it.second->fit;
+            }
+        }
+        return result;
+    }
+}
+
+static void advanceGammaRamp(GammaEntry& entry) {
+    /* runs every frame, so it reuses what the entry was built with. while
+    the last frame's operation is still waiting for a thread there's
+    nothing to add: it shows whichever frame is next when it runs. */
+    if (!entry.frameQueued.exchange(true)) {
+        submitDeviceOperation(entry.ditherKey, entry.showNextFrame);
+    }
+}
+
+static void setBacklight(
+    const Monitor& monitor,
+    int percent,
+    std::function<void(bool)> completion = nullptr)
+{
+    /* each DDC/CI write takes ~50ms, and gamma has nothing to do with it, so
+    it gets its own queue. -1 puts back whatever the panel was set to before
+    dimmer touched it. completion runs on the UI thread, with whether the
+    panel took the new level. */
+    std::wstring device = monitor.info.szDevice;
+    HMONITOR handle = monitor.handle;
+    auto result = std::make_shared<bool>(false);
+
+    auto operation = [device, handle, percent, result]() {
+        std::shared_ptr<BacklightEntry> entry;
+        {
+            std::lock_guard<std::mutex> lock(backlightsLock);
+            auto& slot = backlights[device];
+            if (!slot) {
+                if (percent == DEFAULT_BACKLIGHT) {
+                    return; /* never touched, nothing to restore */
+                }
+                slot = std::make_shared<BacklightEntry>();
+            }
+            entry = slot;
+        }
+
+        /* a display that answered neither DDC/CI nor WMI may just have
+        been asleep, so it's probed again next time. */
+        if (entry->handle != handle || !entry->backlight.hasTransport()) {
+            entry->handle = handle;
+            entry->backlight.setTransport(openBacklightTransport(handle, device));
+        }
+
+        if (percent == DEFAULT_BACKLIGHT) {
+            entry->backlight.restore();
+        }
+        else {
+            *result = entry->backlight.setPercent(VCP_LUMINANCE, percent);
+        }
+    };
+
+    DevicePool::Operation done;
+    if (completion) {
+        done = [completion, result]() {
+            completion(*result);
+        };
     }
 
-    if (kelvin >= 66) {
-        blue = 255.0f;
+    submitDeviceOperation(device + L":ddc", operation, done);
+}
+
+void Overlay::disableBacklight() {
+    hybridBacklights.erase(monitor.info.szDevice);
+    setBacklight(monitor, DEFAULT_BACKLIGHT);
+}
+
+void Overlay::updateBacklight() {
+    int backlight = getMonitorBacklight(monitor);
+
+    if (!enabled(monitor) || backlight == DEFAULT_BACKLIGHT) {
+        disableBacklight();
+    }
+    else if (backlight == HYBRID_BACKLIGHT) {
+        /* the overlay is recomputed once the panel has actually changed;
+        the overlay may be gone by then, so it's looked up again. */
+        std::wstring device = monitor.info.szDevice;
+        int level = hybridBacklightLevel(getMonitorOpacity(monitor));
+
+        setBacklight(monitor, level, [device, level](bool succeeded) {
+            if (succeeded) {
+                hybridBacklights[device] = level;
+            }
+            else {
+                hybridBacklights.erase(device);
+            }
+
+            auto it = deviceToOverlay.find(device);
+            if (it != deviceToOverlay.end()) {
+                it->second->updateOpacity();
+            }
+        });
     }
     else {
-        blue = kelvin - 10.0f;
-        blue = (float)(138.5177312231 * log(blue) - 305.0447927307);
-        blue = std::max(0.0f, std::min(255.0f, blue));
+        hybridBacklights.erase(monitor.info.szDevice);
+        setBacklight(monitor, backlight);
     }
+}
+
+void Overlay::disableAdaptive() {
+    auto loop = EventLoop::current();
+    if (loop) {
+        loop->cancel(this->adaptiveTimerId);
+    }
+    this->adaptiveTimerId = 0;
 
-    red /= 255.0f;
-    green /= 255.0f;
-    blue /= 255.0f;
+    std::wstring device = monitor.info.szDevice;
+    adaptiveStates.erase(device);
+
+    if (this->hwnd) {
+        excludeFromCapture(this->hwnd, false);
+    }
+
+    /* the duplication is released with the feature, not kept around */
+    submitDeviceOperation(device + L":capture", [device]() {
+        std::lock_guard<std::mutex> lock(capturesLock);
+        captures.erase(device);
+    });
+
+    /* that replaced any capture still waiting, which won't clear its flag. */
+    auto sampler = adaptiveSamplers.find(device);
+    if (sampler != adaptiveSamplers.end()) {
+        sampler->second->queued = false;
+    }
 }
 
-void Overlay::disableColorTemperature() {
-    HDC dc = CreateDC(nullptr, monitor.info.szDevice, nullptr, nullptr);
-    if (dc) {
-        for (int i = 0; i < 256; i++) {
-            gammaRamp[0][i] = gammaRamp[1][i] = gammaRamp[2][i] = i * 256;
+void Overlay::updateAdaptive() {
+    /* content only ever moves a display the user is dimming. */
+    auto loop = EventLoop::current();
+    if (!loop || !enabled(monitor) || !isAdaptiveEnabled() || getMonitorOpacity(monitor) == 0.0f ||
+        (this->hwnd && !excludeFromCapture(this->hwnd, true)))
+    {
+        if (this->adaptiveTimerId || adaptiveStates.count(monitor.info.szDevice)) {
+            this->disableAdaptive();
         }
-        SetDeviceGammaRamp(dc, gammaRamp);
-        DeleteDC(dc);
+        return;
+    }
+
+    if (this->adaptiveTimerId) {
+        return;
     }
+
+    /* a frame is captured and measured on the device pool; the controller
+    runs on the UI thread. it's fed the last frame again when nothing on
+    screen has changed, so a slide already under way still finishes. */
+    auto& slot = adaptiveSamplers[monitor.info.szDevice];
+    if (!slot) {
+        slot = std::make_unique<AdaptiveSampler>();
+        AdaptiveSampler* sampler = slot.get();
+        sampler->device = monitor.info.szDevice;
+        sampler->key = sampler->device + L":capture";
+
+        sampler->capture = [sampler]() {
+            sampler->queued = false;
+
+            std::shared_ptr<DesktopCapture> capture;
+            {
+                std::lock_guard<std::mutex> lock(capturesLock);
+                auto& cached = captures[sampler->device];
+                if (!cached) {
+                    cached = std::make_shared<DesktopCapture>(sampler->device);
+                }
+                capture = cached;
+            }
+
+            LumaStats stats;
+            if (capture->capture(stats)) {
+                std::lock_guard<std::mutex> lock(sampler->lock);
+                sampler->stats = stats;
+                sampler->captured = true;
+            }
+        };
+
+        sampler->deliver = [sampler]() {
+            auto it = deviceToOverlay.find(sampler->device);
+            if (it == deviceToOverlay.end() || !it->second->adaptiveTimerId) {
+                return; /* turned off while the capture was in flight */
+            }
+
+            Overlay* overlay = it->second;
+            AdaptiveState& state = adaptiveStates[sampler->device];
+            {
+                std::lock_guard<std::mutex> lock(sampler->lock);
+                if (sampler->captured) {
+                    state.stats = sampler->stats;
+                    sampler->captured = false;
+                }
+            }
+
+            float before = state.controller.current();
+            float after = state.controller.update(
+                getMonitorOpacity(overlay->monitor), getMaximumOpacity(), state.stats, EventLoop::now());
+
+            if (after != before) {
+                overlay->updateOpacity();
+            }
+        };
+    }
+
+    AdaptiveSampler* sampler = slot.get();
+    this->adaptiveTimerId = loop->repeat(adaptiveSampleMs, [sampler]() {
+        if (!sampler->queued.exchange(true)) {
+            submitDeviceOperation(sampler->key, sampler->capture, sampler->deliver);
+        }
+    }, adaptiveSampleMs / 2);
+}
+
+void Overlay::disableColorTemperature() {
+    this->killDitherTimer();
+    setGammaRamp(monitor.info.szDevice, -1, GammaDither::None);
 }
 
 void Overlay::updateColorTemperature() {
@@ -196,27 +667,34 @@ void Overlay::updateColorTemperature() {
         disableColorTemperature();
     }
     else {
-        HDC dc = CreateDC(nullptr, monitor.info.szDevice, nullptr, nullptr);
-        if (dc) {
-            float red = 1.0f;
-            float green = 1.0f;
-            float blue = 1.0f;
-
-            temperature = std::min(6000, std::max(4500, temperature));
-            colorTemperatureToRgb(temperature, red, green, blue);
-
-            for (int i = 0; i < 256; i++) {
-                float brightness = i * (256.0f);
-                gammaRamp[0][i] = (short)std::max(0.0f, std::min(65535.0f, brightness * red));
-                gammaRamp[1][i] = (short)std::max(0.0f, std::min(65535.0f, brightness * green));
-                gammaRamp[2][i] = (short)std::max(0.0f, std::min(65535.0f, brightness * blue));
-            }
-
-            SetDeviceGammaRamp(dc, gammaRamp);
+        GammaDither dither = getGammaDither();
+        setGammaRamp(monitor.info.szDevice, rampTemperature(temperature), dither);
 
-            DeleteDC(dc);
+        if (dither == GammaDither::Temporal) {
+            this->startDitherTimer();
         }
+        else {
+            this->killDitherTimer();
+        }
+    }
+}
+
+void Overlay::startDitherTimer() {
+    auto loop = EventLoop::current();
+    if (loop && !this->ditherTimerId) {
+        auto entry = gammaEntry(monitor.info.szDevice);
+        this->ditherTimerId = loop->repeat(ditherFrameMs, [entry]() {
+            advanceGammaRamp(*entry);
+        });
+    }
+}
+
+void Overlay::killDitherTimer() {
+    auto loop = EventLoop::current();
+    if (loop) {
+        loop->cancel(this->ditherTimerId);
     }
+    this->ditherTimerId = 0;
 }
 
 void Overlay::disableBrigthnessOverlay() {
@@ -238,7 +716,7 @@ void Overlay::disableBrigthnessOverlay() {
 }
 
 void Overlay::updateBrightnessOverlay() {
-    if (!enabled(monitor) || getMonitorOpacity(monitor) == 0.0f) {
+    if (!enabled(monitor) || effectiveOpacity(monitor) == 0.0f) {
         disableBrigthnessOverlay();
     }
     else {
@@ -259,43 +737,99 @@ void Overlay::updateBrightnessOverlay() {
             overlayWindows.push_back(this->hwnd);
 
             SetWindowLong(this->hwnd, GWL_STYLE, 0); /* removes title, borders. */
-        }
 
-        float red, green, blue;
-        colorTemperatureToRgb(3000, red, green, blue);
-        red = (1.0f - red) * 256.0f;
-        green = (1.0f - green) * 256.0f;
-        blue = (1.0f - blue) * 256.0f;
+            /* the attribute sticks to the window, so once is enough. */
+            BOOL compositionEnabled = FALSE;
+            if (SUCCEEDED(DwmIsCompositionEnabled(&compositionEnabled)) && compositionEnabled) {
+                // Exclude from DWM peek
+                BOOL exclude = TRUE;
+                DwmSetWindowAttribute(this->hwnd, DWMWA_EXCLUDED_FROM_PEEK, &exclude, sizeof(exclude));
+            }
 
-        int x = monitor.info.rcMonitor.left;
-        int y = monitor.info.rcMonitor.top;
-        int width = monitor.info.rcMonitor.right - x;
-        int height = monitor.info.rcMonitor.bottom - y;
+            if (this->adaptiveTimerId && !excludeFromCapture(this->hwnd, true)) {
+                this->disableAdaptive();
+            }
+        }
 
-        float value = getMonitorOpacity(this->monitor);
-        value = std::min(1.0f, std::max(0.0f, value));
-        BYTE opacity = std::min((BYTE)240, (BYTE)(value * 255.0f));
+        SetLayeredWindowAttributes(this->hwnd, 0, overlayAlpha(effectiveOpacity(this->monitor)), LWA_ALPHA);
+        this->updateGeometry();
+        this->startTimer();
+    }
+}
 
-        SetLayeredWindowAttributes(this->hwnd, 0, opacity, LWA_ALPHA);
-        
-        // More aggressive positioning
-        SetWindowPos(this->hwnd, HWND_TOPMOST, x, y, width, height, SWP_FRAMECHANGED | SWP_SHOWWINDOW | SWP_NOOWNERZORDER);
-        
-        // Force to front again after a brief moment
-        SetWindowPos(this->hwnd, HWND_TOP, 0, 0, 0, 0, SWP_NOMOVE | SWP_NOSIZE | SWP_NOOWNERZORDER);
+void Overlay::updateOpacity() {
+    /* showing or hiding the overlay needs the full path; otherwise the only
+    thing that changes is the layered window's alpha. */
+    if (!this->hwnd || !enabled(monitor) || effectiveOpacity(monitor) == 0.0f) {
+        this->updateBrightnessOverlay();
+    }
+    else {
+        SetLayeredWindowAttributes(this->hwnd, 0, overlayAlpha(effectiveOpacity(this->monitor)), LWA_ALPHA);
+    }
+}
 
-        UpdateWindow(this->hwnd);
-        this->aggressiveTopMost();
-        this->startTimer();
+void Overlay::updateGeometry() {
+    if (!this->hwnd) {
+        return;
     }
+
+    int x = monitor.info.rcMonitor.left;
+    int y = monitor.info.rcMonitor.top;
+    int width = monitor.info.rcMonitor.right - x;
+    int height = monitor.info.rcMonitor.bottom - y;
+
+    // More aggressive positioning
+    SetWindowPos(this->hwnd, HWND_TOPMOST, x, y, width, height, SWP_FRAMECHANGED | SWP_SHOWWINDOW | SWP_NOOWNERZORDER);
+    
+    // Force to front again after a brief moment
+    SetWindowPos(this->hwnd, HWND_TOP, 0, 0, 0, 0, SWP_NOMOVE | SWP_NOSIZE | SWP_NOOWNERZORDER);
+
+    UpdateWindow(this->hwnd);
+    this->aggressiveTopMost();
 }
 
 void Overlay::update(Monitor& monitor) {
+    this->apply(monitor, PropertyAll);
+}
+
+void Overlay::apply(Monitor& monitor, unsigned dirty) {
     this->monitor = monitor;
-    this->updateColorTemperature();
-    this->updateBrightnessOverlay();
+
+    if (dirty & PropertyEnabled) {
+        /* enabling or disabling touches everything */
+        this->updateColorTemperature();
+        this->updateBacklight();
+        this->updateAdaptive();
+        this->updateBrightnessOverlay();
+    }
+    else {
+        if (dirty & (PropertyTemperature | PropertyDither)) {
+            this->updateColorTemperature();
+        }
+        if (dirty & (PropertyOpacity | PropertyAdaptive)) {
+            /* a new opacity shows as set; content moves it again from there. */
+            auto it = adaptiveStates.find(monitor.info.szDevice);
+            if (it != adaptiveStates.end()) {
+                AdaptiveState& state = it->second;
+                state.controller.update(getMonitorOpacity(monitor), getMaximumOpacity(), state.stats, EventLoop::now());
+            }
+            this->updateAdaptive();
+            this->updateOpacity();
+        }
+        if ((dirty & PropertyBacklight) ||
+            ((dirty & PropertyOpacity) && getMonitorBacklight(monitor) == HYBRID_BACKLIGHT))
+        {
+            this->updateBacklight();
+        }
+        if (dirty & PropertyGeometry) {
+            this->updateGeometry();
+        }
+        if (dirty & PropertyPolling) {
+            this->startTimer();
+        }
+    }
     
-    if (useMagnification) {
+    if (useMagnification && (dirty & (PropertyEnabled | PropertyOpacity | PropertyGeometry))) {
         this->updateMagnificationOverlay();
     }
 }
@@ -303,22 +837,33 @@ void Overlay::update(Monitor& monitor) {
 void Overlay::startTimer() {
     this->killTimer();
 
-    if (isPollingEnabled()) {
-        this->timerId = SetTimer(this->hwnd, TIMER_ID, timerTickMs, nullptr);
-        // Only start aggressive timer when really needed
-        this->aggressiveTimerId = SetTimer(this->hwnd, AGGRESSIVE_TIMER_ID, aggressiveTimerMs, nullptr);
+    auto loop = EventLoop::current();
+    if (loop && isPollingEnabled() && this->hwnd) {
+        HWND hwnd = this->hwnd;
+        this->timerId = loop->repeat(timerTickMs, [hwnd]() {
+            // Don't interfere during Alt+Tab
+            if (!altTabActive) {
+                BringWindowToTop(hwnd);
+            }
+        }, timerTickMs / 2);
+
+        // More aggressive z-order enforcement, but only when needed
+        this->aggressiveTimerId = loop->repeat(aggressiveTimerMs, [this]() {
+            if (!altTabActive) {
+                this->aggressiveTopMost();
+            }
+        }, aggressiveTimerMs / 2);
     }
 }
 
 void Overlay::killTimer() {
-    if (this->timerId) {
-        KillTimer(this->hwnd, this->timerId);
-        this->timerId = 0;
-    }
-    if (this->aggressiveTimerId) {
-        KillTimer(this->hwnd, this->aggressiveTimerId);
-        this->aggressiveTimerId = 0;
+    auto loop = EventLoop::current();
+    if (loop) {
+        loop->cancel(this->timerId);
+        loop->cancel(this->aggressiveTimerId);
     }
+    this->timerId = 0;
+    this->aggressiveTimerId = 0;
 }
 
 LRESULT CALLBACK Overlay::windowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
@@ -333,23 +878,6 @@ LRESULT CALLBACK Overlay::windowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM
                 EndPaint(hwnd, &ps);
                 return 0;
             }
-
-            case WM_TIMER: {
-                if (wParam == overlay->second->timerId) {
-                    // Don't interfere during Alt+Tab
-                    if (!altTabActive) {
-                        BringWindowToTop(hwnd);
-                    }
-                    return 0;
-                }
-                else if (wParam == overlay->second->aggressiveTimerId) {
-                    // More aggressive z-order enforcement, but only when needed
-                    if (!altTabActive) {
-                        overlay->second->aggressiveTopMost();
-                    }
-                    return 0;
-                }
-            }
         }
     }
 
@@ -368,23 +896,6 @@ void Overlay::aggressiveTopMost() {
     // Multiple attempts with different approaches
     SetWindowPos(this->hwnd, HWND_TOPMOST, 0, 0, 0, 0, SWP_NOMOVE | SWP_NOSIZE | SWP_NOOWNERZORDER);
     
-    // Don't interfere during Alt+Tab
-    if (altTabActive) return;
-    
-    // Use DWM to ensure window is above composition (but only occasionally)
-    static DWORD lastDwmUpdate = 0;
-    DWORD currentTime = GetTickCount();
-    if (currentTime - lastDwmUpdate > 1000) { // Only update DWM settings once per second
-        lastDwmUpdate = currentTime;
-        
-        BOOL compositionEnabled = FALSE;
-        if (SUCCEEDED(DwmIsCompositionEnabled(&compositionEnabled)) && compositionEnabled) {
-            // Exclude from DWM peek
-            BOOL exclude = TRUE;
-            DwmSetWindowAttribute(this->hwnd, DWMWA_EXCLUDED_FROM_PEEK, &exclude, sizeof(exclude));
-        }
-    }
-    
     // Only try magnification overlay as fallback if really needed
     // if (magnificationInitialized) {
     //     this->createMagnificationOverlay();
@@ -431,14 +942,12 @@ void Overlay::uninstallKeyboardHook() {
 }
 
 LRESULT CALLBACK Overlay::shellHookProc(int nCode, WPARAM wParam, LPARAM lParam) {
+    // Throttle updates to prevent lag
+    static Throttle raise(shellHookThrottleMs, []() {
+        raiseOverlays(overlayWindows);
+    });
+
     if (nCode >= 0) {
-        // Throttle updates to prevent lag
-        DWORD currentTime = GetTickCount();
-        if (currentTime - lastShellHookUpdate < 100) { // Limit to 10 updates per second
-            return CallNextHookEx(shellHook, nCode, wParam, lParam);
-        }
-        lastShellHookUpdate = currentTime;
-        
         // Better Alt+Tab detection using keyboard hook state
         if (altTabActive) {
             return CallNextHookEx(shellHook, nCode, wParam, lParam);
@@ -452,20 +961,13 @@ LRESULT CALLBACK Overlay::shellHookProc(int nCode, WPARAM wParam, LPARAM lParam)
                 // Check if it's a special window that needs overlay enforcement
                 wchar_t className[256];
                 if (GetClassName(newWindow, className, sizeof(className) / sizeof(wchar_t))) {
-                    std::wstring classStr(className);
-                    
                     // Only handle specific problematic window types
-                    if (classStr.find(L"TaskListThumbnailWnd") != std::wstring::npos ||
-                        classStr.find(L"Chrome_RenderWidgetHostHWND") != std::wstring::npos ||
-                        classStr.find(L"Chrome_WidgetWin") != std::wstring::npos) {
+                    if (wcsstr(className, L"TaskListThumbnailWnd") ||
+                        wcsstr(className, L"Chrome_RenderWidgetHostHWND") ||
+                        wcsstr(className, L"Chrome_WidgetWin")) {
                         
                         // Efficiently bring overlays to front
-                        for (HWND overlayHwnd : overlayWindows) {
-                            if (IsWindow(overlayHwnd)) {
-                                SetWindowPos(overlayHwnd, HWND_TOPMOST, 0, 0, 0, 0, 
-                                           SWP_NOMOVE | SWP_NOSIZE | SWP_NOACTIVATE | SWP_NOOWNERZORDER);
-                            }
-                        }
+                        raise();
                     }
                 }
                 break;
@@ -477,41 +979,29 @@ LRESULT CALLBACK Overlay::shellHookProc(int nCode, WPARAM wParam, LPARAM lParam)
 }
 
 LRESULT CALLBACK Overlay::mouseHookProc(int nCode, WPARAM wParam, LPARAM lParam) {
-    if (nCode >= 0) {
-        // Throttle mouse hook updates heavily to prevent lag
-        DWORD currentTime = GetTickCount();
-        if (currentTime - lastMouseHookUpdate < 500) { // Limit to 2 updates per second
-            return CallNextHookEx(mouseHook, nCode, wParam, lParam);
-        }
-        lastMouseHookUpdate = currentTime;
-        
-        // Don't interfere during Alt+Tab
-        if (altTabActive) {
-            return CallNextHookEx(mouseHook, nCode, wParam, lParam);
+    // Throttle mouse hook updates heavily to prevent lag. the trailing run
+    // checks wherever the mouse ended up.
+    static Throttle check(mouseHookThrottleMs, []() {
+        // Get taskbar position
+        HWND taskbar = FindWindow(L"Shell_TrayWnd", nullptr);
+        if (taskbar) {
+            RECT taskbarRect;
+            GetWindowRect(taskbar, &taskbarRect);
+
+            // Check if mouse is over taskbar area
+            if (PtInRect(&taskbarRect, lastMousePos)) {
+                // Mouse is over taskbar, efficiently bring overlays to front
+                raiseOverlays(overlayWindows);
+            }
         }
-        
+    });
+
+    if (nCode >= 0) {
         // Only handle mouse move events to detect taskbar hover
-        if (wParam == WM_MOUSEMOVE) {
+        if (wParam == WM_MOUSEMOVE && !altTabActive) {
             MSLLHOOKSTRUCT* mouseData = (MSLLHOOKSTRUCT*)lParam;
-            
-            // Get taskbar position
-            HWND taskbar = FindWindow(L"Shell_TrayWnd", nullptr);
-            if (taskbar) {
-                RECT taskbarRect;
-                GetWindowRect(taskbar, &taskbarRect);
-                
-                // Check if mouse is over taskbar area
-                POINT mousePos = mouseData->pt;
-                if (PtInRect(&taskbarRect, mousePos)) {
-                    // Mouse is over taskbar, efficiently bring overlays to front
-                    for (HWND overlayHwnd : overlayWindows) {
-                        if (IsWindow(overlayHwnd)) {
-                            SetWindowPos(overlayHwnd, HWND_TOPMOST, 0, 0, 0, 0, 
-                                       SWP_NOMOVE | SWP_NOSIZE | SWP_NOACTIVATE | SWP_NOOWNERZORDER);
-                        }
-                    }
-                }
-            }
+            lastMousePos = mouseData->pt;
+            check();
         }
     }
     
@@ -575,8 +1065,8 @@ void Overlay::createMagnificationOverlay() {
     
     if (magnificationHost) {
         // Set transparency for dimming effect
-        float opacity = getMonitorOpacity(this->monitor);
-        BYTE alpha = std::min((BYTE)240, (BYTE)(opacity * 255.0f));
+        float opacity = effectiveOpacity(this->monitor);
+        BYTE alpha = overlayAlpha(opacity);
         SetLayeredWindowAttributes(magnificationHost, RGB(0, 0, 0), alpha, LWA_COLORKEY | LWA_ALPHA);
         
         // Create magnification control
@@ -669,7 +1159,7 @@ void Overlay::updateMagnificationOverlay() {
     MAGCOLOREFFECT colorEffect;
     memset(&colorEffect, 0, sizeof(colorEffect));
     
-    float opacity = getMonitorOpacity(this->monitor);
+    float opacity = effectiveOpacity(this->monitor);
     float dimFactor = 1.0f - opacity;
     colorEffect.transform[0][0] = dimFactor;  // Red
     colorEffect.transform[1][1] = dimFactor;  // Green  
@@ -37,6 +37,9 @@
 #include <Windows.h>
 #include <magnification.h>
 #include "Monitor.h"
+#include "EventLoop.h"
+#include <map>
+#include <string>
 
 namespace dimmer {
     class Overlay {
@@ -45,6 +48,7 @@ namespace dimmer {
             ~Overlay();
 
             void update(Monitor& monitor);
+            void apply(Monitor& monitor, unsigned dirty);
             void startTimer();
             void killTimer();
             void forceToTop();
@@ -57,8 +61,16 @@ namespace dimmer {
 
             void disableColorTemperature();
             void updateColorTemperature();
+            void startDitherTimer();
+            void killDitherTimer();
+            void disableBacklight();
+            void updateBacklight();
+            void disableAdaptive();
+            void updateAdaptive();
             void disableBrigthnessOverlay();
             void updateBrightnessOverlay();
+            void updateOpacity();
+            void updateGeometry();
             void aggressiveTopMost();
             
             // Magnification API methods
@@ -70,8 +82,10 @@ namespace dimmer {
             Monitor monitor;
             HINSTANCE instance;
             HBRUSH bgBrush;
-            UINT_PTR timerId;
-            UINT_PTR aggressiveTimerId;
+            EventLoop::Id timerId;
+            EventLoop::Id aggressiveTimerId;
+            EventLoop::Id adaptiveTimerId;
+            EventLoop::Id ditherTimerId;
             HWND hwnd;
             
             // Magnification overlay
@@ -91,4 +105,8 @@ namespace dimmer {
             static LRESULT CALLBACK keyboardHookProc(int nCode, WPARAM wParam, LPARAM lParam);
             static bool magnificationInitialized;
     };
+
+    /* the displays showing a color temperature that was trimmed to fit the
+    range they accept, by device, with what was trimmed. */
+    extern std::map<std::wstring, GammaFit> getTrimmedGammaRamps();
 }
\ No newline at end of file
@@ -0,0 +1,385 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "PanelBacklight.h"
+#include <algorithm>
+#include <vector>
+
+#ifdef _WIN32
+#include <Wbemidl.h>
+#pragma comment(lib, "wbemuuid.lib")
+#else
+#include <cstdio>
+#include <dirent.h>
+#endif
+
+using namespace dimmer;
+
+namespace dimmer {
+    int hybridBacklightLevel(float opacity) {
+        int brightness = (int) ((1.0f - opacity) * 100.0f + 0.5f);
+        return std::min(100, std::max(HYBRID_MINIMUM_BACKLIGHT, brightness));
+    }
+
+    float hybridOverlayOpacity(float opacity, int backlightPercent) {
+        if (backlightPercent <= 0) {
+            return opacity;
+        }
+        float backlight = (float) std::min(100, backlightPercent) / 100.0f;
+        return std::max(0.0f, 1.0f - (1.0f - opacity) / backlight);
+    }
+}
+
+#ifdef _WIN32
+
+/* WMI */
+
+constexpr uint16_t wmiMaximum = 100; /* WmiMonitorBrightness is a percentage */
+
+template <typename T>
+static void release(T*& object) {
+    if (object) {
+        object->Release();
+        object = nullptr;
+    }
+}
+
+/* connects to root\wmi for the duration of one call. */
+class WmiConnection {
+    public:
+        WmiConnection()
+        : services(nullptr)
+        , uninitialize(false) {
+            HRESULT result = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+            this->uninitialize = SUCCEEDED(result);
+            if (FAILED(result) && result != RPC_E_CHANGED_MODE) {
+                return;
+            }
+
+            IWbemLocator* locator = nullptr;
+            if (FAILED(CoCreateInstance(CLSID_WbemLocator, nullptr, CLSCTX_INPROC_SERVER,
+                IID_IWbemLocator, (void**) &locator)))
+            {
+                return;
+            }
+
+            BSTR ns = SysAllocString(L"ROOT\\WMI");
+            locator->ConnectServer(ns, nullptr, nullptr, nullptr, 0, nullptr, nullptr, &this->services);
+            SysFreeString(ns);
+            release(locator);
+
+            if (this->services) {
+                CoSetProxyBlanket(this->services, RPC_C_AUTHN_WINNT, RPC_C_AUTHZ_NONE, nullptr,
+                    RPC_C_AUTHN_LEVEL_CALL, RPC_C_IMP_LEVEL_IMPERSONATE, nullptr, EOAC_NONE);
+            }
+        }
+
+        ~WmiConnection() {
+            release(this->services);
+            if (this->uninitialize) {
+                CoUninitialize();
+            }
+        }
+
+        /* the first active instance of a class, or nullptr. */
+        IWbemClassObject* first(const wchar_t* query) {
+            if (!this->services) {
+                return nullptr;
+            }
+
+            IEnumWbemClassObject* results = nullptr;
+            BSTR language = SysAllocString(L"WQL");
+            BSTR text = SysAllocString(query);
+            this->services->ExecQuery(language, text,
+                WBEM_FLAG_FORWARD_ONLY | WBEM_FLAG_RETURN_IMMEDIATELY, nullptr, &results);
+            SysFreeString(text);
+            SysFreeString(language);
+
+            IWbemClassObject* object = nullptr;
+            ULONG count = 0;
+            if (results) {
+                results->Next(WBEM_INFINITE, 1, &object, &count);
+                release(results);
+            }
+            return count ? object : nullptr;
+        }
+
+        IWbemServices* services;
+
+    private:
+        bool uninitialize;
+};
+
+bool WmiBacklightTransport::getVcp(uint8_t code, VcpValue& value) {
+    if (code != VCP_LUMINANCE) {
+        return false;
+    }
+
+    WmiConnection wmi;
+    IWbemClassObject* brightness = wmi.first(
+        L"SELECT CurrentBrightness FROM WmiMonitorBrightness WHERE Active = TRUE");
+
+    if (!brightness) {
+        return false;
+    }
+
+    VARIANT current;
+    VariantInit(&current);
+    bool result = SUCCEEDED(brightness->Get(L"CurrentBrightness", 0, &current, nullptr, nullptr));
+    if (result) {
+        value.current = (uint16_t) current.bVal;
+        value.maximum = wmiMaximum;
+    }
+
+    VariantClear(&current);
+    release(brightness);
+    return result;
+}
+
+bool WmiBacklightTransport::setVcp(uint8_t code, uint16_t value) {
+    if (code != VCP_LUMINANCE) {
+        return false;
+    }
+
+    WmiConnection wmi;
+    IWbemClassObject* methods = wmi.first(
+        L"SELECT * FROM WmiMonitorBrightnessMethods WHERE Active = TRUE");
+
+    if (!methods) {
+        return false;
+    }
+
+    bool result = false;
+    VARIANT path;
+    VariantInit(&path);
+
+    IWbemClassObject* definition = nullptr;
+    IWbemClassObject* signature = nullptr;
+    IWbemClassObject* arguments = nullptr;
+    BSTR className = SysAllocString(L"WmiMonitorBrightnessMethods");
+    BSTR methodName = SysAllocString(L"WmiSetBrightness");
+
+    if (SUCCEEDED(methods->Get(L"__PATH", 0, &path, nullptr, nullptr)) &&
+        SUCCEEDED(wmi.services->GetObject(className, 0, nullptr, &definition, nullptr)) &&
+        SUCCEEDED(definition->GetMethod(methodName, 0, &signature, nullptr)) &&
+        SUCCEEDED(signature->SpawnInstance(0, &arguments)))
+    {
+        VARIANT timeout, brightness;
+        VariantInit(&timeout);
+        timeout.vt = VT_I4;
+        timeout.lVal = 0;
+        VariantInit(&brightness);
+        brightness.vt = VT_UI1;
+        brightness.bVal = (BYTE) std::min<uint16_t>(value, wmiMaximum);
+
+        result =
+            SUCCEEDED(arguments->Put(L"Timeout", 0, &timeout, 0)) &&
+            SUCCEEDED(arguments->Put(L"Brightness", 0, &brightness, 0)) &&
+            SUCCEEDED(wmi.services->ExecMethod(path.bstrVal, methodName, 0, nullptr, arguments, nullptr, nullptr));
+    }
+
+    SysFreeString(methodName);
+    SysFreeString(className);
+    release(arguments);
+    release(signature);
+    release(definition);
+    VariantClear(&path);
+    release(methods);
+    return result;
+}
+
+/* DisplayConfig */
+
+namespace dimmer {
+    bool isInternalPanel(const std::wstring& device) {
+        UINT32 pathCount = 0, modeCount = 0;
+        if (GetDisplayConfigBufferSizes(QDC_ONLY_ACTIVE_PATHS, &pathCount, &modeCount) != ERROR_SUCCESS) {
+            return false;
+        }
+
+        std::vector<DISPLAYCONFIG_PATH_INFO> paths(pathCount);
+        std::vector<DISPLAYCONFIG_MODE_INFO> modes(modeCount);
+        if (QueryDisplayConfig(QDC_ONLY_ACTIVE_PATHS, &pathCount, paths.data(),
+            &modeCount, modes.data(), nullptr) != ERROR_SUCCESS)
+        {
+            return false;
+        }
+
+        for (UINT32 i = 0; i < pathCount; i++) {
+            DISPLAYCONFIG_SOURCE_DEVICE_NAME source = {};
+            source.header.type = DISPLAYCONFIG_DEVICE_INFO_GET_SOURCE_NAME;
+            source.header.size = sizeof(source);
+            source.header.adapterId = paths[i].sourceInfo.adapterId;
+            source.header.id = paths[i].sourceInfo.id;
+
+            if (DisplayConfigGetDeviceInfo(&source.header) == ERROR_SUCCESS &&
+                device == source.viewGdiDeviceName)
+            {
+                switch (paths[i].targetInfo.outputTechnology) {
+                    case DISPLAYCONFIG_OUTPUT_TECHNOLOGY_INTERNAL:
+                    case DISPLAYCONFIG_OUTPUT_TECHNOLOGY_DISPLAYPORT_EMBEDDED:
+                    case DISPLAYCONFIG_OUTPUT_TECHNOLOGY_UDI_EMBEDDED:
+                        return true;
+                    default:
+                        break;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    std::unique_ptr<VcpTransport> openBacklightTransport(HMONITOR monitor, const std::wstring& device) {
+        VcpValue value;
+
+        if (isInternalPanel(device)) {
+            auto wmi = std::make_unique<WmiBacklightTransport>();
+            if (wmi->getVcp(VCP_LUMINANCE, value)) {
+                return wmi;
+            }
+            return nullptr;
+        }
+
+        auto ddc = std::make_unique<PhysicalMonitorTransport>(monitor);
+        if (ddc->isOpen() && ddc->getVcp(VCP_LUMINANCE, value)) {
+            return ddc;
+        }
+
+        return nullptr;
+    }
+}
+
+#else
+
+/* sysfs */
+
+static bool readNumber(const std::string& fn, long& value) {
+    FILE* file = fopen(fn.c_str(), "r");
+    if (!file) {
+        return false;
+    }
+    bool result = fscanf(file, "%ld", &value) == 1;
+    fclose(file);
+    return result;
+}
+
+static std::string readWord(const std::string& fn) {
+    char buffer[32] = { 0 };
+    FILE* file = fopen(fn.c_str(), "r");
+    if (file) {
+        if (fscanf(file, "%31s", buffer) != 1) {
+            buffer[0] = 0;
+        }
+        fclose(file);
+    }
+    return buffer;
+}
+
+static int typeRank(const std::string& type) {
+    if (type == "firmware") return 0;
+    if (type == "platform") return 1;
+    return 2; /* raw, or unknown */
+}
+
+SysfsBacklightTransport::SysfsBacklightTransport(const std::string& root) {
+    DIR* dir = opendir(root.c_str());
+    if (!dir) {
+        return;
+    }
+
+    /* directory order isn't stable, so ties go to the first name. */
+    int bestRank = 3;
+    std::string bestName;
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name == "." || name == "..") {
+            continue;
+        }
+
+        long maximum = 0;
+        std::string device = root + "/" + name;
+        if (!readNumber(device + "/max_brightness", maximum) || maximum <= 0) {
+            continue;
+        }
+
+        int rank = typeRank(readWord(device + "/type"));
+        if (rank < bestRank || (rank == bestRank && name < bestName)) {
+            bestRank = rank;
+            bestName = name;
+        }
+    }
+    closedir(dir);
+
+    if (!bestName.empty()) {
+        this->path = root + "/" + bestName;
+    }
+}
+
+bool SysfsBacklightTransport::getVcp(uint8_t code, VcpValue& value) {
+    long current = 0, maximum = 0;
+    if (code != VCP_LUMINANCE || !this->isOpen() ||
+        !readNumber(this->path + "/brightness", current) ||
+        !readNumber(this->path + "/max_brightness", maximum))
+    {
+        return false;
+    }
+
+    /* VCP values are 16 bits; some panels count higher than that. */
+    long scale = 1 + maximum / 0x10000;
+    value.maximum = (uint16_t) (maximum / scale);
+    value.current = (uint16_t) std::min(current / scale, (long) value.maximum);
+    return true;
+}
+
+bool SysfsBacklightTransport::setVcp(uint8_t code, uint16_t value) {
+    long maximum = 0;
+    if (code != VCP_LUMINANCE || !this->isOpen() ||
+        !readNumber(this->path + "/max_brightness", maximum))
+    {
+        return false;
+    }
+
+    long scale = 1 + maximum / 0x10000;
+    long raw = std::min((long) value * scale, maximum);
+
+    FILE* file = fopen((this->path + "/brightness").c_str(), "w");
+    if (!file) {
+        return false;
+    }
+    bool result = fprintf(file, "%ld", raw) > 0;
+    result = (fclose(file) == 0) && result;
+    return result;
+}
+
+#endif
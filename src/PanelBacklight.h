@@ -0,0 +1,96 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Ddc.h"
+#include <memory>
+#include <string>
+
+namespace dimmer {
+    /* with HYBRID_BACKLIGHT, panels aren't turned down below this percentage;
+    lower and most of them flicker or go dark. */
+    constexpr int HYBRID_MINIMUM_BACKLIGHT = 20;
+
+    /* the backlight percentage hybrid mode sets for a brightness overlay of
+    the given opacity: as far down as the opacity asks for, but no further
+    than HYBRID_MINIMUM_BACKLIGHT. */
+    extern int hybridBacklightLevel(float opacity);
+
+    /* the overlay makes up whatever the panel didn't: at backlight b, an
+    overlay of 1 - (1 - opacity) / b leaves the same light as the overlay
+    alone would have. */
+    extern float hybridOverlayOpacity(float opacity, int backlightPercent);
+
+    /* built-in laptop panels have no DDC/CI; their backlight is driven by
+    the firmware instead. these transports only know VCP_LUMINANCE, scaled
+    to 0-maximum like any other VCP feature. */
+
+#ifdef _WIN32
+    /* WmiMonitorBrightness / WmiSetBrightness in root\wmi. the class only
+    has instances for internal panels. each call sets up and tears down
+    its own COM connection, so it can be used from any thread. */
+    class WmiBacklightTransport : public VcpTransport {
+        public:
+            bool getVcp(uint8_t code, VcpValue& value) override;
+            bool setVcp(uint8_t code, uint16_t value) override;
+    };
+
+    /* whether the display behind a GDI device name (\\.\DISPLAY1) is the
+    built-in panel, as opposed to something plugged into a port. */
+    extern bool isInternalPanel(const std::wstring& device);
+
+    /* DDC/CI for external monitors, WMI for the internal panel, or nullptr
+    if neither answers. probing can take a while; call it off the UI
+    thread. */
+    extern std::unique_ptr<VcpTransport> openBacklightTransport(HMONITOR monitor, const std::wstring& device);
+#else
+    /* a device under /sys/class/backlight. with more than one there, the
+    firmware interface is preferred over platform and raw ones, the same
+    as the kernel's own policy. root is overridable for tests. */
+    class SysfsBacklightTransport : public VcpTransport {
+        public:
+            explicit SysfsBacklightTransport(const std::string& root = "/sys/class/backlight");
+
+            bool isOpen() const { return !this->path.empty(); }
+            const std::string& getPath() const { return this->path; }
+
+            bool getVcp(uint8_t code, VcpValue& value) override;
+            bool setVcp(uint8_t code, uint16_t value) override;
+
+        private:
+            std::string path;
+    };
+#endif
+}
@@ -0,0 +1,202 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Policy.h"
+#include "File.h"
+#include "JsonReader.h"
+#include "Profile.h"
+#include "Util.h"
+#include <algorithm>
+
+using namespace dimmer;
+
+/* the white point of an unadjusted display. "default" temperature means
+no adjustment at all, which is only allowed if this falls in range. */
+constexpr int NEUTRAL_TEMPERATURE = 6500;
+
+static bool parsePolicy(const MappedFile& file, Policy& result) {
+    JsonReader reader(file.data(), file.size());
+
+    if (!reader.beginObject()) {
+        return false;
+    }
+
+    std::string key;
+    while (reader.nextKey(key)) {
+        if (key == "defaults") {
+            if (reader.beginObject()) {
+                while (reader.nextKey(key)) {
+                    if (key == "opacity") {
+                        reader.readFloat(result.defaults.opacity);
+                    }
+                    else if (key == "temperature") {
+                        reader.readInt(result.defaults.temperature);
+                    }
+                    else if (key == "backlight") {
+                        reader.readInt(result.defaults.backlight);
+                    }
+                    else if (key == "enabled") {
+                        reader.readBool(result.defaults.enabled);
+                    }
+                    else {
+                        reader.skipValue();
+                    }
+                }
+            }
+        }
+        else if (key == "minimumBrightness") {
+            float brightness;
+            if (reader.readFloat(brightness)) {
+                result.maximumOpacity = 1.0f - std::min(std::max(brightness, 0.0f), 1.0f);
+            }
+        }
+        else if (key == "minimumTemperature") {
+            reader.readInt(result.minimumTemperature);
+        }
+        else if (key == "maximumTemperature") {
+            reader.readInt(result.maximumTemperature);
+        }
+        else if (key == "pollingEnabled") {
+            result.pollingLocked = reader.readBool(result.pollingEnabled);
+        }
+        else {
+            reader.skipValue();
+        }
+    }
+
+    /* an inverted range has no temperature that satisfies it; treat it like
+    any other broken file rather than guess which end was meant. */
+    if (result.minimumTemperature > result.maximumTemperature) {
+        return false;
+    }
+
+    return !reader.failed();
+}
+
+namespace dimmer {
+    bool loadPolicy(const std::wstring& fn, Policy& policy) {
+        /* no file means no policy; an unreadable one keeps what we had. */
+        uint64_t writeTime, size;
+        if (!getFileStamp(fn, writeTime, size)) {
+            policy = Policy();
+            return true;
+        }
+
+        MappedFile file;
+        Policy loaded;
+        if (!file.open(fn) || !parsePolicy(file, loaded)) {
+            return false;
+        }
+
+        loaded.defaults = applyPolicy(loaded, loaded.defaults);
+        policy = loaded;
+        return true;
+    }
+
+    MonitorOptions applyPolicy(const Policy& policy, const MonitorOptions& options) {
+        MonitorOptions result = options;
+
+        result.opacity = std::min(std::max(result.opacity, 0.0f), policy.maximumOpacity);
+
+        /* the minimum brightness holds for the panel itself, too. */
+        if (result.backlight >= 0) {
+            int minimum = (int) ((1.0f - policy.maximumOpacity) * 100.0f + 0.5f);
+            result.backlight = std::min(std::max(result.backlight, minimum), 100);
+        }
+
+        int temperature = result.temperature;
+        if (temperature == DEFAULT_TEMPERATURE) {
+            temperature = NEUTRAL_TEMPERATURE;
+        }
+
+        if (temperature < policy.minimumTemperature) {
+            result.temperature = policy.minimumTemperature;
+        }
+        else if (temperature > policy.maximumTemperature) {
+            result.temperature = policy.maximumTemperature;
+        }
+
+        return result;
+    }
+
+    void mergeConfig(
+        const Policy& policy,
+        const Config& config,
+        ConfigSnapshot& snapshot,
+        const MergeListener& changed)
+    {
+        PROFILE_ALLOCATIONS("mergeConfig");
+
+        MonitorOptions previousDefaults = snapshot.defaults;
+        snapshot.defaults = policy.defaults;
+        snapshot.globalEnabled = config.globalEnabled;
+        snapshot.adaptiveEnabled = config.adaptiveEnabled;
+        snapshot.gammaDither = config.gammaDither;
+        snapshot.pollingEnabled = policy.pollingLocked
+            ? policy.pollingEnabled : config.pollingEnabled;
+
+        auto report = [&changed](
+            const std::wstring& id, const MonitorOptions& before, const MonitorOptions& after)
+        {
+            if (changed && !(before == after)) {
+                changed(id, before, after);
+            }
+        };
+
+        /* both maps are sorted the same way, so they're walked side by side. */
+        auto merged = snapshot.monitors.begin();
+        for (auto& entry : config.monitors) {
+            while (merged != snapshot.monitors.end() && merged->first < entry.first) {
+                report(merged->first, merged->second, snapshot.defaults);
+                merged = snapshot.monitors.erase(merged);
+            }
+
+            MonitorOptions options = applyPolicy(policy, entry.second);
+            if (merged != snapshot.monitors.end() && merged->first == entry.first) {
+                report(entry.first, merged->second, options);
+                merged->second = options;
+                ++merged;
+            }
+            else {
+                report(entry.first, previousDefaults, options);
+                snapshot.monitors.emplace_hint(merged, entry.first, options);
+            }
+        }
+
+        while (merged != snapshot.monitors.end()) {
+            report(merged->first, merged->second, snapshot.defaults);
+            merged = snapshot.monitors.erase(merged);
+        }
+    }
+}
@@ -0,0 +1,83 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Config.h"
+#include <climits>
+#include <functional>
+
+namespace dimmer {
+    /* machine-wide defaults and limits, read from policy.json under
+    %ProgramData%\dimmer. the file is maintained by administrators and is
+    never written by dimmer; the per-user config is layered on top of it. */
+    struct Policy {
+        MonitorOptions defaults; /* for monitors the user hasn't configured */
+        float maximumOpacity = 1.0f; /* 1 - "minimumBrightness" */
+        int minimumTemperature = 0;
+        int maximumTemperature = INT_MAX;
+        bool pollingLocked = false; /* "pollingEnabled" is set: the user can't change it */
+        bool pollingEnabled = false;
+    };
+
+    /* the user config merged over the policy, with every limit already
+    applied. merged again whenever either layer changes, so reads never
+    have to consult more than one place. */
+    struct ConfigSnapshot {
+        MonitorOptionsMap monitors;
+        MonitorOptions defaults;
+        bool pollingEnabled = false;
+        bool globalEnabled = true;
+        bool adaptiveEnabled = false;
+        GammaDither gammaDither = GammaDither::None;
+    };
+
+    extern bool loadPolicy(const std::wstring& fn, Policy& policy);
+    extern MonitorOptions applyPolicy(const Policy& policy, const MonitorOptions& options);
+
+    /* a monitor's merged options, before and after a merge that changed
+    them. a monitor new to the snapshot compares against the old defaults,
+    and one that dropped out of it against the new. */
+    using MergeListener = std::function<void(
+        const std::wstring& id, const MonitorOptions& before, const MonitorOptions& after)>;
+
+    /* brings the snapshot up to date with both layers, in place: monitors
+    it already has are overwritten rather than rebuilt, so a merge that
+    adds none doesn't allocate. */
+    extern void mergeConfig(
+        const Policy& policy,
+        const Config& config,
+        ConfigSnapshot& snapshot,
+        const MergeListener& changed = nullptr);
+}
@@ -0,0 +1,221 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Profile.h"
+
+#ifdef DIMMER_PROFILE_ALLOCATIONS
+
+#include "File.h"
+#include "Util.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+
+/* every block is prefixed with its size so frees can be subtracted from the
+live byte count. the prefix is padded to keep the payload maximally aligned. */
+constexpr size_t headerSize = alignof(std::max_align_t) > sizeof(size_t)
+    ? alignof(std::max_align_t) : sizeof(size_t);
+
+constexpr int maxOperations = 32;
+constexpr int maxDepth = 16;
+
+struct OperationStats {
+    const char* name;
+    std::atomic<size_t> calls;
+    std::atomic<size_t> allocations;
+    std::atomic<size_t> bytes;
+    std::atomic<size_t> peak;
+};
+
+struct ActiveScope {
+    OperationStats* stats;
+    size_t baseline;
+};
+
+/* all bookkeeping lives in fixed-size static storage; the allocator hooks
+must never allocate themselves. scopes are opened on the DevicePool's
+threads as well as the ui thread, so each thread keeps its own scope stack
+and the shared counters are atomic. */
+static OperationStats operations[maxOperations];
+static std::atomic<int> operationCount = 0;
+static std::atomic_flag registering = ATOMIC_FLAG_INIT;
+static thread_local ActiveScope scopes[maxDepth];
+static thread_local int depth = 0;
+static thread_local int overflow = 0;
+static std::atomic<size_t> liveBytes = 0;
+static OperationStats unattributed = { "(unattributed)", 0, 0, 0, 0 };
+
+static OperationStats* findOperation(const char* name) {
+    /* registration is rare, so a spin lock is enough; it can't be a mutex
+    because some of them allocate the first time they're locked. */
+    while (registering.test_and_set(std::memory_order_acquire)) {
+    }
+
+    OperationStats* result = &unattributed;
+    int count = operationCount.load(std::memory_order_relaxed);
+    for (int i = 0; i < count; i++) {
+        if (strcmp(operations[i].name, name) == 0) {
+            result = &operations[i];
+            break;
+        }
+    }
+    if (result == &unattributed && count < maxOperations) {
+        operations[count].name = name;
+        result = &operations[count];
+        operationCount.store(count + 1, std::memory_order_release);
+    }
+
+    registering.clear(std::memory_order_release);
+    return result;
+}
+
+static void raisePeak(std::atomic<size_t>& peak, size_t value) {
+    size_t current = peak.load(std::memory_order_relaxed);
+    while (value > current && !peak.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+static void recordAllocation(size_t size) {
+    size_t live = liveBytes.fetch_add(size, std::memory_order_relaxed) + size;
+
+    OperationStats* stats = depth ? scopes[depth - 1].stats : &unattributed;
+    stats->allocations.fetch_add(1, std::memory_order_relaxed);
+    stats->bytes.fetch_add(size, std::memory_order_relaxed);
+
+    /* peak is tracked relative to the live bytes at scope entry, for every
+    scope on this thread's stack, so nested operations count towards their
+    parents. live bytes are process-wide, so other threads' allocations made
+    while the scope is open count towards it too. */
+    for (int i = 0; i < depth; i++) {
+        if (live > scopes[i].baseline) {
+            raisePeak(scopes[i].stats->peak, live - scopes[i].baseline);
+        }
+    }
+}
+
+static void* allocate(size_t size) {
+    char* block = static_cast<char*>(malloc(size + headerSize));
+    if (!block) {
+        throw std::bad_alloc();
+    }
+    *reinterpret_cast<size_t*>(block) = size;
+    recordAllocation(size);
+    return block + headerSize;
+}
+
+static void release(void* ptr) {
+    if (ptr) {
+        char* block = static_cast<char*>(ptr) - headerSize;
+        liveBytes.fetch_sub(*reinterpret_cast<size_t*>(block), std::memory_order_relaxed);
+        free(block);
+    }
+}
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void operator delete(void* ptr) noexcept { release(ptr); }
+void operator delete[](void* ptr) noexcept { release(ptr); }
+void operator delete(void* ptr, size_t) noexcept { release(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { release(ptr); }
+
+namespace dimmer {
+    void beginAllocationScope(const char* operation) {
+        if (depth < maxDepth) {
+            OperationStats* stats = findOperation(operation);
+            stats->calls.fetch_add(1, std::memory_order_relaxed);
+            scopes[depth++] = { stats, liveBytes.load(std::memory_order_relaxed) };
+        }
+        else {
+            overflow++;
+        }
+    }
+
+    void endAllocationScope() {
+        if (overflow > 0) {
+            overflow--;
+        }
+        else if (depth > 0) {
+            --depth;
+        }
+    }
+
+    AllocationScope::AllocationScope(const char* operation) {
+        beginAllocationScope(operation);
+    }
+
+    AllocationScope::~AllocationScope() {
+        endAllocationScope();
+    }
+
+    void writeAllocationReport() {
+        /* snapshot first; building the report allocates, and those
+        allocations shouldn't show up in the numbers being reported. */
+        struct Snapshot {
+            const char* name;
+            size_t calls;
+            size_t allocations;
+            size_t bytes;
+            size_t peak;
+        };
+
+        Snapshot snapshot[maxOperations + 1];
+        int count = operationCount.load(std::memory_order_acquire);
+        for (int i = 0; i <= count; i++) {
+            const OperationStats& s = i < count ? operations[i] : unattributed;
+            snapshot[i] = { s.name, s.calls.load(), s.allocations.load(), s.bytes.load(), s.peak.load() };
+        }
+        count++;
+
+        std::string report;
+        char line[256];
+        snprintf(line, sizeof(line), "%-24s %8s %12s %14s %14s\n",
+            "operation", "calls", "allocations", "bytes", "peak bytes");
+        report += line;
+
+        for (int i = 0; i < count; i++) {
+            const Snapshot& s = snapshot[i];
+            snprintf(line, sizeof(line), "%-24s %8zu %12zu %14zu %14zu\n",
+                s.name, s.calls, s.allocations, s.bytes, s.peak);
+            report += line;
+        }
+
+        writeFileAtomic(getDataDirectory() + PATH_SEPARATOR + L"allocations.txt", report.data(), report.size());
+    }
+}
+
+#endif
@@ -0,0 +1,74 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+/* allocation profiling is compiled in only when DIMMER_PROFILE_ALLOCATIONS is
+defined. otherwise PROFILE_ALLOCATIONS() expands to nothing and the global
+allocator is left untouched. */
+
+#ifdef DIMMER_PROFILE_ALLOCATIONS
+
+namespace dimmer {
+    class AllocationScope {
+        public:
+            AllocationScope(const char* operation);
+            ~AllocationScope();
+
+        private:
+            AllocationScope(const AllocationScope&) = delete;
+            AllocationScope& operator=(const AllocationScope&) = delete;
+    };
+
+    extern void beginAllocationScope(const char* operation);
+    extern void endAllocationScope();
+    extern void writeAllocationReport();
+}
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_ALLOCATIONS(operation) \
+    dimmer::AllocationScope PROFILE_CONCAT(allocationScope, __LINE__)(operation)
+#define PROFILE_ALLOCATIONS_BEGIN(operation) dimmer::beginAllocationScope(operation)
+#define PROFILE_ALLOCATIONS_END() dimmer::endAllocationScope()
+#define WRITE_ALLOCATION_REPORT() dimmer::writeAllocationReport()
+
+#else
+
+#define PROFILE_ALLOCATIONS(operation)
+#define PROFILE_ALLOCATIONS_BEGIN(operation)
+#define PROFILE_ALLOCATIONS_END()
+#define WRITE_ALLOCATION_REPORT()
+
+#endif
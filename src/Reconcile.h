@@ -0,0 +1,85 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Monitor.h"
+#include <map>
+#include <string>
+#include <vector>
+
+namespace dimmer {
+    inline const Monitor* findMonitor(const std::vector<Monitor>& list, const std::wstring& id) {
+        for (auto& monitor : list) {
+            if (monitor.getId() == id) {
+                return &monitor;
+            }
+        }
+        return nullptr;
+    }
+
+    /* brings the overlays in line with the monitors that are attached now.
+    an overlay whose monitor is still there is kept and told what changed:
+    the dirty properties, plus its geometry if the monitor moved or was
+    resized. monitors without one get a new one from create(). whatever is
+    left in old belonged to monitors that are gone. */
+    template <typename Overlays, typename Create>
+    void reconcileOverlays(
+        Overlays& overlays,
+        Overlays& old,
+        const std::vector<Monitor>& previous,
+        std::vector<Monitor>& current,
+        unsigned dirty,
+        Create create)
+    {
+        for (auto& monitor : current) {
+            auto& id = monitor.getId();
+            auto it = old.find(id);
+
+            if (it != old.end()) {
+                unsigned changed = dirty;
+                auto before = findMonitor(previous, id);
+                if (!before || before->getBounds() != monitor.getBounds()) {
+                    changed |= PropertyGeometry;
+                }
+
+                it->second->apply(monitor, changed);
+                overlays[id] = it->second;
+            }
+            else {
+                overlays[id] = create(monitor);
+            }
+        }
+    }
+}
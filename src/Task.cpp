@@ -0,0 +1,403 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Task.h"
+#include <algorithm>
+#include <exception>
+
+#ifdef _WIN32
+#include <dwmapi.h>
+#pragma comment(lib, "dwmapi.lib")
+#else
+#include <thread>
+#endif
+
+using namespace dimmer;
+
+constexpr uint32_t defaultFrameMs = 16;
+
+static Signal displayChangedSignal;
+
+/* Task */
+
+Task Task::promise_type::get_return_object() {
+    return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+}
+
+void Task::promise_type::unhandled_exception() {
+    std::terminate();
+}
+
+std::coroutine_handle<> Task::promise_type::FinalAwaiter::await_suspend(
+    std::coroutine_handle<promise_type> handle) noexcept
+{
+    /* stays suspended at the end, so the Task can still see that it's done;
+    whoever was awaiting it carries on from here. */
+    auto continuation = handle.promise().continuation;
+    return continuation ? continuation : std::noop_coroutine();
+}
+
+Task::Task()
+: handle(nullptr) {
+}
+
+Task::Task(std::coroutine_handle<promise_type> handle)
+: handle(handle) {
+}
+
+Task::Task(Task&& other)
+: handle(other.handle) {
+    other.handle = nullptr;
+}
+
+Task& Task::operator=(Task&& other) {
+    if (this != &other) {
+        if (this->handle) {
+            this->handle.destroy();
+        }
+        this->handle = other.handle;
+        other.handle = nullptr;
+    }
+    return *this;
+}
+
+Task::~Task() {
+    if (this->handle) {
+        this->handle.destroy();
+    }
+}
+
+bool Task::done() const {
+    return !this->handle || this->handle.done();
+}
+
+bool Task::await_ready() const {
+    return this->done();
+}
+
+void Task::await_suspend(std::coroutine_handle<> awaiting) {
+    this->handle.promise().continuation = awaiting;
+}
+
+/* Delay */
+
+Delay::Delay(uint32_t delayMs, uint32_t slackMs)
+: delayMs(delayMs)
+, slackMs(slackMs)
+, loop(nullptr)
+, timer(0) {
+}
+
+Delay::Delay(Delay&& other)
+: delayMs(other.delayMs)
+, slackMs(other.slackMs)
+, loop(other.loop)
+, timer(other.timer) {
+    other.timer = 0;
+}
+
+Delay::~Delay() {
+    /* only still set if the coroutine was destroyed while waiting. */
+    if (this->timer) {
+        this->loop->cancel(this->timer);
+    }
+}
+
+bool Delay::await_suspend(std::coroutine_handle<> handle) {
+    this->loop = EventLoop::current();
+    if (!this->loop) {
+        return false;
+    }
+
+    this->timer = this->loop->schedule(this->delayMs, [this, handle]() {
+        this->timer = 0;
+        handle.resume();
+    }, this->slackMs);
+
+    return true;
+}
+
+/* Signal */
+
+Signal::Awaiter::Awaiter(Signal& signal)
+: signal(&signal)
+, handle(nullptr)
+, generation(0)
+, timed(false)
+, notified(false)
+, timeoutMs(0)
+, slackMs(0)
+, loop(nullptr)
+, timer(0) {
+}
+
+Signal::Awaiter::Awaiter(Signal& signal, uint32_t timeoutMs, uint32_t slackMs)
+: signal(&signal)
+, handle(nullptr)
+, generation(0)
+, timed(true)
+, notified(false)
+, timeoutMs(timeoutMs)
+, slackMs(slackMs)
+, loop(nullptr)
+, timer(0) {
+}
+
+Signal::Awaiter::Awaiter(Awaiter&& other)
+: signal(other.signal)
+, handle(nullptr)
+, generation(0)
+, timed(other.timed)
+, notified(false)
+, timeoutMs(other.timeoutMs)
+, slackMs(other.slackMs)
+, loop(nullptr)
+, timer(0) {
+}
+
+Signal::Awaiter::~Awaiter() {
+    if (this->signal && this->handle) {
+        auto& waiters = this->signal->waiters;
+        waiters.erase(std::remove(waiters.begin(), waiters.end(), this), waiters.end());
+    }
+    if (this->timer) {
+        this->loop->cancel(this->timer);
+    }
+}
+
+bool Signal::Awaiter::await_suspend(std::coroutine_handle<> handle) {
+    if (!this->signal) {
+        return false;
+    }
+
+    /* like a Delay, a timeout without a loop is already over. */
+    if (this->timed) {
+        this->loop = EventLoop::current();
+        if (!this->loop) {
+            return false;
+        }
+
+        this->timer = this->loop->schedule(this->timeoutMs, [this]() {
+            this->timer = 0;
+            this->expire();
+        }, this->slackMs);
+    }
+
+    this->handle = handle;
+    this->generation = this->signal->generation;
+    this->signal->waiters.push_back(this);
+    return true;
+}
+
+void Signal::Awaiter::expire() {
+    if (this->signal) {
+        auto& waiters = this->signal->waiters;
+        waiters.erase(std::remove(waiters.begin(), waiters.end(), this), waiters.end());
+        this->signal = nullptr;
+    }
+    this->handle.resume();
+}
+
+Signal::Signal()
+: generation(0)
+, scheduled(false) {
+}
+
+Signal::Awaiter Signal::wait(uint32_t timeoutMs, uint32_t slackMs) {
+    return Awaiter(*this, timeoutMs, slackMs);
+}
+
+Signal::~Signal() {
+    for (auto waiter : this->waiters) {
+        waiter->signal = nullptr;
+    }
+}
+
+void Signal::notify() {
+    /* a burst of notifications before the loop gets around to it only
+    resumes everyone once. */
+    this->generation++;
+    auto loop = EventLoop::current();
+    if (loop && !this->scheduled) {
+        this->scheduled = true;
+        loop->post([this]() {
+            this->scheduled = false;
+            this->resumeWaiters(this->generation);
+        });
+    }
+}
+
+void Signal::resumeWaiters(uint64_t generation) {
+    /* resuming one waiter may destroy or add others, so the list is searched
+    again each time. coroutines that start waiting again from here are left
+    for the next notification. */
+    for (;;) {
+        auto it = std::find_if(this->waiters.begin(), this->waiters.end(),
+            [generation](Awaiter* waiter) { return waiter->generation < generation; });
+
+        if (it == this->waiters.end()) {
+            return;
+        }
+
+        Awaiter* waiter = *it;
+        this->waiters.erase(it);
+        waiter->signal = nullptr;
+        waiter->notified = true;
+        if (waiter->timer) {
+            waiter->loop->cancel(waiter->timer);
+            waiter->timer = 0;
+        }
+        waiter->handle.resume();
+    }
+}
+
+/* ThreadPoolAwaiter */
+
+struct ThreadPoolAwaiter::State {
+    std::function<void()> work;
+    std::coroutine_handle<> handle;
+    EventLoop* loop;
+    bool alive;
+};
+
+ThreadPoolAwaiter::ThreadPoolAwaiter(std::function<void()> work)
+: state(std::make_shared<State>()) {
+    this->state->work = work;
+    this->state->loop = nullptr;
+    this->state->alive = true;
+}
+
+ThreadPoolAwaiter::ThreadPoolAwaiter(ThreadPoolAwaiter&& other)
+: state(std::move(other.state)) {
+}
+
+ThreadPoolAwaiter::~ThreadPoolAwaiter() {
+    /* a result arriving after this point has nobody left to resume. */
+    if (this->state) {
+        this->state->alive = false;
+    }
+}
+
+bool ThreadPoolAwaiter::await_suspend(std::coroutine_handle<> handle) {
+    this->state->handle = handle;
+    this->state->loop = EventLoop::current();
+
+    if (!this->state->loop) {
+        this->state->work();
+        return false;
+    }
+
+    auto shared = new std::shared_ptr<State>(this->state);
+
+#ifdef _WIN32
+    auto callback = [](PTP_CALLBACK_INSTANCE, void* context) {
+        run((std::shared_ptr<State>*) context);
+    };
+
+    if (!TrySubmitThreadpoolCallback(callback, shared, nullptr)) {
+        delete shared;
+        this->state->work();
+        return false;
+    }
+#else
+    std::thread([shared]() {
+        run(shared);
+    }).detach();
+#endif
+
+    return true;
+}
+
+void ThreadPoolAwaiter::run(std::shared_ptr<State>* context) {
+    std::shared_ptr<State> state = *context;
+    delete context;
+
+    state->work();
+
+    /* alive is only ever touched on the loop's thread. */
+    state->loop->post([state]() {
+        if (state->alive) {
+            state->handle.resume();
+        }
+    });
+}
+
+/* awaitables */
+
+static uint32_t untilNextFrame() {
+#ifdef _WIN32
+    DWM_TIMING_INFO timing = {};
+    timing.cbSize = sizeof(timing);
+
+    LARGE_INTEGER now, frequency;
+    if (SUCCEEDED(DwmGetCompositionTimingInfo(nullptr, &timing)) &&
+        timing.qpcRefreshPeriod &&
+        QueryPerformanceCounter(&now) &&
+        QueryPerformanceFrequency(&frequency))
+    {
+        /* the last vblank may be reported a little ahead of now. */
+        int64_t period = (int64_t) timing.qpcRefreshPeriod;
+        int64_t elapsed = ((now.QuadPart - (int64_t) timing.qpcVBlank) % period + period) % period;
+        int64_t remaining = period - elapsed;
+        return (uint32_t) ((remaining * 1000 + frequency.QuadPart - 1) / frequency.QuadPart);
+    }
+#endif
+    return defaultFrameMs;
+}
+
+namespace dimmer {
+    Delay delay(uint32_t delayMs, uint32_t slackMs) {
+        return Delay(delayMs, slackMs);
+    }
+
+    Delay nextFrame() {
+        return Delay(untilNextFrame(), 0);
+    }
+
+    Signal::Awaiter displayChanged() {
+        return Signal::Awaiter(displayChangedSignal);
+    }
+
+    Signal::Awaiter displayChanged(uint32_t timeoutMs, uint32_t slackMs) {
+        return displayChangedSignal.wait(timeoutMs, slackMs);
+    }
+
+    void notifyDisplayChanged() {
+        displayChangedSignal.notify();
+    }
+
+    ThreadPoolAwaiter onThreadPool(std::function<void()> work) {
+        return ThreadPoolAwaiter(work);
+    }
+}
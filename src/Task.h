@@ -0,0 +1,189 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <coroutine>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "EventLoop.h"
+
+namespace dimmer {
+    /* a coroutine that starts running as soon as it is called, and suspends
+    only at co_await. everything it awaits resumes it on the thread running
+    the EventLoop, so the code between awaits never needs locking.
+
+    destroying the Task destroys the coroutine wherever it is suspended,
+    which cancels whatever it was waiting for. a Task may itself be awaited
+    by another Task. */
+    class Task {
+        public:
+            struct promise_type {
+                struct FinalAwaiter {
+                    bool await_ready() noexcept { return false; }
+                    std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept;
+                    void await_resume() noexcept { }
+                };
+
+                Task get_return_object();
+                std::suspend_never initial_suspend() noexcept { return { }; }
+                FinalAwaiter final_suspend() noexcept { return { }; }
+                void return_void() { }
+                void unhandled_exception();
+
+                std::coroutine_handle<> continuation;
+            };
+
+            Task();
+            Task(Task&& other);
+            Task& operator=(Task&& other);
+            ~Task();
+
+            bool done() const;
+
+            bool await_ready() const;
+            void await_suspend(std::coroutine_handle<> awaiting);
+            void await_resume() { }
+
+        private:
+            Task(const Task&) = delete;
+            Task& operator=(const Task&) = delete;
+
+            explicit Task(std::coroutine_handle<promise_type> handle);
+
+            std::coroutine_handle<promise_type> handle;
+    };
+
+    /* resumes after delayMs, give or take slackMs, through the current
+    thread's EventLoop. without a loop it doesn't suspend at all. */
+    class Delay {
+        public:
+            Delay(uint32_t delayMs, uint32_t slackMs);
+            Delay(Delay&& other);
+            ~Delay();
+
+            bool await_ready() const { return false; }
+            bool await_suspend(std::coroutine_handle<> handle);
+            void await_resume() { }
+
+        private:
+            uint32_t delayMs;
+            uint32_t slackMs;
+            EventLoop* loop;
+            EventLoop::Id timer;
+    };
+
+    /* resumes everything waiting on it, from the EventLoop, some time after
+    notify() is called. notifications made while nobody is waiting are not
+    remembered.
+
+    a wait may also be given a timeout, which races the notification
+    against a timer on the EventLoop: co_await then yields true if it was
+    notified and false if the time ran out first. */
+    class Signal {
+        public:
+            class Awaiter {
+                public:
+                    explicit Awaiter(Signal& signal);
+                    Awaiter(Signal& signal, uint32_t timeoutMs, uint32_t slackMs);
+                    Awaiter(Awaiter&& other);
+                    ~Awaiter();
+
+                    bool await_ready() const { return false; }
+                    bool await_suspend(std::coroutine_handle<> handle);
+                    bool await_resume() const { return this->notified; }
+
+                private:
+                    friend class Signal;
+
+                    void expire();
+
+                    Signal* signal;
+                    std::coroutine_handle<> handle;
+                    uint64_t generation;
+                    bool timed;
+                    bool notified;
+                    uint32_t timeoutMs;
+                    uint32_t slackMs;
+                    EventLoop* loop;
+                    EventLoop::Id timer;
+            };
+
+            Signal();
+            ~Signal();
+
+            Awaiter operator co_await() { return Awaiter(*this); }
+            Awaiter wait(uint32_t timeoutMs, uint32_t slackMs = 0);
+            void notify();
+
+        private:
+            Signal(const Signal&) = delete;
+            Signal& operator=(const Signal&) = delete;
+
+            void resumeWaiters(uint64_t generation);
+
+            std::vector<Awaiter*> waiters;
+            uint64_t generation;
+            bool scheduled;
+    };
+
+    /* runs work on a pool thread, then resumes on the EventLoop. the work
+    can't be cancelled once it has started: if the Task may be destroyed
+    in the meantime, the work must not touch the coroutine's locals. */
+    class ThreadPoolAwaiter {
+        public:
+            explicit ThreadPoolAwaiter(std::function<void()> work);
+            ThreadPoolAwaiter(ThreadPoolAwaiter&& other);
+            ~ThreadPoolAwaiter();
+
+            bool await_ready() const { return false; }
+            bool await_suspend(std::coroutine_handle<> handle);
+            void await_resume() { }
+
+        private:
+            struct State;
+            static void run(std::shared_ptr<State>* state);
+
+            std::shared_ptr<State> state;
+    };
+
+    extern Delay delay(uint32_t delayMs, uint32_t slackMs = 0);
+    extern Delay nextFrame();
+    extern Signal::Awaiter displayChanged();
+    extern Signal::Awaiter displayChanged(uint32_t timeoutMs, uint32_t slackMs = 0);
+    extern void notifyDisplayChanged();
+    extern ThreadPoolAwaiter onThreadPool(std::function<void()> work);
+}
@@ -0,0 +1,293 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "TimerWheel.h"
+
+using namespace dimmer;
+
+static int lowestBit(uint64_t value) {
+    static const int table[64] = {
+        0, 1, 48, 2, 57, 49, 28, 3, 61, 58, 50, 42, 38, 29, 17, 4,
+        62, 55, 59, 36, 53, 51, 43, 22, 45, 39, 33, 30, 24, 18, 12, 5,
+        63, 47, 56, 27, 60, 41, 37, 16, 54, 35, 52, 21, 44, 32, 23, 11,
+        46, 26, 40, 15, 34, 20, 31, 10, 25, 14, 19, 9, 13, 8, 7, 6
+    };
+    return table[((value & (~value + 1)) * 0x03f79d71b4cb0a89ull) >> 58];
+}
+
+static int highestBit(uint64_t value) {
+    int result = 0;
+    for (int shift = 32; shift > 0; shift >>= 1) {
+        if (value >> shift) {
+            value >>= shift;
+            result += shift;
+        }
+    }
+    return result;
+}
+
+TimerWheel::TimerWheel(uint64_t now)
+: current(now)
+, count(0) {
+    for (auto& head : this->heads) {
+        head = none;
+    }
+    for (auto& bits : this->occupied) {
+        bits = 0;
+    }
+}
+
+uint64_t TimerWheel::coalesce(uint64_t deadline, uint32_t slack) {
+    /* round up to the coarsest power of two that still lands in the window;
+    everything else with an overlapping window rounds to the same tick. */
+    for (int bit = highestBit((uint64_t) slack); slack && bit > 0; bit--) {
+        uint64_t mask = (1ull << bit) - 1;
+        uint64_t rounded = (deadline + mask) & ~mask;
+        if (rounded - deadline <= slack) {
+            return rounded;
+        }
+    }
+    return deadline;
+}
+
+uint32_t TimerWheel::allocate() {
+    if (!this->freeList.empty()) {
+        uint32_t index = this->freeList.back();
+        this->freeList.pop_back();
+        return index;
+    }
+
+    Timer timer = {};
+    timer.state = State::Free;
+    this->timers.push_back(timer);
+    return (uint32_t) this->timers.size() - 1;
+}
+
+void TimerWheel::release(uint32_t index) {
+    Timer& timer = this->timers[index];
+    timer.callback = nullptr;
+    timer.state = State::Free;
+    timer.generation++; /* invalidates outstanding ids */
+    this->freeList.push_back(index);
+    this->count--;
+}
+
+void TimerWheel::link(uint32_t index) {
+    Timer& timer = this->timers[index];
+
+    /* a timer lives on the level of the highest digit in which its deadline
+    differs from the current time, in the slot given by that digit. */
+    if (timer.deadline <= this->current) {
+        timer.deadline = this->current + 1;
+    }
+
+    int level = highestBit(timer.deadline ^ this->current) / levelBits;
+    int slot = (int) ((timer.deadline >> (level * levelBits)) & (slotsPerLevel - 1));
+    uint16_t bucket = overflow;
+    if (level < levels) {
+        bucket = (uint16_t) (level * slotsPerLevel + slot);
+        this->occupied[level] |= 1ull << slot;
+    }
+
+    timer.slot = bucket;
+    timer.prev = none;
+    timer.next = this->heads[bucket];
+    if (timer.next != none) {
+        this->timers[timer.next].prev = index;
+    }
+    this->heads[bucket] = index;
+    timer.state = State::Linked;
+}
+
+void TimerWheel::unlink(uint32_t index) {
+    Timer& timer = this->timers[index];
+
+    if (timer.prev != none) {
+        this->timers[timer.prev].next = timer.next;
+    }
+    else {
+        this->heads[timer.slot] = timer.next;
+        if (timer.next == none && timer.slot != overflow) {
+            this->occupied[timer.slot / slotsPerLevel] &= ~(1ull << (timer.slot % slotsPerLevel));
+        }
+    }
+
+    if (timer.next != none) {
+        this->timers[timer.next].prev = timer.prev;
+    }
+}
+
+TimerWheel::Id TimerWheel::schedule(uint64_t deadline, uint32_t slack, uint32_t interval, Callback callback) {
+    uint32_t index = this->allocate();
+    Timer& timer = this->timers[index];
+    timer.callback = std::move(callback);
+    timer.deadline = coalesce(deadline, slack);
+    timer.interval = interval;
+    timer.slack = slack;
+    this->count++;
+    this->link(index);
+    return ((Id) timer.generation << 32) | (index + 1);
+}
+
+bool TimerWheel::cancel(Id id) {
+    uint32_t index = (uint32_t) id - 1;
+    if (id == 0 || index >= this->timers.size()) {
+        return false;
+    }
+
+    Timer& timer = this->timers[index];
+    if (timer.generation != (uint32_t) (id >> 32)) {
+        return false;
+    }
+
+    if (timer.state == State::Linked) {
+        this->unlink(index);
+        this->release(index);
+        return true;
+    }
+
+    if (timer.state == State::Firing) {
+        timer.state = State::Cancelled; /* released once its callback returns */
+        return true;
+    }
+
+    return false;
+}
+
+bool TimerWheel::nextEvent(int& level, int& slot, uint64_t& time) const {
+    /* the first occupied slot past the current digit, on the lowest level
+    that has one, is always the next thing to happen. */
+    for (level = 0; level < levels; level++) {
+        int digit = (int) ((this->current >> (level * levelBits)) & (slotsPerLevel - 1));
+        uint64_t pending = (digit == slotsPerLevel - 1)
+            ? 0 : this->occupied[level] & (~0ull << (digit + 1));
+
+        if (pending) {
+            slot = lowestBit(pending);
+            int shift = (level + 1) * levelBits;
+            time = (this->current >> shift << shift) | ((uint64_t) slot << (level * levelBits));
+            return true;
+        }
+    }
+
+    /* the overflow list is revisited each time the top level wraps. */
+    if (this->heads[overflow] != none) {
+        int shift = levels * levelBits;
+        slot = 0;
+        time = ((this->current >> shift) + 1) << shift;
+        return true;
+    }
+
+    return false;
+}
+
+uint64_t TimerWheel::nextDeadline() const {
+    int level, slot;
+    uint64_t time;
+    if (!this->nextEvent(level, slot, time)) {
+        return UINT64_MAX;
+    }
+
+    /* every later slot starts after this one's range ends, so the earliest
+    deadline is in here. */
+    uint64_t result = UINT64_MAX;
+    for (uint32_t i = this->heads[level * slotsPerLevel + slot]; i != none; i = this->timers[i].next) {
+        if (this->timers[i].deadline < result) {
+            result = this->timers[i].deadline;
+        }
+    }
+    return result;
+}
+
+void TimerWheel::advance(uint64_t now) {
+    /* first move time forward, collecting everything that's due and pushing
+    the rest down the levels. callbacks only run afterwards, so they are
+    free to schedule and cancel. */
+    int level, slot;
+    uint64_t time;
+    while (this->nextEvent(level, slot, time) && time <= now) {
+        this->current = time;
+
+        uint16_t bucket = (uint16_t) (level * slotsPerLevel + slot);
+        uint32_t index = this->heads[bucket];
+        this->heads[bucket] = none;
+        if (level < levels) {
+            this->occupied[level] &= ~(1ull << slot);
+        }
+
+        while (index != none) {
+            uint32_t next = this->timers[index].next;
+            if (this->timers[index].deadline == time) {
+                this->timers[index].state = State::Firing;
+                this->due.push_back(index);
+            }
+            else {
+                this->link(index);
+            }
+            index = next;
+        }
+    }
+
+    if (now > this->current) {
+        this->current = now;
+    }
+
+    /* repeating timers are re-armed from now rather than from their old
+    deadline, so a long stall doesn't turn into a burst of catch-up calls. */
+    std::vector<uint32_t> firing;
+    firing.swap(this->due);
+
+    for (uint32_t index : firing) {
+        Callback callback;
+        if (this->timers[index].state == State::Firing) {
+            callback = std::move(this->timers[index].callback);
+            callback();
+        }
+
+        Timer& timer = this->timers[index]; /* callbacks may have grown the pool */
+        if (timer.state == State::Firing && timer.interval) {
+            timer.callback = std::move(callback);
+            timer.deadline = coalesce(this->current + timer.interval, timer.slack);
+            this->link(index);
+        }
+        else {
+            this->release(index);
+        }
+    }
+
+    firing.clear();
+    if (this->due.empty()) {
+        this->due.swap(firing); /* keep the capacity for next time */
+    }
+}
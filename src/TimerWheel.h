@@ -0,0 +1,112 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace dimmer {
+    /* a hierarchical timing wheel with millisecond resolution: 6 levels of
+    64 slots each, covering ~795 days, plus an overflow list for anything
+    further out. scheduling and cancelling are O(1); timers move down a
+    level at most once per level on their way to firing.
+
+    the wheel has no clock of its own. the owner passes the current time to
+    advance(), which makes it usable with a virtual clock.
+
+    every timer may be given some slack: its deadline is then moved to the
+    most "round" millisecond within [deadline, deadline + slack], so timers
+    with overlapping windows end up firing together in a single wakeup. */
+    class TimerWheel {
+        public:
+            using Callback = std::function<void()>;
+            using Id = uint64_t; /* 0 is never a valid id */
+
+            explicit TimerWheel(uint64_t now = 0);
+
+            /* deadlines at or before the last advance() fire on the next one.
+            a non-zero interval makes the timer repeat, interval ms after each
+            time it fires, until cancelled. */
+            Id schedule(uint64_t deadline, uint32_t slack, uint32_t interval, Callback callback);
+
+            /* safe to call with stale ids, and from inside callbacks. */
+            bool cancel(Id id);
+
+            /* fires every timer whose deadline is <= now, in deadline order. */
+            void advance(uint64_t now);
+
+            /* the earliest pending deadline, or UINT64_MAX if there is none. */
+            uint64_t nextDeadline() const;
+
+            size_t size() const { return this->count; }
+
+        private:
+            static constexpr int levelBits = 6;
+            static constexpr int slotsPerLevel = 1 << levelBits;
+            static constexpr int levels = 6;
+            static constexpr uint32_t none = UINT32_MAX;
+            static constexpr uint16_t overflow = levels * slotsPerLevel;
+
+            enum class State : uint8_t { Free, Linked, Firing, Cancelled };
+
+            struct Timer {
+                Callback callback;
+                uint64_t deadline;
+                uint32_t interval;
+                uint32_t slack;
+                uint32_t generation;
+                uint32_t prev;
+                uint32_t next;
+                uint16_t slot;
+                State state;
+            };
+
+            uint32_t allocate();
+            void release(uint32_t index);
+            void link(uint32_t index);
+            void unlink(uint32_t index);
+            bool nextEvent(int& level, int& slot, uint64_t& time) const;
+            static uint64_t coalesce(uint64_t deadline, uint32_t slack);
+
+            uint64_t current;
+            size_t count;
+            std::vector<Timer> timers;
+            std::vector<uint32_t> freeList;
+            std::vector<uint32_t> due;
+            uint32_t heads[levels * slotsPerLevel + 1];
+            uint64_t occupied[levels];
+    };
+}
@@ -33,7 +33,11 @@
 //////////////////////////////////////////////////////////////////////////////
 
 #include "TrayMenu.h"
+#include "MenuModel.h"
 #include "Monitor.h"
+#include "Profile.h"
+#include "Config.h"
+#include "Overlay.h"
 #include "resource.h"
 #include <Commdlg.h>
 #include <CommCtrl.h>
@@ -41,22 +45,11 @@
 #include <map>
 #include <memory>
 #include <algorithm>
+#include <cmath>
 
 using namespace dimmer;
 
 #define WM_TRAYICON (WM_USER + 2000)
-#define MENU_ID_EXIT 500
-#define MENU_ID_POLL 501
-#define MENU_ID_ENABLED 502
-#define MENU_ID_MONITOR_BASE 1000
-#define MENU_ID_MONITOR_USER 100
-#define MENU_ID_MONITOR_COLOR 1
-
-#define MENU_ID_DEFAULTK (MENU_ID_MONITOR_USER + 1)
-#define MENU_ID_4500K (MENU_ID_MONITOR_USER + 2)
-#define MENU_ID_5000K (MENU_ID_MONITOR_USER + 3)
-#define MENU_ID_5500K (MENU_ID_MONITOR_USER + 4)
-#define MENU_ID_6000K (MENU_ID_MONITOR_USER + 5)
 
 constexpr wchar_t version[] = L"v0.3";
 constexpr wchar_t className[] = L"DimmerTrayMenuClass";
@@ -74,73 +67,61 @@ struct ColorProcContext {
     CHOOSECOLOR* data;
 };
 
-static UINT checked(int temp, int value) {
-    return (temp == value) ? MF_CHECKED : MF_UNCHECKED;
-}
-
 static void refocus(HWND hwnd) {
     BringWindowToTop(hwnd);
     SetForegroundWindow(hwnd);
     SetFocus(hwnd);
 }
 
-static HMENU createMenu(HWND hwnd) {
-    if (menu) {
-        DestroyMenu(menu);
+/* the name and version, then a line for each display whose color
+temperature had to be trimmed before windows would take it. */
+static std::wstring tooltipText() {
+    std::wstring text = std::wstring(L"dimmer") + L" - " + std::wstring(version);
+
+    for (auto& it : getTrimmedGammaRamps()) {
+        const wchar_t* name = it.first.c_str();
+        if (wcsncmp(name, L"\\\\.\\", 4) == 0) {
+            name += 4;
+        }
+
+        int levels = (int) std::ceil(it.second.maximumClamp);
+        text += L"\n" + std::wstring(name) + L": color limited by " + std::to_wstring(levels) + L" levels";
     }
 
-    menu = CreatePopupMenu();
+    return text;
+}
+
+static void appendItems(HMENU target, const std::vector<MenuItem>& items) {
+    for (auto& item : items) {
+        UINT flags =
+            ((item.flags & MenuItem::Checked) ? MF_CHECKED : MF_UNCHECKED) |
+            ((item.flags & MenuItem::Grayed) ? MF_GRAYED : 0) |
+            ((item.flags & MenuItem::Disabled) ? MF_DISABLED : 0) |
+            ((item.flags & MenuItem::Separator) ? MF_SEPARATOR : 0);
 
-    auto monitors = queryMonitors();
-    int i = 1;
-    for (auto m : monitors) {
-        const int checkedValue = (int) round(getMonitorOpacity(m) * 100.0f);
-        UINT_PTR baseId = (MENU_ID_MONITOR_BASE * i++);
-
-        /* "brightness" submenu */
-        HMENU brightnessMenu = CreatePopupMenu();
-        UINT_PTR menuId;
-        for (int j = 0; j < 10; j++) {
-            const int currentValue = j * 10;
-
-            const std::wstring title = (j == 0)
-                ? L"full brightness"
-                : std::to_wstring(100 - currentValue) + L"%";
-
-            UINT flags = (currentValue == checkedValue) ? MF_CHECKED : 0;
-            menuId = baseId + (j * 10);
-            AppendMenu(brightnessMenu, flags, menuId, title.c_str());
+        if (item.children.empty()) {
+            AppendMenu(target, flags, item.id, item.title.c_str());
+        }
+        else {
+            HMENU submenu = CreatePopupMenu();
+            appendItems(submenu, item.children);
+            AppendMenu(target, flags | MF_POPUP, reinterpret_cast<UINT_PTR>(submenu), item.title.c_str());
         }
+    }
+}
 
-        /* "temperature" submenu */
-        HMENU tempMenu = CreatePopupMenu();
-        const int currentTemp = getMonitorTemperature(m);
-        AppendMenu(tempMenu, checked(currentTemp, -1), baseId + MENU_ID_DEFAULTK, L"default");
-        AppendMenu(tempMenu, checked(currentTemp, 4500), baseId + MENU_ID_4500K, L"4500k");
-        AppendMenu(tempMenu, checked(currentTemp, 5000), baseId + MENU_ID_5000K, L"5000k");
-        AppendMenu(tempMenu, checked(currentTemp, 5500), baseId + MENU_ID_5500K, L"5500k");
-        AppendMenu(tempMenu, checked(currentTemp, 6000), baseId + MENU_ID_6000K, L"6000k");
-
-        /* brightness, temperature popup */
-        HMENU brightTempMenu = CreatePopupMenu();
-        AppendMenu(brightTempMenu, MF_POPUP, (UINT_PTR) brightnessMenu, L"brightness");
-        AppendMenu(brightTempMenu, MF_POPUP, (UINT_PTR) tempMenu, L"temperature");
-
-        /* main menu */
-        UINT submenuEnabled = isDimmerEnabled() ? MF_ENABLED : MF_DISABLED;
-        AppendMenu(
-            menu,
-            MF_POPUP | submenuEnabled,
-            reinterpret_cast<UINT_PTR>(brightTempMenu),
-            m.getName().c_str());
+static HMENU createMenu(HWND hwnd) {
+    PROFILE_ALLOCATIONS("createMenu");
+
+    if (menu) {
+        DestroyMenu(menu);
     }
 
-    bool poll = isPollingEnabled();
-    AppendMenu(menu, MF_SEPARATOR, 0, L"-");
-    AppendMenu(menu, isDimmerEnabled() ? MF_CHECKED : MF_UNCHECKED, MENU_ID_ENABLED, L"enabled");
-    AppendMenu(menu, poll ? MF_CHECKED : MF_UNCHECKED, MENU_ID_POLL, L"dim popups");
-    AppendMenu(menu, MF_SEPARATOR, 0, L"-");
-    AppendMenu(menu, 0, MENU_ID_EXIT, L"exit");
+    std::vector<MenuItem> items;
+    buildMenuModel(queryMonitors(), items);
+
+    menu = CreatePopupMenu();
+    appendItems(menu, items);
     return menu;
 }
 
@@ -211,16 +192,23 @@ void TrayMenu::initIcon() {
     this->iconData.uCallbackMessage = WM_TRAYICON;
     this->iconData.hIcon = trayIcon;
 
-    static const std::wstring title =
-        std::wstring(L"dimmer") + L" - " + std::wstring(version);
-
-    ::wcscpy_s(this->iconData.szTip, 255, title.c_str());
+    this->tooltip = tooltipText();
+    ::wcsncpy_s(this->iconData.szTip, _countof(this->iconData.szTip), this->tooltip.c_str(), _TRUNCATE);
 
     Shell_NotifyIcon(NIM_ADD, &this->iconData);
     this->iconData.uVersion = NOTIFYICON_VERSION;
     Shell_NotifyIcon(NIM_SETVERSION, &this->iconData);
 }
 
+void TrayMenu::updateTooltip() {
+    std::wstring text = tooltipText();
+    if (text != this->tooltip) {
+        this->tooltip = text;
+        ::wcsncpy_s(this->iconData.szTip, _countof(this->iconData.szTip), text.c_str(), _TRUNCATE);
+        Shell_NotifyIcon(NIM_MODIFY, &this->iconData);
+    }
+}
+
 void TrayMenu::setPopupMenuChangedCallback(PopupMenuChanged callback) {
     this->popupMenuChanged = callback;
 }
@@ -237,7 +225,6 @@ LRESULT CALLBACK TrayMenu::windowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM
                     if (monitors.size() > index) {
                         auto monitor = monitors[index];
                         setMonitorEnabled(monitor, !isMonitorEnabled(monitor));
-                        instance->monitorsChanged();
                         refocus(hwnd);
                         instance->middleFlags |= MiddleProcessed;
                     }
@@ -251,6 +238,13 @@ LRESULT CALLBACK TrayMenu::windowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM
             auto instance = hwndToInstance.find(hwnd)->second;
             auto type = LOWORD(lParam);
 
+            /* the shell shows the tooltip as the pointer comes to rest,
+            so it's brought up to date on the way there. */
+            if (type == WM_MOUSEMOVE) {
+                instance->updateTooltip();
+                return 1;
+            }
+
             if (type == WM_MBUTTONDOWN) {
                 if (instance->popupMenuChanged) {
                     instance->popupMenuChanged(true);
@@ -264,7 +258,6 @@ LRESULT CALLBACK TrayMenu::windowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM
             if (type == WM_MBUTTONUP) {
                 if ((instance->middleFlags & MiddleProcessed) == 0) {
                     setDimmerEnabled(!isDimmerEnabled());
-                    instance->notify();
                 }
                 else {
                     if (instance->popupMenuChanged) {
@@ -307,6 +300,19 @@ LRESULT CALLBACK TrayMenu::windowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM
                 else if (id == MENU_ID_ENABLED) {
                     setDimmerEnabled(!isDimmerEnabled());
                 }
+                else if (id == MENU_ID_ADAPTIVE) {
+                    setAdaptiveEnabled(!isAdaptiveEnabled());
+                }
+                else if (id >= MENU_ID_DITHER_NONE && id <= MENU_ID_DITHER_TEMPORAL) {
+                    setGammaDither((GammaDither) (id - MENU_ID_DITHER_NONE));
+                }
+                else if (id >= MENU_ID_PRESET_BASE && id <= MENU_ID_PRESET_MAX) {
+                    auto presets = getPresetNames();
+                    size_t index = id - MENU_ID_PRESET_BASE;
+                    if (presets.size() > index) {
+                        applyPreset(presets[index]);
+                    }
+                }
                 else if (id >= MENU_ID_MONITOR_BASE) {
                     auto index = (id / MENU_ID_MONITOR_BASE) - 1;
                     auto monitors = queryMonitors();
@@ -315,9 +321,10 @@ LRESULT CALLBACK TrayMenu::windowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM
                         auto monitor = monitors[index];
                         auto value = id - (MENU_ID_MONITOR_BASE * (index + 1));
 
-                        if (value >= MENU_ID_DEFAULTK && value <= MENU_ID_6000K) {
+                        if (value >= MENU_ID_DEFAULTK && value <= MENU_ID_4000K) {
                             int temperature = -1;
                             switch (value) {
+                                case MENU_ID_4000K: temperature = 4000; break;
                                 case MENU_ID_4500K: temperature = 4500; break;
                                 case MENU_ID_5000K: temperature = 5000; break;
                                 case MENU_ID_5500K: temperature = 5500; break;
@@ -325,6 +332,16 @@ LRESULT CALLBACK TrayMenu::windowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM
                             }
                             setMonitorTemperature(monitor, temperature);
                         }
+                        else if (value >= MENU_ID_BACKLIGHT_BASE && value <= MENU_ID_BACKLIGHT_HYBRID) {
+                            int backlight = (int) (value - MENU_ID_BACKLIGHT_BASE) * 10;
+                            if (value == MENU_ID_BACKLIGHT_NONE) {
+                                backlight = DEFAULT_BACKLIGHT;
+                            }
+                            else if (value == MENU_ID_BACKLIGHT_HYBRID) {
+                                backlight = HYBRID_BACKLIGHT;
+                            }
+                            setMonitorBacklight(monitor, backlight);
+                        }
                         else if (id >= MENU_ID_MONITOR_BASE) {
                             /* if above MENU_ID_MONITOR_USER it's not one of the % toggles */
                             if (value < MENU_ID_MONITOR_USER) {
@@ -335,8 +352,6 @@ LRESULT CALLBACK TrayMenu::windowProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM
                     }
                 }
 
-                hwndToInstance.find(hwnd)->second->notify();
-
                 if (instance->popupMenuChanged) {
                     instance->popupMenuChanged(false);
                 }
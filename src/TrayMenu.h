@@ -36,6 +36,7 @@
 
 #include "Monitor.h"
 #include <functional>
+#include <string>
 #include <Windows.h>
 #include <Shellapi.h>
 
@@ -57,6 +58,7 @@ namespace dimmer {
             };
 
             void initIcon();
+            void updateTooltip();
 
             void notify() {
                 if (monitorsChanged) {
@@ -70,6 +72,7 @@ namespace dimmer {
             HWND hwnd;
             int middleFlags;
             NOTIFYICONDATA iconData;
+            std::wstring tooltip;
             MonitorsChanged monitorsChanged;
             PopupMenuChanged popupMenuChanged;
     };
@@ -0,0 +1,349 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Utf.h"
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define DIMMER_UTF_SSE2
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#include <arm_neon.h>
+#define DIMMER_UTF_NEON
+#endif
+
+using namespace dimmer;
+
+constexpr bool wideIsUtf16 = sizeof(wchar_t) == 2;
+
+#if defined(DIMMER_UTF_SSE2)
+constexpr UtfKernel vectorKernel = UtfKernel::Sse2;
+#elif defined(DIMMER_UTF_NEON)
+constexpr UtfKernel vectorKernel = UtfKernel::Neon;
+#else
+constexpr UtfKernel vectorKernel = UtfKernel::Scalar;
+#endif
+
+/* an unsupported kernel falls back to the scalar one. */
+static bool useVector(UtfKernel kernel) {
+    return kernel == UtfKernel::Best || (kernel != UtfKernel::Scalar && kernel == vectorKernel);
+}
+
+/* copies the leading run of ASCII, 8 units at a time, and returns how many
+units were copied. the scalar loops pick up from wherever it stops. wide
+strings are UTF-16 or UTF-32 depending on the platform, so each vector
+kernel comes in both widths. */
+static size_t asciiPrefix16(const wchar_t* input, size_t length, char* output, size_t capacity, bool vector) {
+    size_t i = 0;
+    size_t end = (length < capacity) ? length : capacity;
+
+    if (!vector) {
+        return i;
+    }
+
+    if (wideIsUtf16) {
+        const uint16_t* in = reinterpret_cast<const uint16_t*>(input);
+
+#if defined(DIMMER_UTF_SSE2)
+        const __m128i mask = _mm_set1_epi16((short) 0xff80);
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 8 <= end; i += 8) {
+            __m128i units = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(units, mask), zero)) != 0xffff) {
+                break;
+            }
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(output + i), _mm_packus_epi16(units, units));
+        }
+#elif defined(DIMMER_UTF_NEON)
+        for (; i + 8 <= end; i += 8) {
+            uint16x8_t units = vld1q_u16(in + i);
+            if (vmaxvq_u16(units) >= 0x80) {
+                break;
+            }
+            vst1_u8(reinterpret_cast<uint8_t*>(output + i), vmovn_u16(units));
+        }
+#endif
+    }
+    else {
+        const uint32_t* in = reinterpret_cast<const uint32_t*>(input);
+
+#if defined(DIMMER_UTF_SSE2)
+        const __m128i mask = _mm_set1_epi32((int) 0xffffff80);
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 8 <= end; i += 8) {
+            __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+            __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 4));
+            __m128i either = _mm_and_si128(_mm_or_si128(low, high), mask);
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(either, zero)) != 0xffff) {
+                break;
+            }
+            __m128i units = _mm_packs_epi32(low, high); /* everything is < 0x80 */
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(output + i), _mm_packus_epi16(units, units));
+        }
+#elif defined(DIMMER_UTF_NEON)
+        for (; i + 8 <= end; i += 8) {
+            uint32x4_t low = vld1q_u32(in + i);
+            uint32x4_t high = vld1q_u32(in + i + 4);
+            if (vmaxvq_u32(vorrq_u32(low, high)) >= 0x80) {
+                break;
+            }
+            uint16x8_t units = vcombine_u16(vmovn_u32(low), vmovn_u32(high));
+            vst1_u8(reinterpret_cast<uint8_t*>(output + i), vmovn_u16(units));
+        }
+#endif
+    }
+
+    return i;
+}
+
+/* the same in the other direction, 16 bytes at a time. */
+static size_t asciiPrefix8(const char* input, size_t length, wchar_t* output, size_t capacity, bool vector) {
+    size_t i = 0;
+    size_t end = (length < capacity) ? length : capacity;
+
+    if (!vector) {
+        return i;
+    }
+
+    if (wideIsUtf16) {
+        uint16_t* out = reinterpret_cast<uint16_t*>(output);
+
+#if defined(DIMMER_UTF_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 16 <= end; i += 16) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+            if (_mm_movemask_epi8(bytes) != 0) {
+                break;
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_unpacklo_epi8(bytes, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 8), _mm_unpackhi_epi8(bytes, zero));
+        }
+#elif defined(DIMMER_UTF_NEON)
+        for (; i + 16 <= end; i += 16) {
+            uint8x16_t bytes = vld1q_u8(reinterpret_cast<const uint8_t*>(input + i));
+            if (vmaxvq_u8(bytes) >= 0x80) {
+                break;
+            }
+            vst1q_u16(out + i, vmovl_u8(vget_low_u8(bytes)));
+            vst1q_u16(out + i + 8, vmovl_u8(vget_high_u8(bytes)));
+        }
+#endif
+    }
+    else {
+        uint32_t* out = reinterpret_cast<uint32_t*>(output);
+
+#if defined(DIMMER_UTF_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 16 <= end; i += 16) {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+            if (_mm_movemask_epi8(bytes) != 0) {
+                break;
+            }
+            __m128i low = _mm_unpacklo_epi8(bytes, zero);
+            __m128i high = _mm_unpackhi_epi8(bytes, zero);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_unpacklo_epi16(low, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 4), _mm_unpackhi_epi16(low, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 8), _mm_unpacklo_epi16(high, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 12), _mm_unpackhi_epi16(high, zero));
+        }
+#elif defined(DIMMER_UTF_NEON)
+        for (; i + 16 <= end; i += 16) {
+            uint8x16_t bytes = vld1q_u8(reinterpret_cast<const uint8_t*>(input + i));
+            if (vmaxvq_u8(bytes) >= 0x80) {
+                break;
+            }
+            uint16x8_t low = vmovl_u8(vget_low_u8(bytes));
+            uint16x8_t high = vmovl_u8(vget_high_u8(bytes));
+            vst1q_u32(out + i, vmovl_u16(vget_low_u16(low)));
+            vst1q_u32(out + i + 4, vmovl_u16(vget_high_u16(low)));
+            vst1q_u32(out + i + 8, vmovl_u16(vget_low_u16(high)));
+            vst1q_u32(out + i + 12, vmovl_u16(vget_high_u16(high)));
+        }
+#endif
+    }
+
+    return i;
+}
+
+namespace dimmer {
+    bool isUtfKernelSupported(UtfKernel kernel) {
+        return kernel == UtfKernel::Scalar || kernel == UtfKernel::Best || kernel == vectorKernel;
+    }
+
+    size_t utf16to8(const wchar_t* input, size_t length, char* output, size_t capacity, UtfKernel kernel) {
+        bool vector = useVector(kernel);
+        size_t i = asciiPrefix16(input, length, output, capacity, vector);
+        size_t o = i;
+
+        while (i < length) {
+            uint32_t c = (uint32_t) input[i++];
+
+            if (c < 0x80) {
+                if (o >= capacity) {
+                    return UTF_ERROR;
+                }
+                output[o++] = (char) c;
+
+                /* most text is ASCII; go back to the fast path as soon as
+                there's another run of it. */
+                size_t run = asciiPrefix16(input + i, length - i, output + o, capacity - o, vector);
+                i += run;
+                o += run;
+                continue;
+            }
+
+            if (wideIsUtf16 && c >= 0xd800 && c <= 0xdfff) {
+                if (c > 0xdbff || i >= length) {
+                    return UTF_ERROR; /* unpaired low, or truncated high surrogate */
+                }
+                uint32_t low = (uint32_t) input[i];
+                if (low < 0xdc00 || low > 0xdfff) {
+                    return UTF_ERROR;
+                }
+                c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+                i++;
+            }
+            else if (c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff)) {
+                return UTF_ERROR;
+            }
+
+            if (c < 0x800) {
+                if (capacity - o < 2) {
+                    return UTF_ERROR;
+                }
+                output[o++] = (char) (0xc0 | (c >> 6));
+                output[o++] = (char) (0x80 | (c & 0x3f));
+            }
+            else if (c < 0x10000) {
+                if (capacity - o < 3) {
+                    return UTF_ERROR;
+                }
+                output[o++] = (char) (0xe0 | (c >> 12));
+                output[o++] = (char) (0x80 | ((c >> 6) & 0x3f));
+                output[o++] = (char) (0x80 | (c & 0x3f));
+            }
+            else {
+                if (capacity - o < 4) {
+                    return UTF_ERROR;
+                }
+                output[o++] = (char) (0xf0 | (c >> 18));
+                output[o++] = (char) (0x80 | ((c >> 12) & 0x3f));
+                output[o++] = (char) (0x80 | ((c >> 6) & 0x3f));
+                output[o++] = (char) (0x80 | (c & 0x3f));
+            }
+        }
+
+        return o;
+    }
+
+    size_t utf8to16(const char* input, size_t length, wchar_t* output, size_t capacity, UtfKernel kernel) {
+        bool vector = useVector(kernel);
+        const uint8_t* in = reinterpret_cast<const uint8_t*>(input);
+        size_t i = asciiPrefix8(input, length, output, capacity, vector);
+        size_t o = i;
+
+        while (i < length) {
+            uint32_t c = in[i++];
+
+            if (c < 0x80) {
+                if (o >= capacity) {
+                    return UTF_ERROR;
+                }
+                output[o++] = (wchar_t) c;
+
+                size_t run = asciiPrefix8(input + i, length - i, output + o, capacity - o, vector);
+                i += run;
+                o += run;
+                continue;
+            }
+
+            /* the lead byte determines the sequence length, and the smallest
+            value it may encode; anything smaller is overlong. 0xc0, 0xc1 and
+            0xf5 and up can never start a valid sequence. */
+            size_t continuation;
+            uint32_t minimum;
+            if (c >= 0xc2 && c <= 0xdf) {
+                continuation = 1;
+                minimum = 0x80;
+                c &= 0x1f;
+            }
+            else if (c >= 0xe0 && c <= 0xef) {
+                continuation = 2;
+                minimum = 0x800;
+                c &= 0x0f;
+            }
+            else if (c >= 0xf0 && c <= 0xf4) {
+                continuation = 3;
+                minimum = 0x10000;
+                c &= 0x07;
+            }
+            else {
+                return UTF_ERROR;
+            }
+
+            if (length - i < continuation) {
+                return UTF_ERROR;
+            }
+
+            for (size_t j = 0; j < continuation; j++) {
+                uint32_t byte = in[i++];
+                if ((byte & 0xc0) != 0x80) {
+                    return UTF_ERROR;
+                }
+                c = (c << 6) | (byte & 0x3f);
+            }
+
+            if (c < minimum || c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff)) {
+                return UTF_ERROR;
+            }
+
+            if (wideIsUtf16 && c >= 0x10000) {
+                if (capacity - o < 2) {
+                    return UTF_ERROR;
+                }
+                c -= 0x10000;
+                output[o++] = (wchar_t) (0xd800 + (c >> 10));
+                output[o++] = (wchar_t) (0xdc00 + (c & 0x3ff));
+            }
+            else {
+                if (o >= capacity) {
+                    return UTF_ERROR;
+                }
+                output[o++] = (wchar_t) c;
+            }
+        }
+
+        return o;
+    }
+}
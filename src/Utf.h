@@ -0,0 +1,75 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+
+namespace dimmer {
+    constexpr size_t UTF_ERROR = (size_t) -1;
+
+    /* strict transcoders between UTF-8 and the platform's wide strings
+    (UTF-16 on Windows, UTF-32 elsewhere). they write into caller-provided
+    buffers and never allocate. the return value is the number of code units
+    written, or UTF_ERROR if the input isn't well-formed (overlong or
+    truncated sequences, unpaired surrogates, values past U+10FFFF) or the
+    output doesn't fit. output is not null-terminated. */
+    enum class UtfKernel {
+        Scalar,
+        Sse2,
+        Neon,
+        Best /* whichever of the above this CPU has */
+    };
+
+    extern bool isUtfKernelSupported(UtfKernel kernel);
+
+    /* every kernel gives the same result; the vector ones only speed up
+    runs of ASCII. */
+    extern size_t utf16to8(
+        const wchar_t* input, size_t length, char* output, size_t capacity,
+        UtfKernel kernel = UtfKernel::Best);
+
+    extern size_t utf8to16(
+        const char* input, size_t length, wchar_t* output, size_t capacity,
+        UtfKernel kernel = UtfKernel::Best);
+
+    /* output sizes that are always enough for an input of the given length */
+    constexpr size_t utf8Capacity(size_t wideLength) {
+        return wideLength * (sizeof(wchar_t) == 2 ? 3 : 4);
+    }
+
+    constexpr size_t utf16Capacity(size_t utf8Length) {
+        return utf8Length;
+    }
+}
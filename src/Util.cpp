@@ -32,65 +32,76 @@
 //
 //////////////////////////////////////////////////////////////////////////////
 
+#include "Util.h"
+#include "Utf.h"
+#include "Profile.h"
+
+#ifdef _WIN32
 #include <Windows.h>
 #include <ShlObj.h>
-#include "Util.h"
+#else
+#include <cstdlib>
+#include <sys/stat.h>
+#endif
 
 namespace dimmer {
-    std::string u16to8(const std::wstring& utf16) {
-        int size = WideCharToMultiByte(CP_UTF8, 0, utf16.c_str(), -1, 0, 0, 0, 0);
-        if (size <= 0) return "";
-        char* buffer = new char[size];
-        WideCharToMultiByte(CP_UTF8, 0, utf16.c_str(), -1, buffer, size, 0, 0);
-        std::string utf8str(buffer);
-        delete[] buffer;
-        return utf8str;
-    }
+    /* short strings (monitor ids, config keys) are converted on the stack,
+    so the only allocation is the result's, if it doesn't fit inline. */
+    constexpr size_t stackBufferSize = 256;
 
-    std::wstring u8to16(const std::string& utf8) {
-        int size = MultiByteToWideChar(CP_UTF8, 0, utf8.c_str(), -1, 0, 0);
-        if (size <= 0) return L"";
-        wchar_t* buffer = new wchar_t[size];
-        MultiByteToWideChar(CP_UTF8, 0, utf8.c_str(), -1, buffer, size);
-        std::wstring utf16fn(buffer);
-        delete[] buffer;
-        return utf16fn;
-    }
-
-    std::string fileToString(const std::wstring& fn) {
-        FILE* f = _wfopen(fn.c_str(), L"rb");
-        std::string result;
+    void u16to8(const std::wstring& utf16, std::string& result) {
+        PROFILE_ALLOCATIONS("u16to8");
+        size_t capacity = utf8Capacity(utf16.size());
 
-        if (!f) {
-            return result;
+        if (capacity <= stackBufferSize) {
+            char buffer[stackBufferSize];
+            size_t size = utf16to8(utf16.data(), utf16.size(), buffer, capacity);
+            result.assign(buffer, size != UTF_ERROR ? size : 0);
         }
+        else {
+            result.resize(capacity);
+            size_t size = utf16to8(utf16.data(), utf16.size(), &result[0], capacity);
+            result.resize(size != UTF_ERROR ? size : 0);
+        }
+    }
 
-        fseek(f, 0, SEEK_END);
-        long len = ftell(f);
-        rewind(f);
+    void u8to16(const std::string& utf8, std::wstring& result) {
+        PROFILE_ALLOCATIONS("u8to16");
+        size_t capacity = utf16Capacity(utf8.size());
 
-        if (len > 0) {
-            char* bytes = new char[len];
-            fread(static_cast<void*>(bytes), len, 1, f);
-            result.assign(bytes, len);
-            delete[] bytes;
+        if (capacity <= stackBufferSize) {
+            wchar_t buffer[stackBufferSize];
+            size_t size = utf8to16(utf8.data(), utf8.size(), buffer, capacity);
+            result.assign(buffer, size != UTF_ERROR ? size : 0);
         }
+        else {
+            result.resize(capacity);
+            size_t size = utf8to16(utf8.data(), utf8.size(), &result[0], capacity);
+            result.resize(size != UTF_ERROR ? size : 0);
+        }
+    }
 
-        fclose(f);
-
+    std::string u16to8(const std::wstring& utf16) {
+        std::string result;
+        u16to8(utf16, result);
         return result;
     }
 
-    bool stringToFile(const std::wstring& fn, const std::string& str) {
-        FILE* f = _wfopen(fn.c_str(), L"wb");
+    std::wstring u8to16(const std::string& utf8) {
+        std::wstring result;
+        u8to16(utf8, result);
+        return result;
+    }
 
-        if (!f) {
+#ifdef _WIN32
+    bool getFileStamp(const std::wstring& fn, uint64_t& writeTime, uint64_t& size) {
+        WIN32_FILE_ATTRIBUTE_DATA data;
+        if (!GetFileAttributesEx(fn.c_str(), GetFileExInfoStandard, &data)) {
             return false;
         }
-
-        size_t written = fwrite(str.c_str(), str.size(), 1, f);
-        fclose(f);
-        return (written == str.size());
+        writeTime = ((uint64_t) data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+        size = ((uint64_t) data.nFileSizeHigh << 32) | data.nFileSizeLow;
+        return true;
     }
 
     std::wstring getDataDirectory() {
@@ -104,4 +115,57 @@ namespace dimmer {
         delete[] buffer;
         return directory;
     }
+
+    std::wstring getPolicyDirectory() {
+        /* machine-wide and administrator-owned; never created here. */
+        std::wstring directory;
+        DWORD bufferSize = GetEnvironmentVariable(L"ProgramData", 0, 0);
+        wchar_t *buffer = new wchar_t[bufferSize + 2];
+        buffer[0] = 0;
+        GetEnvironmentVariable(L"ProgramData", buffer, bufferSize);
+        directory.assign(buffer);
+        directory += L"\\dimmer";
+        delete[] buffer;
+        return directory;
+    }
+#else
+    bool getFileStamp(const std::wstring& fn, uint64_t& writeTime, uint64_t& size) {
+        struct stat info;
+        if (stat(u16to8(fn).c_str(), &info) != 0) {
+            return false;
+        }
+        writeTime = (uint64_t) info.st_mtim.tv_sec * 1000000000ull + (uint64_t) info.st_mtim.tv_nsec;
+        size = (uint64_t) info.st_size;
+        return true;
+    }
+
+    std::wstring getDataDirectory() {
+        /* $XDG_CONFIG_HOME/dimmer, which is usually ~/.config/dimmer */
+        std::string directory;
+        const char* config = getenv("XDG_CONFIG_HOME");
+        if (config && *config) {
+            directory = config;
+        }
+        else {
+            const char* home = getenv("HOME");
+            directory = std::string(home ? home : ".") + "/.config";
+        }
+        mkdir(directory.c_str(), 0700);
+        directory += "/dimmer";
+        mkdir(directory.c_str(), 0700);
+        return u8to16(directory);
+    }
+
+    std::wstring getPolicyDirectory() {
+        /* the first of $XDG_CONFIG_DIRS, usually /etc/xdg; never created
+        here, for the same reason as on Windows. */
+        std::string directory = "/etc/xdg";
+        const char* dirs = getenv("XDG_CONFIG_DIRS");
+        if (dirs && *dirs) {
+            directory = dirs;
+            directory = directory.substr(0, directory.find(':'));
+        }
+        return u8to16(directory + "/dimmer");
+    }
+#endif
 }
\ No newline at end of file
@@ -34,12 +34,25 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
 
 namespace dimmer {
-    extern std::string fileToString(const std::wstring& fn);
-    extern bool stringToFile(const std::wstring& fn, const std::string& contents);
+#ifdef _WIN32
+    constexpr wchar_t PATH_SEPARATOR[] = L"\\";
+#else
+    constexpr wchar_t PATH_SEPARATOR[] = L"/";
+#endif
+
+    extern bool getFileStamp(const std::wstring& fn, uint64_t& writeTime, uint64_t& size);
     extern std::wstring getDataDirectory();
+    extern std::wstring getPolicyDirectory();
     extern std::string u16to8(const std::wstring& input);
     extern std::wstring u8to16(const std::string& input);
+
+    /* the same, into a string the caller keeps around: once it has grown
+    big enough, converting into it doesn't allocate. malformed input gives
+    an empty string. */
+    extern void u16to8(const std::wstring& input, std::string& output);
+    extern void u8to16(const std::string& input, std::wstring& output);
 }
\ No newline at end of file
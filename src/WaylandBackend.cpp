@@ -0,0 +1,287 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _WIN32
+
+#include "WaylandBackend.h"
+#include "Gamma.h"
+#include <algorithm>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <wayland-client.h>
+#include "wlr-gamma-control-unstable-v1-client-protocol.h"
+
+using namespace dimmer;
+
+/* wl_output's name event arrived in version 4. */
+constexpr uint32_t outputVersion = 4;
+
+static void outputGeometry(void*, wl_output*, int32_t, int32_t, int32_t, int32_t, int32_t, const char*, const char*, int32_t) { }
+static void outputMode(void*, wl_output*, uint32_t, int32_t, int32_t, int32_t) { }
+static void outputDone(void*, wl_output*) { }
+static void outputScale(void*, wl_output*, int32_t) { }
+static void outputDescription(void*, wl_output*, const char*) { }
+
+WaylandBackend::WaylandBackend(const char* displayName)
+: display(wl_display_connect(displayName))
+, registry(nullptr)
+, manager(nullptr) {
+    if (!this->display) {
+        return;
+    }
+
+    static const wl_registry_listener registryListener = {
+        &WaylandBackend::global,
+        &WaylandBackend::globalRemove
+    };
+
+    this->registry = wl_display_get_registry(this->display);
+    wl_registry_add_listener(this->registry, &registryListener, this);
+
+    /* once for the globals, once more for the outputs' names. */
+    wl_display_roundtrip(this->display);
+    wl_display_roundtrip(this->display);
+}
+
+WaylandBackend::~WaylandBackend() {
+    for (auto& output : this->list) {
+        this->release(*output);
+        wl_output_release(output->output);
+    }
+
+    if (this->manager) {
+        zwlr_gamma_control_manager_v1_destroy(this->manager);
+    }
+
+    if (this->registry) {
+        wl_registry_destroy(this->registry);
+    }
+
+    if (this->display) {
+        wl_display_flush(this->display);
+        wl_display_disconnect(this->display);
+    }
+}
+
+int WaylandBackend::getFd() const {
+    return this->display ? wl_display_get_fd(this->display) : -1;
+}
+
+void WaylandBackend::dispatch() {
+    if (!this->display) {
+        return;
+    }
+
+    /* libwayland reads with MSG_DONTWAIT, so reading when there's nothing
+    there just reads nothing. */
+    while (wl_display_prepare_read(this->display) != 0) {
+        wl_display_dispatch_pending(this->display);
+    }
+    wl_display_flush(this->display);
+    wl_display_read_events(this->display);
+    wl_display_dispatch_pending(this->display);
+}
+
+std::vector<std::string> WaylandBackend::outputs() const {
+    std::vector<std::string> result;
+    for (auto& output : this->list) {
+        if (!output->name.empty()) {
+            result.push_back(output->name);
+        }
+    }
+    return result;
+}
+
+bool WaylandBackend::apply(const std::string& name, const MonitorOptions& options) {
+    Output* output = this->find(name);
+    if (!this->manager || !output) {
+        return false;
+    }
+
+    float brightness = 1.0f - std::min(1.0f, std::max(0.0f, options.opacity));
+    if (!options.enabled || (options.temperature == DEFAULT_TEMPERATURE && brightness >= 1.0f)) {
+        this->reset(name);
+        return true;
+    }
+
+    output->options = options;
+    output->pending = true;
+
+    if (!output->control) {
+        static const zwlr_gamma_control_v1_listener controlListener = {
+            &WaylandBackend::gammaSize,
+            &WaylandBackend::gammaFailed
+        };
+
+        output->control = zwlr_gamma_control_manager_v1_get_gamma_control(this->manager, output->output);
+        zwlr_gamma_control_v1_add_listener(output->control, &controlListener, output);
+        wl_display_flush(this->display);
+    }
+    else if (output->rampSize) {
+        this->write(*output);
+    }
+
+    return true;
+}
+
+void WaylandBackend::reset(const std::string& name) {
+    Output* output = this->find(name);
+    if (output) {
+        this->release(*output);
+        wl_display_flush(this->display);
+    }
+}
+
+void WaylandBackend::write(Output& output) {
+    output.pending = false;
+
+    /* the table goes over as a file: red, green and blue planes, back to
+    back, rampSize entries each. */
+    size_t size = output.rampSize;
+    size_t bytes = size * 3 * sizeof(uint16_t);
+
+    int fd = memfd_create("dimmer-gamma", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, (off_t) bytes) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+
+    void* mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        close(fd);
+        return;
+    }
+
+    const MonitorOptions& options = output.options;
+    float brightness = 1.0f - std::min(1.0f, std::max(0.0f, options.opacity));
+    uint16_t* table = (uint16_t*) mapped;
+    buildTemperatureRamp(options.temperature, brightness, { table, table + size, table + size * 2, size });
+    munmap(mapped, bytes);
+
+    zwlr_gamma_control_v1_set_gamma(output.control, fd);
+    wl_display_flush(this->display);
+    close(fd);
+}
+
+WaylandBackend::Output* WaylandBackend::find(const std::string& name) const {
+    for (auto& output : this->list) {
+        if (output->name == name) {
+            return output.get();
+        }
+    }
+    return nullptr;
+}
+
+void WaylandBackend::release(Output& output) {
+    /* destroying the control is what puts the original ramp back. */
+    if (output.control) {
+        zwlr_gamma_control_v1_destroy(output.control);
+        output.control = nullptr;
+    }
+    output.rampSize = 0;
+    output.pending = false;
+}
+
+void WaylandBackend::global(void* data, wl_registry* registry, uint32_t id, const char* interface, uint32_t version) {
+    auto backend = (WaylandBackend*) data;
+
+    if (strcmp(interface, zwlr_gamma_control_manager_v1_interface.name) == 0) {
+        backend->manager = (zwlr_gamma_control_manager_v1*)
+            wl_registry_bind(registry, id, &zwlr_gamma_control_manager_v1_interface, 1);
+    }
+    else if (strcmp(interface, wl_output_interface.name) == 0 && version >= outputVersion) {
+        static const wl_output_listener outputListener = {
+            &outputGeometry,
+            &outputMode,
+            &outputDone,
+            &outputScale,
+            &WaylandBackend::outputName,
+            &outputDescription
+        };
+
+        auto output = std::make_unique<Output>();
+        output->backend = backend;
+        output->id = id;
+        output->output = (wl_output*) wl_registry_bind(registry, id, &wl_output_interface, outputVersion);
+        output->control = nullptr;
+        output->rampSize = 0;
+        output->pending = false;
+        wl_output_add_listener(output->output, &outputListener, output.get());
+        backend->list.push_back(std::move(output));
+    }
+}
+
+void WaylandBackend::globalRemove(void* data, wl_registry*, uint32_t id) {
+    auto backend = (WaylandBackend*) data;
+    auto& list = backend->list;
+
+    auto it = std::find_if(list.begin(), list.end(), [id](const std::unique_ptr<Output>& output) {
+        return output->id == id;
+    });
+
+    if (it != list.end()) {
+        backend->release(**it);
+        wl_output_release((*it)->output);
+        list.erase(it);
+    }
+}
+
+void WaylandBackend::outputName(void* data, wl_output*, const char* name) {
+    ((Output*) data)->name = name;
+}
+
+void WaylandBackend::gammaSize(void* data, zwlr_gamma_control_v1*, uint32_t size) {
+    auto output = (Output*) data;
+    if (size == 0) {
+        output->backend->release(*output); /* an output without gamma */
+        return;
+    }
+
+    output->rampSize = size;
+    if (output->pending) {
+        output->backend->write(*output);
+    }
+}
+
+/* another client has the output's gamma, or it has none. the control is
+dead either way; the next apply() asks again. */
+void WaylandBackend::gammaFailed(void* data, zwlr_gamma_control_v1*) {
+    auto output = (Output*) data;
+    output->backend->release(*output);
+}
+
+#endif
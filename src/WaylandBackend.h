@@ -0,0 +1,119 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef _WIN32
+
+#include "Config.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+struct wl_display;
+struct wl_registry;
+struct wl_output;
+struct zwlr_gamma_control_manager_v1;
+struct zwlr_gamma_control_v1;
+
+namespace dimmer {
+    /* gamma tables per output through wlr-gamma-control-unstable-v1, on
+    wlroots compositors (sway, river, labwc, ...). Wayland doesn't let a
+    client put a window over everything, so the ramp is the only way to
+    dim and does all of it, down to whatever the options ask for. options
+    are the same MonitorOptions as everywhere else; outputs are keyed by
+    their wl_output name, e.g. DP-1.
+
+    a control is only taken for outputs that are actually dimmed: the
+    compositor gives each output's gamma to one client at a time, and puts
+    the original back as soon as that client lets go. */
+    class WaylandBackend {
+        public:
+            /* nullptr uses $WAYLAND_DISPLAY, so tests can point it at a
+            headless compositor. */
+            explicit WaylandBackend(const char* displayName = nullptr);
+            ~WaylandBackend();
+
+            /* connected, and the compositor has the gamma control protocol */
+            bool isOpen() const { return this->manager != nullptr; }
+
+            /* for EventLoop::addHandle(); call dispatch() when it's readable,
+            to pick up outputs that come and go and the compositor's answers
+            to apply(). dispatch() never blocks. */
+            int getFd() const;
+            void dispatch();
+
+            std::vector<std::string> outputs() const;
+
+            /* nothing here waits for the compositor. the first apply() to an
+            output only asks for its gamma control; the table is written from
+            dispatch() once the compositor says how big it is, with whatever
+            options were applied last by then. false if there is no such
+            output. */
+            bool apply(const std::string& output, const MonitorOptions& options);
+            void reset(const std::string& output);
+
+        private:
+            WaylandBackend(const WaylandBackend&) = delete;
+            WaylandBackend& operator=(const WaylandBackend&) = delete;
+
+            struct Output {
+                WaylandBackend* backend;
+                uint32_t id; /* the registry's name for it */
+                wl_output* output;
+                std::string name;
+                zwlr_gamma_control_v1* control;
+                uint32_t rampSize; /* 0 until the compositor has answered */
+                MonitorOptions options;
+                bool pending; /* options not written yet */
+            };
+
+            static void global(void* data, wl_registry* registry, uint32_t id, const char* interface, uint32_t version);
+            static void globalRemove(void* data, wl_registry* registry, uint32_t id);
+            static void outputName(void* data, wl_output* output, const char* name);
+            static void gammaSize(void* data, zwlr_gamma_control_v1* control, uint32_t size);
+            static void gammaFailed(void* data, zwlr_gamma_control_v1* control);
+
+            Output* find(const std::string& name) const;
+            void write(Output& output);
+            void release(Output& output);
+
+            wl_display* display;
+            wl_registry* registry;
+            zwlr_gamma_control_manager_v1* manager;
+            std::vector<std::unique_ptr<Output>> list;
+    };
+}
+
+#endif
@@ -0,0 +1,268 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#ifndef _WIN32
+
+#include "X11Backend.h"
+#include <algorithm>
+#include <X11/extensions/Xfixes.h>
+#include <X11/extensions/shape.h>
+
+using namespace dimmer;
+
+/* the ramp isn't scaled below this; the overlay takes it from there. */
+constexpr float gammaFloor = 0.4f;
+
+X11Backend::X11Backend(const char* displayName)
+: display(XOpenDisplay(displayName))
+, root(0)
+, visual()
+, argb(false) {
+    if (!this->display) {
+        return;
+    }
+
+    int event, error, major = 0, minor = 0;
+    if (!XRRQueryExtension(this->display, &event, &error) ||
+        !XRRQueryVersion(this->display, &major, &minor) ||
+        (major == 1 && minor < 2))
+    {
+        XCloseDisplay(this->display);
+        this->display = nullptr;
+        return;
+    }
+
+    this->root = DefaultRootWindow(this->display);
+
+    int screen = DefaultScreen(this->display);
+    this->argb = XMatchVisualInfo(this->display, screen, 32, TrueColor, &this->visual) != 0;
+}
+
+X11Backend::~X11Backend() {
+    if (!this->display) {
+        return;
+    }
+
+    while (!this->overlays.empty()) {
+        this->hideOverlay(this->overlays.begin()->first);
+    }
+
+    while (!this->original.empty()) {
+        this->restoreGamma(this->original.begin()->first);
+    }
+
+    XCloseDisplay(this->display);
+}
+
+std::vector<X11Output> X11Backend::outputs() {
+    std::vector<X11Output> result;
+    if (!this->display) {
+        return result;
+    }
+
+    XRRScreenResources* resources = XRRGetScreenResourcesCurrent(this->display, this->root);
+    if (!resources) {
+        return result;
+    }
+
+    for (int i = 0; i < resources->noutput; i++) {
+        XRROutputInfo* info = XRRGetOutputInfo(this->display, resources, resources->outputs[i]);
+        if (!info) {
+            continue;
+        }
+
+        if (info->connection == RR_Connected && info->crtc) {
+            XRRCrtcInfo* crtc = XRRGetCrtcInfo(this->display, resources, info->crtc);
+            if (crtc) {
+                X11Output output;
+                output.name = std::string(info->name, info->nameLen);
+                output.crtc = info->crtc;
+                output.x = crtc->x;
+                output.y = crtc->y;
+                output.width = (int) crtc->width;
+                output.height = (int) crtc->height;
+                output.rampSize = XRRGetCrtcGammaSize(this->display, info->crtc);
+                result.push_back(output);
+                XRRFreeCrtcInfo(crtc);
+            }
+        }
+
+        XRRFreeOutputInfo(info);
+    }
+
+    XRRFreeScreenResources(resources);
+    return result;
+}
+
+bool X11Backend::apply(const X11Output& output, const MonitorOptions& options, bool useOverlay) {
+    if (!this->display || !options.enabled) {
+        this->reset(output);
+        return this->display != nullptr;
+    }
+
+    float brightness = 1.0f - std::min(1.0f, std::max(0.0f, options.opacity));
+
+    /* without an overlay the ramp does all of the dimming. */
+    useOverlay = useOverlay && this->argb;
+    float gamma = useOverlay ? std::max(brightness, gammaFloor) : brightness;
+
+    if (options.temperature == DEFAULT_TEMPERATURE && gamma >= 1.0f) {
+        this->restoreGamma(output.crtc);
+    }
+    else if (!this->setGamma(output.crtc, options.temperature, gamma)) {
+        gamma = 1.0f; /* no gamma on this CRTC; the overlay does everything */
+    }
+
+    float opacity = useOverlay ? 1.0f - brightness / gamma : 0.0f;
+    if (opacity > 0.0f) {
+        this->showOverlay(output, opacity);
+    }
+    else {
+        this->hideOverlay(output.crtc);
+    }
+
+    XFlush(this->display);
+    return true;
+}
+
+void X11Backend::reset(const X11Output& output) {
+    if (this->display) {
+        this->hideOverlay(output.crtc);
+        this->restoreGamma(output.crtc);
+        XFlush(this->display);
+    }
+}
+
+bool X11Backend::setGamma(RRCrtc crtc, int kelvin, float brightness) {
+    int size = XRRGetCrtcGammaSize(this->display, crtc);
+    if (size <= 1) {
+        return false;
+    }
+
+    /* the first ramp seen is what gets put back later. */
+    if (this->original.find(crtc) == this->original.end()) {
+        XRRCrtcGamma* current = XRRGetCrtcGamma(this->display, crtc);
+        if (!current) {
+            return false;
+        }
+
+        Planes& planes = this->original[crtc];
+        planes.red.assign(current->red, current->red + current->size);
+        planes.green.assign(current->green, current->green + current->size);
+        planes.blue.assign(current->blue, current->blue + current->size);
+        XRRFreeGamma(current);
+    }
+
+    XRRCrtcGamma* gamma = XRRAllocGamma(size);
+    if (!gamma) {
+        return false;
+    }
+
+    buildTemperatureRamp(kelvin, brightness, { gamma->red, gamma->green, gamma->blue, (size_t) size });
+    XRRSetCrtcGamma(this->display, crtc, gamma);
+    XRRFreeGamma(gamma);
+    return true;
+}
+
+void X11Backend::restoreGamma(RRCrtc crtc) {
+    auto it = this->original.find(crtc);
+    if (it == this->original.end()) {
+        return;
+    }
+
+    /* the mode may have changed since; only a ramp of the right size goes back. */
+    Planes& planes = it->second;
+    int size = (int) planes.red.size();
+    if (size == XRRGetCrtcGammaSize(this->display, crtc)) {
+        XRRCrtcGamma* gamma = XRRAllocGamma(size);
+        if (gamma) {
+            std::copy(planes.red.begin(), planes.red.end(), gamma->red);
+            std::copy(planes.green.begin(), planes.green.end(), gamma->green);
+            std::copy(planes.blue.begin(), planes.blue.end(), gamma->blue);
+            XRRSetCrtcGamma(this->display, crtc, gamma);
+            XRRFreeGamma(gamma);
+        }
+    }
+
+    this->original.erase(it);
+}
+
+void X11Backend::showOverlay(const X11Output& output, float opacity) {
+    /* a 32-bit visual's background pixel is premultiplied ARGB; black at
+    the given alpha is just the alpha byte. */
+    unsigned long alpha = (unsigned long) (std::min(opacity, 240.0f / 255.0f) * 255.0f);
+    unsigned long pixel = alpha << 24;
+
+    auto it = this->overlays.find(output.crtc);
+    if (it != this->overlays.end()) {
+        Window window = it->second.window;
+        XMoveResizeWindow(this->display, window, output.x, output.y, output.width, output.height);
+        XSetWindowBackground(this->display, window, pixel);
+        XClearWindow(this->display, window);
+        XRaiseWindow(this->display, window);
+        return;
+    }
+
+    XSetWindowAttributes attributes = {};
+    attributes.override_redirect = True;
+    attributes.colormap = XCreateColormap(this->display, this->root, this->visual.visual, AllocNone);
+    attributes.background_pixel = pixel;
+    attributes.border_pixel = 0;
+
+    Window window = XCreateWindow(
+        this->display, this->root,
+        output.x, output.y, output.width, output.height, 0,
+        this->visual.depth, InputOutput, this->visual.visual,
+        CWOverrideRedirect | CWColormap | CWBackPixel | CWBorderPixel,
+        &attributes);
+
+    /* an empty input shape lets every click through to whatever's below. */
+    XserverRegion region = XFixesCreateRegion(this->display, nullptr, 0);
+    XFixesSetWindowShapeRegion(this->display, window, ShapeInput, 0, 0, region);
+    XFixesDestroyRegion(this->display, region);
+
+    XMapRaised(this->display, window);
+    this->overlays[output.crtc] = { window, attributes.colormap };
+}
+
+void X11Backend::hideOverlay(RRCrtc crtc) {
+    auto it = this->overlays.find(crtc);
+    if (it != this->overlays.end()) {
+        XDestroyWindow(this->display, it->second.window);
+        XFreeColormap(this->display, it->second.colormap);
+        this->overlays.erase(it);
+    }
+}
+
+#endif
@@ -0,0 +1,109 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#ifndef _WIN32
+
+#include "Config.h"
+#include "Gamma.h"
+#include <map>
+#include <string>
+#include <vector>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/Xrandr.h>
+
+namespace dimmer {
+    /* one connected output that's driving a CRTC. clones share a CRTC, and
+    so share a ramp. */
+    struct X11Output {
+        std::string name; /* e.g. DP-1; the key under "monitors" */
+        RRCrtc crtc;
+        int x, y, width, height;
+        int rampSize; /* whatever the driver wants; 0 if it has no gamma */
+    };
+
+    /* the Linux counterpart to Overlay's gamma and brightness paths, for X
+    servers with RandR 1.2+. options are the same MonitorOptions the Windows
+    build uses. brightness goes into the CRTC's ramp, down to the gamma
+    floor; below that, an optional click-through overlay window dims the
+    rest, because a ramp scaled much further throws away most of its
+    levels and bands. servers without a 32-bit ARGB visual have nothing
+    that could blend such a window, so there the ramp does all of it. */
+    class X11Backend {
+        public:
+            /* nullptr uses $DISPLAY, so tests can point it at an Xvfb. */
+            explicit X11Backend(const char* displayName = nullptr);
+            ~X11Backend();
+
+            bool isOpen() const { return this->display != nullptr; }
+            bool canOverlay() const { return this->argb; }
+
+            std::vector<X11Output> outputs();
+
+            bool apply(const X11Output& output, const MonitorOptions& options, bool useOverlay = true);
+
+            /* puts back the ramp the CRTC had before it was first touched,
+            and removes its overlay. */
+            void reset(const X11Output& output);
+
+        private:
+            X11Backend(const X11Backend&) = delete;
+            X11Backend& operator=(const X11Backend&) = delete;
+
+            struct Planes {
+                std::vector<uint16_t> red, green, blue;
+            };
+
+            struct OverlayWindow {
+                Window window;
+                Colormap colormap;
+            };
+
+            bool setGamma(RRCrtc crtc, int kelvin, float brightness);
+            void restoreGamma(RRCrtc crtc);
+            void showOverlay(const X11Output& output, float opacity);
+            void hideOverlay(RRCrtc crtc);
+
+            Display* display;
+            Window root;
+            XVisualInfo visual;
+            bool argb;
+            std::map<RRCrtc, Planes> original;
+            std::map<RRCrtc, OverlayWindow> overlays;
+    };
+}
+
+#endif
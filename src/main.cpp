@@ -41,8 +41,14 @@
 
 #include "Monitor.h"
 #include "Overlay.h"
+#include "Reconcile.h"
 #include "TrayMenu.h"
+#include "ConfigWatcher.h"
+#include "EventLoop.h"
+#include "DevicePool.h"
+#include "Task.h"
 #include "Util.h"
+#include "Profile.h"
 
 #pragma comment(linker,"/manifestdependency:\"type='win32' name='Microsoft.Windows.Common-Controls' version='6.0.0.0' processorArchitecture='*' publicKeyToken='6595b64144ccf1df' language='*'\"")
 
@@ -51,40 +57,109 @@ using Overlays = std::map<std::wstring, OverlayPtr>;
 static Overlays overlays;
 static std::vector<dimmer::Monitor> monitors;
 
+/* docking, undocking and waking up all change the displays several times in
+quick succession; the overlays are rebuilt once things have settled. */
+constexpr uint32_t displaySettleMs = 250;
+
 static void updateOverlays(HINSTANCE instance) {
+    PROFILE_ALLOCATIONS("updateOverlays");
+
+    std::vector<dimmer::Monitor> previous;
+    std::swap(monitors, previous);
     monitors = dimmer::queryMonitors();
 
     Overlays old;
     std::swap(overlays, old);
 
+    /* a display change resets the gamma ramp; nothing else about a monitor
+    that's still attached has changed, unless the new topology brings a
+    layout profile of its own. the overlays are out of the way while that's
+    selected, so the config listener leaves them alone; they're all brought
+    up to date just below. */
+    unsigned dirty = dimmer::PropertyTemperature;
+    if (dimmer::selectLayout(monitors)) {
+        dirty = dimmer::PropertyAll;
+    }
+
     if (dimmer::isDimmerEnabled()) {
-        for (auto monitor : monitors) {
-            auto id = monitor.getId();
-            auto it = old.find(monitor.getId());
-
-            OverlayPtr overlay;
-            if (it != old.end()) {
-                overlay = it->second;
-                overlay->update(monitor);
-            }
-            else {
-                overlay = std::make_shared<dimmer::Overlay>(instance, monitor);
-            }
+        dimmer::reconcileOverlays(overlays, old, previous, monitors, dirty,
+            [instance](dimmer::Monitor& monitor) {
+                return std::make_shared<dimmer::Overlay>(instance, monitor);
+            });
+    }
+}
+
+static dimmer::Task refreshOnDisplayChange(HINSTANCE instance) {
+    for (;;) {
+        co_await dimmer::displayChanged();
 
-            overlays[id] = overlay;
+        /* every further change starts the wait over. */
+        bool changed = true;
+        while (changed) {
+            changed = co_await dimmer::displayChanged(displaySettleMs, displaySettleMs / 4);
+        }
+
+        updateOverlays(instance);
+    }
+}
+
+static void applyConfigChanges(HINSTANCE instance, const dimmer::ConfigChanges& changes) {
+    if (changes.general & dimmer::PropertyEnabled) {
+        updateOverlays(instance);
+        return;
+    }
+
+    /* only the properties that changed are re-applied, and only on the
+    monitors they changed on. */
+    for (auto& entry : overlays) {
+        unsigned dirty = changes.general;
+        const unsigned* changed = changes.monitors.find(entry.first);
+        if (changed) {
+            dirty |= *changed;
+        }
+
+        if (dirty) {
+            auto monitor = dimmer::findMonitor(monitors, entry.first);
+            if (monitor) {
+                dimmer::Monitor copy = *monitor;
+                entry.second->apply(copy, dirty);
+            }
         }
     }
 }
 
 int CALLBACK wWinMain(HINSTANCE instance, HINSTANCE prev, LPWSTR args, int showType) {
+    PROFILE_ALLOCATIONS_BEGIN("startup");
+
     InitCommonControlsEx(nullptr);
 
+    /* created first, so everything set up below can schedule on it. the
+    pool goes away before the loop does, and finishes any device work that's
+    still queued (like resetting gamma ramps) on the way. */
+    dimmer::EventLoop loop;
+    dimmer::DevicePool devicePool;
+
     dimmer::loadConfig();
 
-    dimmer::TrayMenu trayMenu(instance, [instance]() {
-        updateOverlays(instance);
+    dimmer::setConfigListener([instance](const dimmer::ConfigChanges& changes) {
+        applyConfigChanges(instance, changes);
+    });
+
+    /* the tray menu reports the initial set of monitors right away, and
+    every display change after that. */
+    bool started = false;
+    dimmer::TrayMenu trayMenu(instance, [instance, &started]() {
+        if (started) {
+            dimmer::notifyDisplayChanged();
+        }
+        else {
+            started = true;
+            updateOverlays(instance);
+        }
     });
 
+    dimmer::Task displayRefresh = refreshOnDisplayChange(instance);
+
     trayMenu.setPopupMenuChangedCallback([](bool visible) {
         for (auto overlay : overlays) {
             if (visible) {
@@ -98,17 +173,38 @@ int CALLBACK wWinMain(HINSTANCE instance, HINSTANCE prev, LPWSTR args, int showT
         }
     });
 
-    MSG msg = {};
-    while (GetMessage(&msg, nullptr, 0, 0)) {
-        TranslateMessage(&msg);
-        DispatchMessage(&msg);
+    PROFILE_ALLOCATIONS_END();
+
+    /* the policy directory may not exist at all, in which case there is
+    nothing to watch there. */
+    dimmer::ConfigWatcher configWatcher(dimmer::getDataDirectory(), L"config.json");
+    if (configWatcher.isOpen()) {
+        loop.addHandle(configWatcher.handle(), [&configWatcher]() {
+            if (configWatcher.changed()) {
+                dimmer::reloadConfig();
+            }
+        });
     }
 
+    dimmer::ConfigWatcher policyWatcher(dimmer::getPolicyDirectory(), L"policy.json");
+    if (policyWatcher.isOpen()) {
+        loop.addHandle(policyWatcher.handle(), [&policyWatcher]() {
+            if (policyWatcher.changed()) {
+                dimmer::reloadPolicy();
+            }
+        });
+    }
+
+    int exitCode = loop.run();
+
     dimmer::saveConfig();
+    dimmer::saveConfigCache();
 
     monitors.clear();
     overlays.clear();
 
-    return 0;
+    WRITE_ALLOCATION_REPORT();
+
+    return exitCode;
 }
 
@@ -0,0 +1,217 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Test.h"
+#include "Adaptive.h"
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+using namespace dimmer;
+
+static const LumaKernel kernels[] = { LumaKernel::Scalar, LumaKernel::Sse2, LumaKernel::Best };
+
+static uint32_t nextRandom(uint32_t& state) {
+    state = state * 1664525u + 1013904223u;
+    return state;
+}
+
+static bool near(float a, float b) {
+    return std::fabs(a - b) < 1e-4f;
+}
+
+/* stats for content that's uniformly this bright. */
+static LumaStats uniform(float brightness) {
+    LumaStats stats;
+    stats.mean = brightness;
+    stats.percentile = brightness;
+    stats.samples = 1000;
+    return stats;
+}
+
+TEST(lumaFollowsBt709) {
+    const uint32_t colors[] = { 0xffffffff, 0xff000000, 0xffff0000, 0xff00ff00, 0xff0000ff, 0x00ffffff };
+    const int expected[] = { 255, 0, 53, 182, 18, 255 };
+
+    for (LumaKernel kernel : kernels) {
+        if (!isLumaKernelSupported(kernel)) {
+            continue;
+        }
+        for (int i = 0; i < 6; i++) {
+            /* wide enough for the vector loop and its tail */
+            std::vector<uint32_t> row(7, colors[i]);
+            uint32_t histogram[256] = {};
+            lumaHistogram(row.data(), row.size(), 1, row.size() * 4, histogram, kernel);
+            CHECK(histogram[expected[i]] == 7);
+        }
+    }
+}
+
+TEST(theScalarKernelIsAlwaysThere) {
+    CHECK(isLumaKernelSupported(LumaKernel::Scalar));
+    CHECK(isLumaKernelSupported(LumaKernel::Best));
+}
+
+/* random images at every width up to a few vectors, with padding at the
+end of each row that mustn't be counted. */
+TEST(vectorKernelCountsLikeTheScalarOne) {
+    uint32_t state = 3;
+
+    for (size_t width = 1; width <= 37; width++) {
+        size_t height = 5;
+        size_t pitch = (width + 3) * 4;
+        std::vector<uint32_t> pixels(pitch / 4 * height);
+        for (auto& p : pixels) {
+            p = nextRandom(state);
+        }
+
+        uint32_t scalar[256] = {};
+        lumaHistogram(pixels.data(), width, height, pitch, scalar, LumaKernel::Scalar);
+
+        uint32_t total = 0;
+        for (uint32_t count : scalar) {
+            total += count;
+        }
+        CHECK(total == width * height);
+
+        for (LumaKernel kernel : kernels) {
+            if (!isLumaKernelSupported(kernel)) {
+                continue;
+            }
+            uint32_t vector[256] = {};
+            lumaHistogram(pixels.data(), width, height, pitch, vector, kernel);
+            CHECK(memcmp(scalar, vector, sizeof(scalar)) == 0);
+        }
+    }
+}
+
+TEST(statsCatchABrightWindowTheMeanMisses) {
+    uint32_t histogram[256] = {};
+    histogram[0] = 80;
+    histogram[255] = 20;
+
+    LumaStats stats = lumaStats(histogram);
+    CHECK(stats.samples == 100);
+    CHECK(near(stats.mean, 0.2f));
+    CHECK(stats.percentile == 1.0f);
+    CHECK(lumaStats(histogram, 0.5f).percentile == 0.0f);
+    CHECK(lumaStats(histogram, 0.75f).percentile == 0.0f);
+    CHECK(lumaStats(histogram, 0.81f).percentile == 1.0f);
+
+    uint32_t empty[256] = {};
+    CHECK(lumaStats(empty).samples == 0);
+}
+
+TEST(controllerStartsAtTheUsersSetting) {
+    AdaptiveController controller;
+    CHECK(controller.update(0.4f, 0.9f, uniform(1.0f), 0) == 0.4f);
+    CHECK(controller.update(0.4f, 0.9f, LumaStats(), 5000) == 0.4f);
+
+    /* a new setting starts over from there, rather than sliding */
+    CHECK(controller.update(0.7f, 0.9f, uniform(1.0f), 5250) == 0.7f);
+    CHECK(controller.update(0.95f, 0.9f, uniform(1.0f), 5500) == 0.9f);
+}
+
+TEST(controllerIgnoresSmallChanges) {
+    AdaptiveController controller(0.2f);
+    uint64_t now = 0;
+    controller.update(0.4f, 0.9f, uniform(0.5f), now);
+
+    /* 0.55 asks for 0.42, inside the deadband */
+    for (int i = 0; i < 20; i++) {
+        now += 250;
+        CHECK(controller.update(0.4f, 0.9f, uniform(0.55f), now) == 0.4f);
+    }
+
+    /* 0.6 asks for 0.44, which is outside it */
+    for (int i = 0; i < 20; i++) {
+        now += 250;
+        controller.update(0.4f, 0.9f, uniform(0.6f), now);
+    }
+    CHECK(near(controller.current(), 0.44f));
+}
+
+TEST(controllerWaitsForAChangeToHold) {
+    AdaptiveController controller(0.2f);
+    controller.update(0.4f, 0.9f, uniform(0.5f), 0);
+
+    /* bright for half a second, then back: nothing moves */
+    CHECK(controller.update(0.4f, 0.9f, uniform(1.0f), 250) == 0.4f);
+    CHECK(controller.update(0.4f, 0.9f, uniform(1.0f), 500) == 0.4f);
+    CHECK(controller.update(0.4f, 0.9f, uniform(0.5f), 750) == 0.4f);
+
+    /* bright again; the 750ms start over from here */
+    CHECK(controller.update(0.4f, 0.9f, uniform(1.0f), 1000) == 0.4f);
+    CHECK(controller.update(0.4f, 0.9f, uniform(1.0f), 1250) == 0.4f);
+    CHECK(controller.update(0.4f, 0.9f, uniform(1.0f), 1500) == 0.4f);
+    CHECK(controller.update(0.4f, 0.9f, uniform(1.0f), 1740) == 0.4f);
+    CHECK(controller.update(0.4f, 0.9f, uniform(1.0f), 1750) > 0.4f);
+}
+
+TEST(controllerSlewsToTheTarget) {
+    AdaptiveController controller(0.2f);
+    controller.update(0.4f, 0.9f, uniform(0.5f), 0);
+    controller.update(0.4f, 0.9f, uniform(1.0f), 250);
+    controller.update(0.4f, 0.9f, uniform(1.0f), 500);
+    CHECK(controller.update(0.4f, 0.9f, uniform(1.0f), 750) == 0.4f);
+
+    /* 0.25 a second, toward 0.6; the last step is short and lands on it,
+    even though it's inside the deadband by then */
+    CHECK(near(controller.update(0.4f, 0.9f, uniform(1.0f), 1000), 0.4625f));
+    CHECK(near(controller.update(0.4f, 0.9f, uniform(1.0f), 1250), 0.525f));
+    CHECK(near(controller.update(0.4f, 0.9f, uniform(1.0f), 1500), 0.5875f));
+    CHECK(near(controller.update(0.4f, 0.9f, uniform(1.0f), 1750), 0.6f));
+    CHECK(near(controller.update(0.4f, 0.9f, uniform(1.0f), 5000), 0.6f));
+
+    /* and the same way back down, after another hold */
+    uint64_t now = 5000;
+    float previous = controller.current();
+    for (int i = 0; i < 40; i++) {
+        now += 250;
+        float opacity = controller.update(0.4f, 0.9f, uniform(0.0f), now);
+        CHECK(opacity <= previous && previous - opacity <= 0.0625f + 1e-4f);
+        previous = opacity;
+    }
+    CHECK(near(controller.current(), 0.2f));
+}
+
+TEST(controllerStaysUnderTheMaximum) {
+    AdaptiveController controller(0.2f);
+    uint64_t now = 0;
+    for (int i = 0; i < 40; i++) {
+        CHECK(controller.update(0.8f, 0.85f, uniform(1.0f), now) <= 0.85f);
+        now += 250;
+    }
+    CHECK(near(controller.current(), 0.85f));
+}
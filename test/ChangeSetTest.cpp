@@ -0,0 +1,358 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Test.h"
+#include "DevicePool.h"
+#include "EventLoop.h"
+#include "File.h"
+#include "Monitor.h"
+#include "Util.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+
+using namespace dimmer;
+
+/* every allocation in the process goes through here, so a test can tell
+whether the code between two reads of the counter touched the heap. */
+static std::atomic<size_t> allocations(0);
+
+void* operator new(size_t size) {
+    allocations++;
+    void* result = std::malloc(size ? size : 1);
+    if (!result) {
+        throw std::bad_alloc();
+    }
+    return result;
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+static std::vector<Monitor> attach(size_t count) {
+    std::vector<Monitor> monitors;
+    for (size_t i = 0; i < count; i++) {
+        int left = (int) i * 1920;
+        monitors.push_back(Monitor(L"DP-" + std::to_wstring(i + 1), (int) i, { left, 0, left + 1920, 1080 }));
+    }
+    setAttachedMonitors(monitors);
+    return monitors;
+}
+
+static void setUp() {
+    static bool initialized = false;
+    if (!initialized) {
+        std::string directory = test::temporaryDirectory();
+        setenv("XDG_CONFIG_HOME", directory.c_str(), 1);
+        setenv("XDG_CONFIG_DIRS", directory.c_str(), 1);
+        loadConfig();
+        initialized = true;
+    }
+}
+
+TEST(stagingDoesNotAllocate) {
+    setUp();
+    std::vector<Monitor> monitors = attach(4);
+
+    ChangeSet changes;
+    size_t before = allocations;
+
+    for (auto& monitor : monitors) {
+        changes.setMonitorOpacity(monitor, 0.25f);
+        changes.setMonitorTemperature(monitor, 4500);
+        changes.setMonitorEnabled(monitor, true);
+        changes.setMonitorBacklight(monitor, 60);
+    }
+
+    /* restaging a monitor that's already there reuses its slot */
+    changes.setMonitorOpacity(monitors[0], 0.5f);
+
+    changes.setPollingEnabled(true);
+    changes.setDimmerEnabled(true);
+    changes.setAdaptiveEnabled(true);
+    changes.setGammaDither(GammaDither::Static);
+
+    CHECK(allocations == before);
+    CHECK(!changes.empty());
+    CHECK(allocations == before);
+
+    changes.commit();
+    CHECK(changes.empty());
+
+    CHECK(getMonitorOpacity(monitors[0]) == 0.5f);
+    CHECK(getMonitorOpacity(monitors[3]) == 0.25f);
+    CHECK(getMonitorTemperature(monitors[2]) == 4500);
+    CHECK(getMonitorBacklight(monitors[1]) == 60);
+    CHECK(isMonitorEnabled(monitors[3]));
+    CHECK(isPollingEnabled());
+    CHECK(isAdaptiveEnabled());
+    CHECK(getGammaDither() == GammaDither::Static);
+}
+
+TEST(aCommittedChangeSetStagesWithoutAllocatingAgain) {
+    setUp();
+    std::vector<Monitor> monitors = attach(2);
+
+    ChangeSet changes;
+    changes.setMonitorOpacity(monitors[0], 0.1f).commit();
+
+    size_t before = allocations;
+    changes.setMonitorOpacity(monitors[0], 0.2f);
+    changes.setMonitorOpacity(monitors[1], 0.3f);
+    CHECK(allocations == before);
+
+    changes.commit();
+    CHECK(getMonitorOpacity(monitors[0]) == 0.2f);
+    CHECK(getMonitorOpacity(monitors[1]) == 0.3f);
+}
+
+/* what the config listener last heard about two of the monitors, and how
+often it was called. */
+struct Heard {
+    const Monitor* first = nullptr;
+    const Monitor* second = nullptr;
+    int calls = 0;
+    unsigned general = 0;
+    unsigned firstChanged = 0;
+    unsigned secondChanged = 0;
+};
+
+static void listen(Heard& heard, const std::vector<Monitor>& monitors) {
+    heard.first = &monitors[0];
+    heard.second = &monitors[1];
+
+    /* a single reference, so the listener fits inside std::function. */
+    setConfigListener([&heard](const ConfigChanges& changes) {
+        const unsigned* first = changes.monitors.find(heard.first->getId());
+        const unsigned* second = changes.monitors.find(heard.second->getId());
+        heard.calls++;
+        heard.general = changes.general;
+        heard.firstChanged = first ? *first : 0;
+        heard.secondChanged = second ? *second : 0;
+    });
+}
+
+TEST(committingDoesNotAllocate) {
+    setUp();
+    std::vector<Monitor> monitors = attach(4);
+    Heard heard;
+    listen(heard, monitors);
+
+    /* the first commit gives every monitor options of its own, and that
+    does allocate; after that, their entries are reused. */
+    ChangeSet changes;
+    for (auto& monitor : monitors) {
+        changes.setMonitorOpacity(monitor, 0.1f).setMonitorTemperature(monitor, 5000);
+    }
+    changes.commit();
+    changes.setAdaptiveEnabled(false).commit();
+
+    size_t before = allocations;
+
+    changes.setMonitorOpacity(monitors[0], 0.3f);
+    changes.setMonitorTemperature(monitors[1], 4200);
+    changes.setMonitorBacklight(monitors[1], 70);
+    changes.setAdaptiveEnabled(true);
+    changes.commit();
+
+    CHECK(allocations == before);
+    CHECK(heard.calls == 3);
+    CHECK(heard.general == PropertyAdaptive);
+    CHECK(heard.firstChanged == PropertyOpacity);
+    CHECK(heard.secondChanged == (PropertyTemperature | PropertyBacklight));
+
+    CHECK(getMonitorOpacity(monitors[0]) == 0.3f);
+    CHECK(getMonitorTemperature(monitors[1]) == 4200);
+    CHECK(getMonitorBacklight(monitors[1]) == 70);
+    CHECK(isAdaptiveEnabled());
+
+    setConfigListener(nullptr);
+}
+
+TEST(changingOpacityOrTemperatureDoesNotAllocate) {
+    setUp();
+    std::vector<Monitor> monitors = attach(2);
+    Heard heard;
+    listen(heard, monitors);
+
+    setMonitorOpacity(monitors[0], 0.1f);
+    setMonitorTemperature(monitors[1], 5000);
+
+    size_t before = allocations;
+    for (int i = 1; i <= 10; i++) {
+        setMonitorOpacity(monitors[0], 0.1f + 0.05f * (float) i);
+        setMonitorTemperature(monitors[1], 5000 - 100 * i);
+    }
+    CHECK(allocations == before);
+
+    CHECK(heard.calls == 22);
+    CHECK(heard.firstChanged == 0 && heard.secondChanged == PropertyTemperature);
+    CHECK(getMonitorOpacity(monitors[0]) == 0.1f + 0.05f * 10.0f);
+    CHECK(getMonitorTemperature(monitors[1]) == 4000);
+
+    setConfigListener(nullptr);
+}
+
+static uint64_t fakeNow = 0;
+
+static uint64_t fakeClock() {
+    return fakeNow;
+}
+
+TEST(aTimerTickDoesNotAllocate) {
+    setUp();
+    std::vector<Monitor> monitors = attach(2);
+
+    fakeNow = 0;
+    EventLoop loop(&fakeClock);
+    DevicePool pool(2);
+
+    /* the way the overlays sample a display: both operations are built once
+    and resubmitted on every tick, under a key too long to be stored inline
+    in a string; the sample ends in a change of opacity. */
+    struct Sampler {
+        std::wstring key = L"\\\\.\\DISPLAY1:capture";
+        std::atomic<int> captured { 0 };
+        int delivered = 0;
+        Monitor* monitor = nullptr;
+        DevicePool::Operation capture;
+        DevicePool::Operation deliver;
+    };
+
+    Sampler sampler;
+    Sampler* self = &sampler;
+    sampler.monitor = &monitors[0];
+    sampler.capture = [self]() {
+        self->captured++;
+    };
+    sampler.deliver = [self]() {
+        self->delivered++;
+        setMonitorOpacity(*self->monitor, 0.01f * (float) (self->delivered % 50));
+    };
+
+    EventLoop::Id timer = loop.repeat(10, [self]() {
+        DevicePool::current()->submit(self->key, self->capture, self->deliver);
+    });
+
+    auto tick = [&loop, self]() {
+        int expected = self->delivered + 1;
+        fakeNow += 10;
+        loop.poll();
+        while (self->delivered < expected) {
+            std::this_thread::yield();
+            loop.poll();
+        }
+    };
+
+    /* the first few start the pool's thread and size its queues. */
+    for (int i = 0; i < 5; i++) {
+        tick();
+    }
+
+    size_t before = allocations;
+    for (int i = 0; i < 100; i++) {
+        tick();
+    }
+    CHECK(allocations == before);
+    CHECK(sampler.captured == 105);
+    CHECK(getMonitorOpacity(monitors[0]) == 0.01f * (float) (105 % 50));
+
+    loop.cancel(timer);
+}
+
+TEST(monitorsPastTheInlineSlotsStillCommit) {
+    setUp();
+    std::vector<Monitor> monitors = attach(MAX_INLINE_MONITORS + 4);
+
+    ChangeSet changes;
+    for (size_t i = 0; i < monitors.size(); i++) {
+        changes.setMonitorTemperature(monitors[i], 4000 + (int) i * 100);
+    }
+    changes.commit();
+
+    for (size_t i = 0; i < monitors.size(); i++) {
+        CHECK(getMonitorTemperature(monitors[i]) == 4000 + (int) i * 100);
+    }
+}
+
+TEST(longIdsFallBackToTheHeap) {
+    setUp();
+    std::wstring name(MAX_INLINE_MONITOR_ID + 10, L'x');
+    Monitor monitor(name, 0, { 0, 0, 1920, 1080 });
+    setAttachedMonitors({ monitor });
+
+    ChangeSet changes;
+    changes.setMonitorOpacity(monitor, 0.4f);
+    changes.commit();
+    CHECK(getMonitorOpacity(monitor) == 0.4f);
+}
+
+static void setPolicy(const std::string& contents) {
+    std::string directory = u16to8(getPolicyDirectory());
+    mkdir(directory.c_str(), 0700);
+    writeFileAtomic(getPolicyDirectory() + PATH_SEPARATOR + L"policy.json", contents.data(), contents.size());
+    reloadPolicy();
+}
+
+TEST(stagingWhatAMonitorAlreadyShowsLeavesItOnTheDefaults) {
+    setUp();
+    Monitor monitor(L"HDMI-7", 0, { 0, 0, 1920, 1080 });
+    Monitor other(L"HDMI-8", 1, { 1920, 0, 3840, 1080 });
+    setAttachedMonitors({ monitor, other });
+
+    ChangeSet()
+        .setMonitorOpacity(monitor, getMonitorOpacity(monitor))
+        .setMonitorTemperature(monitor, getMonitorTemperature(monitor))
+        .setMonitorEnabled(monitor, isMonitorEnabled(monitor))
+        .setMonitorTemperature(other, 5000)
+        .commit();
+
+    /* without options of its own, the first one keeps following the
+    policy; the second one was given some, and keeps them. */
+    setPolicy("{ \"defaults\": { \"opacity\": 0.45, \"temperature\": 4000 } }");
+    CHECK(getMonitorOpacity(monitor) == 0.45f);
+    CHECK(getMonitorTemperature(monitor) == 4000);
+    CHECK(getMonitorTemperature(other) == 5000);
+
+    setPolicy("{}");
+}
@@ -0,0 +1,213 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Test.h"
+#include "DevicePool.h"
+#include "EventLoop.h"
+#include "File.h"
+#include "Journal.h"
+#include "Monitor.h"
+#include "Util.h"
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace dimmer;
+
+static uint64_t fakeNow = 0;
+
+static uint64_t fakeClock() {
+    return fakeNow;
+}
+
+static std::wstring getConfigFilename() {
+    return getDataDirectory() + PATH_SEPARATOR + L"config.json";
+}
+
+static std::wstring getJournalFilename() {
+    return getDataDirectory() + PATH_SEPARATOR + L"journal.bin";
+}
+
+static size_t journalSize() {
+    MappedFile file;
+    return file.open(getJournalFilename()) ? file.size() : 0;
+}
+
+/* the config layer is global, so every test uses a monitor of its own. */
+static Monitor setUp(const wchar_t* name) {
+    std::string directory = test::temporaryDirectory();
+    setenv("XDG_CONFIG_HOME", directory.c_str(), 1);
+    setenv("XDG_CONFIG_DIRS", directory.c_str(), 1);
+
+    Monitor monitor(name, 0, { 0, 0, 2560, 1440 });
+    setAttachedMonitors({ monitor });
+    loadConfig();
+
+    /* the first change to a monitor is a full save, which puts it into the
+    journal's slot table; everything after that is journaled. */
+    ChangeSet().setMonitorOpacity(monitor, 0.1f).commit();
+    return monitor;
+}
+
+/* replays journal.bin over an empty config, against whatever config.json
+is on disk now. */
+static Config replayJournal() {
+    uint64_t writeTime = 0, size = 0;
+    getFileStamp(getConfigFilename(), writeTime, size);
+    Config result;
+    Journal::replay(getJournalFilename(), writeTime, size, MonitorOptions(), result);
+    return result;
+}
+
+TEST(compactionWritesOnThePoolAndRestartsTheJournal) {
+    EventLoop loop(&fakeClock);
+    Monitor monitor = setUp(L"DP-1");
+    size_t empty = journalSize();
+
+    uint64_t writeTime, size;
+    getFileStamp(getConfigFilename(), writeTime, size);
+
+    {
+        DevicePool pool;
+        ChangeSet().setMonitorTemperature(monitor, 4500).commit();
+        CHECK(journalSize() > empty);
+
+        fakeNow += 10000;
+        loop.poll(); /* the compaction timer submits the write */
+    } /* the pool drains here */
+
+    uint64_t newWriteTime, newSize;
+    getFileStamp(getConfigFilename(), newWriteTime, newSize);
+    CHECK(newWriteTime != writeTime || newSize != size);
+
+    /* the journal is only restarted once the completion has run here */
+    CHECK(journalSize() > empty);
+    loop.poll();
+    CHECK(journalSize() == empty);
+    CHECK(getMonitorTemperature(monitor) == 4500);
+}
+
+TEST(changesMadeDuringTheWriteAreJournaledAgain) {
+    EventLoop loop(&fakeClock);
+    Monitor monitor = setUp(L"DP-2");
+
+    {
+        DevicePool pool;
+        ChangeSet().setMonitorTemperature(monitor, 4500).commit();
+        fakeNow += 10000;
+        loop.poll();
+
+        /* the copy being written has 4500 and the old opacity */
+        ChangeSet().setMonitorOpacity(monitor, 0.6f).commit();
+    }
+
+    loop.poll();
+
+    Config replayed = replayJournal();
+    auto it = replayed.monitors.find(L"DP-2");
+    CHECK(it != replayed.monitors.end());
+    CHECK(it != replayed.monitors.end() && it->second.opacity == 0.6f);
+    CHECK(getMonitorOpacity(monitor) == 0.6f);
+}
+
+TEST(aSaveThatOvertakesACompactionIsNotUndone) {
+    EventLoop loop(&fakeClock);
+    Monitor monitor = setUp(L"DP-3");
+
+    {
+        DevicePool pool;
+        ChangeSet().setMonitorTemperature(monitor, 4500).commit();
+        fakeNow += 10000;
+        loop.poll();
+
+        /* a full save, e.g. from a layout change, while the write runs */
+        saveConfig();
+    }
+
+    uint64_t writeTime, size;
+    getFileStamp(getConfigFilename(), writeTime, size);
+    loop.poll();
+
+    /* nothing is rewritten, and the journal that was restarted by the save
+    still matches config.json */
+    uint64_t newWriteTime, newSize;
+    getFileStamp(getConfigFilename(), newWriteTime, newSize);
+    CHECK(newWriteTime == writeTime && newSize == size);
+
+    ChangeSet().setMonitorBacklight(monitor, 30).commit();
+    Config replayed = replayJournal();
+    CHECK(replayed.monitors[L"DP-3"].backlight == 30);
+}
+
+TEST(aCrashBeforeTheJournalRestartsLosesNothing) {
+    EventLoop loop(&fakeClock);
+    Monitor monitor = setUp(L"DP-5");
+
+    {
+        DevicePool pool;
+        ChangeSet().setMonitorTemperature(monitor, 4500).commit();
+        fakeNow += 10000;
+        loop.poll();
+
+        /* goes to the old journal, since the new one doesn't exist yet */
+        ChangeSet().setMonitorOpacity(monitor, 0.6f).commit();
+    }
+
+    /* config.json has been replaced, but the completion that restarts the
+    journal hasn't run: the process dies here, and starts up again. */
+    uint64_t writeTime, size, baseWriteTime, baseSize;
+    getFileStamp(getConfigFilename(), writeTime, size);
+    CHECK(Journal::readBase(getJournalFilename(), baseWriteTime, baseSize));
+    CHECK(baseWriteTime != writeTime || baseSize != size);
+
+    loadConfig();
+    CHECK(getMonitorTemperature(monitor) == 4500);
+    CHECK(getMonitorOpacity(monitor) == 0.6f);
+
+    /* the stale completion finds a newer save and leaves it alone */
+    loop.poll();
+    CHECK(getMonitorOpacity(monitor) == 0.6f);
+}
+
+TEST(withoutAPoolCompactionIsASave) {
+    EventLoop loop(&fakeClock);
+    Monitor monitor = setUp(L"DP-4");
+    size_t empty = journalSize();
+
+    ChangeSet().setMonitorTemperature(monitor, 5000).commit();
+    fakeNow += 10000;
+    loop.poll();
+    CHECK(journalSize() == empty);
+}
@@ -0,0 +1,253 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Test.h"
+#include "Compositor.h"
+#include "File.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace dimmer;
+
+/* the golden images are in test/golden. after a change to the color math
+that's meant to change what's on screen, run this with
+DIMMER_UPDATE_GOLDEN=1 to write new ones, look at them, and commit them. */
+static const std::string goldenDirectory = GOLDEN_DIRECTORY;
+
+static const BlendKernel kernels[] = { BlendKernel::Scalar, BlendKernel::Sse2, BlendKernel::Avx2 };
+
+static uint32_t nextRandom(uint32_t& state) {
+    state = state * 1664525u + 1013904223u;
+    return state;
+}
+
+/* every 8-bit level on each channel, then grays, then noise with varying
+alpha bytes, which the blend has to leave alone. */
+static Image makeTestCard() {
+    Image image;
+    image.width = 256;
+    image.height = 8;
+    image.pixels.resize(256 * 8);
+
+    uint32_t state = 1;
+    for (uint32_t x = 0; x < 256; x++) {
+        image.pixels[x] = 0xff000000 | (x << 16);
+        image.pixels[256 + x] = 0xff000000 | (x << 8);
+        image.pixels[512 + x] = 0xff000000 | x;
+        image.pixels[768 + x] = 0xff000000 | (x << 16) | (x << 8) | x;
+        for (int row = 4; row < 8; row++) {
+            image.pixels[row * 256 + x] = nextRandom(state);
+        }
+    }
+
+    return image;
+}
+
+/* the largest difference between any two channels, or 256 if the images
+aren't even the same size. */
+static int maximumDifference(const Image& a, const Image& b) {
+    if (a.width != b.width || a.height != b.height || a.pixels.size() != b.pixels.size()) {
+        return 256;
+    }
+
+    int result = 0;
+    for (size_t i = 0; i < a.pixels.size(); i++) {
+        for (int shift = 0; shift < 32; shift += 8) {
+            int difference = abs((int) ((a.pixels[i] >> shift) & 0xff) - (int) ((b.pixels[i] >> shift) & 0xff));
+            result = std::max(result, difference);
+        }
+    }
+    return result;
+}
+
+static MonitorOptions optionsFor(float opacity, int temperature) {
+    MonitorOptions options;
+    options.opacity = opacity;
+    options.temperature = temperature;
+    return options;
+}
+
+/* composites the test card and compares it with the golden image. the
+overlay is pure integer math and has to match exactly; the ramps come from
+floating point, so they're allowed one level either way. */
+static void checkGolden(const char* name, float opacity, int temperature) {
+    std::string fn = goldenDirectory + "/" + name + ".bmp";
+
+    Image actual = makeTestCard();
+    composite(actual, optionsFor(opacity, temperature));
+
+    if (getenv("DIMMER_UPDATE_GOLDEN")) {
+        CHECK(writeBmp(test::widen(fn), actual));
+        return;
+    }
+
+    MappedFile file;
+    Image expected;
+    CHECK(file.open(test::widen(fn)));
+    CHECK(decodeBmp((const uint8_t*) file.data(), file.size(), expected));
+
+    int allowed = (temperature == DEFAULT_TEMPERATURE) ? 0 : 1;
+    int difference = maximumDifference(actual, expected);
+    if (difference > allowed) {
+        fprintf(stderr, "%s differs from the golden image by up to %d\n", name, difference);
+    }
+    CHECK(difference <= allowed);
+
+    /* and every kernel draws the same thing */
+    for (BlendKernel kernel : kernels) {
+        Image other = makeTestCard();
+        composite(other, optionsFor(opacity, temperature), kernel);
+        CHECK(other.pixels == actual.pixels);
+    }
+}
+
+TEST(overlayAtAQuarter) {
+    checkGolden("opacity-25", 0.25f, DEFAULT_TEMPERATURE);
+}
+
+TEST(overlayAtHalf) {
+    checkGolden("opacity-50", 0.5f, DEFAULT_TEMPERATURE);
+}
+
+TEST(overlayIsCappedBeforeBlack) {
+    checkGolden("opacity-100", 1.0f, DEFAULT_TEMPERATURE);
+}
+
+TEST(rampAtThreeThousandFourHundredKelvin) {
+    checkGolden("temperature-3400", 0.0f, 3400);
+}
+
+TEST(rampAndOverlayAtFourThousandFiveHundredKelvin) {
+    checkGolden("opacity-40-temperature-4500", 0.4f, 4500);
+}
+
+TEST(rampAndOverlayAtTheWarmEnd) {
+    checkGolden("opacity-80-temperature-1000", 0.8f, 1000);
+}
+
+TEST(nothingToDoLeavesTheImageAlone) {
+    Image card = makeTestCard();
+
+    Image image = makeTestCard();
+    composite(image, optionsFor(0.0f, DEFAULT_TEMPERATURE));
+    CHECK(image.pixels == card.pixels);
+
+    MonitorOptions disabled = optionsFor(0.8f, 3400);
+    disabled.enabled = false;
+    composite(image, disabled);
+    CHECK(image.pixels == card.pixels);
+}
+
+TEST(overlayAlphaIsCapped) {
+    CHECK(overlayAlpha(-1.0f) == 0);
+    CHECK(overlayAlpha(0.0f) == 0);
+    CHECK(overlayAlpha(0.5f) == 127);
+    CHECK(overlayAlpha(0.94f) == 239);
+    CHECK(overlayAlpha(0.95f) == 240);
+    CHECK(overlayAlpha(1.0f) == 240);
+    CHECK(overlayAlpha(2.0f) == 240);
+}
+
+TEST(rampTemperatureIsClamped) {
+    CHECK(rampTemperature(500) == 1000);
+    CHECK(rampTemperature(3400) == 3400);
+    CHECK(rampTemperature(6500) == 6000);
+}
+
+/* each vector kernel against the exact formula, for every alpha, at every
+length up to a few vectors (so the tails are covered) and from an unaligned
+start. */
+TEST(vectorKernelsMatchTheScalarOne) {
+    std::vector<uint32_t> source(67);
+    uint32_t state = 7;
+    for (auto& p : source) {
+        p = nextRandom(state);
+    }
+
+    for (BlendKernel kernel : kernels) {
+        if (!isBlendKernelSupported(kernel)) {
+            continue;
+        }
+
+        for (int alpha = 0; alpha < 256; alpha++) {
+            std::vector<uint32_t> pixels = source;
+            blendOverlay(pixels.data() + 1, pixels.size() - 1, (uint8_t) alpha, kernel);
+
+            bool exact = pixels[0] == source[0];
+            for (size_t i = 1; i < pixels.size(); i++) {
+                uint32_t expected = source[i] & 0xff000000;
+                for (int shift = 0; shift < 24; shift += 8) {
+                    uint32_t c = (source[i] >> shift) & 0xff;
+                    uint32_t scaled = (c * (255 - alpha) * 2 + 255) / 510;
+                    expected |= scaled << shift;
+                }
+                exact = exact && pixels[i] == expected;
+            }
+            CHECK(exact);
+        }
+
+        for (size_t count = 0; count <= 33; count++) {
+            std::vector<uint32_t> scalar(source.begin(), source.begin() + count);
+            std::vector<uint32_t> vector = scalar;
+            blendOverlay(scalar.data(), count, 200, BlendKernel::Scalar);
+            blendOverlay(vector.data(), count, 200, kernel);
+            CHECK(scalar == vector);
+        }
+    }
+}
+
+TEST(bmpRoundTrips) {
+    Image image = makeTestCard();
+    std::vector<uint8_t> bytes = encodeBmp(image);
+    CHECK(bytes.size() == 54 + image.pixels.size() * 4);
+
+    Image decoded;
+    CHECK(decodeBmp(bytes.data(), bytes.size(), decoded));
+    CHECK(decoded.width == image.width && decoded.height == image.height);
+    CHECK(decoded.pixels == image.pixels);
+
+    /* bottom-up, the way most other tools write them */
+    std::vector<uint8_t> flipped = bytes;
+    int32_t height = image.height;
+    memcpy(flipped.data() + 22, &height, 4);
+    CHECK(decodeBmp(flipped.data(), flipped.size(), decoded));
+    CHECK(decoded.pixels[0] == image.pixels[(image.height - 1) * image.width]);
+
+    CHECK(!decodeBmp(bytes.data(), bytes.size() - 1, decoded));
+    CHECK(!decodeBmp(bytes.data(), 20, decoded));
+}
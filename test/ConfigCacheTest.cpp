@@ -0,0 +1,143 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Test.h"
+#include "ConfigCache.h"
+#include "File.h"
+#include "Util.h"
+#include <cstring>
+#include <string>
+
+using namespace dimmer;
+
+static std::wstring setUp() {
+    std::string directory = test::temporaryDirectory();
+    setenv("XDG_CONFIG_HOME", directory.c_str(), 1);
+    std::wstring json = getDataDirectory() + PATH_SEPARATOR + L"config.json";
+    std::string contents = "{}";
+    writeFileAtomic(json, contents.data(), contents.size());
+    return json;
+}
+
+static std::wstring getCacheFilename() {
+    return getDataDirectory() + PATH_SEPARATOR + L"config.bin";
+}
+
+static Config sample(size_t monitors) {
+    Config config;
+    for (size_t i = 0; i < monitors; i++) {
+        MonitorOptions options;
+        options.opacity = (float) i / (float) monitors;
+        options.temperature = 4000 + (int) i;
+        options.backlight = (int) i % 100;
+        options.enabled = (i % 2) == 0;
+        config.monitors[L"monitor-" + std::to_wstring(i)] = options;
+    }
+    config.presets[L"night"][PRESET_ANY_MONITOR].opacity = 0.5f;
+    config.presets[L"day"][L"monitor-1"].temperature = 6500;
+    config.layouts[0x1234][L"monitor-0"].enabled = false;
+    config.layout = 0x5678;
+    config.adaptiveEnabled = true;
+    config.gammaDither = GammaDither::Temporal;
+    return config;
+}
+
+TEST(aSnapshotReadsBackEverything) {
+    std::wstring json = setUp();
+    Config written = sample(300);
+    CHECK(writeConfigCache(json, written));
+
+    Config read;
+    CHECK(readConfigCache(json, read));
+    CHECK(read.monitors == written.monitors);
+    CHECK(read.presets == written.presets);
+    CHECK(read.layouts == written.layouts);
+    CHECK(read.layout == written.layout);
+    CHECK(read.adaptiveEnabled && !read.pollingEnabled && read.globalEnabled);
+    CHECK(read.gammaDither == GammaDither::Temporal);
+}
+
+TEST(anEditedJsonFileInvalidatesTheSnapshot) {
+    std::wstring json = setUp();
+    CHECK(writeConfigCache(json, sample(4)));
+
+    std::string contents = "{ \"monitors\": {} }";
+    writeFileAtomic(json, contents.data(), contents.size());
+
+    Config read;
+    CHECK(!readConfigCache(json, read));
+}
+
+TEST(outOfOrderRecordsAreRejected) {
+    std::wstring json = setUp();
+    CHECK(writeConfigCache(json, sample(4)));
+
+    /* swap the first two ids; the checksum is fixed up so that only the
+    ordering check stands in the way. */
+    MappedFile file;
+    CHECK(file.open(getCacheFilename()));
+    std::string contents(file.data(), file.size());
+    file.close();
+
+    const size_t header = 56, group = 208, record = 208;
+    size_t first = header + 3 * group;
+    std::string a = contents.substr(first, record);
+    contents.replace(first, record, contents.substr(first + record, record));
+    contents.replace(first + record, record, a);
+
+    uint32_t hash = 2166136261u;
+    for (size_t i = header; i < contents.size(); i++) {
+        hash = (hash ^ (uint8_t) contents[i]) * 16777619u;
+    }
+    memcpy(&contents[8], &hash, sizeof(hash));
+    CHECK(writeFileAtomic(getCacheFilename(), contents.data(), contents.size()));
+
+    Config read;
+    CHECK(!readConfigCache(json, read));
+    CHECK(read.monitors.empty());
+}
+
+TEST(aTruncatedSnapshotIsRejected) {
+    std::wstring json = setUp();
+    CHECK(writeConfigCache(json, sample(4)));
+
+    MappedFile file;
+    CHECK(file.open(getCacheFilename()));
+    std::string contents(file.data(), file.size() - 1);
+    file.close();
+    CHECK(writeFileAtomic(getCacheFilename(), contents.data(), contents.size()));
+
+    Config read;
+    CHECK(!readConfigCache(json, read));
+}
@@ -0,0 +1,112 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Test.h"
+#include "ConfigWatcher.h"
+#include "EventLoop.h"
+#include "File.h"
+#include "Util.h"
+#include <cstdio>
+#include <string>
+
+using namespace dimmer;
+
+/* runs a loop until the watcher reports the file, or half a second passes. */
+static bool waitForChange(ConfigWatcher& watcher) {
+    EventLoop loop;
+    bool changed = false;
+    auto id = loop.addHandle(watcher.handle(), [&]() {
+        if (watcher.changed()) {
+            changed = true;
+            loop.quit();
+        }
+    });
+    auto timeout = loop.schedule(500, [&]() { loop.quit(); });
+    loop.run();
+    loop.removeHandle(id);
+    loop.cancel(timeout);
+    return changed;
+}
+
+TEST(aMissingDirectoryIsNotWatched) {
+    ConfigWatcher watcher(test::widen(test::temporaryDirectory() + "/missing"), L"config.json");
+    CHECK(!watcher.isOpen());
+    CHECK(!watcher.changed());
+}
+
+TEST(anAtomicReplaceIsReported) {
+    std::wstring directory = test::widen(test::temporaryDirectory());
+    ConfigWatcher watcher(directory, L"config.json");
+    CHECK(watcher.isOpen());
+
+    std::string contents = "{}";
+    CHECK(writeFileAtomic(directory + PATH_SEPARATOR + L"config.json", contents.data(), contents.size()));
+    CHECK(waitForChange(watcher));
+}
+
+TEST(anInPlaceWriteIsReported) {
+    std::string directory = test::temporaryDirectory();
+    ConfigWatcher watcher(test::widen(directory), L"config.json");
+
+    FILE* file = fopen((directory + "/config.json").c_str(), "w");
+    CHECK(file != nullptr);
+    fputs("{}", file);
+    fclose(file);
+    CHECK(waitForChange(watcher));
+}
+
+TEST(otherFilesInTheDirectoryAreIgnored) {
+    std::wstring directory = test::widen(test::temporaryDirectory());
+    ConfigWatcher watcher(directory, L"config.json");
+
+    std::string contents = "{}";
+    CHECK(writeFileAtomic(directory + PATH_SEPARATOR + L"policy.json", contents.data(), contents.size()));
+    CHECK(!waitForChange(watcher));
+
+    /* the queue was drained, and the watch still works afterwards */
+    CHECK(writeFileAtomic(directory + PATH_SEPARATOR + L"config.json", contents.data(), contents.size()));
+    CHECK(waitForChange(watcher));
+}
+
+TEST(everyChangeIsReportedOnce) {
+    std::wstring directory = test::widen(test::temporaryDirectory());
+    ConfigWatcher watcher(directory, L"config.json");
+
+    std::string contents = "{}";
+    for (int i = 0; i < 3; i++) {
+        CHECK(writeFileAtomic(directory + PATH_SEPARATOR + L"config.json", contents.data(), contents.size()));
+        CHECK(waitForChange(watcher));
+    }
+    CHECK(!watcher.changed());
+}
@@ -0,0 +1,222 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Test.h"
+#include "Ddc.h"
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+using namespace dimmer;
+
+using Bytes = std::vector<uint8_t>;
+
+/* an I2C bus with a display on it that says whatever the test queued up. */
+class FakeI2cBus : public I2cBus {
+    public:
+        bool write(uint8_t address, const uint8_t* data, size_t size) override {
+            this->addresses.push_back(address);
+            this->writes.push_back(Bytes(data, data + size));
+            return this->writable;
+        }
+
+        bool read(uint8_t address, uint8_t* data, size_t size) override {
+            this->addresses.push_back(address);
+            if (this->replies.empty()) {
+                return false;
+            }
+            Bytes reply = this->replies.front();
+            this->replies.pop_front();
+            if (reply.size() < size) {
+                return false; /* a short read */
+            }
+            std::copy(reply.begin(), reply.begin() + size, data);
+            return true;
+        }
+
+        std::vector<uint8_t> addresses;
+        std::vector<Bytes> writes;
+        std::deque<Bytes> replies;
+        bool writable = true;
+};
+
+static uint8_t xorAll(uint8_t seed, const Bytes& bytes) {
+    for (uint8_t byte : bytes) {
+        seed ^= byte;
+    }
+    return seed;
+}
+
+/* a "get VCP" reply as a display sends it: from 0x6e, checksummed as if
+it included the host's 0x50 address. padded out to a full read. */
+static Bytes reply(uint8_t code, uint16_t current, uint16_t maximum, uint8_t result = 0, uint8_t seed = 0x50) {
+    Bytes bytes = {
+        0x6e, 0x88, 0x02, result, code, 0x00,
+        (uint8_t) (maximum >> 8), (uint8_t) maximum,
+        (uint8_t) (current >> 8), (uint8_t) current
+    };
+    bytes.push_back(xorAll(seed, bytes));
+    return bytes;
+}
+
+static DdcReply decode(const Bytes& bytes, uint8_t code, VcpValue& value) {
+    return decodeVcpReply(bytes.data(), bytes.size(), code, value);
+}
+
+TEST(requestsAreChecksummedFromTheDisplaysWriteAddress) {
+    uint8_t out[DDC_MAX_REQUEST];
+
+    /* the brightness query every DDC tool sends; 0xac is its well-known
+    checksum, 0x6e ^ 0x51 ^ 0x82 ^ 0x01 ^ 0x10. */
+    size_t size = encodeVcpGet(VCP_LUMINANCE, out);
+    CHECK((Bytes(out, out + size) == Bytes { 0x51, 0x82, 0x01, 0x10, 0xac }));
+
+    size = encodeVcpSet(VCP_LUMINANCE, 0x0132, out);
+    Bytes set(out, out + size);
+    CHECK((set == Bytes { 0x51, 0x84, 0x03, 0x10, 0x01, 0x32, 0x9b }));
+    CHECK(xorAll(0x6e, set) == 0); /* the checksum cancels out everything before it */
+}
+
+TEST(repliesAreChecksummedFromTheHostsAddress) {
+    VcpValue value;
+
+    Bytes good = reply(VCP_LUMINANCE, 50, 100);
+    CHECK(good.back() == 0xf2);
+    CHECK(decode(good, VCP_LUMINANCE, value) == DdcReply::Ok);
+    CHECK(value.current == 50);
+    CHECK(value.maximum == 100);
+
+    /* seeded with anything else, the same reply is garbage */
+    for (uint8_t seed : { 0x00, 0x51, 0x6e, 0x6f }) {
+        CHECK(decode(reply(VCP_LUMINANCE, 50, 100, 0, seed), VCP_LUMINANCE, value) == DdcReply::Invalid);
+    }
+}
+
+TEST(shortRepliesAreRejected) {
+    Bytes good = reply(VCP_LUMINANCE, 50, 100);
+    VcpValue value;
+
+    for (size_t size = 0; size < good.size(); size++) {
+        CHECK(decodeVcpReply(good.data(), size, VCP_LUMINANCE, value) == DdcReply::Invalid);
+    }
+}
+
+TEST(corruptRepliesAreNeverTakenAsValues) {
+    Bytes good = reply(VCP_LUMINANCE, 50, 100);
+
+    for (size_t i = 0; i < good.size(); i++) {
+        for (int bit = 0; bit < 8; bit++) {
+            Bytes corrupt = good;
+            corrupt[i] ^= (uint8_t) (1 << bit);
+            VcpValue value;
+            CHECK(decode(corrupt, VCP_LUMINANCE, value) != DdcReply::Ok);
+        }
+    }
+}
+
+TEST(otherKindsOfReply) {
+    VcpValue value;
+
+    /* a null message, checksummed like any other */
+    CHECK(decode(Bytes { 0x6e, 0x80, 0x50 ^ 0x6e ^ 0x80 }, VCP_LUMINANCE, value) == DdcReply::Busy);
+
+    CHECK(decode(reply(VCP_CONTRAST, 50, 100, 1), VCP_CONTRAST, value) == DdcReply::Unsupported);
+
+    /* an answer to a different question */
+    CHECK(decode(reply(VCP_CONTRAST, 50, 100), VCP_LUMINANCE, value) == DdcReply::Invalid);
+}
+
+TEST(getVcpWaitsForTheReplyAndRetriesBadOnes) {
+    FakeI2cBus bus;
+    std::vector<uint32_t> sleeps;
+    DdcTransport transport(bus, [&sleeps](uint32_t ms) { sleeps.push_back(ms); });
+
+    Bytes corrupt = reply(VCP_LUMINANCE, 50, 100);
+    corrupt[8] ^= 0x01;
+    bus.replies = { corrupt, Bytes { 0x6e }, reply(VCP_LUMINANCE, 70, 100) };
+
+    VcpValue value;
+    CHECK(transport.getVcp(VCP_LUMINANCE, value));
+    CHECK(value.current == 70);
+
+    /* the same request each time, to the display's 7-bit address */
+    CHECK(bus.writes.size() == 3);
+    for (auto& write : bus.writes) {
+        CHECK((write == Bytes { 0x51, 0x82, 0x01, 0x10, 0xac }));
+    }
+    for (uint8_t address : bus.addresses) {
+        CHECK(address == DDC_ADDRESS);
+    }
+
+    /* 40ms before each read, and a pause before each retry */
+    CHECK((sleeps == std::vector<uint32_t> { 40, 50, 40, 50, 40 }));
+}
+
+TEST(getVcpGivesUpAfterThreeAttempts) {
+    FakeI2cBus bus;
+    DdcTransport transport(bus, [](uint32_t) { });
+
+    Bytes corrupt = reply(VCP_LUMINANCE, 50, 100);
+    corrupt.back() ^= 0xff;
+    bus.replies = { corrupt, corrupt, corrupt, reply(VCP_LUMINANCE, 50, 100) };
+
+    VcpValue value;
+    CHECK(!transport.getVcp(VCP_LUMINANCE, value));
+    CHECK(bus.writes.size() == 3);
+    CHECK(bus.replies.size() == 1);
+}
+
+TEST(unsupportedFeaturesAreNotRetried) {
+    FakeI2cBus bus;
+    DdcTransport transport(bus, [](uint32_t) { });
+    bus.replies = { reply(VCP_COLOR_PRESET, 0, 0, 1) };
+
+    VcpValue value;
+    CHECK(!transport.getVcp(VCP_COLOR_PRESET, value));
+    CHECK(bus.writes.size() == 1);
+}
+
+TEST(setVcpWaitsAfterWriting) {
+    FakeI2cBus bus;
+    std::vector<uint32_t> sleeps;
+    DdcTransport transport(bus, [&sleeps](uint32_t ms) { sleeps.push_back(ms); });
+
+    CHECK(transport.setVcp(VCP_LUMINANCE, 0x0132));
+    CHECK((bus.writes == std::vector<Bytes> { { 0x51, 0x84, 0x03, 0x10, 0x01, 0x32, 0x9b } }));
+    CHECK((sleeps == std::vector<uint32_t> { 50 }));
+
+    bus.writable = false;
+    CHECK(!transport.setVcp(VCP_LUMINANCE, 0x0132));
+    CHECK(bus.writes.size() == 4);
+}
@@ -0,0 +1,232 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Test.h"
+#include "DevicePool.h"
+#include "EventLoop.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace dimmer;
+
+/* holds device calls until the test lets them through. */
+class Gate {
+    public:
+        void open() {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->opened = true;
+            this->changed.notify_all();
+        }
+
+        void wait() {
+            std::unique_lock<std::mutex> guard(this->lock);
+            this->changed.wait(guard, [this]() { return this->opened; });
+        }
+
+    private:
+        std::mutex lock;
+        std::condition_variable changed;
+        bool opened = false;
+};
+
+/* stands in for the monitors: records every write, and how many were in
+flight at once, overall and per device. */
+struct FakeBackend {
+    std::mutex lock;
+    std::map<std::wstring, std::vector<int>> writes;
+    std::map<std::wstring, int> inFlight;
+    std::set<std::thread::id> threads;
+    int running = 0;
+    int mostRunning = 0;
+    bool overlapped = false;
+
+    DevicePool::Operation write(const std::wstring& device, int value, Gate* gate = nullptr) {
+        return [this, device, value, gate]() {
+            {
+                std::lock_guard<std::mutex> guard(this->lock);
+                this->threads.insert(std::this_thread::get_id());
+                this->mostRunning = std::max(this->mostRunning, ++this->running);
+                this->overlapped |= ++this->inFlight[device] > 1;
+            }
+
+            if (gate) {
+                gate->wait();
+            }
+
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->writes[device].push_back(value);
+            this->running--;
+            this->inFlight[device]--;
+        };
+    }
+
+    int currentlyRunning() {
+        std::lock_guard<std::mutex> guard(this->lock);
+        return this->running;
+    }
+};
+
+/* polls until the condition holds, or gives up after a couple of seconds. */
+static bool waitFor(EventLoop& loop, std::function<bool()> condition) {
+    for (int i = 0; i < 2000; i++) {
+        loop.poll();
+        if (condition()) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+
+TEST(noMoreThanMaxThreadsRunAtOnce) {
+    EventLoop loop;
+    FakeBackend backend;
+    Gate gate;
+    int completed = 0;
+
+    {
+        DevicePool pool(4);
+        for (int i = 0; i < 16; i++) {
+            std::wstring device = L"DP-" + std::to_wstring(i);
+            pool.submit(device, backend.write(device, i, &gate), [&completed]() { completed++; });
+        }
+
+        /* every thread is now stuck on a device, and the rest have to wait */
+        CHECK(waitFor(loop, [&backend]() { return backend.currentlyRunning() == 4; }));
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        CHECK(backend.currentlyRunning() == 4);
+
+        gate.open();
+        CHECK(waitFor(loop, [&completed]() { return completed == 16; }));
+    }
+
+    CHECK(backend.mostRunning == 4);
+    CHECK(backend.threads.size() <= 4);
+    CHECK(backend.writes.size() == 16);
+}
+
+TEST(onlyTheNewestWaitingOperationPerDeviceRuns) {
+    EventLoop loop;
+    FakeBackend backend;
+    Gate gate;
+    std::vector<int> completions;
+
+    {
+        DevicePool pool;
+        auto submit = [&](const std::wstring& device, int value, Gate* gate) {
+            pool.submit(device, backend.write(device, value, gate), [&completions, value]() {
+                completions.push_back(value);
+            });
+        };
+
+        submit(L"DP-1", 1, &gate);
+        CHECK(waitFor(loop, [&backend]() { return backend.currentlyRunning() == 1; }));
+
+        /* the first is running; these three queue up behind it, each one
+        replacing the last. another device isn't held up by any of it. */
+        submit(L"DP-1", 2, nullptr);
+        submit(L"DP-1", 3, nullptr);
+        submit(L"DP-1", 4, nullptr);
+        submit(L"HDMI-1", 10, nullptr);
+        CHECK(waitFor(loop, [&completions]() { return completions.size() == 1; }));
+        CHECK((completions == std::vector<int> { 10 }));
+
+        gate.open();
+        CHECK(waitFor(loop, [&completions]() { return completions.size() == 3; }));
+    }
+
+    loop.poll();
+    CHECK((backend.writes[L"DP-1"] == std::vector<int> { 1, 4 }));
+    CHECK((completions == std::vector<int> { 10, 1, 4 }));
+    CHECK(!backend.overlapped);
+}
+
+TEST(completionsRunOnTheSubmittingLoop) {
+    EventLoop loop;
+    FakeBackend backend;
+    std::thread::id completedOn;
+
+    {
+        DevicePool pool;
+        pool.submit(L"DP-1", backend.write(L"DP-1", 1), [&completedOn]() {
+            completedOn = std::this_thread::get_id();
+        });
+        CHECK(waitFor(loop, [&completedOn]() { return completedOn != std::thread::id(); }));
+    }
+
+    CHECK(completedOn == std::this_thread::get_id());
+    CHECK(backend.threads.count(std::this_thread::get_id()) == 0);
+}
+
+TEST(destroyingThePoolFinishesEverythingSubmitted) {
+    EventLoop loop;
+    FakeBackend backend;
+    int completed = 0;
+
+    {
+        DevicePool pool(2);
+        for (int i = 0; i < 8; i++) {
+            std::wstring device = L"DP-" + std::to_wstring(i);
+            pool.submit(device, [&backend, device, i]() {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                backend.write(device, i)();
+            }, [&completed]() { completed++; });
+        }
+    } /* no waiting before this */
+
+    CHECK(backend.writes.size() == 8);
+
+    /* the completions were posted, and run once the loop gets to them */
+    CHECK(completed == 0);
+    loop.poll();
+    CHECK(completed == 8);
+}
+
+TEST(withoutALoopOperationsRunRightAway) {
+    FakeBackend backend;
+    bool completed = false;
+
+    DevicePool pool;
+    pool.submit(L"DP-1", backend.write(L"DP-1", 1), [&completed]() { completed = true; });
+    CHECK(backend.writes[L"DP-1"].size() == 1);
+    CHECK(completed);
+}
@@ -0,0 +1,230 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Test.h"
+#include "EventLoop.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+using namespace dimmer;
+
+static uint64_t fakeNow = 0;
+
+static uint64_t fakeClock() {
+    return fakeNow;
+}
+
+/* a pipe whose read end is watched; closed again on the way out. */
+struct Pipe {
+    int fds[2];
+    Pipe() { CHECK(pipe(this->fds) == 0); }
+    ~Pipe() { close(this->fds[0]); close(this->fds[1]); }
+    void write() { char byte = 1; CHECK(::write(this->fds[1], &byte, 1) == 1); }
+    void drain() { char byte; CHECK(::read(this->fds[0], &byte, 1) == 1); }
+};
+
+/* if a test goes wrong, the loop gives up after a while rather than
+hanging the whole run. */
+static void guard(EventLoop& loop) {
+    loop.schedule(2000, [&loop]() { loop.quit(-1); });
+}
+
+TEST(aReadyDescriptorRunsItsCallback) {
+    EventLoop loop;
+    Pipe pipe;
+    int calls = 0;
+
+    loop.addHandle(pipe.fds[0], [&]() {
+        pipe.drain();
+        if (++calls == 2) {
+            loop.quit(7);
+        }
+    });
+
+    std::thread writer([&pipe]() {
+        pipe.write();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        pipe.write();
+    });
+
+    guard(loop);
+    CHECK(loop.run() == 7);
+    writer.join();
+    CHECK(calls == 2);
+}
+
+TEST(aRemovedDescriptorIsNotDispatched) {
+    EventLoop loop;
+    Pipe pipe;
+    bool called = false;
+
+    auto id = loop.addHandle(pipe.fds[0], [&]() { called = true; });
+    loop.removeHandle(id);
+    pipe.write();
+
+    loop.schedule(30, [&loop]() { loop.quit(); });
+    loop.run();
+    CHECK(!called);
+}
+
+TEST(aCallbackMayRemoveItsOwnDescriptor) {
+    EventLoop loop;
+    Pipe pipe;
+    int calls = 0;
+    EventLoop::Id id = 0;
+
+    id = loop.addHandle(pipe.fds[0], [&]() {
+        calls++;
+        loop.removeHandle(id); /* not drained, so it would fire again */
+    });
+    pipe.write();
+
+    loop.schedule(30, [&loop]() { loop.quit(); });
+    loop.run();
+    CHECK(calls == 1);
+}
+
+TEST(timersRunInDeadlineOrder) {
+    fakeNow = 1000;
+    EventLoop loop(&fakeClock);
+    std::vector<int> order;
+
+    loop.schedule(30, [&]() { order.push_back(30); });
+    loop.schedule(10, [&]() { order.push_back(10); });
+    loop.schedule(20, [&]() { order.push_back(20); });
+    auto cancelled = loop.schedule(15, [&]() { order.push_back(15); });
+    loop.cancel(cancelled);
+
+    fakeNow += 9;
+    loop.poll();
+    CHECK(order.empty());
+
+    fakeNow += 100;
+    loop.poll();
+    CHECK((order == std::vector<int> { 10, 20, 30 }));
+}
+
+TEST(repeatingTimersRunUntilCancelled) {
+    fakeNow = 0;
+    EventLoop loop(&fakeClock);
+    int runs = 0;
+    EventLoop::Id id = 0;
+
+    id = loop.repeat(10, [&]() {
+        if (++runs == 3) {
+            loop.cancel(id);
+        }
+    });
+
+    for (int i = 0; i < 10; i++) {
+        fakeNow += 10;
+        loop.poll();
+    }
+    CHECK(runs == 3);
+}
+
+TEST(runSleepsUntilTheNearestTimer) {
+    EventLoop loop;
+    auto start = EventLoop::now();
+    uint64_t fired = 0;
+
+    loop.schedule(1000, [&]() { loop.quit(-1); });
+    loop.schedule(50, [&]() {
+        fired = EventLoop::now();
+        loop.quit();
+    });
+
+    CHECK(loop.run() == 0);
+    CHECK(fired - start >= 50);
+    CHECK(fired - start < 1000);
+}
+
+TEST(postWakesASleepingLoop) {
+    EventLoop loop;
+    std::thread::id ranOn;
+
+    std::thread poster([&loop, &ranOn]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        loop.post([&loop, &ranOn]() {
+            ranOn = std::this_thread::get_id();
+            loop.quit(3);
+        });
+    });
+
+    /* nothing else is pending, so only the post can end this */
+    CHECK(loop.run() == 3);
+    poster.join();
+    CHECK(ranOn == std::this_thread::get_id());
+}
+
+TEST(postsFromManyThreadsAllRunOnce) {
+    EventLoop loop;
+    constexpr int threads = 4;
+    constexpr int posts = 1000;
+    int total = 0; /* only touched on the loop's thread */
+    std::atomic<int> finished(0);
+
+    std::vector<std::thread> posters;
+    for (int t = 0; t < threads; t++) {
+        posters.emplace_back([&]() {
+            for (int i = 0; i < posts; i++) {
+                loop.post([&total]() { total++; });
+            }
+            if (++finished == threads) {
+                loop.post([&loop]() { loop.quit(); });
+            }
+        });
+    }
+
+    guard(loop);
+    CHECK(loop.run() == 0);
+    for (auto& poster : posters) {
+        poster.join();
+    }
+    CHECK(total == threads * posts);
+}
+
+TEST(quitFromAnotherThreadWakesTheLoop) {
+    EventLoop loop;
+    std::thread quitter([&loop]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        loop.quit(5);
+    });
+
+    CHECK(loop.run() == 5);
+    quitter.join();
+}
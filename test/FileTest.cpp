@@ -0,0 +1,175 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Test.h"
+#include "File.h"
+#include <csignal>
+#include <cstring>
+#include <string>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <vector>
+
+using namespace dimmer;
+
+static std::wstring write(const std::wstring& fn, const std::string& contents) {
+    CHECK(writeFileAtomic(fn, contents.data(), contents.size()));
+    return fn;
+}
+
+static std::string read(const std::wstring& fn) {
+    MappedFile file;
+    if (!file.open(fn)) {
+        return "(missing)";
+    }
+    return std::string(file.data(), file.size());
+}
+
+static bool exists(const std::string& path) {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0;
+}
+
+TEST(anEmptyFileMapsToNothing) {
+    std::wstring fn = write(test::widen(test::temporaryDirectory() + "/empty"), "");
+
+    MappedFile file;
+    CHECK(file.open(fn));
+    CHECK(file.size() == 0);
+    CHECK(file.data() != nullptr);
+
+    file.close();
+    CHECK(file.size() == 0);
+    CHECK(file.data() == nullptr);
+}
+
+TEST(aMissingFileDoesNotOpen) {
+    std::wstring fn = test::widen(test::temporaryDirectory() + "/missing");
+
+    MappedFile mapped;
+    CHECK(!mapped.open(fn));
+    CHECK(mapped.data() == nullptr && mapped.size() == 0);
+
+    /* open() only appends to what's there; create() is what makes it. */
+    AppendFile append;
+    CHECK(!append.open(fn));
+    CHECK(!append.isOpen());
+    CHECK(!append.append("x", 1));
+    CHECK(read(fn) == "(missing)");
+}
+
+TEST(aMappedFileIsTheWholeFile) {
+    std::string contents(100000, '\0');
+    for (size_t i = 0; i < contents.size(); i++) {
+        contents[i] = (char) (i * 7);
+    }
+    std::wstring fn = write(test::widen(test::temporaryDirectory() + "/large"), contents);
+    CHECK(read(fn) == contents);
+}
+
+TEST(appendingAfterReopenKeepsWhatWasThere) {
+    std::wstring fn = test::widen(test::temporaryDirectory() + "/log");
+    {
+        AppendFile file;
+        CHECK(file.create(fn));
+        CHECK(file.append("one ", 4));
+        CHECK(file.append("two ", 4));
+    }
+    {
+        AppendFile file;
+        CHECK(file.open(fn));
+        CHECK(file.isOpen());
+        CHECK(file.append("three", 5));
+    }
+    CHECK(read(fn) == "one two three");
+
+    /* and create() starts over. */
+    AppendFile file;
+    CHECK(file.create(fn));
+    CHECK(file.append("four", 4));
+    file.close();
+    CHECK(!file.isOpen());
+    CHECK(read(fn) == "four");
+}
+
+TEST(aMappingOutlivesTheFileBeingReplaced) {
+    std::wstring fn = write(test::widen(test::temporaryDirectory() + "/config"), "old");
+
+    MappedFile file;
+    CHECK(file.open(fn));
+    write(fn, "new contents");
+    CHECK(std::string(file.data(), file.size()) == "old");
+    CHECK(read(fn) == "new contents");
+}
+
+TEST(aFailedWriteLeavesTheOldFile) {
+    std::string path = test::temporaryDirectory() + "/config";
+    std::wstring fn = write(test::widen(path), "old");
+
+    /* the write itself fails partway: files can't grow past 4 KiB. */
+    struct rlimit limit;
+    CHECK(getrlimit(RLIMIT_FSIZE, &limit) == 0);
+    struct rlimit small = limit;
+    small.rlim_cur = 4096;
+    void (*previous)(int) = signal(SIGXFSZ, SIG_IGN);
+    CHECK(setrlimit(RLIMIT_FSIZE, &small) == 0);
+
+    std::string contents(65536, 'x');
+    bool written = writeFileAtomic(fn, contents.data(), contents.size());
+
+    setrlimit(RLIMIT_FSIZE, &limit);
+    signal(SIGXFSZ, previous);
+
+    CHECK(!written);
+    CHECK(read(fn) == "old");
+    CHECK(!exists(path + ".tmp"));
+}
+
+TEST(aFailedRenameLeavesTheOldFile) {
+    std::string directory = test::temporaryDirectory();
+
+    /* nothing can be renamed over a directory that isn't empty. */
+    std::string path = directory + "/occupied";
+    CHECK(mkdir(path.c_str(), 0700) == 0);
+    CHECK(mkdir((path + "/inside").c_str(), 0700) == 0);
+    CHECK(!writeFileAtomic(test::widen(path), "new", 3));
+    CHECK(exists(path + "/inside"));
+    CHECK(!exists(path + ".tmp"));
+
+    /* and a temporary that can't be created fails before touching anything. */
+    std::wstring fn = write(test::widen(directory + "/config"), "old");
+    CHECK(mkdir((directory + "/config.tmp").c_str(), 0700) == 0);
+    CHECK(!writeFileAtomic(fn, "new", 3));
+    CHECK(read(fn) == "old");
+}
@@ -0,0 +1,327 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Test.h"
+#include "Gamma.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace dimmer;
+
+TEST(sixThousandFiveHundredKelvinIsWhite) {
+    float red, green, blue;
+    colorTemperatureToRgb(6600, red, green, blue);
+    CHECK(red == 1.0f);
+    CHECK(std::fabs(green - 1.0f) < 0.02f);
+    CHECK(blue == 1.0f);
+}
+
+TEST(warmerTemperaturesLoseBlueFirst) {
+    float previousBlue = 1.0f, previousGreen = 1.0f;
+    for (int kelvin = 6000; kelvin >= 1000; kelvin -= 500) {
+        float red, green, blue;
+        colorTemperatureToRgb(kelvin, red, green, blue);
+        CHECK(red == 1.0f);
+        CHECK(blue <= green);
+        CHECK(blue <= previousBlue);
+        CHECK(green <= previousGreen);
+        CHECK(blue >= 0.0f && green >= 0.0f);
+        previousBlue = blue;
+        previousGreen = green;
+    }
+}
+
+TEST(identityRampIsLinear) {
+    GammaRamp ramp;
+    buildIdentityRamp(ramp);
+    for (int channel = 0; channel < 3; channel++) {
+        for (int i = 0; i < GAMMA_RAMP_SIZE; i++) {
+            CHECK(ramp[channel][i] == i * 256);
+        }
+    }
+    CHECK(rampDeviation(ramp) == 0);
+}
+
+TEST(noTemperatureIsIdentity) {
+    GammaRamp ramp, identity;
+    buildTemperatureRamp(-1, ramp);
+    buildIdentityRamp(identity);
+    for (int channel = 0; channel < 3; channel++) {
+        for (int i = 0; i < GAMMA_RAMP_SIZE; i++) {
+            CHECK(ramp[channel][i] == identity[channel][i]);
+        }
+    }
+}
+
+TEST(temperatureRampsAreMonotonic) {
+    for (int kelvin : { 3000, 4000, 4500, 5000, 5500, 6000 }) {
+        GammaRamp ramp;
+        buildTemperatureRamp(kelvin, ramp);
+        for (int channel = 0; channel < 3; channel++) {
+            for (int i = 1; i < GAMMA_RAMP_SIZE; i++) {
+                CHECK(ramp[channel][i] >= ramp[channel][i - 1]);
+            }
+        }
+        CHECK(ramp[2][GAMMA_RAMP_SIZE - 1] < ramp[0][GAMMA_RAMP_SIZE - 1]);
+    }
+}
+
+TEST(largerPlanesScaleWithBrightness) {
+    /* XRandR drivers often want 1024 entries, and dim through the ramp. */
+    std::vector<uint16_t> red(1024), green(1024), blue(1024);
+    buildTemperatureRamp(-1, 0.5f, { red.data(), green.data(), blue.data(), red.size() });
+    CHECK(red[0] == 0);
+    CHECK(red[512] == 16384);
+    CHECK(red[1023] == green[1023] && green[1023] == blue[1023]);
+    CHECK(red[1023] < 32768 && red[1023] > 32700);
+}
+
+/* the GdiIcmGammaRange values worth checking: none at all, a few an
+administrator might set, the default, and the one that allows anything. */
+static const int gammaRanges[] = { 0, 32, 64, DEFAULT_GAMMA_RANGE, 192, FULL_GAMMA_RANGE };
+
+static void fillRamp(GammaRamp& ramp, uint16_t value) {
+    for (int channel = 0; channel < 3; channel++) {
+        for (int i = 0; i < GAMMA_RAMP_SIZE; i++) {
+            ramp[channel][i] = value;
+        }
+    }
+}
+
+TEST(acceptableRampsAreNotFitted) {
+    for (int kelvin : { -1, 4000, 6000 }) {
+        GammaRamp ramp, original;
+        buildTemperatureRamp(kelvin, ramp);
+        memcpy(original, ramp, sizeof(GammaRamp));
+        CHECK(isRampAcceptable(ramp, DEFAULT_GAMMA_RANGE));
+
+        GammaFit fit = fitRamp(ramp, DEFAULT_GAMMA_RANGE);
+        CHECK(fit.clampedEntries == 0);
+        CHECK(fit.maximumClamp == 0.0f);
+        CHECK(memcmp(ramp, original, sizeof(GammaRamp)) == 0);
+    }
+}
+
+/* warm ramps go further from identity than most ranges allow; fitting has
+to make them acceptable, and report exactly what it changed. */
+TEST(warmRampsAreFittedToEveryRange) {
+    for (int range : gammaRanges) {
+        for (int kelvin : { 1000, 2000, 3000, 4000 }) {
+            GammaRamp ramp, original;
+            buildTemperatureRamp(kelvin, ramp);
+            memcpy(original, ramp, sizeof(GammaRamp));
+            bool acceptable = isRampAcceptable(ramp, range);
+
+            GammaFit fit = fitRamp(ramp, range);
+            CHECK(isRampAcceptable(ramp, range));
+            CHECK(rampDeviation(ramp) <= range);
+            CHECK(acceptable == (fit.clampedEntries == 0));
+
+            int changed = 0;
+            float largest = 0.0f;
+            for (int channel = 0; channel < 3; channel++) {
+                for (int i = 0; i < GAMMA_RAMP_SIZE; i++) {
+                    int difference = std::abs(ramp[channel][i] - original[channel][i]);
+                    changed += difference ? 1 : 0;
+                    largest = std::max(largest, (float) difference / 256.0f);
+                }
+            }
+            CHECK(fit.clampedEntries == changed);
+            CHECK(fit.maximumClamp == largest);
+        }
+    }
+
+    /* anything monotonic goes with the full range */
+    GammaRamp ramp;
+    buildTemperatureRamp(1000, ramp);
+    CHECK(fitRamp(ramp, FULL_GAMMA_RANGE).clampedEntries == 0);
+}
+
+TEST(fittingMovesEntriesToTheEdgeOfTheRange) {
+    /* all black: everything past the range has to come up to its edge */
+    GammaRamp ramp;
+    fillRamp(ramp, 0);
+    GammaFit fit = fitRamp(ramp, DEFAULT_GAMMA_RANGE);
+    CHECK(fit.clampedEntries == 3 * 127);
+    CHECK(fit.maximumClamp == 127.0f);
+    CHECK(ramp[0][128] == 0);
+    CHECK(ramp[1][129] == 1 << 8);
+    CHECK(ramp[2][255] == 127 << 8);
+
+    /* all white: the bottom comes down to the top of its range */
+    fillRamp(ramp, 0xffff);
+    fit = fitRamp(ramp, 64);
+    CHECK(fit.clampedEntries == 3 * 191);
+    CHECK(ramp[0][0] == ((64 << 8) | 0xff));
+    CHECK(ramp[2][190] == ((254 << 8) | 0xff));
+    CHECK(ramp[2][191] == 0xffff);
+    CHECK(isRampAcceptable(ramp, 64));
+
+    /* with no range at all, only identity is left */
+    fillRamp(ramp, 0x8000);
+    fitRamp(ramp, 0);
+    CHECK(rampDeviation(ramp) == 0);
+}
+
+TEST(fittingFlattensDips) {
+    GammaRamp ramp;
+    buildIdentityRamp(ramp);
+    ramp[1][100] = ramp[1][99] - 512;
+    CHECK(!isRampAcceptable(ramp, DEFAULT_GAMMA_RANGE));
+
+    GammaFit fit = fitRamp(ramp, DEFAULT_GAMMA_RANGE);
+    CHECK(fit.clampedEntries == 1);
+    CHECK(fit.maximumClamp == 2.0f);
+    CHECK(ramp[1][100] == ramp[1][99]);
+    CHECK(isRampAcceptable(ramp, DEFAULT_GAMMA_RANGE));
+}
+
+TEST(threeThousandKelvinIsTrimmedUnderTheDefaultRange) {
+    GammaRamp ramp;
+    buildTemperatureRamp(3000, ramp);
+    CHECK(rampDeviation(ramp) > DEFAULT_GAMMA_RANGE);
+
+    GammaFit fit = fitRamp(ramp, DEFAULT_GAMMA_RANGE);
+    CHECK(fit.clampedEntries > 0);
+    CHECK(fit.maximumClamp > 1.0f && fit.maximumClamp < 32.0f);
+    CHECK(rampDeviation(ramp) == DEFAULT_GAMMA_RANGE);
+}
+
+static bool isMonotonic(const GammaRamp& ramp) {
+    for (int channel = 0; channel < 3; channel++) {
+        for (int i = 1; i < GAMMA_RAMP_SIZE; i++) {
+            if (ramp[channel][i] < ramp[channel][i - 1]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool isOnWholeLevels(const GammaRamp& ramp) {
+    for (int channel = 0; channel < 3; channel++) {
+        for (int i = 0; i < GAMMA_RAMP_SIZE; i++) {
+            if (ramp[channel][i] & 0xff) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+TEST(identityIsNotDithered) {
+    GammaRamp identity;
+    buildIdentityRamp(identity);
+
+    for (GammaDither dither : { GammaDither::None, GammaDither::Static, GammaDither::Temporal }) {
+        DitheredRamps ramps;
+        buildDitheredRamps(identity, dither, ramps);
+        CHECK(ramps.count >= 1);
+        for (int frame = 0; frame < ramps.count; frame++) {
+            CHECK(memcmp(ramps.frames[frame], identity, sizeof(GammaRamp)) == 0);
+        }
+    }
+}
+
+TEST(noDitherIsTheTargetItself) {
+    GammaRamp target;
+    buildTemperatureRamp(3400, target);
+
+    DitheredRamps ramps;
+    buildDitheredRamps(target, GammaDither::None, ramps);
+    CHECK(ramps.count == 1);
+    CHECK(memcmp(ramps.frames[0], target, sizeof(GammaRamp)) == 0);
+}
+
+/* one ramp on whole levels, each entry within a level of the target, and
+the rounding carried along so the ramp as a whole doesn't drift: on
+average, entries are within a sixteenth of a level. shallow planes, like
+blue at 2000K, are where that's hardest. */
+TEST(staticDitherKeepsTheAverageSlope) {
+    for (int kelvin : { 2000, 3400, 4500, 5500 }) {
+        GammaRamp target;
+        buildTemperatureRamp(kelvin, target);
+
+        DitheredRamps ramps;
+        buildDitheredRamps(target, GammaDither::Static, ramps);
+        CHECK(ramps.count == 1);
+        CHECK(isMonotonic(ramps.frames[0]));
+        CHECK(isOnWholeLevels(ramps.frames[0]));
+
+        for (int channel = 0; channel < 3; channel++) {
+            long drift = 0;
+            for (int i = 0; i < GAMMA_RAMP_SIZE; i++) {
+                int difference = ramps.frames[0][channel][i] - target[channel][i];
+                CHECK(std::abs(difference) <= 256);
+                drift += difference;
+            }
+            CHECK(std::abs(drift) / GAMMA_RAMP_SIZE <= 16);
+        }
+    }
+}
+
+TEST(temporalFramesAverageOutToTheTarget) {
+    for (int kelvin : { 2000, 3400, 4500, 5500 }) {
+        GammaRamp target;
+        buildTemperatureRamp(kelvin, target);
+
+        DitheredRamps ramps;
+        buildDitheredRamps(target, GammaDither::Temporal, ramps);
+        CHECK(ramps.count == DITHER_FRAMES);
+
+        for (int frame = 0; frame < ramps.count; frame++) {
+            CHECK(isMonotonic(ramps.frames[frame]));
+            CHECK(isOnWholeLevels(ramps.frames[frame]));
+        }
+
+        /* within a quarter of a level, and no entry flickers by more than
+        one level between frames */
+        for (int channel = 0; channel < 3; channel++) {
+            for (int i = 0; i < GAMMA_RAMP_SIZE; i++) {
+                int sum = 0, lowest = 0xffff, highest = 0;
+                for (int frame = 0; frame < ramps.count; frame++) {
+                    int value = ramps.frames[frame][channel][i];
+                    sum += value;
+                    lowest = std::min(lowest, value);
+                    highest = std::max(highest, value);
+                }
+                CHECK(std::abs(sum / (float) ramps.count - target[channel][i]) <= 64.0f);
+                CHECK(highest - lowest <= 256);
+            }
+        }
+    }
+}
@@ -0,0 +1,264 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Test.h"
+#include "Journal.h"
+#include "File.h"
+#include "Util.h"
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace dimmer;
+
+static uint32_t bits(float value) {
+    uint32_t result;
+    memcpy(&result, &value, sizeof(result));
+    return result;
+}
+
+static bool sameConfig(const Config& a, const Config& b) {
+    return a.monitors == b.monitors &&
+        a.pollingEnabled == b.pollingEnabled &&
+        a.globalEnabled == b.globalEnabled &&
+        a.adaptiveEnabled == b.adaptiveEnabled &&
+        a.gammaDither == b.gammaDither;
+}
+
+struct Fixture {
+    std::wstring filename;
+    Config base;
+    std::vector<Config> committed; /* the state after each transaction */
+    JournalMark mark; /* after the second transaction */
+    std::string contents;
+};
+
+/* writes a journal with a handful of transactions of different sizes, and
+remembers what the config looks like after each one. */
+static Fixture journalSomeChanges() {
+    Fixture fixture;
+    fixture.filename = test::widen(test::temporaryDirectory()) + PATH_SEPARATOR + L"journal.bin";
+    fixture.base.monitors[L"DP-1"] = MonitorOptions();
+    fixture.base.monitors[L"HDMI-1"] = MonitorOptions();
+
+    Journal journal;
+    CHECK(journal.reset(fixture.filename, 1234, 5678, fixture.base));
+
+    const std::wstring* dp = &fixture.base.monitors.find(L"DP-1")->first;
+    const std::wstring* hdmi = &fixture.base.monitors.find(L"HDMI-1")->first;
+
+    Config state = fixture.base;
+    fixture.committed.push_back(state);
+
+    JournalEntry first[] = {
+        { dp, JournalField::Opacity, bits(0.5f) },
+        { hdmi, JournalField::Temperature, 4500 },
+        { nullptr, JournalField::PollingEnabled, 1 }
+    };
+    CHECK(journal.append(first, 3));
+    state.monitors[L"DP-1"].opacity = 0.5f;
+    state.monitors[L"HDMI-1"].temperature = 4500;
+    state.pollingEnabled = true;
+    fixture.committed.push_back(state);
+
+    JournalEntry second[] = { { dp, JournalField::Enabled, 0 } };
+    CHECK(journal.append(second, 1));
+    state.monitors[L"DP-1"].enabled = false;
+    fixture.committed.push_back(state);
+    fixture.mark = journal.mark();
+
+    JournalEntry third[] = {
+        { hdmi, JournalField::Backlight, 40 },
+        { nullptr, JournalField::GammaDither, (uint32_t) GammaDither::Temporal },
+        { dp, JournalField::Opacity, bits(0.25f) },
+        { nullptr, JournalField::AdaptiveEnabled, 1 }
+    };
+    CHECK(journal.append(third, 4));
+    state.monitors[L"HDMI-1"].backlight = 40;
+    state.gammaDither = GammaDither::Temporal;
+    state.monitors[L"DP-1"].opacity = 0.25f;
+    state.adaptiveEnabled = true;
+    fixture.committed.push_back(state);
+
+    MappedFile file;
+    CHECK(file.open(fixture.filename));
+    fixture.contents.assign(file.data(), file.size());
+    return fixture;
+}
+
+TEST(replayAppliesEveryCommittedTransaction) {
+    Fixture fixture = journalSomeChanges();
+
+    Config config = fixture.base;
+    CHECK(Journal::replay(fixture.filename, 1234, 5678, MonitorOptions(), config));
+    CHECK(sameConfig(config, fixture.committed.back()));
+}
+
+TEST(aJournalForAnotherBaseIsIgnored) {
+    Fixture fixture = journalSomeChanges();
+
+    Config config = fixture.base;
+    CHECK(!Journal::replay(fixture.filename, 1234, 5679, MonitorOptions(), config));
+    CHECK(sameConfig(config, fixture.base));
+}
+
+TEST(replayOfATruncatedJournalYieldsACommittedPrefix) {
+    Fixture fixture = journalSomeChanges();
+    std::wstring truncated = fixture.filename + L".truncated";
+
+    /* a torn write can stop anywhere. whatever survives has to replay to
+    exactly the state after some whole number of transactions, and never
+    to fewer of them than a shorter file did. */
+    size_t previous = 0;
+    for (size_t length = 0; length <= fixture.contents.size(); length++) {
+        CHECK(writeFileAtomic(truncated, fixture.contents.data(), length));
+
+        Config config = fixture.base;
+        Journal::replay(truncated, 1234, 5678, MonitorOptions(), config);
+
+        size_t match = fixture.committed.size();
+        for (size_t i = 0; i < fixture.committed.size(); i++) {
+            if (sameConfig(config, fixture.committed[i])) {
+                match = i;
+                break;
+            }
+        }
+
+        CHECK(match < fixture.committed.size());
+        CHECK(match >= previous);
+        previous = match;
+    }
+
+    CHECK(previous == fixture.committed.size() - 1);
+}
+
+TEST(monitorsMissingFromTheBaseStartAtTheDefaults) {
+    Fixture fixture = journalSomeChanges();
+
+    /* config.json saves every monitor in the live map, so the base normally
+    has all of the slot table. replay mustn't depend on that, though: a
+    monitor the base lacks still gets its changes, over the defaults. */
+    MonitorOptions defaults;
+    defaults.opacity = 0.7f;
+    defaults.temperature = 5000;
+    defaults.backlight = 80;
+
+    Config config = fixture.base;
+    config.monitors.erase(L"HDMI-1");
+    CHECK(Journal::replay(fixture.filename, 1234, 5678, defaults, config));
+
+    const MonitorOptions& hdmi = config.monitors[L"HDMI-1"];
+    CHECK(hdmi.temperature == 4500); /* journaled */
+    CHECK(hdmi.backlight == 40); /* journaled */
+    CHECK(hdmi.opacity == 0.7f); /* from the defaults */
+    CHECK(hdmi.enabled);
+}
+
+TEST(aCompactedJournalReplaysOnlyWhatCameAfterItsMark) {
+    Fixture fixture = journalSomeChanges();
+    CHECK(fixture.mark.salt != 0);
+    CHECK(fixture.mark.sequence == 4);
+
+    /* config.json was rewritten from the first two transactions, and the
+    journal never restarted against it. */
+    Config config = fixture.committed[2];
+    CHECK(Journal::replay(fixture.filename, 4321, 8765, MonitorOptions(), config, fixture.mark));
+    CHECK(sameConfig(config, fixture.committed.back()));
+
+    /* a mark from some other journal doesn't make this one apply */
+    JournalMark other = fixture.mark;
+    other.salt++;
+    config = fixture.committed[2];
+    CHECK(!Journal::replay(fixture.filename, 4321, 8765, MonitorOptions(), config, other));
+    CHECK(sameConfig(config, fixture.committed[2]));
+
+    /* nor does one that's past everything in it */
+    JournalMark end = fixture.mark;
+    end.sequence = 8;
+    config = fixture.committed.back();
+    CHECK(!Journal::replay(fixture.filename, 4321, 8765, MonitorOptions(), config, end));
+    CHECK(sameConfig(config, fixture.committed.back()));
+}
+
+TEST(aMarkIsIgnoredWhenTheBaseMatches) {
+    Fixture fixture = journalSomeChanges();
+
+    Config config = fixture.base;
+    CHECK(Journal::replay(fixture.filename, 1234, 5678, MonitorOptions(), config, fixture.mark));
+    CHECK(sameConfig(config, fixture.committed.back()));
+}
+
+TEST(readBaseReportsWhatTheJournalWasStartedAgainst) {
+    Fixture fixture = journalSomeChanges();
+
+    uint64_t writeTime = 0, size = 0;
+    CHECK(Journal::readBase(fixture.filename, writeTime, size));
+    CHECK(writeTime == 1234 && size == 5678);
+    CHECK(!Journal::readBase(fixture.filename + L".missing", writeTime, size));
+}
+
+TEST(resetStartsWithTheChangesItIsGiven) {
+    std::wstring filename = test::widen(test::temporaryDirectory()) + PATH_SEPARATOR + L"journal.bin";
+    Config base;
+    base.monitors[L"DP-1"] = MonitorOptions();
+    const std::wstring* dp = &base.monitors.find(L"DP-1")->first;
+
+    Journal journal;
+    JournalEntry carried[] = {
+        { dp, JournalField::Opacity, bits(0.4f) },
+        { nullptr, JournalField::GlobalEnabled, 0 }
+    };
+    CHECK(journal.reset(filename, 1, 2, base, carried, 2));
+    CHECK(journal.recordCount() == 2);
+
+    Config config = base;
+    CHECK(Journal::replay(filename, 1, 2, MonitorOptions(), config));
+    CHECK(config.monitors[L"DP-1"].opacity == 0.4f);
+    CHECK(!config.globalEnabled);
+
+    /* later transactions follow on */
+    JournalEntry next[] = { { dp, JournalField::Temperature, 3000 } };
+    CHECK(journal.append(next, 1));
+    config = base;
+    CHECK(Journal::replay(filename, 1, 2, MonitorOptions(), config));
+    CHECK(config.monitors[L"DP-1"].opacity == 0.4f);
+    CHECK(config.monitors[L"DP-1"].temperature == 3000);
+
+    /* a change that can't be journaled fails the reset, rather than
+    starting a journal without it */
+    std::wstring missing = L"HDMI-1";
+    JournalEntry unknown[] = { { &missing, JournalField::Opacity, bits(0.1f) } };
+    CHECK(!journal.reset(filename, 3, 4, base, unknown, 1));
+    CHECK(journal.mark().salt == 0);
+}
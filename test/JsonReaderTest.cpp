@@ -0,0 +1,236 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Test.h"
+#include "JsonReader.h"
+#include <string>
+
+using namespace dimmer;
+
+/* reads {"key": <string>} and returns the string, or "(failed)". */
+static std::string readOnlyString(const std::string& json) {
+    JsonReader r(json.data(), json.size());
+    std::string key, value;
+    if (!r.beginObject() || !r.nextKey(key) || !r.readString(value) || r.nextKey(key) || r.failed()) {
+        return "(failed)";
+    }
+    return value;
+}
+
+/* skips every member of the object and says whether it all parsed. */
+static bool parses(const std::string& json) {
+    JsonReader r(json.data(), json.size());
+    if (!r.beginObject()) {
+        return false;
+    }
+    std::string key;
+    while (r.nextKey(key)) {
+        r.skipValue();
+    }
+    return !r.failed();
+}
+
+/* reads {"n": <number>}. */
+static bool readOnlyNumber(const std::string& number, double& value) {
+    std::string json = "{\"n\":" + number + "}";
+    JsonReader r(json.data(), json.size());
+    std::string key;
+    return r.beginObject() && r.nextKey(key) && r.readNumber(value) && !r.nextKey(key) && !r.failed();
+}
+
+TEST(membersAreReadInOrder) {
+    std::string json = "{ \"a\": 1, \"b\": \"two\", \"c\": true, \"d\": 0.5 }";
+    JsonReader r(json.data(), json.size());
+    std::string key, text;
+    int number = 0;
+    bool flag = false;
+    float fraction = 0.0f;
+
+    CHECK(r.beginObject());
+    CHECK(r.nextKey(key) && key == "a" && r.readInt(number) && number == 1);
+    CHECK(r.nextKey(key) && key == "b" && r.readString(text) && text == "two");
+    CHECK(r.nextKey(key) && key == "c" && r.readBool(flag) && flag);
+    CHECK(r.nextKey(key) && key == "d" && r.readFloat(fraction) && fraction == 0.5f);
+    CHECK(!r.nextKey(key));
+    CHECK(!r.failed());
+}
+
+TEST(escapesAreDecoded) {
+    CHECK(readOnlyString("{\"s\":\"\\\" \\\\ \\/ \\b \\f \\n \\r \\t\"}") == "\" \\ / \b \f \n \r \t");
+    CHECK(readOnlyString("{\"s\":\"\\u0041\\u00e9\\u20AC\"}") == "A\xc3\xa9\xe2\x82\xac");
+    CHECK(readOnlyString("{\"s\":\"\\x\"}") == "(failed)");
+    CHECK(readOnlyString("{\"s\":\"\\u12g4\"}") == "(failed)");
+}
+
+TEST(surrogatePairsAreCombined) {
+    /* U+1F600 */
+    CHECK(readOnlyString("{\"s\":\"\\ud83d\\ude00\"}") == "\xf0\x9f\x98\x80");
+
+    /* lone halves become U+FFFD, and whatever follows is kept. */
+    CHECK(readOnlyString("{\"s\":\"\\ud83dx\"}") == "\xef\xbf\xbdx");
+    CHECK(readOnlyString("{\"s\":\"\\ude00\"}") == "\xef\xbf\xbd");
+    CHECK(readOnlyString("{\"s\":\"\\ud83d\\u0041\"}") == "\xef\xbf\xbd" "A");
+}
+
+TEST(aByteOrderMarkIsSkipped) {
+    CHECK(readOnlyString("\xef\xbb\xbf{\"s\":\"bom\"}") == "bom");
+
+    /* but only at the very start. */
+    CHECK(!parses(" \xef\xbb\xbf{\"s\":1}"));
+}
+
+TEST(aTrailingCommaIsAllowed) {
+    CHECK(parses("{\"a\":1,}"));
+    CHECK(parses("{\"a\":[1,2,],}"));
+    CHECK(parses("{\"a\":{\"b\":{},},}"));
+}
+
+TEST(separatorsAreRequired) {
+    CHECK(!parses("{\"a\":1 \"b\":2}"));
+    CHECK(!parses("{\"a\":{} \"b\":2}"));
+    CHECK(!parses("{,\"a\":1}"));
+    CHECK(!parses("{,}"));
+    CHECK(!parses("{\"a\":1,,\"b\":2}"));
+    CHECK(!parses("{\"a\" 1}"));
+    CHECK(!parses("{\"a\":[1 2]}"));
+    CHECK(!parses("{\"a\":[,1]}"));
+    CHECK(!parses("{\"a\":[1,,2]}"));
+
+    CHECK(parses("{}"));
+    CHECK(parses("{\"a\":{},\"b\":[],\"c\":[{},{}]}"));
+}
+
+TEST(numbersFollowTheGrammar) {
+    double value = 0;
+    CHECK(readOnlyNumber("0", value) && value == 0);
+    CHECK(readOnlyNumber("-12", value) && value == -12);
+    CHECK(readOnlyNumber("1.25", value) && value == 1.25);
+    CHECK(readOnlyNumber("-0.5e2", value) && value == -50);
+    CHECK(readOnlyNumber("2E+3", value) && value == 2000);
+    CHECK(readOnlyNumber("25e-2", value) && value == 0.25);
+
+    const char* malformed[] = {
+        "+1", "-", "01", "1.", ".5", "1.2.3", "1e", "1e+", "1-2", "1ee2", "--1", "0x10", "1e2e3"
+    };
+    for (const char* number : malformed) {
+        CHECK(!readOnlyNumber(number, value));
+    }
+}
+
+TEST(aValueOfTheWrongTypeIsSkipped) {
+    std::string json =
+        "{ \"n\": \"text\", \"s\": 5, \"b\": null, \"i\": [1, 2], \"f\": {\"x\": 1}, \"big\": 1e20, \"last\": 7 }";
+    JsonReader r(json.data(), json.size());
+    std::string key, text = "untouched";
+    int number = -1;
+    float fraction = -1.0f;
+    bool flag = true;
+
+    CHECK(r.beginObject());
+    CHECK(r.nextKey(key) && !r.readInt(number) && number == -1);
+    CHECK(r.nextKey(key) && !r.readString(text) && text == "untouched");
+    CHECK(r.nextKey(key) && !r.readBool(flag) && flag);
+    CHECK(r.nextKey(key) && !r.readFloat(fraction) && fraction == -1.0f);
+    CHECK(r.nextKey(key) && key == "f" && r.beginObject());
+    CHECK(r.nextKey(key) && key == "x" && r.readInt(number) && number == 1);
+    CHECK(!r.nextKey(key));
+    CHECK(r.nextKey(key) && key == "big" && !r.readInt(number) && number == 1);
+    CHECK(r.nextKey(key) && key == "last" && r.readInt(number) && number == 7);
+    CHECK(!r.nextKey(key));
+    CHECK(!r.failed());
+}
+
+TEST(unknownKeysAreSkipped) {
+    std::string json =
+        "{ \"unknown\": { \"deep\": [true, false, null, \"}\", {\"a\": [] }] }, \"known\": 3 }";
+    JsonReader r(json.data(), json.size());
+    std::string key;
+    int number = 0;
+
+    CHECK(r.beginObject());
+    CHECK(r.nextKey(key) && key == "unknown" && r.skipValue());
+    CHECK(r.nextKey(key) && key == "known" && r.readInt(number) && number == 3);
+    CHECK(!r.nextKey(key));
+    CHECK(!r.failed());
+}
+
+TEST(truncatedInputFails) {
+    std::string json = "{ \"a\": [1, {\"b\": \"c\\u0041\"}], \"d\": true, \"e\": -1.5e3 }";
+    CHECK(parses(json));
+
+    /* every proper prefix is broken somewhere. */
+    for (size_t length = 0; length < json.size(); length++) {
+        JsonReader r(json.data(), length);
+        std::string key;
+        bool closed = false;
+        if (r.beginObject()) {
+            while (r.nextKey(key)) {
+                r.skipValue();
+            }
+            closed = !r.failed();
+        }
+        CHECK(!closed);
+    }
+}
+
+TEST(afterAnErrorEveryCallFails) {
+    std::string json = "{ \"a\": tru, \"b\": 1 }";
+    JsonReader r(json.data(), json.size());
+    std::string key;
+    bool flag = false;
+    int number = 0;
+
+    CHECK(r.beginObject());
+    CHECK(r.nextKey(key) && !r.readBool(flag));
+    CHECK(r.failed());
+    CHECK(!r.nextKey(key));
+    CHECK(!r.readInt(number));
+    CHECK(!r.skipValue());
+}
+
+TEST(deepNestingIsCut) {
+    std::string shallow, deep;
+    for (int i = 0; i < 60; i++) {
+        shallow += "[";
+    }
+    for (int i = 0; i < 60; i++) {
+        shallow += "]";
+    }
+    for (int i = 0; i < 100000; i++) {
+        deep += "[";
+    }
+
+    CHECK(parses("{\"a\":" + shallow + "}"));
+    CHECK(!parses("{\"a\":" + deep + "}"));
+}
@@ -0,0 +1,130 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Test.h"
+#include "File.h"
+#include "Monitor.h"
+#include "Util.h"
+#include <string>
+#include <vector>
+
+using namespace dimmer;
+
+/* starts over from the given config.json in a new directory. */
+static void setUp(const std::string& contents) {
+    std::string directory = test::temporaryDirectory();
+    setenv("XDG_CONFIG_HOME", directory.c_str(), 1);
+    setenv("XDG_CONFIG_DIRS", directory.c_str(), 1);
+    std::wstring filename = getDataDirectory() + PATH_SEPARATOR + L"config.json";
+    writeFileAtomic(filename, contents.data(), contents.size());
+    loadConfig();
+}
+
+static std::vector<Monitor> attach(std::vector<Monitor> monitors) {
+    setAttachedMonitors(monitors);
+    return monitors;
+}
+
+static const Monitor laptop(L"eDP-1", 0, { 0, 0, 1920, 1200 });
+static const Monitor external(L"DP-1", 1, { 1920, 0, 4480, 1440 });
+
+TEST(onlyANewTopologyIsANewLayout) {
+    setUp("{}");
+    auto docked = attach({ laptop, external });
+    CHECK(selectLayout(docked));
+    CHECK(!selectLayout(docked));
+
+    /* moving a monitor doesn't make it a different layout; resizing does */
+    Monitor moved(L"DP-1", 1, { -2560, 0, 0, 1440 });
+    CHECK(!selectLayout(attach({ laptop, moved })));
+    Monitor resized(L"DP-1", 1, { 1920, 0, 3840, 1080 });
+    CHECK(selectLayout(attach({ laptop, resized })));
+}
+
+TEST(optionsFollowTheLayout) {
+    setUp("{}");
+    auto docked = attach({ laptop, external });
+    selectLayout(docked);
+    ChangeSet().setMonitorOpacity(laptop, 0.2f).setMonitorOpacity(external, 0.4f).commit();
+
+    /* a layout seen for the first time keeps the current values */
+    auto undocked = attach({ laptop });
+    CHECK(selectLayout(undocked));
+    CHECK(getMonitorOpacity(laptop) == 0.2f);
+    ChangeSet().setMonitorOpacity(laptop, 0.7f).commit();
+
+    CHECK(selectLayout(attach(docked)));
+    CHECK(getMonitorOpacity(laptop) == 0.2f);
+    CHECK(getMonitorOpacity(external) == 0.4f);
+
+    CHECK(selectLayout(attach(undocked)));
+    CHECK(getMonitorOpacity(laptop) == 0.7f);
+}
+
+TEST(layoutsSurviveARestart) {
+    setUp("{}");
+    auto docked = attach({ laptop, external });
+    selectLayout(docked);
+    ChangeSet().setMonitorTemperature(laptop, 4500).setMonitorTemperature(external, 5000).commit();
+
+    auto undocked = attach({ laptop });
+    selectLayout(undocked);
+    ChangeSet().setMonitorTemperature(laptop, 6000).commit();
+    saveConfig();
+
+    /* the stashed layout was saved along with the selection */
+    loadConfig();
+    CHECK(!selectLayout(undocked));
+    CHECK(getMonitorTemperature(laptop) == 6000);
+    CHECK(selectLayout(attach(docked)));
+    CHECK(getMonitorTemperature(laptop) == 4500);
+    CHECK(getMonitorTemperature(external) == 5000);
+}
+
+TEST(aConfigWithoutALayoutKeepsDetachedMonitors) {
+    /* written before layouts existed: there's nowhere to stash the
+    external monitor's options, so they have to stay put. */
+    setUp(
+        "{ \"monitors\": {"
+        "  \"eDP-1\": { \"opacity\": 0.1 },"
+        "  \"DP-1\": { \"opacity\": 0.6 } } }");
+
+    CHECK(selectLayout(attach({ laptop })));
+    CHECK(getMonitorOpacity(laptop) == 0.1f);
+
+    /* and they're saved, so a restart doesn't lose them either */
+    loadConfig();
+    CHECK(selectLayout(attach({ laptop, external })));
+    CHECK(getMonitorOpacity(external) == 0.6f);
+}
@@ -0,0 +1,170 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Test.h"
+#include "PanelBacklight.h"
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace dimmer;
+
+/* a /sys/class/backlight with whatever devices the test adds to it. */
+struct FakeSysfs {
+    std::string root = test::temporaryDirectory();
+
+    std::string add(const std::string& name, long brightness, long maximum, const std::string& type = "raw") {
+        std::string device = this->root + "/" + name;
+        mkdir(device.c_str(), 0755);
+        write(device + "/brightness", std::to_string(brightness));
+        write(device + "/max_brightness", std::to_string(maximum));
+        write(device + "/type", type);
+        return device;
+    }
+
+    static void write(const std::string& fn, const std::string& contents) {
+        std::ofstream(fn) << contents << "\n";
+    }
+
+    static long read(const std::string& fn) {
+        long value = -1;
+        std::ifstream(fn) >> value;
+        return value;
+    }
+};
+
+TEST(firmwareInterfacesArePreferred) {
+    FakeSysfs sysfs;
+    sysfs.add("acpi_video0", 5, 10, "firmware");
+    sysfs.add("intel_backlight", 500, 1000, "raw");
+    sysfs.add("platform0", 50, 100, "platform");
+    sysfs.add("broken", 0, 0, "firmware"); /* no range, so not a backlight */
+
+    SysfsBacklightTransport transport(sysfs.root);
+    CHECK(transport.isOpen());
+    CHECK(transport.getPath() == sysfs.root + "/acpi_video0");
+
+    CHECK(!SysfsBacklightTransport(test::temporaryDirectory()).isOpen());
+    CHECK(!SysfsBacklightTransport(sysfs.root + "/missing").isOpen());
+}
+
+TEST(valuesAreScaledToMaxBrightness) {
+    FakeSysfs sysfs;
+    std::string device = sysfs.add("intel_backlight", 937, 1875);
+    SysfsBacklightTransport transport(sysfs.root);
+
+    VcpValue value;
+    CHECK(transport.getVcp(VCP_LUMINANCE, value));
+    CHECK(value.current == 937);
+    CHECK(value.maximum == 1875);
+    CHECK(!transport.getVcp(VCP_CONTRAST, value));
+
+    /* percentages go through the same path as DDC/CI monitors */
+    Backlight backlight;
+    backlight.setTransport(std::make_unique<SysfsBacklightTransport>(sysfs.root));
+    CHECK(backlight.setPercent(VCP_LUMINANCE, 40));
+    CHECK(FakeSysfs::read(device + "/brightness") == 750);
+    CHECK(backlight.setPercent(VCP_LUMINANCE, 150));
+    CHECK(FakeSysfs::read(device + "/brightness") == 1875);
+}
+
+TEST(rangesPastSixteenBitsAreScaledDown) {
+    FakeSysfs sysfs;
+    std::string device = sysfs.add("amdgpu_bl0", 90000, 120000);
+    SysfsBacklightTransport transport(sysfs.root);
+
+    VcpValue value;
+    CHECK(transport.getVcp(VCP_LUMINANCE, value));
+    CHECK(value.maximum == 60000);
+    CHECK(value.current == 45000);
+
+    CHECK(transport.setVcp(VCP_LUMINANCE, 30000));
+    CHECK(FakeSysfs::read(device + "/brightness") == 60000);
+    CHECK(transport.setVcp(VCP_LUMINANCE, 60000));
+    CHECK(FakeSysfs::read(device + "/brightness") == 120000);
+}
+
+TEST(anUnwritableBrightnessFileFailsTheWrite) {
+    FakeSysfs sysfs;
+    std::string device = sysfs.add("intel_backlight", 500, 1000);
+
+    Backlight backlight;
+    backlight.setTransport(std::make_unique<SysfsBacklightTransport>(sysfs.root));
+    VcpValue value;
+    CHECK(backlight.get(VCP_LUMINANCE, value));
+
+    /* root can write to read-only files, so the write fails the way a
+    driver rejecting it would: not until the data is flushed. */
+    std::string brightness = device + "/brightness";
+    unlink(brightness.c_str());
+    CHECK(symlink("/dev/full", brightness.c_str()) == 0);
+    CHECK(!backlight.setPercent(VCP_LUMINANCE, 30));
+
+    /* or not opening at all */
+    unlink(brightness.c_str());
+    mkdir(brightness.c_str(), 0755);
+    SysfsBacklightTransport transport(sysfs.root);
+    CHECK(!transport.setVcp(VCP_LUMINANCE, 300));
+}
+
+TEST(hybridModeStopsAtTheMinimumBacklight) {
+    CHECK(hybridBacklightLevel(0.0f) == 100);
+    CHECK(hybridBacklightLevel(0.3f) == 70);
+    CHECK(hybridBacklightLevel(0.8f) == HYBRID_MINIMUM_BACKLIGHT);
+    CHECK(hybridBacklightLevel(0.95f) == HYBRID_MINIMUM_BACKLIGHT);
+    CHECK(hybridBacklightLevel(1.0f) == HYBRID_MINIMUM_BACKLIGHT);
+    CHECK(HYBRID_MINIMUM_BACKLIGHT == 20);
+}
+
+TEST(hybridOverlaysMakeUpTheRest) {
+    /* until the floor, the panel does all of it */
+    CHECK(hybridOverlayOpacity(0.5f, hybridBacklightLevel(0.5f)) == 0.0f);
+
+    /* past it, the panel and the overlay together leave as much light as
+    the overlay alone would have */
+    for (int i = 0; i <= 100; i++) {
+        float opacity = (float) i / 100.0f;
+        int level = hybridBacklightLevel(opacity);
+        float overlay = hybridOverlayOpacity(opacity, level);
+        float light = (1.0f - overlay) * (float) level / 100.0f;
+        CHECK(std::fabs(light - (1.0f - opacity)) < 0.006f);
+    }
+
+    /* a panel that hasn't changed yet, or never will, gets the lot */
+    CHECK(hybridOverlayOpacity(0.9f, 100) == 0.9f);
+    CHECK(hybridOverlayOpacity(0.9f, 0) == 0.9f);
+}
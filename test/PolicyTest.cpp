@@ -0,0 +1,238 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Test.h"
+#include "File.h"
+#include "Policy.h"
+#include <string>
+#include <vector>
+
+using namespace dimmer;
+
+static std::wstring writePolicy(const std::string& contents) {
+    std::wstring fn = test::widen(test::temporaryDirectory() + "/policy.json");
+    writeFileAtomic(fn, contents.data(), contents.size());
+    return fn;
+}
+
+static MonitorOptions options(float opacity, int temperature, int backlight) {
+    MonitorOptions result;
+    result.opacity = opacity;
+    result.temperature = temperature;
+    result.backlight = backlight;
+    return result;
+}
+
+TEST(noFileMeansNoPolicy) {
+    Policy policy;
+    policy.maximumOpacity = 0.5f;
+    CHECK(loadPolicy(test::widen(test::temporaryDirectory() + "/policy.json"), policy));
+    CHECK(policy.maximumOpacity == 1.0f);
+    CHECK(!policy.pollingLocked);
+}
+
+TEST(limitsAreRead) {
+    Policy policy;
+    CHECK(loadPolicy(writePolicy(
+        "{ \"minimumBrightness\": 0.25, \"minimumTemperature\": 3000,"
+        "  \"maximumTemperature\": 5000, \"unknown\": [1, 2] }"), policy));
+    CHECK(policy.maximumOpacity == 0.75f);
+    CHECK(policy.minimumTemperature == 3000);
+    CHECK(policy.maximumTemperature == 5000);
+    CHECK(!policy.pollingLocked);
+}
+
+TEST(theDefaultsAreHeldToTheLimits) {
+    Policy policy;
+    CHECK(loadPolicy(writePolicy(
+        "{ \"minimumBrightness\": 0.5, \"maximumTemperature\": 5000,"
+        "  \"defaults\": { \"opacity\": 0.9, \"backlight\": 10, \"enabled\": false } }"), policy));
+    CHECK(policy.defaults.opacity == 0.5f);
+    CHECK(policy.defaults.backlight == 50);
+    CHECK(policy.defaults.temperature == 5000);
+    CHECK(!policy.defaults.enabled);
+}
+
+TEST(anInvertedTemperatureRangeIsRejected) {
+    Policy policy;
+    CHECK(loadPolicy(writePolicy("{ \"minimumTemperature\": 4000 }"), policy));
+
+    /* the policy that was in force stays in force. */
+    CHECK(!loadPolicy(writePolicy(
+        "{ \"minimumTemperature\": 6000, \"maximumTemperature\": 3000 }"), policy));
+    CHECK(policy.minimumTemperature == 4000);
+    CHECK(policy.maximumTemperature == INT_MAX);
+
+    CHECK(loadPolicy(writePolicy(
+        "{ \"minimumTemperature\": 4000, \"maximumTemperature\": 4000 }"), policy));
+    CHECK(policy.maximumTemperature == 4000);
+}
+
+TEST(aBrokenFileKeepsThePolicy) {
+    Policy policy;
+    CHECK(loadPolicy(writePolicy("{ \"minimumBrightness\": 0.5 }"), policy));
+    CHECK(!loadPolicy(writePolicy("{ \"minimumBrightness\": "), policy));
+    CHECK(policy.maximumOpacity == 0.5f);
+}
+
+TEST(opacityIsClamped) {
+    Policy policy;
+    policy.maximumOpacity = 0.6f;
+    CHECK(applyPolicy(policy, options(0.8f, DEFAULT_TEMPERATURE, DEFAULT_BACKLIGHT)).opacity == 0.6f);
+    CHECK(applyPolicy(policy, options(0.3f, DEFAULT_TEMPERATURE, DEFAULT_BACKLIGHT)).opacity == 0.3f);
+    CHECK(applyPolicy(policy, options(-1.0f, DEFAULT_TEMPERATURE, DEFAULT_BACKLIGHT)).opacity == 0.0f);
+}
+
+TEST(theBacklightKeepsTheMinimumBrightness) {
+    Policy policy;
+    policy.maximumOpacity = 0.6f; /* at least 40% */
+    CHECK(applyPolicy(policy, options(0.0f, DEFAULT_TEMPERATURE, 10)).backlight == 40);
+    CHECK(applyPolicy(policy, options(0.0f, DEFAULT_TEMPERATURE, 70)).backlight == 70);
+    CHECK(applyPolicy(policy, options(0.0f, DEFAULT_TEMPERATURE, 150)).backlight == 100);
+
+    /* leaving the panel alone, or following the brightness, isn't a level. */
+    CHECK(applyPolicy(policy, options(0.0f, DEFAULT_TEMPERATURE, DEFAULT_BACKLIGHT)).backlight == DEFAULT_BACKLIGHT);
+    CHECK(applyPolicy(policy, options(0.0f, DEFAULT_TEMPERATURE, HYBRID_BACKLIGHT)).backlight == HYBRID_BACKLIGHT);
+
+    /* without a limit, anything in 0-100 goes. */
+    CHECK(applyPolicy(Policy(), options(0.0f, DEFAULT_TEMPERATURE, 0)).backlight == 0);
+}
+
+TEST(temperatureIsClamped) {
+    Policy policy;
+    policy.minimumTemperature = 3000;
+    policy.maximumTemperature = 5000;
+    CHECK(applyPolicy(policy, options(0.0f, 2000, DEFAULT_BACKLIGHT)).temperature == 3000);
+    CHECK(applyPolicy(policy, options(0.0f, 4000, DEFAULT_BACKLIGHT)).temperature == 4000);
+    CHECK(applyPolicy(policy, options(0.0f, 9000, DEFAULT_BACKLIGHT)).temperature == 5000);
+
+    /* no adjustment is neutral white, which is above this range. */
+    CHECK(applyPolicy(policy, options(0.0f, DEFAULT_TEMPERATURE, DEFAULT_BACKLIGHT)).temperature == 5000);
+
+    /* but stays no adjustment when neutral is allowed. */
+    policy.maximumTemperature = 7000;
+    CHECK(applyPolicy(policy, options(0.0f, DEFAULT_TEMPERATURE, DEFAULT_BACKLIGHT)).temperature == DEFAULT_TEMPERATURE);
+}
+
+TEST(aLockedPollingSettingOverridesTheUser) {
+    Config config;
+    config.pollingEnabled = true;
+
+    Policy policy;
+    CHECK(loadPolicy(writePolicy("{ \"pollingEnabled\": false }"), policy));
+    CHECK(policy.pollingLocked && !policy.pollingEnabled);
+    ConfigSnapshot snapshot;
+    mergeConfig(policy, config, snapshot);
+    CHECK(!snapshot.pollingEnabled);
+
+    config.pollingEnabled = false;
+    CHECK(loadPolicy(writePolicy("{ \"pollingEnabled\": true }"), policy));
+    mergeConfig(policy, config, snapshot);
+    CHECK(snapshot.pollingEnabled);
+}
+
+TEST(anUnlockedPollingSettingIsTheUsers) {
+    Config config;
+    Policy policy;
+    CHECK(loadPolicy(writePolicy("{ \"minimumBrightness\": 0.1 }"), policy));
+    CHECK(!policy.pollingLocked);
+
+    ConfigSnapshot snapshot;
+    config.pollingEnabled = true;
+    mergeConfig(policy, config, snapshot);
+    CHECK(snapshot.pollingEnabled);
+    config.pollingEnabled = false;
+    mergeConfig(policy, config, snapshot);
+    CHECK(!snapshot.pollingEnabled);
+}
+
+TEST(mergingAppliesThePolicyToEveryMonitor) {
+    Policy policy;
+    policy.maximumOpacity = 0.5f;
+    policy.minimumTemperature = 3000;
+
+    Config config;
+    config.monitors[L"a"] = options(0.9f, 2000, 10);
+    config.monitors[L"b"] = options(0.2f, 4000, DEFAULT_BACKLIGHT);
+    config.globalEnabled = false;
+    config.adaptiveEnabled = true;
+
+    ConfigSnapshot snapshot;
+    mergeConfig(policy, config, snapshot);
+    CHECK(snapshot.monitors.size() == 2);
+    CHECK(snapshot.monitors[L"a"] == options(0.5f, 3000, 50));
+    CHECK(snapshot.monitors[L"b"] == options(0.2f, 4000, DEFAULT_BACKLIGHT));
+    CHECK(!snapshot.globalEnabled && snapshot.adaptiveEnabled);
+}
+
+struct Change {
+    std::wstring id;
+    MonitorOptions before;
+    MonitorOptions after;
+};
+
+TEST(mergingInPlaceReportsWhatChanged) {
+    Policy policy;
+    Config config;
+    config.monitors[L"a"] = options(0.1f, 4000, DEFAULT_BACKLIGHT);
+    config.monitors[L"b"] = options(0.2f, 4000, DEFAULT_BACKLIGHT);
+    config.monitors[L"c"] = options(0.3f, 4000, DEFAULT_BACKLIGHT);
+
+    ConfigSnapshot snapshot;
+    mergeConfig(policy, config, snapshot);
+    const MonitorOptions* kept = &snapshot.monitors[L"c"];
+
+    /* a is dropped, b changes, c stays as it was and d is new. */
+    config.monitors.erase(L"a");
+    config.monitors[L"b"].opacity = 0.25f;
+    config.monitors[L"d"] = options(0.4f, 4000, DEFAULT_BACKLIGHT);
+    policy.defaults.opacity = 0.05f;
+
+    std::vector<Change> changes;
+    mergeConfig(policy, config, snapshot, [&changes](
+        const std::wstring& id, const MonitorOptions& before, const MonitorOptions& after)
+    {
+        changes.push_back({ id, before, after });
+    });
+
+    CHECK(changes.size() == 3);
+    CHECK(changes[0].id == L"a" && changes[0].before.opacity == 0.1f && changes[0].after.opacity == 0.05f);
+    CHECK(changes[1].id == L"b" && changes[1].before.opacity == 0.2f && changes[1].after.opacity == 0.25f);
+    CHECK(changes[2].id == L"d" && changes[2].before == MonitorOptions() && changes[2].after.opacity == 0.4f);
+
+    CHECK(snapshot.monitors.size() == 3);
+    CHECK(snapshot.monitors.count(L"a") == 0);
+    CHECK(snapshot.defaults.opacity == 0.05f);
+    CHECK(&snapshot.monitors[L"c"] == kept);
+}
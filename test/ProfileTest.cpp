@@ -0,0 +1,141 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Test.h"
+#include "Profile.h"
+#include "Util.h"
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* built with DIMMER_PROFILE_ALLOCATIONS and its own copy of Profile.cpp, so
+the profiler's operator new is the one in use here. */
+
+using namespace dimmer;
+
+struct Row {
+    size_t calls = 0;
+    size_t allocations = 0;
+    size_t bytes = 0;
+    size_t peak = 0;
+};
+
+/* writes the report and reads back the row for one operation. */
+static Row report(const std::string& operation) {
+    std::string directory = test::temporaryDirectory();
+    setenv("XDG_CONFIG_HOME", directory.c_str(), 1);
+    WRITE_ALLOCATION_REPORT();
+
+    Row row;
+    std::ifstream file(directory + "/dimmer/allocations.txt");
+    std::string line;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string name;
+        fields >> name;
+        if (name == operation) {
+            fields >> row.calls >> row.allocations >> row.bytes >> row.peak;
+        }
+    }
+    return row;
+}
+
+/* the blocks are kept until the end, so the compiler can't pair up the new
+and delete and leave both out. the list itself is made before the scope. */
+static void allocate(int count, const char* operation = nullptr) {
+    std::vector<int*> blocks(count);
+    if (operation) {
+        PROFILE_ALLOCATIONS_BEGIN(operation);
+    }
+    for (int i = 0; i < count; i++) {
+        blocks[i] = new int(i);
+    }
+    if (operation) {
+        PROFILE_ALLOCATIONS_END();
+    }
+    for (int* block : blocks) {
+        delete block;
+    }
+}
+
+TEST(scopesAreCountedOnEveryThread) {
+    constexpr int threads = 8;
+    constexpr int perThread = 20000;
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back([] { allocate(perThread, "worker"); });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    Row row = report("worker");
+    CHECK(row.calls == threads);
+    CHECK(row.allocations == threads * perThread);
+    CHECK(row.bytes == threads * perThread * sizeof(int));
+}
+
+TEST(aScopeOnlyCountsItsOwnThread) {
+    std::thread outside;
+    {
+        PROFILE_ALLOCATIONS("idle");
+        outside = std::thread([] { allocate(1000); });
+        outside.join();
+    }
+
+    /* the thread itself is allocated inside the scope, but none of the
+    work it does is. */
+    Row row = report("idle");
+    CHECK(row.calls == 1);
+    CHECK(row.allocations < 10);
+}
+
+TEST(nestedScopesCountTowardsTheirParentsPeak) {
+    {
+        PROFILE_ALLOCATIONS("parent");
+        PROFILE_ALLOCATIONS("child");
+        std::vector<char> block(4096);
+    }
+
+    Row parent = report("parent");
+    Row child = report("child");
+    CHECK(parent.allocations == 0);
+    CHECK(child.allocations == 1);
+    CHECK(child.peak >= 4096);
+    CHECK(parent.peak >= 4096);
+}
@@ -0,0 +1,329 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Test.h"
+#include "Task.h"
+#include "EventLoop.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace dimmer;
+
+/* every test drives its own loop by hand, on this clock. */
+static uint64_t fakeNow = 0;
+
+static uint64_t fakeClock() {
+    return fakeNow;
+}
+
+static void advance(EventLoop& loop, uint64_t ms) {
+    fakeNow += ms;
+    loop.poll();
+}
+
+static Task sleepThenCount(uint32_t ms, int& count) {
+    co_await delay(ms);
+    count++;
+}
+
+static Task waitThenCount(Signal& signal, int& count) {
+    for (;;) {
+        co_await signal;
+        count++;
+    }
+}
+
+static Task waitWithTimeout(Signal& signal, uint32_t ms, std::vector<bool>& results) {
+    for (;;) {
+        results.push_back(co_await signal.wait(ms));
+    }
+}
+
+static Task waitAFrameThenCount(int& count) {
+    co_await nextFrame();
+    count++;
+}
+
+/* runs work off the loop, and records which threads it and the rest of the
+task ran on. */
+static Task workOnThePool(
+    std::function<void()> work,
+    std::thread::id& worker,
+    std::thread::id& resumed,
+    int& count)
+{
+    co_await onThreadPool([&worker, work]() {
+        worker = std::this_thread::get_id();
+        work();
+    });
+    resumed = std::this_thread::get_id();
+    count++;
+    if (EventLoop::current()) {
+        EventLoop::current()->quit();
+    }
+}
+
+static Task awaitBoth(Task& first, Task& second, int& count) {
+    co_await first;
+    co_await second;
+    count++;
+}
+
+/* how main.cpp rebuilds the overlays after a display change. */
+static Task refreshOnceSettled(Signal& signal, uint32_t settleMs, std::vector<uint64_t>& refreshes) {
+    for (;;) {
+        co_await signal;
+        bool changed = true;
+        while (changed) {
+            changed = co_await signal.wait(settleMs);
+        }
+        refreshes.push_back(fakeNow);
+    }
+}
+
+TEST(delayResumesOnceItsTimeHasPassed) {
+    fakeNow = 0;
+    EventLoop loop(&fakeClock);
+    int count = 0;
+
+    Task task = sleepThenCount(100, count);
+    CHECK(!task.done());
+    advance(loop, 99);
+    CHECK(count == 0);
+    advance(loop, 1);
+    CHECK(count == 1);
+    CHECK(task.done());
+}
+
+TEST(destroyingATaskCancelsItsDelay) {
+    fakeNow = 0;
+    EventLoop loop(&fakeClock);
+    int count = 0;
+
+    {
+        Task task = sleepThenCount(100, count);
+    }
+    advance(loop, 1000);
+    CHECK(count == 0);
+}
+
+TEST(aTaskCanAwaitOtherTasks) {
+    fakeNow = 0;
+    EventLoop loop(&fakeClock);
+    int slept = 0, both = 0;
+
+    Task first = sleepThenCount(10, slept);
+    Task second = sleepThenCount(30, slept);
+    Task waiter = awaitBoth(first, second, both);
+
+    advance(loop, 10);
+    CHECK(slept == 1);
+    CHECK(both == 0);
+    advance(loop, 20);
+    CHECK(slept == 2);
+    CHECK(both == 1);
+    CHECK(waiter.done());
+}
+
+TEST(aBurstOfNotificationsResumesWaitersOnce) {
+    fakeNow = 0;
+    EventLoop loop(&fakeClock);
+    Signal signal;
+    int a = 0, b = 0;
+
+    Task first = waitThenCount(signal, a);
+    Task second = waitThenCount(signal, b);
+
+    signal.notify();
+    signal.notify();
+    signal.notify();
+    CHECK(a == 0); /* always from the loop, never from notify() itself */
+    loop.poll();
+    CHECK(a == 1);
+    CHECK(b == 1);
+
+    /* and they went straight back to waiting */
+    signal.notify();
+    loop.poll();
+    CHECK(a == 2);
+    CHECK(b == 2);
+}
+
+TEST(notificationsWithNobodyWaitingAreForgotten) {
+    fakeNow = 0;
+    EventLoop loop(&fakeClock);
+    Signal signal;
+    int count = 0;
+
+    signal.notify();
+    loop.poll();
+
+    Task task = waitThenCount(signal, count);
+    loop.poll();
+    CHECK(count == 0);
+}
+
+TEST(aTimedWaitReportsWhetherItWasNotified) {
+    fakeNow = 0;
+    EventLoop loop(&fakeClock);
+    Signal signal;
+    std::vector<bool> results;
+
+    Task task = waitWithTimeout(signal, 100, results);
+
+    advance(loop, 50);
+    signal.notify();
+    loop.poll();
+    CHECK((results == std::vector<bool> { true }));
+
+    /* the notification cancelled the first timeout; only the second's left */
+    advance(loop, 99);
+    CHECK(results.size() == 1);
+    advance(loop, 1);
+    CHECK((results == std::vector<bool> { true, false }));
+}
+
+TEST(aTimedOutWaiterIsNoLongerNotified) {
+    fakeNow = 0;
+    EventLoop loop(&fakeClock);
+    Signal signal;
+    std::vector<bool> results;
+
+    {
+        Task task = waitWithTimeout(signal, 100, results);
+        advance(loop, 100);
+        CHECK((results == std::vector<bool> { false }));
+    }
+
+    /* the waiter and its timer went away with the task */
+    signal.notify();
+    advance(loop, 1000);
+    CHECK(results.size() == 1);
+}
+
+TEST(refreshesWaitUntilChangesHaveSettled) {
+    fakeNow = 0;
+    EventLoop loop(&fakeClock);
+    Signal signal;
+    std::vector<uint64_t> refreshes;
+
+    Task task = refreshOnceSettled(signal, 250, refreshes);
+
+    /* changes keep coming in, each within 250ms of the last */
+    for (int i = 0; i < 5; i++) {
+        signal.notify();
+        loop.poll();
+        advance(loop, 200);
+    }
+    CHECK(refreshes.empty());
+
+    /* 800ms in was the last one */
+    advance(loop, 49);
+    CHECK(refreshes.empty());
+    advance(loop, 1);
+    CHECK((refreshes == std::vector<uint64_t> { 1050 }));
+
+    /* and the next change starts it all over */
+    advance(loop, 1000);
+    signal.notify();
+    loop.poll();
+    advance(loop, 250);
+    CHECK((refreshes == std::vector<uint64_t> { 1050, 2300 }));
+}
+
+TEST(nextFrameWaitsAFrameWithoutACompositorToAsk) {
+    fakeNow = 0;
+    EventLoop loop(&fakeClock);
+    int count = 0;
+
+    /* there's no vblank to line up with here, so it's a 60Hz frame */
+    Task task = waitAFrameThenCount(count);
+    advance(loop, 15);
+    CHECK(count == 0);
+    advance(loop, 1);
+    CHECK(count == 1);
+    CHECK(task.done());
+}
+
+TEST(onThreadPoolRunsTheWorkElsewhereAndResumesOnTheLoop) {
+    EventLoop loop;
+    std::thread::id worker, resumed;
+    int count = 0;
+
+    Task task = workOnThePool([]() { }, worker, resumed, count);
+    CHECK(count == 0); /* never resumed from inside co_await itself */
+
+    loop.schedule(2000, [&loop]() { loop.quit(-1); });
+    CHECK(loop.run() == 0);
+    CHECK(count == 1);
+    CHECK(task.done());
+    CHECK(worker != std::this_thread::get_id());
+    CHECK(resumed == std::this_thread::get_id());
+}
+
+TEST(onThreadPoolWithoutALoopRunsTheWorkRightAway) {
+    std::thread::id worker, resumed;
+    int count = 0;
+
+    Task task = workOnThePool([]() { }, worker, resumed, count);
+    CHECK(count == 1);
+    CHECK(task.done());
+    CHECK(worker == std::this_thread::get_id());
+}
+
+TEST(destroyingATaskDropsItsThreadPoolResult) {
+    EventLoop loop;
+    std::thread::id worker, resumed;
+    std::atomic<bool> release(false), finished(false);
+    int count = 0;
+
+    {
+        Task task = workOnThePool([&]() {
+            while (!release) {
+                std::this_thread::yield();
+            }
+            finished = true;
+        }, worker, resumed, count);
+    }
+
+    /* the work still runs to the end, but there's nothing to resume */
+    release = true;
+    while (!finished) {
+        std::this_thread::yield();
+    }
+    loop.schedule(100, [&loop]() { loop.quit(); });
+    loop.run();
+    CHECK(count == 0);
+}
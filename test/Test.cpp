@@ -0,0 +1,119 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Test.h"
+#include "Util.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <ftw.h>
+#include <unistd.h>
+
+using namespace dimmer::test;
+
+struct Case {
+    const char* name;
+    Function function;
+};
+
+static std::vector<Case>& cases() {
+    static std::vector<Case> list;
+    return list;
+}
+
+static std::vector<std::string> directories;
+static int failures = 0;
+
+static int removeEntry(const char* path, const struct stat*, int, struct FTW*) {
+    return remove(path);
+}
+
+static void removeDirectories() {
+    for (auto& directory : directories) {
+        nftw(directory.c_str(), &removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+}
+
+namespace dimmer {
+    namespace test {
+        Registrar::Registrar(const char* name, Function function) {
+            cases().push_back({ name, function });
+        }
+
+        void fail(const char* file, int line, const char* expression) {
+            fprintf(stderr, "    %s:%d: CHECK(%s) failed\n", file, line, expression);
+            failures++;
+        }
+
+        std::string temporaryDirectory() {
+            const char* root = getenv("TMPDIR");
+            std::string pattern = std::string(root && *root ? root : "/tmp") + "/dimmer-test-XXXXXX";
+            if (!mkdtemp(&pattern[0])) {
+                fprintf(stderr, "mkdtemp failed for %s\n", pattern.c_str());
+                exit(2);
+            }
+            if (directories.empty()) {
+                atexit(&removeDirectories);
+            }
+            directories.push_back(pattern);
+            return pattern;
+        }
+
+        std::wstring widen(const std::string& path) {
+            return u8to16(path);
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    /* an optional argument runs only the cases whose names contain it. */
+    const char* filter = argc > 1 ? argv[1] : nullptr;
+
+    int failed = 0;
+    for (auto& test : cases()) {
+        if (filter && !strstr(test.name, filter)) {
+            continue;
+        }
+        int before = failures;
+        test.function();
+        bool passed = failures == before;
+        printf("%s %s\n", passed ? "ok  " : "FAIL", test.name);
+        fflush(stdout);
+        failed += passed ? 0 : 1;
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,218 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Test.h"
+#include "TimerWheel.h"
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+using namespace dimmer;
+
+/* the wheel only knows the time it's advanced to; this is that time, as the
+callbacks see it. */
+static uint64_t now = 0;
+
+static void advance(TimerWheel& wheel, uint64_t to) {
+    now = to;
+    wheel.advance(to);
+}
+
+/* the deadlines either side of every level boundary, and some that only
+the overflow list can hold (the levels cover 2^36 ms). */
+static std::vector<uint64_t> boundaryOffsets() {
+    std::vector<uint64_t> offsets;
+    for (int bits = 6; bits <= 42; bits += 6) {
+        uint64_t boundary = 1ull << bits;
+        offsets.push_back(boundary - 1);
+        offsets.push_back(boundary);
+        offsets.push_back(boundary + 1);
+    }
+    offsets.push_back((3ull << 36) + 12345);
+    return offsets;
+}
+
+TEST(timersFireExactlyOnTheirDeadlineAcrossLevels) {
+    /* starting points just short of a carry are where cascading goes wrong. */
+    const uint64_t starts[] = { 0, 1, 63, 4095, 4096 + 17, (1ull << 36) - 1 };
+
+    for (uint64_t start : starts) {
+        for (uint64_t offset : boundaryOffsets()) {
+            uint64_t deadline = start + offset;
+            TimerWheel wheel(start);
+            uint64_t firedAt = 0;
+            wheel.schedule(deadline, 0, 0, [&firedAt]() { firedAt = now; });
+
+            CHECK(wheel.nextDeadline() == deadline);
+            advance(wheel, deadline - 1);
+            CHECK(firedAt == 0);
+            CHECK(wheel.size() == 1);
+            CHECK(wheel.nextDeadline() == deadline);
+
+            advance(wheel, deadline);
+            CHECK(firedAt == deadline);
+            CHECK(wheel.size() == 0);
+            CHECK(wheel.nextDeadline() == UINT64_MAX);
+        }
+    }
+}
+
+TEST(timersFireInDeadlineOrderWhateverTheStepSize) {
+    std::mt19937_64 random(40);
+
+    for (int round = 0; round < 20; round++) {
+        uint64_t start = random() % (1ull << 40);
+        TimerWheel wheel(start);
+
+        std::vector<uint64_t> deadlines;
+        std::vector<uint64_t> fired;
+        for (int i = 0; i < 500; i++) {
+            /* mostly near, some far, a few in overflow */
+            int bits = 1 + (int) (random() % 40);
+            uint64_t deadline = start + 1 + random() % (1ull << bits);
+            deadlines.push_back(deadline);
+            wheel.schedule(deadline, 0, 0, [deadline, &fired]() {
+                CHECK(deadline <= now);
+                fired.push_back(deadline);
+            });
+        }
+        std::sort(deadlines.begin(), deadlines.end());
+
+        /* every step has to fire precisely the timers it passed. a broken
+        wheel may never empty, so the steps are bounded. */
+        uint64_t time = start;
+        for (int steps = 0; wheel.size() && steps < 10000; steps++) {
+            uint64_t next = wheel.nextDeadline();
+            CHECK(fired.size() < deadlines.size() && next == deadlines[fired.size()]);
+            uint64_t step = 1 + random() % (1ull << (random() % 41));
+            uint64_t before = fired.size();
+            time += step;
+            advance(wheel, time);
+            auto passed = std::upper_bound(deadlines.begin(), deadlines.end(), time) - deadlines.begin();
+            CHECK((uint64_t) passed == fired.size());
+            CHECK(fired.size() >= before);
+        }
+
+        CHECK(fired == deadlines);
+    }
+}
+
+TEST(cancellingADueTimerFromACallbackSkipsIt) {
+    TimerWheel wheel;
+    bool firstRan = false, secondRan = false;
+    TimerWheel::Id second = 0;
+
+    /* both are due in the same advance(), whichever order they run in */
+    auto first = wheel.schedule(100, 0, 0, [&]() {
+        firstRan = true;
+        wheel.cancel(second);
+    });
+    second = wheel.schedule(100, 0, 0, [&]() {
+        secondRan = true;
+        wheel.cancel(first);
+    });
+
+    advance(wheel, 100);
+    CHECK(firstRan != secondRan);
+    CHECK(wheel.size() == 0);
+
+    /* and the ids are dead now, even once their slots are reused */
+    wheel.schedule(200, 0, 0, []() { });
+    CHECK(!wheel.cancel(first));
+    CHECK(!wheel.cancel(second));
+    CHECK(wheel.size() == 1);
+}
+
+TEST(aRepeatingTimerCanCancelItself) {
+    TimerWheel wheel;
+    int runs = 0;
+    TimerWheel::Id id = 0;
+
+    id = wheel.schedule(10, 0, 10, [&]() {
+        if (++runs == 3) {
+            CHECK(wheel.cancel(id));
+        }
+    });
+
+    for (uint64_t time = 10; time <= 100; time += 10) {
+        advance(wheel, time);
+    }
+    CHECK(runs == 3);
+    CHECK(wheel.size() == 0);
+    CHECK(!wheel.cancel(id));
+}
+
+TEST(repeatingTimersRearmFromNowAfterAStall) {
+    TimerWheel wheel;
+    std::vector<uint64_t> runs;
+    wheel.schedule(10, 0, 10, [&runs]() { runs.push_back(now); });
+
+    advance(wheel, 10);
+    advance(wheel, 1000); /* one call, not 99 catch-up calls */
+    advance(wheel, 1010);
+    CHECK((runs == std::vector<uint64_t> { 10, 1000, 1010 }));
+}
+
+TEST(timersScheduledFromACallbackWaitForTheNextAdvance) {
+    TimerWheel wheel;
+    int nested = 0;
+
+    wheel.schedule(50, 0, 0, [&]() {
+        wheel.schedule(now, 0, 0, [&nested]() { nested++; });
+    });
+
+    advance(wheel, 50);
+    CHECK(nested == 0);
+    CHECK(wheel.nextDeadline() == 51);
+    advance(wheel, 51);
+    CHECK(nested == 1);
+}
+
+TEST(slackCoalescesOverlappingDeadlines) {
+    TimerWheel wheel;
+    int fired = 0;
+
+    for (uint64_t deadline = 100; deadline <= 110; deadline++) {
+        wheel.schedule(deadline, 16, 0, [&fired]() { fired++; });
+    }
+    wheel.schedule(105, 0, 0, []() { });
+
+    CHECK(wheel.nextDeadline() == 105);
+    advance(wheel, 105);
+    CHECK(fired == 0);
+    CHECK(wheel.nextDeadline() == 112);
+    advance(wheel, 112);
+    CHECK(fired == 11);
+}
@@ -0,0 +1,216 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Test.h"
+#include "Utf.h"
+#include "Util.h"
+#include <codecvt>
+#include <locale>
+#include <random>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using namespace dimmer;
+
+/* the standard library's (deprecated, but still shipped) converters serve
+as the reference. */
+using Reference = std::wstring_convert<std::conditional_t<sizeof(wchar_t) == 2,
+    std::codecvt_utf8_utf16<wchar_t>, std::codecvt_utf8<wchar_t>>, wchar_t>;
+
+static const UtfKernel kernels[] = { UtfKernel::Sse2, UtfKernel::Neon, UtfKernel::Best };
+
+static void appendCodePoint(std::wstring& text, uint32_t c) {
+    if (sizeof(wchar_t) == 2 && c >= 0x10000) {
+        c -= 0x10000;
+        text += (wchar_t) (0xd800 + (c >> 10));
+        text += (wchar_t) (0xdc00 + (c & 0x3ff));
+    }
+    else {
+        text += (wchar_t) c;
+    }
+}
+
+/* mostly ASCII, in runs of every length around the vector widths, with
+code points of every encoded length in between. */
+static std::wstring randomText(std::mt19937& random) {
+    std::wstring text;
+    size_t parts = random() % 12;
+    for (size_t i = 0; i < parts; i++) {
+        size_t run = random() % 40;
+        for (size_t j = 0; j < run; j++) {
+            text += (wchar_t) (0x20 + random() % 0x5f);
+        }
+        switch (random() % 4) {
+            case 0: appendCodePoint(text, 0x80 + random() % 0x780); break;
+            case 1: appendCodePoint(text, 0x800 + random() % 0xd000); break; /* below the surrogates */
+            case 2: appendCodePoint(text, 0x10000 + random() % 0x100000); break;
+            default: appendCodePoint(text, random() % 0x80); break;
+        }
+    }
+    return text;
+}
+
+/* anything at all, valid or not. */
+static std::wstring randomUnits(std::mt19937& random) {
+    std::wstring text;
+    size_t length = random() % 64;
+    for (size_t i = 0; i < length; i++) {
+        uint32_t pick = random() % 8;
+        text += (wchar_t) (pick < 5 ? random() % 0x80 : pick < 7 ? 0xd800 + random() % 0x800 : random() % 0x110010);
+    }
+    return text;
+}
+
+static std::string randomBytes(std::mt19937& random) {
+    std::string bytes;
+    size_t length = random() % 64;
+    for (size_t i = 0; i < length; i++) {
+        bytes += (char) (random() % 4 ? random() % 0x80 : 0x80 + random() % 0x80);
+    }
+    return bytes;
+}
+
+/* both the result and the bytes written have to match the scalar kernel,
+at every capacity from too small to plenty. */
+static void checkWide(const std::wstring& text) {
+    size_t enough = utf8Capacity(text.size());
+    for (size_t capacity : { (size_t) 0, text.size() / 2, text.size(), enough }) {
+        std::string expected(enough, '\0');
+        size_t expectedSize = utf16to8(text.data(), text.size(), &expected[0], capacity, UtfKernel::Scalar);
+
+        for (UtfKernel kernel : kernels) {
+            std::string actual(enough, '\0');
+            size_t actualSize = utf16to8(text.data(), text.size(), &actual[0], capacity, kernel);
+            CHECK(actualSize == expectedSize);
+            if (expectedSize != UTF_ERROR) {
+                CHECK(actual.compare(0, expectedSize, expected, 0, expectedSize) == 0);
+            }
+        }
+    }
+}
+
+static void checkNarrow(const std::string& bytes) {
+    size_t enough = utf16Capacity(bytes.size());
+    for (size_t capacity : { (size_t) 0, bytes.size() / 2, enough }) {
+        std::wstring expected(enough, L'\0');
+        size_t expectedSize = utf8to16(bytes.data(), bytes.size(), &expected[0], capacity, UtfKernel::Scalar);
+
+        for (UtfKernel kernel : kernels) {
+            std::wstring actual(enough, L'\0');
+            size_t actualSize = utf8to16(bytes.data(), bytes.size(), &actual[0], capacity, kernel);
+            CHECK(actualSize == expectedSize);
+            if (expectedSize != UTF_ERROR) {
+                CHECK(actual.compare(0, expectedSize, expected, 0, expectedSize) == 0);
+            }
+        }
+    }
+}
+
+TEST(theScalarKernelIsAlwaysThere) {
+    CHECK(isUtfKernelSupported(UtfKernel::Scalar));
+    CHECK(isUtfKernelSupported(UtfKernel::Best));
+}
+
+TEST(vectorKernelsMatchTheScalarOneOnValidText) {
+    std::mt19937 random(1);
+    for (int i = 0; i < 2000; i++) {
+        std::wstring text = randomText(random);
+        checkWide(text);
+        checkNarrow(u16to8(text));
+    }
+}
+
+TEST(vectorKernelsMatchTheScalarOneOnGarbage) {
+    std::mt19937 random(2);
+    for (int i = 0; i < 2000; i++) {
+        checkWide(randomUnits(random));
+        checkNarrow(randomBytes(random));
+    }
+}
+
+TEST(roundTripsMatchTheReferenceConverter) {
+    Reference reference;
+    std::mt19937 random(3);
+    for (int i = 0; i < 2000; i++) {
+        std::wstring text = randomText(random);
+        std::string bytes = reference.to_bytes(text);
+        CHECK(u16to8(text) == bytes);
+        CHECK(u8to16(bytes) == text);
+        CHECK(u8to16(u16to8(text)) == text);
+    }
+}
+
+TEST(malformedInputIsRejected) {
+    const char* invalid[] = {
+        "\xc0\xaf", /* overlong */
+        "\xe0\x80\xaf", /* overlong */
+        "\xed\xa0\x80", /* a surrogate */
+        "\xf4\x90\x80\x80", /* past U+10FFFF */
+        "\xe2\x82", /* truncated */
+        "abc\x80", /* a stray continuation byte */
+        "\xff"
+    };
+
+    for (const char* bytes : invalid) {
+        std::string text = std::string(64, 'a') + bytes;
+        for (UtfKernel kernel : { UtfKernel::Scalar, UtfKernel::Best }) {
+            std::wstring output(text.size(), L'\0');
+            CHECK(utf8to16(text.data(), text.size(), &output[0], output.size(), kernel) == UTF_ERROR);
+        }
+    }
+
+    std::wstring lone = std::wstring(64, L'a') + (wchar_t) 0xdc00;
+    std::string output(utf8Capacity(lone.size()), '\0');
+    CHECK(utf16to8(lone.data(), lone.size(), &output[0], output.size()) == UTF_ERROR);
+}
+
+TEST(convertingIntoAStringReusesIt) {
+    std::string narrow;
+    std::wstring wide;
+
+    u16to8(std::wstring(1000, L'x'), narrow);
+    CHECK(narrow == std::string(1000, 'x'));
+    const char* storage = narrow.data();
+    u16to8(L"DP-1", narrow);
+    CHECK(narrow == "DP-1");
+    u16to8(std::wstring(900, L'y'), narrow);
+    CHECK(narrow == std::string(900, 'y'));
+    CHECK(narrow.data() == storage);
+
+    u8to16(std::string(1000, 'x'), wide);
+    CHECK(wide == std::wstring(1000, L'x'));
+    u8to16("\xe2\x82", wide);
+    CHECK(wide.empty());
+}
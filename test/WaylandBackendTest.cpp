@@ -0,0 +1,397 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Test.h"
+#include "WaylandBackend.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <unistd.h>
+#include <wayland-server.h>
+#include "wlr-gamma-control-unstable-v1-server-protocol.h"
+
+using namespace dimmer;
+
+/* a headless compositor with a few outputs and, optionally, the gamma
+control protocol, running on a thread of its own. it hands each output's
+gamma to one control at a time, like wlroots does, and keeps every table
+it's sent. it can also be held up before answering, to show that the
+backend doesn't wait for it. */
+class FakeCompositor {
+    public:
+        struct Table {
+            std::string output;
+            std::vector<uint16_t> values; /* red, green, blue */
+        };
+
+        FakeCompositor(std::vector<std::string> outputs, uint32_t rampSize = 256, bool withGamma = true)
+        : names(outputs)
+        , rampSize(rampSize)
+        , running(true) {
+            std::string runtime = test::temporaryDirectory();
+            setenv("XDG_RUNTIME_DIR", runtime.c_str(), 1);
+
+            this->display = wl_display_create();
+            this->socket = wl_display_add_socket_auto(this->display);
+
+            for (auto& name : this->names) {
+                wl_global_create(this->display, &wl_output_interface, 4, &name, &bindOutput);
+            }
+            if (withGamma) {
+                wl_global_create(this->display, &zwlr_gamma_control_manager_v1_interface, 1, this, &bindManager);
+            }
+
+            this->thread = std::thread([this]() {
+                wl_event_loop* loop = wl_display_get_event_loop(this->display);
+                while (this->running) {
+                    wl_display_flush_clients(this->display);
+                    wl_event_loop_dispatch(loop, 10);
+                }
+            });
+        }
+
+        ~FakeCompositor() {
+            this->release();
+            this->running = false;
+            this->thread.join();
+            wl_display_destroy_clients(this->display);
+            wl_display_destroy(this->display);
+        }
+
+        const char* getSocket() const { return this->socket; }
+
+        /* requests for a control wait until release(). */
+        void hold() {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->held = true;
+        }
+
+        void release() {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->held = false;
+            this->changed.notify_all();
+        }
+
+        std::vector<Table> tables() {
+            std::lock_guard<std::mutex> guard(this->lock);
+            return this->received;
+        }
+
+        int requests() {
+            std::lock_guard<std::mutex> guard(this->lock);
+            return this->requested;
+        }
+
+        int failures() {
+            std::lock_guard<std::mutex> guard(this->lock);
+            return this->failed;
+        }
+
+        size_t activeControls() {
+            std::lock_guard<std::mutex> guard(this->lock);
+            return this->active.size();
+        }
+
+    private:
+        struct Control {
+            FakeCompositor* compositor;
+            std::string output;
+            bool active;
+        };
+
+        static void bindOutput(wl_client* client, void* data, uint32_t version, uint32_t id) {
+            static const struct wl_output_interface implementation = {
+                [](wl_client*, wl_resource* resource) { wl_resource_destroy(resource); }
+            };
+
+            wl_resource* resource = wl_resource_create(client, &wl_output_interface, (int) version, id);
+            wl_resource_set_implementation(resource, &implementation, data, nullptr);
+            wl_output_send_name(resource, ((std::string*) data)->c_str());
+            wl_output_send_done(resource);
+        }
+
+        static void bindManager(wl_client* client, void* data, uint32_t version, uint32_t id) {
+            static const struct zwlr_gamma_control_manager_v1_interface implementation = {
+                &FakeCompositor::getGammaControl,
+                [](wl_client*, wl_resource* resource) { wl_resource_destroy(resource); }
+            };
+
+            wl_resource* resource = wl_resource_create(client, &zwlr_gamma_control_manager_v1_interface, (int) version, id);
+            wl_resource_set_implementation(resource, &implementation, data, nullptr);
+        }
+
+        static void getGammaControl(wl_client* client, wl_resource* manager, uint32_t id, wl_resource* output) {
+            static const struct zwlr_gamma_control_v1_interface implementation = {
+                &FakeCompositor::setGamma,
+                [](wl_client*, wl_resource* resource) { wl_resource_destroy(resource); }
+            };
+
+            auto compositor = (FakeCompositor*) wl_resource_get_user_data(manager);
+            auto control = new Control { compositor, *(std::string*) wl_resource_get_user_data(output), false };
+
+            wl_resource* resource = wl_resource_create(client, &zwlr_gamma_control_v1_interface,
+                wl_resource_get_version(manager), id);
+            wl_resource_set_implementation(resource, &implementation, control, &destroyControl);
+
+            std::unique_lock<std::mutex> guard(compositor->lock);
+            compositor->changed.wait(guard, [compositor]() { return !compositor->held; });
+            compositor->requested++;
+
+            if (compositor->rampSize == 0 || compositor->active.count(control->output)) {
+                compositor->failed++;
+                zwlr_gamma_control_v1_send_failed(resource);
+            }
+            else {
+                control->active = true;
+                compositor->active.insert(control->output);
+                zwlr_gamma_control_v1_send_gamma_size(resource, compositor->rampSize);
+            }
+        }
+
+        static void setGamma(wl_client*, wl_resource* resource, int32_t fd) {
+            auto control = (Control*) wl_resource_get_user_data(resource);
+            auto compositor = control->compositor;
+
+            Table table;
+            table.output = control->output;
+            table.values.resize(compositor->rampSize * 3);
+            size_t bytes = table.values.size() * sizeof(uint16_t);
+            bool complete = pread(fd, table.values.data(), bytes, 0) == (ssize_t) bytes;
+            close(fd);
+
+            std::lock_guard<std::mutex> guard(compositor->lock);
+            if (control->active && complete) {
+                compositor->received.push_back(table);
+            }
+        }
+
+        static void destroyControl(wl_resource* resource) {
+            auto control = (Control*) wl_resource_get_user_data(resource);
+            {
+                std::lock_guard<std::mutex> guard(control->compositor->lock);
+                if (control->active) {
+                    control->compositor->active.erase(control->output);
+                }
+            }
+            delete control;
+        }
+
+        std::vector<std::string> names;
+        uint32_t rampSize;
+        wl_display* display;
+        const char* socket;
+        std::thread thread;
+        std::atomic<bool> running;
+
+        std::mutex lock;
+        std::condition_variable changed;
+        bool held = false;
+        int requested = 0;
+        int failed = 0;
+        std::set<std::string> active;
+        std::vector<Table> received;
+};
+
+/* runs the backend's side until the condition holds, or a couple of
+seconds have gone by. */
+static bool pump(WaylandBackend& backend, std::function<bool()> condition) {
+    for (int i = 0; i < 200; i++) {
+        if (condition()) {
+            return true;
+        }
+        pollfd fd = { backend.getFd(), POLLIN, 0 };
+        poll(&fd, 1, 10);
+        backend.dispatch();
+    }
+    return condition();
+}
+
+/* lets a held compositor go after a while, so a backend that did wait for
+it fails the test rather than hanging it. */
+static std::thread releaseLater(FakeCompositor& compositor) {
+    return std::thread([&compositor]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(300));
+        compositor.release();
+    });
+}
+
+static MonitorOptions dimmedTo(float opacity) {
+    MonitorOptions options;
+    options.enabled = true;
+    options.opacity = opacity;
+    options.temperature = DEFAULT_TEMPERATURE;
+    return options;
+}
+
+/* each plane's top entry, as a fraction of full scale. */
+static bool tableTopNear(const FakeCompositor::Table& table, float expected) {
+    size_t size = table.values.size() / 3;
+    for (size_t plane = 0; plane < 3; plane++) {
+        float top = (float) table.values[plane * size + size - 1] / 65535.0f;
+        if (top < expected - 0.01f || top > expected + 0.01f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST(outputsAreListedByName) {
+    FakeCompositor compositor({ "HEADLESS-1", "HEADLESS-2" });
+    WaylandBackend backend(compositor.getSocket());
+    CHECK(backend.isOpen());
+
+    auto outputs = backend.outputs();
+    std::sort(outputs.begin(), outputs.end());
+    CHECK((outputs == std::vector<std::string> { "HEADLESS-1", "HEADLESS-2" }));
+
+    CHECK(!backend.apply("HEADLESS-3", dimmedTo(0.5f)));
+}
+
+TEST(withoutTheProtocolThereIsNothingToDo) {
+    FakeCompositor compositor({ "HEADLESS-1" }, 256, false);
+    WaylandBackend backend(compositor.getSocket());
+    CHECK(!backend.isOpen());
+    CHECK(!backend.apply("HEADLESS-1", dimmedTo(0.5f)));
+}
+
+TEST(applyDoesNotWaitForTheCompositor) {
+    FakeCompositor compositor({ "HEADLESS-1" });
+    WaylandBackend backend(compositor.getSocket());
+
+    compositor.hold();
+    std::thread releaser = releaseLater(compositor);
+
+    auto start = std::chrono::steady_clock::now();
+    CHECK(backend.apply("HEADLESS-1", dimmedTo(0.5f)));
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::milliseconds(100));
+    CHECK(compositor.tables().empty());
+
+    /* the table follows from dispatch(), once the compositor answers */
+    CHECK(pump(backend, [&]() { return compositor.tables().size() == 1; }));
+    releaser.join();
+
+    auto tables = compositor.tables();
+    CHECK(tables.size() == 1);
+    if (!tables.empty()) {
+        CHECK(tables[0].output == "HEADLESS-1");
+        CHECK(tables[0].values.size() == 256 * 3);
+        CHECK(tableTopNear(tables[0], 0.5f));
+    }
+}
+
+TEST(onlyTheNewestOptionsAreWritten) {
+    FakeCompositor compositor({ "HEADLESS-1" }, 1024);
+    WaylandBackend backend(compositor.getSocket());
+
+    compositor.hold();
+    std::thread releaser = releaseLater(compositor);
+    CHECK(backend.apply("HEADLESS-1", dimmedTo(0.2f)));
+    CHECK(backend.apply("HEADLESS-1", dimmedTo(0.6f)));
+
+    CHECK(pump(backend, [&]() { return compositor.tables().size() == 1; }));
+    releaser.join();
+    CHECK(compositor.requests() == 1);
+
+    /* once the control is there, changes go straight out */
+    CHECK(backend.apply("HEADLESS-1", dimmedTo(0.8f)));
+    CHECK(pump(backend, [&]() { return compositor.tables().size() == 2; }));
+
+    auto tables = compositor.tables();
+    CHECK(tables.size() == 2);
+    if (tables.size() == 2) {
+        CHECK(tableTopNear(tables[0], 0.4f));
+        CHECK(tableTopNear(tables[1], 0.2f));
+    }
+}
+
+TEST(resetHandsTheOutputBack) {
+    FakeCompositor compositor({ "HEADLESS-1" });
+    WaylandBackend backend(compositor.getSocket());
+
+    CHECK(backend.apply("HEADLESS-1", dimmedTo(0.5f)));
+    CHECK(pump(backend, [&]() { return compositor.activeControls() == 1 && compositor.tables().size() == 1; }));
+
+    backend.reset("HEADLESS-1");
+    CHECK(pump(backend, [&]() { return compositor.activeControls() == 0; }));
+
+    /* options that don't dim at all let go of it too, without asking */
+    CHECK(backend.apply("HEADLESS-1", dimmedTo(0.5f)));
+    CHECK(pump(backend, [&]() { return compositor.activeControls() == 1; }));
+    CHECK(backend.apply("HEADLESS-1", dimmedTo(0.0f)));
+    CHECK(pump(backend, [&]() { return compositor.activeControls() == 0; }));
+    CHECK(compositor.requests() == 2);
+}
+
+TEST(aRefusedOutputIsAskedAgainNextTime) {
+    FakeCompositor compositor({ "HEADLESS-1" }, 0); /* no gamma on any output */
+    WaylandBackend backend(compositor.getSocket());
+
+    CHECK(backend.apply("HEADLESS-1", dimmedTo(0.5f)));
+    CHECK(pump(backend, [&]() { return compositor.failures() == 1; }));
+    CHECK(backend.apply("HEADLESS-1", dimmedTo(0.5f)));
+    CHECK(pump(backend, [&]() { return compositor.failures() == 2; }));
+    CHECK(compositor.tables().empty());
+}
+
+TEST(anotherClientCanTakeOverOnceItsLetGo) {
+    FakeCompositor compositor({ "HEADLESS-1" });
+    WaylandBackend first(compositor.getSocket());
+    WaylandBackend second(compositor.getSocket());
+
+    CHECK(first.apply("HEADLESS-1", dimmedTo(0.5f)));
+    CHECK(pump(first, [&]() { return compositor.tables().size() == 1; }));
+
+    CHECK(second.apply("HEADLESS-1", dimmedTo(0.7f)));
+    CHECK(pump(second, [&]() { return compositor.failures() == 1; }));
+
+    first.reset("HEADLESS-1");
+    CHECK(pump(first, [&]() { return compositor.activeControls() == 0; }));
+
+    CHECK(second.apply("HEADLESS-1", dimmedTo(0.7f)));
+    CHECK(pump(second, [&]() { return compositor.tables().size() == 2; }));
+
+    auto tables = compositor.tables();
+    if (tables.size() == 2) {
+        CHECK(tableTopNear(tables[1], 0.3f));
+    }
+}
@@ -0,0 +1,249 @@
+//////////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2007-2017 Casey Langen
+//
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//    * Redistributions of source code must retain the above copyright notice,
+//      this list of conditions and the following disclaimer.
+//
+//    * Redistributions in binary form must reproduce the above copyright
+//      notice, this list of conditions and the following disclaimer in the
+//      documentation and/or other materials provided with the distribution.
+//
+//    * Neither the name of the author nor the names of other contributors may
+//      be used to endorse or promote products derived from this software
+//      without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+//////////////////////////////////////////////////////////////////////////////
+
+#include "Test.h"
+#include "X11Backend.h"
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <thread>
+#include <vector>
+
+using namespace dimmer;
+
+/* runs under Xvfb (see CMakeLists.txt), both with the Composite extension
+and without it, which also takes away the ARGB visual. the server is looked
+at through a connection of its own; the backend only flushes, so every
+check waits a little for its requests to land. */
+
+static bool eventually(Display* display, std::function<bool()> condition) {
+    for (int i = 0; i < 100; i++) {
+        XSync(display, False);
+        if (condition()) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+}
+
+/* the top of the CRTC's green ramp, as a fraction of full scale. */
+static float rampTop(Display* display, RRCrtc crtc) {
+    XRRCrtcGamma* gamma = XRRGetCrtcGamma(display, crtc);
+    if (!gamma) {
+        return -1.0f;
+    }
+    float top = gamma->size > 0 ? (float) gamma->green[gamma->size - 1] / 65535.0f : -1.0f;
+    XRRFreeGamma(gamma);
+    return top;
+}
+
+static bool rampTopNear(Display* display, RRCrtc crtc, float expected) {
+    float top = rampTop(display, crtc);
+    return top >= expected - 0.02f && top <= expected + 0.02f;
+}
+
+/* mapped override-redirect windows, which is what the overlays are. */
+static int overlayCount(Display* display) {
+    Window root, parent, *children = nullptr;
+    unsigned count = 0;
+    if (!XQueryTree(display, DefaultRootWindow(display), &root, &parent, &children, &count)) {
+        return -1;
+    }
+
+    int result = 0;
+    for (unsigned i = 0; i < count; i++) {
+        XWindowAttributes attributes;
+        if (XGetWindowAttributes(display, children[i], &attributes) &&
+            attributes.override_redirect && attributes.map_state == IsViewable)
+        {
+            result++;
+        }
+    }
+
+    if (children) {
+        XFree(children);
+    }
+    return result;
+}
+
+static MonitorOptions dimmedTo(float opacity) {
+    MonitorOptions options;
+    options.enabled = true;
+    options.opacity = opacity;
+    options.temperature = DEFAULT_TEMPERATURE;
+    return options;
+}
+
+struct Session {
+    X11Backend backend;
+    Display* observer = XOpenDisplay(nullptr);
+    std::vector<X11Output> outputs = backend.outputs();
+
+    ~Session() {
+        if (this->observer) {
+            XCloseDisplay(this->observer);
+        }
+    }
+
+    bool ready() {
+        return this->backend.isOpen() && this->observer && !this->outputs.empty();
+    }
+
+    /* Xvfb may not give its CRTC a ramp; the overlay does everything then. */
+    bool hasGamma() {
+        return this->outputs[0].rampSize > 1;
+    }
+};
+
+TEST(outputsAreReported) {
+    Session session;
+    CHECK(session.ready());
+    if (!session.ready()) {
+        return;
+    }
+
+    for (auto& output : session.outputs) {
+        CHECK(!output.name.empty());
+        CHECK(output.crtc != 0);
+        CHECK(output.width > 0 && output.height > 0);
+    }
+}
+
+TEST(lightDimmingOnlyTouchesTheRamp) {
+    Session session;
+    if (!session.ready()) {
+        CHECK(session.ready());
+        return;
+    }
+
+    auto& output = session.outputs[0];
+    Display* observer = session.observer;
+
+    CHECK(session.backend.apply(output, dimmedTo(0.3f)));
+    if (session.hasGamma()) {
+        CHECK(eventually(observer, [&]() { return rampTopNear(observer, output.crtc, 0.7f); }));
+        CHECK(overlayCount(observer) == 0);
+    }
+    else if (session.backend.canOverlay()) {
+        CHECK(eventually(observer, [&]() { return overlayCount(observer) == 1; }));
+    }
+
+    session.backend.reset(output);
+    CHECK(eventually(observer, [&]() { return overlayCount(observer) == 0; }));
+    if (session.hasGamma()) {
+        CHECK(eventually(observer, [&]() { return rampTopNear(observer, output.crtc, 1.0f); }));
+    }
+}
+
+TEST(deepDimmingSplitsBetweenRampAndOverlay) {
+    Session session;
+    if (!session.ready()) {
+        CHECK(session.ready());
+        return;
+    }
+
+    auto& output = session.outputs[0];
+    Display* observer = session.observer;
+    CHECK(session.backend.apply(output, dimmedTo(0.9f)));
+
+    if (session.backend.canOverlay()) {
+        /* the ramp stops at its floor, and a window does the rest */
+        CHECK(eventually(observer, [&]() { return overlayCount(observer) == 1; }));
+        if (session.hasGamma()) {
+            CHECK(rampTopNear(observer, output.crtc, 0.4f));
+        }
+    }
+    else if (session.hasGamma()) {
+        /* nothing could blend a window, so the ramp goes all the way */
+        CHECK(eventually(observer, [&]() { return rampTopNear(observer, output.crtc, 0.1f); }));
+        CHECK(overlayCount(observer) == 0);
+    }
+
+    /* changing the level reuses the same window */
+    CHECK(session.backend.apply(output, dimmedTo(0.8f)));
+    XSync(observer, False);
+    CHECK(overlayCount(observer) == (session.backend.canOverlay() ? 1 : 0));
+
+    session.backend.reset(output);
+    CHECK(eventually(observer, [&]() { return overlayCount(observer) == 0; }));
+}
+
+TEST(withoutTheOverlayTheRampDoesEverything) {
+    Session session;
+    if (!session.ready()) {
+        CHECK(session.ready());
+        return;
+    }
+    if (!session.hasGamma()) {
+        return;
+    }
+
+    auto& output = session.outputs[0];
+    Display* observer = session.observer;
+    CHECK(session.backend.apply(output, dimmedTo(0.9f), false));
+    CHECK(eventually(observer, [&]() { return rampTopNear(observer, output.crtc, 0.1f); }));
+    CHECK(overlayCount(observer) == 0);
+
+    /* disabling puts the original ramp back */
+    MonitorOptions disabled = dimmedTo(0.9f);
+    disabled.enabled = false;
+    CHECK(session.backend.apply(output, disabled));
+    CHECK(eventually(observer, [&]() { return rampTopNear(observer, output.crtc, 1.0f); }));
+}
+
+TEST(destroyingTheBackendRestoresEverything) {
+    Display* observer = XOpenDisplay(nullptr);
+    CHECK(observer != nullptr);
+    if (!observer) {
+        return;
+    }
+
+    RRCrtc crtc = 0;
+    {
+        X11Backend backend;
+        auto outputs = backend.outputs();
+        CHECK(!outputs.empty());
+        if (!outputs.empty()) {
+            crtc = outputs[0].crtc;
+            backend.apply(outputs[0], dimmedTo(0.9f));
+        }
+    }
+
+    CHECK(eventually(observer, [&]() { return overlayCount(observer) == 0; }));
+    if (crtc && XRRGetCrtcGammaSize(observer, crtc) > 1) {
+        CHECK(eventually(observer, [&]() { return rampTopNear(observer, crtc, 1.0f); }));
+    }
+    XCloseDisplay(observer);
+}